@@ -15,6 +15,7 @@
 #include <CscNetLib/iniFile.h>
 #include <CscNetLib/isvalid.h>
 #include <CscNetLib/servBase.h>
+#include <CscNetLib/coro.h>
 
 #define MaxLineLen 255
 
@@ -86,10 +87,11 @@ int doConn( int fd0            // client file descriptor
 {   boxDim_t *boxDim = local;
     char line[MaxLineLen+1];
  
-// Convert the file descriptor into FILE streams.
-    int fd1 = dup(fd0);           csc_log_assert(log, fd1!=-1);
-    FILE *fin = fdopen(fd0,"r");  csc_log_assert(log, fin!=NULL);
-    FILE *fout = fdopen(fd1,"w"); csc_log_assert(log, fout!=NULL);
+// Convert the file descriptor into FILE streams.  These also work in the
+// "Coro" model, where waiting for the client lets other connections run.
+    int fd1 = dup(fd0);                    csc_log_assert(log, fd1!=-1);
+    FILE *fin = csc_coro_fdopen(fd0,"r");  csc_log_assert(log, fin!=NULL);
+    FILE *fout = csc_coro_fdopen(fd1,"w"); csc_log_assert(log, fout!=NULL);
  
 // Read one line.
     csc_fgetline(fin,line,MaxLineLen);
@@ -117,6 +119,7 @@ int main(int argc, char **argv)
                        , "test.ini"    // Path to configuration file.
                        , doConn       // Callback called for each connection.
                        , doInit       // Callback called for initialisation.
+                       , NULL         // Overload response as configured.
                        , &boxDims     // Passed to doInit() and to doConn().
                        );
     exit(0);
@@ -0,0 +1,268 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ----------------------------------------------------------------
+// Loopback benchmark of the server models.
+//
+// Usage: servBench [model [nClients [nRequests]]]
+//
+// For each model, runs a line echo server in a child process, and then
+// has 'nClients' threads each make 'nRequests' requests.  Each request
+// connects, sends a line, reads the echo, and closes, so that it costs
+// the server an accept as well as a read and a write.  Without a model,
+// or with "all", benchmarks each of them in turn.
+// ----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <CscNetLib/std.h>
+#include <CscNetLib/alloc.h>
+#include <CscNetLib/logger.h>
+#include <CscNetLib/iniFile.h>
+#include <CscNetLib/netCli.h>
+#include <CscNetLib/servBase.h>
+#include <CscNetLib/coro.h>
+
+#define BasePort 9880
+#define ConfPath "servBench.ini"
+#define LogPath "servBench.log"
+#define MsgLen 64
+
+const char *models[] = { "OneByOne", "Forking", "ThreadPool", "PreFork"
+                       , "Coro", "EventLoop", "Uring", NULL };
+
+
+// ------------------------ The server ------------------------------
+
+int doConn( int fd
+          , const char *clientIp
+          , csc_ini_t *conf
+          , csc_log_t *log
+          , void *local
+          )
+{   char buf[MsgLen];
+    int len = 0;
+    int nRead;
+ 
+// Read one line, and echo it.  The coroutine I/O blocks as usual, except
+// in the "Coro" model.
+    while (len==0 || buf[len-1]!='\n')
+    {   nRead = csc_coro_read(fd, buf+len, MsgLen-len);
+        if (nRead <= 0)
+        {   close(fd);
+            return -1;
+        }
+        len += nRead;
+    }
+    csc_coro_write(fd, buf, len);
+ 
+// The client closes first, so that its end keeps the TIME_WAIT and the
+// port can be reused at once.
+    while (csc_coro_read(fd, buf, MsgLen) > 0)
+        ;
+    close(fd);
+    return 0;
+}
+
+
+int onReadable(csc_servBase_conn_t *conn, void *connCtx)
+{   char buf[MsgLen];
+    int nRead;
+ 
+// Echo whatever has arrived.  The client closes.
+    while ((nRead = csc_servBase_connRead(conn, buf, sizeof(buf))) > 0)
+        csc_servBase_connWrite(conn, buf, nRead);
+    if (nRead == -1)
+        return -1;
+    else if (nRead == 0)
+        csc_servBase_connClose(conn);
+    return 0;
+}
+
+
+void runServer(const char *model, int port)
+{   csc_servBase_evHandlers_t handlers = { NULL, onReadable, NULL, NULL };
+    const char *eventModel = NULL;
+    FILE *fp;
+ 
+// The event driven models are chosen by configuration.
+    if (csc_streq(model,"EventLoop") || csc_streq(model,"Uring"))
+        eventModel = model;
+ 
+// Write the configuration.  Notices would log every connection.
+    fp = fopen(ConfPath, "w");
+    if (fp == NULL)
+        exit(1);
+    fprintf(fp, "[ServerBase]\n");
+    fprintf(fp, "IP = 127.0.0.1\n");
+    fprintf(fp, "PortNum = %d\n", port);
+    fprintf(fp, "MaxThreads = 8\n");
+    fprintf(fp, "Backlog = 1024\n");
+    fprintf(fp, "LogLevel = 3\n");
+    if (eventModel != NULL)
+        fprintf(fp, "EventModel = %s\n", eventModel);
+    fclose(fp);
+ 
+// Serve.  Keep the server quiet, so as not to clutter the results.
+    csc_errOut = NULL;
+    freopen("/dev/null", "w", stderr);
+    if (eventModel != NULL)
+        csc_servBase_evServer(LogPath, "servBench", ConfPath, &handlers, NULL, NULL, NULL);
+    else
+        csc_servBase_server(model, LogPath, "servBench", ConfPath, doConn, NULL, NULL, NULL);
+    exit(0);
+}
+
+
+// ------------------------ The clients -----------------------------
+
+typedef struct
+{   pthread_t thread;
+    int port;
+    int nRequests;
+    int nFails;
+} client_t;
+
+
+int request(csc_cli_t *cli)
+{   char msg[MsgLen];
+    char buf[MsgLen];
+    int len = 0;
+    int nRead;
+    int fd;
+ 
+    fd = csc_cli_connect(cli);
+    if (fd < 0)
+        return csc_FALSE;
+    memset(msg, 'x', MsgLen-1);
+    msg[MsgLen-1] = '\n';
+    if (write(fd, msg, MsgLen) != MsgLen)
+    {   close(fd);
+        return csc_FALSE;
+    }
+    while (len < MsgLen)
+    {   nRead = read(fd, buf+len, MsgLen-len);
+        if (nRead <= 0)
+            break;
+        len += nRead;
+    }
+    close(fd);
+    return len==MsgLen && memcmp(msg,buf,MsgLen)==0;
+}
+
+
+void *clientThread(void *arg)
+{   client_t *client = arg;
+    int i;
+ 
+    csc_cli_t *cli = csc_cli_new();
+    if (!csc_cli_setServAddr(cli, "127.0.0.1", client->port))
+        client->nFails = client->nRequests;
+    else
+    {   for (i=0; i<client->nRequests; i++)
+        {   if (!request(cli))
+                client->nFails++;
+        }
+    }
+    csc_cli_free(cli);
+    return NULL;
+}
+
+
+// Wait for the server to accept connections.  Returns csc_FALSE if it
+// does not start.
+int awaitServer(pid_t pid, int port)
+{   csc_cli_t *cli = csc_cli_new();
+    int isUp = csc_FALSE;
+    int i, fd;
+ 
+    csc_cli_setServAddr(cli, "127.0.0.1", port);
+    for (i=0; i<200 && !isUp; i++)
+    {   if (waitpid(pid, NULL, WNOHANG) == pid)
+            break;
+        fd = csc_cli_connect(cli);
+        if (fd >= 0)
+        {   close(fd);
+            isUp = csc_TRUE;
+        }
+        else
+            usleep(20000);
+    }
+    csc_cli_free(cli);
+    return isUp;
+}
+
+
+void bench(const char *model, int port, int nClients, int nRequests)
+{   struct timespec t0, t1;
+    client_t *clients;
+    double secs;
+    int i, nFails;
+    pid_t pid;
+ 
+// Start the server.
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+        runServer(model, port);
+    if (!awaitServer(pid, port))
+    {   printf("%-10s  not available\n", model);
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return;
+    }
+ 
+// Run the clients.
+    clients = csc_allocMany(client_t, nClients);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i=0; i<nClients; i++)
+    {   clients[i].port = port;
+        clients[i].nRequests = nRequests;
+        clients[i].nFails = 0;
+        pthread_create(&clients[i].thread, NULL, clientThread, &clients[i]);
+    }
+    nFails = 0;
+    for (i=0; i<nClients; i++)
+    {   pthread_join(clients[i].thread, NULL);
+        nFails += clients[i].nFails;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    free(clients);
+ 
+// Report.
+    secs = (t1.tv_sec-t0.tv_sec) + (t1.tv_nsec-t0.tv_nsec)/1e9;
+    printf( "%-10s  %9.0f requests/sec  (%d failed)\n"
+          , model, (nClients*nRequests-nFails)/secs, nFails);
+ 
+// Stop the server.
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+
+int main(int argc, char **argv)
+{   int nClients = 4;
+    int nRequests = 2000;
+    int i;
+ 
+    if (argc > 2)
+        nClients = atoi(argv[2]);
+    if (argc > 3)
+        nRequests = atoi(argv[3]);
+    if (nClients<1 || nRequests<1)
+    {   fprintf(stderr, "Usage: %s [model [nClients [nRequests]]]\n", argv[0]);
+        exit(1);
+    }
+ 
+    for (i=0; models[i]!=NULL; i++)
+    {   if (argc<=1 || csc_streq(argv[1],"all") || csc_streq(argv[1],models[i]))
+            bench(models[i], BasePort+i, nClients, nRequests);
+    }
+    exit(0);
+}
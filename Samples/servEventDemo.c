@@ -0,0 +1,99 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ---------------------------------------------
+// Line echo server using the EventLoop model.
+// ---------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CscNetLib/std.h>
+#include <CscNetLib/alloc.h>
+#include <CscNetLib/logger.h>
+#include <CscNetLib/iniFile.h>
+#include <CscNetLib/servBase.h>
+
+#define MaxLineLen 255
+
+
+typedef struct
+{   char line[MaxLineLen+1];
+    int len;
+    int nLines;
+} connCtx_t;
+
+
+int onOpen( csc_servBase_conn_t *conn
+          , const char *clientIp
+          , csc_ini_t *conf
+          , csc_log_t *log
+          , void *local
+          )
+{   connCtx_t *ctx = csc_allocOne(connCtx_t);
+    ctx->len = 0;
+    ctx->nLines = 0;
+    csc_servBase_connSetCtx(conn, ctx);
+    return 0;
+}
+
+
+int onReadable(csc_servBase_conn_t *conn, void *connCtx)
+{   connCtx_t *ctx = connCtx;
+    char buf[MaxLineLen+1];
+    int nRead, i;
+ 
+// Read whatever has arrived.
+    while ((nRead = csc_servBase_connRead(conn, buf, sizeof(buf))) > 0)
+    {
+    // Echo each complete line.
+        for (i=0; i<nRead; i++)
+        {   if (ctx->len < MaxLineLen)
+                ctx->line[ctx->len++] = buf[i];
+            if (buf[i] == '\n')
+            {   csc_servBase_connWrite(conn, ctx->line, ctx->len);
+                ctx->len = 0;
+                ctx->nLines++;
+            }
+        }
+    }
+ 
+// The client has finished, or failed.
+    if (nRead == 0)
+        csc_servBase_connClose(conn);
+    else if (nRead == -1)
+        return -1;
+ 
+    return 0;
+}
+
+
+void onClose(csc_servBase_conn_t *conn, void *connCtx)
+{   connCtx_t *ctx = connCtx;
+    if (ctx != NULL)
+    {   csc_log_printf( csc_servBase_connLog(conn), csc_log_NOTICE
+                      , "%s echoed %d lines"
+                      , csc_servBase_connClientIp(conn), ctx->nLines);
+        free(ctx);
+    }
+}
+
+
+int main(int argc, char **argv)
+{   csc_servBase_evHandlers_t handlers;
+ 
+    handlers.onOpen = onOpen;
+    handlers.onReadable = onReadable;
+    handlers.onWritable = NULL;
+    handlers.onClose = onClose;
+ 
+    csc_servBase_evServer( "test.log"        // Path to log file.
+                         , "servEventDemo"   // Id used in log file.
+                         , "test.ini"        // Path to configuration file.
+                         , &handlers         // Called for connection events.
+                         , NULL              // No initialisation.
+                         , NULL              // Overload response as configured.
+                         , NULL              // Passed to doInit() and to onOpen().
+                         );
+    exit(0);
+}
@@ -0,0 +1,200 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ----------------------------------------------------------------
+// Loopback benchmark of sending and receiving UDP packets one at a time,
+// with csc_udp_snd() and csc_udp_rcv(), and in batches, with
+// csc_udp_sndMany() and csc_udp_rcvMany(), or, for sending, as one buffer
+// split by the kernel, with csc_udp_sndSegs().
+//
+// Usage: udpBench [seconds [batchSize]]
+//
+// Sending is timed on its own, to a socket that nobody reads.  Receiving
+// is timed on its own, emptying a queue of packets sent beforehand.  Each
+// is run for about 'seconds'.
+// ----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <CscNetLib/std.h>
+#include <CscNetLib/udp.h>
+
+#define BasePort 9870
+#define PktLen 64
+#define MaxBatch 64
+
+int seconds = 2;
+int batchSize = 32;
+
+
+double nowSecs()
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+
+csc_udp_t *mkServer(int port)
+{   csc_udp_t *udp = csc_udp_new();
+    if (!csc_udp_setSrv(udp, "127.0.0.1", port))
+    {   fprintf(stderr, "Error: %s.\n", csc_udp_getErrMsg(udp));
+        exit(1);
+    }
+    return udp;
+}
+
+
+csc_udp_t *mkClient(csc_udpAddr_t *to, int port)
+{   csc_udp_t *udp = csc_udp_new();
+    csc_udp_setCli(udp, AF_INET);
+    csc_udpAddr_setAddr(to, "127.0.0.1", port);
+    return udp;
+}
+
+
+// ------------------------ Sending ------------------------------
+
+double benchSnd(csc_bool_t isMany, csc_bool_t isSegs)
+{   char buf[PktLen];
+    char segsBuf[PktLen*MaxBatch];
+    csc_udpPkt_t pkts[MaxBatch];
+    csc_udpAddr_t *to = csc_udpAddr_new();
+    csc_udp_t *srv = mkServer(BasePort);
+    csc_udp_t *cli = mkClient(to, BasePort);
+    double startSecs = nowSecs();
+    long nPkts = 0;
+    int i;
+ 
+    memset(buf, 'x', PktLen);
+    memset(segsBuf, 'x', sizeof(segsBuf));
+    for (i=0; i<batchSize; i++)
+    {   pkts[i].buf = buf;
+        pkts[i].len = PktLen;
+        pkts[i].addr = to;
+    }
+    while (nowSecs()-startSecs < seconds)
+    {   for (i=0; i<1000; i+=batchSize)
+        {   if (isSegs)
+                nPkts += csc_udp_sndSegs(cli, segsBuf, PktLen*batchSize, PktLen, to);
+            else if (isMany)
+                nPkts += csc_udp_sndMany(cli, pkts, batchSize);
+            else
+            {   for (int j=0; j<batchSize; j++)
+                    nPkts += csc_udp_snd(cli, buf, PktLen, to);
+            }
+        }
+    }
+ 
+    csc_udp_free(cli);
+    csc_udp_free(srv);
+    csc_udpAddr_free(to);
+    return nPkts / (nowSecs()-startSecs);
+}
+
+
+// ------------------------ Receiving ------------------------------
+
+// Sends 'nPkts' packets to the receiver, in batches.
+void fill(csc_udp_t *cli, csc_udpAddr_t *to, int nPkts)
+{   char buf[PktLen];
+    csc_udpPkt_t pkts[MaxBatch];
+    int i, n;
+ 
+    memset(buf, 'x', PktLen);
+    for (i=0; i<MaxBatch; i++)
+    {   pkts[i].buf = buf;
+        pkts[i].len = PktLen;
+        pkts[i].addr = to;
+    }
+    for (i=0; i<nPkts; i+=n)
+    {   n = nPkts-i < MaxBatch ? nPkts-i : MaxBatch;
+        csc_udp_sndMany(cli, pkts, n);
+    }
+}
+
+
+// Receives what is queued.  Returns how many there were.
+int drain(csc_udp_t *srv, csc_udpPkt_t *pkts, int batch)
+{   int nPkts = 0;
+    int n;
+    while ((n = csc_udp_rcvMany(srv, pkts, batch, 0)) > 0)
+        nPkts += n;
+    return nPkts;
+}
+
+
+// Times receiving packets that are already queued, so that only the cost
+// of receiving them is counted.  The queue is filled, untimed, with as
+// many as the socket's receive buffer holds, and then emptied, timed.
+double benchRcv(csc_bool_t isMany)
+{   char bufs[MaxBatch][PktLen+1];
+    csc_udpPkt_t pkts[MaxBatch];
+    csc_udpAddr_t *to = csc_udpAddr_new();
+    csc_udp_t *srv = mkServer(BasePort+1);
+    csc_udp_t *cli = mkClient(to, BasePort+1);
+    double startSecs, rcvSecs = 0;
+    long nPkts = 0;
+    int nFill = MaxBatch*100;
+    int i, n;
+ 
+    for (i=0; i<MaxBatch; i++)
+    {   pkts[i].buf = bufs[i];
+        pkts[i].bufSiz = PktLen;
+        pkts[i].addr = NULL;
+    }
+ 
+// How many fit, without any being dropped.
+    for (i=0; i<3; i++)
+    {   fill(cli, to, nFill);
+        n = drain(srv, pkts, MaxBatch);
+        if (n < nFill)
+            nFill = n * 9 / 10;
+    }
+ 
+    while (rcvSecs < seconds)
+    {   fill(cli, to, nFill);
+        startSecs = nowSecs();
+        if (isMany)
+            n = drain(srv, pkts, batchSize);
+        else
+        {   for (n=0; n<nFill; n++)
+                csc_udp_rcv(srv, bufs[0], PktLen, NULL);
+        }
+        rcvSecs += nowSecs() - startSecs;
+        nPkts += n;
+    }
+ 
+    csc_udp_free(cli);
+    csc_udp_free(srv);
+    csc_udpAddr_free(to);
+    return nPkts / rcvSecs;
+}
+
+
+int main(int argc, char **argv)
+{   double single, many;
+ 
+    if (argc > 1)
+        seconds = atoi(argv[1]);
+    if (argc > 2)
+        batchSize = atoi(argv[2]);
+    if (seconds<1 || batchSize<1 || batchSize>MaxBatch)
+    {   fprintf(stderr, "Usage: %s [seconds [batchSize(1-%d)]]\n", argv[0], MaxBatch);
+        exit(1);
+    }
+ 
+    printf("%-10s %14s %14s %8s\n", "", "single pkt/s", "batched pkt/s", "ratio");
+    single = benchSnd(csc_FALSE, csc_FALSE);
+    many = benchSnd(csc_TRUE, csc_FALSE);
+    printf("%-10s %14.0f %14.0f %8.2f\n", "send", single, many, many/single);
+    many = benchSnd(csc_TRUE, csc_TRUE);
+    printf("%-10s %14.0f %14.0f %8.2f\n", "send segs", single, many, many/single);
+    single = benchRcv(csc_FALSE);
+    many = benchRcv(csc_TRUE);
+    printf("%-10s %14.0f %14.0f %8.2f\n", "receive", single, many, many/single);
+    return 0;
+}
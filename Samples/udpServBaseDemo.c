@@ -0,0 +1,50 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ---------------------------------------------
+// UDP echo server using the Udp model.  Each
+// packet is sent back, prefixed by the number of
+// the worker that received it.
+// ---------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CscNetLib/std.h>
+#include <CscNetLib/logger.h>
+#include <CscNetLib/iniFile.h>
+#include <CscNetLib/udp.h>
+#include <CscNetLib/servBase.h>
+
+#define MaxReplyLen 2048
+
+
+int onPacket( csc_servBase_udp_t *udp
+            , char *pkt
+            , int pktLen
+            , const csc_udpAddr_t *from
+            , void *local
+            )
+{   char reply[MaxReplyLen];
+    int len;
+ 
+    len = snprintf( reply, sizeof(reply), "%d: %s"
+                  , csc_servBase_udpWorkerNum(udp), pkt);
+    if (len >= sizeof(reply))
+        len = sizeof(reply) - 1;
+    if (!csc_servBase_udpReply(udp, reply, len))
+        return -1;
+    return 0;
+}
+
+
+int main(int argc, char **argv)
+{   csc_servBase_udpServer( "test.log"          // Path to log file.
+                          , "udpServBaseDemo"   // Id used in log file.
+                          , "test.ini"          // Path to configuration file.
+                          , onPacket            // Called for each packet.
+                          , NULL                // No initialisation.
+                          , NULL                // Passed to doInit() and to onPacket().
+                          );
+    exit(0);
+}
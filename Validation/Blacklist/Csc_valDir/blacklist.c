@@ -63,6 +63,17 @@ int main(int argc, char **argv)
     }
  
     csc_blacklist_free(bl);
+ 
+// A binary identity is the same as a string identity of the same bytes.
+    bl = csc_blacklist_new(15); assert(bl);
+    csc_blacklist_blackness(bl, "10.0.0.1");
+    csc_blacklist_blackness(bl, "10.0.0.2");
+    blackness = csc_blacklist_blacknessBin(bl, "10.0.0.1", 8);
+    if (blackness==2 && csc_blacklist_blacknessBin(bl, "\x0a\0\0\x01", 4)==1)
+        printf("pass (blacklist_bin)\n");
+    else
+        printf("FAIL (blacklist_bin)\n");
+    csc_blacklist_free(bl);
 
     if (csc_mck_nchunks() == 0)
         printf("pass (blacklist_mem)\n");
@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/netCli.h>
+#include <CscNetLib/http.h>
+#include <CscNetLib/timerWheel.h>
+#include <CscNetLib/cliMux.h>
+
+FILE *fout;
+int port;
+pid_t srvPid;
+
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+// ----------- A server, in another process ------------
+
+// Answers requests on a connection.  The path says how:-
+//  *   "/delay/N" - After N milliseconds, with "delayed N".
+//  *   "/close" - With a body that ends when the connection closes.
+//  *   "/chunked" - With a chunked body.
+//  *   "/hang" - Never.
+void *srvConn(void *arg)
+{   int fd = (int)(long)arg;
+    char buf[1000], resp[200], path[100];
+    int n, len, ms;
+ 
+    for (;;)
+    {   len = 0;
+        while (strstr(buf,"\r\n\r\n")==NULL || len==0)
+        {   n = read(fd, buf+len, sizeof(buf)-1-len);
+            if (n <= 0)
+                goto done;
+            len += n;
+            buf[len] = '\0';
+        }
+        sscanf(buf, "%*s %99s", path);
+        buf[0] = '\0';
+        if (sscanf(path, "/delay/%d", &ms) == 1)
+        {   usleep(ms*1000);
+            sprintf(resp, "delayed %d", ms);
+            sprintf( buf, "HTTP/1.1 200 OK\r\nContent-length: %d\r\nX-Test: yes\r\n\r\n%s"
+                   , (int)strlen(resp), resp);
+            write(fd, buf, strlen(buf));
+        }
+        else if (csc_streq(path, "/close"))
+        {   strcpy(buf, "HTTP/1.1 200 OK\r\n\r\nuntil closed");
+            write(fd, buf, strlen(buf));
+            break;
+        }
+        else if (csc_streq(path, "/chunked"))
+        {   strcpy(buf, "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n");
+            write(fd, buf, strlen(buf));
+        }
+        else
+            pause();
+        buf[0] = '\0';
+    }
+done:
+    close(fd);
+    return NULL;
+}
+
+
+void startServer()
+{   struct sockaddr_in addr;
+    pthread_t thread;
+    int listenSock, fd, i, isOk = csc_FALSE;
+ 
+    listenSock = socket(AF_INET, SOCK_STREAM, 0);  assert(listenSock >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    port = 30000 + getpid()%20000;
+    for (i=0; i<100 && !isOk; i++)
+    {   addr.sin_port = htons(++port);
+        isOk = bind(listenSock, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+    assert(isOk && listen(listenSock, 20)==0);
+ 
+    srvPid = fork();  assert(srvPid >= 0);
+    if (srvPid == 0)
+    {   while ((fd = accept(listenSock, NULL, NULL)) >= 0)
+        {   pthread_create(&thread, NULL, srvConn, (void*)(long)fd);
+            pthread_detach(thread);
+        }
+        exit(0);
+    }
+    close(listenSock);
+}
+
+
+// ----------- Requests ------------
+
+typedef struct
+{   int nDone;
+    int statCode;
+    char body[100];
+    csc_bool_t isReusable;
+    char errMsg[100];
+    int elapsedMs;
+} outcome_t;
+
+
+void onDone(void *arg, const csc_cliMux_result_t *res)
+{   outcome_t *out = arg;
+    out->nDone++;
+    out->statCode = res->resp==NULL ? 0 : atoi(csc_http_getSF(res->resp, csc_httpSF_statCode));
+    strcpy(out->body, res->body==NULL ? "" : res->body);
+    out->isReusable = res->isReusable;
+    strcpy(out->errMsg, res->errMsg==NULL ? "" : res->errMsg);
+    out->elapsedMs = res->elapsedMs;
+    close(res->fd);
+}
+
+
+// Sends a GET for 'path' on a new connection.
+csc_bool_t addGet( csc_cliMux_t *mux, const char *path, int timeoutMs
+                 , csc_cliMux_onDone_t *fn, void *arg)
+{   csc_cli_t *cli = csc_cli_new();
+    char req[200];
+    int fd = csc_cli_mkConn(cli, "127.0.0.1", port);
+    csc_cli_free(cli);
+    if (fd < 0)
+        return csc_FALSE;
+    sprintf(req, "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", path);
+    return csc_cliMux_add(mux, fd, req, strlen(req), timeoutMs, fn, arg);
+}
+
+
+// ----------- Tests ------------
+
+// Requests to slow servers take as long as the slowest, not all of them.
+void testFanOut()
+{   csc_cliMux_t *mux = csc_cliMux_new();
+    outcome_t outs[4];
+    char path[20];
+    uint64_t startMs = csc_timerWheel_nowMs();
+    int isOk = csc_TRUE;
+    int i, elapsedMs;
+ 
+    memset(outs, 0, sizeof(outs));
+    for (i=0; i<4; i++)
+    {   sprintf(path, "/delay/%d", 200+50*i);
+        isOk = isOk && addGet(mux, path, 2000, onDone, &outs[i]);
+    }
+    isOk = isOk && csc_cliMux_nPending(mux)==4 && csc_cliMux_run(mux);
+    elapsedMs = (int)(csc_timerWheel_nowMs() - startMs);
+    isOk = isOk && csc_cliMux_nPending(mux)==0 && elapsedMs>=350 && elapsedMs<700;
+    for (i=0; i<4; i++)
+    {   sprintf(path, "delayed %d", 200+50*i);
+        isOk = isOk && outs[i].nDone==1 && outs[i].statCode==200;
+        isOk = isOk && csc_streq(outs[i].body, path) && outs[i].isReusable;
+    }
+ 
+    csc_cliMux_free(mux);
+    report("fanOut", isOk);
+}
+
+
+// A server that does not answer in time fails, without holding up others.
+void testTimeout()
+{   csc_cliMux_t *mux = csc_cliMux_new();
+    outcome_t hang, quick;
+    int isOk;
+ 
+    memset(&hang, 0, sizeof(hang));
+    memset(&quick, 0, sizeof(quick));
+    isOk = addGet(mux, "/hang", 200, onDone, &hang);
+    isOk = isOk && addGet(mux, "/delay/10", 2000, onDone, &quick);
+    isOk = isOk && csc_cliMux_run(mux);
+    isOk = isOk && hang.nDone==1 && csc_streq(hang.errMsg, "Timed out");
+    isOk = isOk && hang.elapsedMs>=195 && hang.elapsedMs<400;
+    isOk = isOk && quick.nDone==1 && quick.statCode==200 && quick.elapsedMs<150;
+ 
+    csc_cliMux_free(mux);
+    report("timeout", isOk);
+}
+
+
+// Bodies without a length last until the connection closes, and other
+// encodings fail.
+void testBodies()
+{   csc_cliMux_t *mux = csc_cliMux_new();
+    outcome_t closed, chunked;
+    int isOk;
+ 
+    memset(&closed, 0, sizeof(closed));
+    memset(&chunked, 0, sizeof(chunked));
+    isOk = addGet(mux, "/close", 2000, onDone, &closed);
+    isOk = isOk && addGet(mux, "/chunked", 2000, onDone, &chunked);
+    isOk = isOk && csc_cliMux_run(mux);
+    isOk = isOk && closed.nDone==1 && closed.statCode==200;
+    isOk = isOk && csc_streq(closed.body, "until closed") && !closed.isReusable;
+    isOk = isOk && chunked.nDone==1 && strstr(chunked.errMsg, "Chunked")!=NULL;
+ 
+    csc_cliMux_free(mux);
+    report("bodies", isOk);
+}
+
+
+// A connection is used again from the function called when done.
+int nChained = 0;
+void onChain(void *arg, const csc_cliMux_result_t *res)
+{   const char *req = "GET /delay/1 HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    const char *hdr = res->resp==NULL ? NULL : csc_http_getHdr(res->resp, "X-Test");
+    if (res->isReusable && hdr!=NULL && csc_streq(hdr,"yes") && ++nChained<5)
+        csc_cliMux_add(arg, res->fd, req, strlen(req), 1000, onChain, arg);
+    else
+        close(res->fd);
+}
+
+void testChain()
+{   csc_cliMux_t *mux = csc_cliMux_new();
+    int isOk;
+ 
+    isOk = addGet(mux, "/delay/1", 1000, onChain, mux);
+    isOk = isOk && csc_cliMux_run(mux);
+    isOk = isOk && nChained==5 && csc_cliMux_nPending(mux)==0;
+ 
+    csc_cliMux_free(mux);
+    report("chain", isOk);
+}
+
+
+// Those not done when freed fail.
+void testAbandon()
+{   csc_cliMux_t *mux = csc_cliMux_new();
+    outcome_t hang;
+    int isOk;
+ 
+    memset(&hang, 0, sizeof(hang));
+    isOk = addGet(mux, "/hang", -1, onDone, &hang);
+    csc_cliMux_free(mux);
+    isOk = isOk && hang.nDone==1 && csc_streq(hang.errMsg, "Abandoned");
+    report("abandon", isOk);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    startServer();
+    testFanOut();
+    testTimeout();
+    testBodies();
+    testChain();
+    testAbandon();
+    kill(srvPid, SIGKILL);
+    waitpid(srvPid, NULL, 0);
+    fclose(fout);
+}
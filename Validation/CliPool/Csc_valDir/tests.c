@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/cliPool.h>
+
+FILE *fout;
+int listenSock;
+int port;
+
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+// Listen on any free port, without accepting until asked to.
+void startServer()
+{   struct sockaddr_in addr;
+    int i, isOk = csc_FALSE;
+ 
+    listenSock = socket(AF_INET, SOCK_STREAM, 0);  assert(listenSock >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    port = 40000 + getpid()%10000;
+    for (i=0; i<100 && !isOk; i++)
+    {   addr.sin_port = htons(++port);
+        isOk = bind(listenSock, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+    assert(isOk && listen(listenSock, 20)==0);
+    fcntl(listenSock, F_SETFL, O_NONBLOCK);
+}
+
+
+// Accepts a new connection, if there is one.  Returns -1 if there is none.
+int srvAccept()
+{   return accept(listenSock, NULL, NULL);
+}
+
+
+// A connection handed back is handed out again, rather than a new one.
+void testReuse()
+{   csc_cliPool_t *pool = csc_cliPool_new(0, 0, 0, 0);
+    int fd1, fd2, srvFd;
+    int isOk;
+    char c;
+ 
+    fd1 = csc_cliPool_get(pool, "127.0.0.1", port);
+    srvFd = srvAccept();
+    isOk = fd1>=0 && srvFd>=0;
+    isOk = isOk && csc_cliPool_put(pool, fd1, csc_TRUE);
+    isOk = isOk && csc_cliPool_nIdle(pool, "127.0.0.1", port)==1;
+    fd2 = csc_cliPool_get(pool, "127.0.0.1", port);
+    isOk = isOk && fd2==fd1 && srvAccept()<0;
+    isOk = isOk && csc_cliPool_nIdle(pool, "127.0.0.1", port)==0;
+ 
+// Still connected to the same server socket.
+    isOk = isOk && write(fd2, "x", 1)==1;
+    isOk = isOk && read(srvFd, &c, 1)==1 && c=='x';
+ 
+    csc_cliPool_put(pool, fd2, csc_TRUE);
+    csc_cliPool_free(pool);
+    close(srvFd);
+    report("reuse", isOk);
+}
+
+
+// A connection that the server has closed is not handed out.
+void testPeerClosed()
+{   csc_cliPool_t *pool = csc_cliPool_new(0, 0, 0, 0);
+    int fd, srvFd, srvFd2;
+    int isOk;
+ 
+    fd = csc_cliPool_get(pool, "127.0.0.1", port);
+    srvFd = srvAccept();
+    isOk = fd>=0 && srvFd>=0 && csc_cliPool_put(pool, fd, csc_TRUE);
+    close(srvFd);
+    usleep(50000);
+    fd = csc_cliPool_get(pool, "127.0.0.1", port);
+    srvFd2 = srvAccept();
+    isOk = isOk && fd>=0 && srvFd2>=0;
+ 
+    csc_cliPool_put(pool, fd, csc_FALSE);
+    csc_cliPool_free(pool);
+    close(srvFd2);
+    report("peerClosed", isOk);
+}
+
+
+// A connection that may not be reused is closed.
+void testNotReusable()
+{   csc_cliPool_t *pool = csc_cliPool_new(0, 0, 0, 0);
+    int fd, srvFd;
+    int isOk;
+    char c;
+ 
+    fd = csc_cliPool_get(pool, "127.0.0.1", port);
+    srvFd = srvAccept();
+    isOk = fd>=0 && srvFd>=0 && csc_cliPool_put(pool, fd, csc_FALSE);
+    isOk = isOk && csc_cliPool_nIdle(pool, "127.0.0.1", port)==0;
+    isOk = isOk && read(srvFd, &c, 1)==0;
+ 
+// Nor is one that did not come from the pool kept.
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    isOk = isOk && !csc_cliPool_put(pool, fd, csc_TRUE);
+    isOk = isOk && fcntl(fd, F_GETFD)==-1;
+ 
+    csc_cliPool_free(pool);
+    close(srvFd);
+    report("notReusable", isOk);
+}
+
+
+// No more than the maximum are in use or idle, and extra idle ones are
+// closed.
+void testLimits()
+{   csc_cliPool_t *pool = csc_cliPool_new(2, 1, 0, 0);
+    int fd1, fd2, fd3, srv1, srv2;
+    int isOk;
+ 
+    fd1 = csc_cliPool_get(pool, "127.0.0.1", port);
+    fd2 = csc_cliPool_get(pool, "127.0.0.1", port);
+    srv1 = srvAccept();
+    srv2 = srvAccept();
+    isOk = fd1>=0 && fd2>=0 && srv1>=0 && srv2>=0;
+    fd3 = csc_cliPool_get(pool, "127.0.0.1", port);
+    isOk = isOk && fd3<0 && strstr(csc_cliPool_getErrMsg(pool), "Too many")!=NULL;
+ 
+// Handing one back allows another.
+    isOk = isOk && csc_cliPool_put(pool, fd1, csc_TRUE);
+    fd3 = csc_cliPool_get(pool, "127.0.0.1", port);
+    isOk = isOk && fd3==fd1;
+ 
+// Only one is kept idle.
+    csc_cliPool_put(pool, fd2, csc_TRUE);
+    csc_cliPool_put(pool, fd3, csc_TRUE);
+    isOk = isOk && csc_cliPool_nIdle(pool, "127.0.0.1", port)==1;
+ 
+// Other addresses are counted apart.
+    fd1 = csc_cliPool_get(pool, "127.0.0.2", port);
+    isOk = isOk && fd1>=0 && csc_cliPool_nIdle(pool, "127.0.0.2", port)==0;
+    csc_cliPool_put(pool, fd1, csc_FALSE);
+ 
+    csc_cliPool_free(pool);
+    close(srv1);
+    close(srv2);
+    while ((srv1 = srvAccept()) >= 0)
+        close(srv1);
+    report("limits", isOk);
+}
+
+
+// A connection idle too long is closed rather than handed out.
+void testIdleExpiry()
+{   csc_cliPool_t *pool = csc_cliPool_new(0, 0, 1, 0);
+    int fd, srvFd, srvFd2;
+    int isOk;
+    char c;
+ 
+    fd = csc_cliPool_get(pool, "127.0.0.1", port);
+    srvFd = srvAccept();
+    isOk = fd>=0 && srvFd>=0 && csc_cliPool_put(pool, fd, csc_TRUE);
+    sleep(2);
+    fd = csc_cliPool_get(pool, "127.0.0.1", port);
+    srvFd2 = srvAccept();
+    isOk = isOk && fd>=0 && srvFd2>=0 && read(srvFd, &c, 1)==0;
+ 
+    csc_cliPool_put(pool, fd, csc_TRUE);
+    csc_cliPool_free(pool);
+    close(srvFd);
+    close(srvFd2);
+    report("idleExpiry", isOk);
+}
+
+
+// Nothing listening.
+void testNoServer()
+{   csc_cliPool_t *pool = csc_cliPool_new(0, 0, 0, 0);
+    int fd = csc_cliPool_get(pool, "127.0.0.1", 1);
+    report("noServer", fd<0 && csc_cliPool_getErrMsg(pool)!=NULL);
+    csc_cliPool_free(pool);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    startServer();
+    testReuse();
+    testPeerClosed();
+    testNotReusable();
+    testLimits();
+    testIdleExpiry();
+    testNoServer();
+    close(listenSock);
+    fclose(fout);
+}
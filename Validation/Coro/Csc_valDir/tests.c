@@ -0,0 +1,294 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/alloc.h>
+#include <CscNetLib/cstr.h>
+#include <CscNetLib/timerWheel.h>
+#include <CscNetLib/coro.h>
+
+#define stackSize (64*1024)
+
+FILE *fout;
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+// ------------------------ Yielding --------------------------------
+
+typedef struct
+{   csc_str_t *trace;
+    char ch;
+} yielder_t;
+
+void yielder(void *arg)
+{   yielder_t *y = arg;
+    int i;
+    for (i=0; i<3; i++)
+    {   csc_str_append_ch(y->trace, y->ch);
+        csc_coro_yield();
+    }
+}
+
+
+// Coroutines that are ready take turns.
+void testYield()
+{   csc_coroSched_t *sched = csc_coroSched_new(stackSize);
+    csc_str_t *trace = csc_str_new(NULL);
+    yielder_t ys[3];
+    int i, isOk;
+ 
+    for (i=0; i<3; i++)
+    {   ys[i].trace = trace;
+        ys[i].ch = 'a' + i;
+        csc_coro_spawn(sched, yielder, &ys[i]);
+    }
+    isOk = csc_coroSched_run(sched) && csc_streq(csc_str_charr(trace), "abcabcabc");
+    isOk = isOk && csc_coro_self()==NULL;
+ 
+    csc_str_free(trace);
+    csc_coroSched_free(sched);
+    report("coro_yield", isOk);
+}
+
+
+// ------------------------ Sleeping --------------------------------
+
+typedef struct
+{   csc_coro_t *sleeper;
+    int isWoken;
+    int isTimedOut;
+    uint64_t sleptMs;
+} sleepers_t;
+
+void sleeper(void *arg)
+{   sleepers_t *s = arg;
+    uint64_t start = csc_timerWheel_nowMs();
+    s->isTimedOut = !csc_coro_sleep(50);
+    s->sleptMs = csc_timerWheel_nowMs() - start;
+    s->isWoken = csc_coro_sleep(-1);
+}
+
+void waker(void *arg)
+{   sleepers_t *s = arg;
+    csc_coro_sleep(100);
+    csc_coro_wake(s->sleeper);
+}
+
+
+void testSleep()
+{   csc_coroSched_t *sched = csc_coroSched_new(stackSize);
+    sleepers_t s;
+    int isOk;
+ 
+    s.isWoken = s.isTimedOut = csc_FALSE;
+    s.sleeper = csc_coro_spawn(sched, sleeper, &s);
+    csc_coro_spawn(sched, waker, &s);
+    isOk = csc_coroSched_run(sched);
+    isOk = isOk && s.isTimedOut && s.isWoken && s.sleptMs>=40 && s.sleptMs<200;
+ 
+    csc_coroSched_free(sched);
+    report("coro_sleep", isOk);
+}
+
+
+// ------------------------ I/O -------------------------------------
+
+#define nPairs 100
+#define nBytes (64*1024)
+#define sockBufSize 4096
+
+typedef struct
+{   int fd;
+    int isOk;
+} conn_t;
+
+
+// Echoes whatever it reads until the other end has finished.
+void echoer(void *arg)
+{   conn_t *conn = arg;
+    char buf[1000];
+    ssize_t n;
+    while ((n=csc_coro_read(conn->fd,buf,sizeof(buf))) > 0)
+    {   if (csc_coro_write(conn->fd, buf, n) != n)
+            break;
+    }
+    conn->isOk = n==0;
+    close(conn->fd);
+}
+
+
+// Writes a pattern through a stream, much more than the socket buffers
+// hold, so that the writes must wait while the echo is read on a dup() of the
+// socket.
+void writer(void *arg)
+{   conn_t *conn = arg;
+    FILE *stream = csc_coro_fdopen(conn->fd, "w");
+    int i, isOk = stream!=NULL;
+    for (i=0; i<nBytes && isOk; i++)
+        isOk = fputc('a'+i%26, stream) != EOF;
+    isOk = isOk && fflush(stream)==0;
+    shutdown(conn->fd, SHUT_WR);
+    conn->isOk = isOk;
+    fclose(stream);
+}
+
+
+void reader(void *arg)
+{   conn_t *conn = arg;
+    FILE *stream = csc_coro_fdopen(conn->fd, "r");
+    int i, isOk = stream!=NULL;
+    for (i=0; i<nBytes && isOk; i++)
+        isOk = fgetc(stream) == 'a'+i%26;
+    conn->isOk = isOk && fgetc(stream)==EOF;
+    fclose(stream);
+}
+
+
+// Many connections at once on one thread.
+void testIo()
+{   csc_coroSched_t *sched = csc_coroSched_new(stackSize);
+    conn_t echoers[nPairs], writers[nPairs], readers[nPairs];
+    int fds[2];
+    int bufSize = sockBufSize;
+    int i, isOk;
+ 
+    for (i=0; i<nPairs; i++)
+    {   assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+        setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+        echoers[i].fd = fds[0];
+        echoers[i].isOk = csc_FALSE;
+        writers[i].fd = fds[1];
+        writers[i].isOk = csc_FALSE;
+        readers[i].fd = dup(fds[1]);
+        readers[i].isOk = csc_FALSE;
+        csc_coro_spawn(sched, echoer, &echoers[i]);
+        csc_coro_spawn(sched, writer, &writers[i]);
+        csc_coro_spawn(sched, reader, &readers[i]);
+    }
+    isOk = csc_coroSched_run(sched);
+    for (i=0; i<nPairs; i++)
+        isOk = isOk && echoers[i].isOk && writers[i].isOk && readers[i].isOk;
+ 
+    csc_coroSched_free(sched);
+    report("coro_io", isOk);
+}
+
+
+typedef struct
+{   int fd;
+    int isOk;
+    uint64_t waitedMs;
+} timeout_t;
+
+void timeoutReader(void *arg)
+{   timeout_t *t = arg;
+    char ch;
+    uint64_t start = csc_timerWheel_nowMs();
+    t->isOk = csc_coro_read(t->fd, &ch, 1)==-1 && errno==EAGAIN;
+    t->waitedMs = csc_timerWheel_nowMs() - start;
+}
+
+
+// A read gives up after the socket's receive timeout.
+void testTimeout()
+{   csc_coroSched_t *sched = csc_coroSched_new(stackSize);
+    struct timeval tv;
+    timeout_t t;
+    int fds[2];
+    int isOk;
+ 
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    t.fd = fds[0];
+    t.isOk = csc_FALSE;
+    csc_coro_spawn(sched, timeoutReader, &t);
+    isOk = csc_coroSched_run(sched) && t.isOk && t.waitedMs>=90 && t.waitedMs<500;
+ 
+    close(fds[0]);
+    close(fds[1]);
+    csc_coroSched_free(sched);
+    report("coro_timeout", isOk);
+}
+
+
+// Outside a coroutine, the I/O functions simply block.
+void testNoCoro()
+{   char buf[10];
+    int fds[2];
+    int isOk;
+ 
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    isOk = csc_coro_write(fds[0], "hello", 5) == 5;
+    isOk = isOk && csc_coro_read(fds[1], buf, sizeof(buf)) == 5 && memcmp(buf, "hello", 5) == 0;
+    isOk = isOk && csc_coro_waitFd(fds[1], POLLIN, 10) == 0;
+    close(fds[0]);
+    isOk = isOk && csc_coro_waitFd(fds[1], POLLIN, 10) == 1;
+    close(fds[1]);
+    report("coro_noCoro", isOk);
+}
+
+
+// ------------------------ Spawning --------------------------------
+
+typedef struct
+{   csc_coroSched_t *sched;
+    int nLeft;
+    int nRun;
+} chain_t;
+
+// Each coroutine starts the next, so that stacks are reused.
+void chainLink(void *arg)
+{   chain_t *chain = arg;
+    char big[8000];
+    memset(big, chain->nLeft, sizeof(big));
+    chain->nRun++;
+    if (--chain->nLeft > 0)
+        csc_coro_spawn(chain->sched, chainLink, chain);
+    csc_coro_yield();
+    chain->nRun += big[100]==big[7000] ? 0 : 1000000;
+}
+
+
+void testSpawn()
+{   csc_coroSched_t *sched = csc_coroSched_new(stackSize);
+    chain_t chain;
+    int isOk;
+ 
+    chain.sched = sched;
+    chain.nLeft = 100000;
+    chain.nRun = 0;
+    csc_coro_spawn(sched, chainLink, &chain);
+    isOk = csc_coroSched_run(sched) && chain.nRun==100000;
+ 
+    csc_coroSched_free(sched);
+    report("coro_spawn", isOk);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    testYield();
+    testSleep();
+    testIo();
+    testTimeout();
+    testNoCoro();
+    testSpawn();
+    report("coro_mem", csc_mck_nchunks()==0);
+    fclose(fout);
+}
@@ -0,0 +1,192 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/netCli.h>
+#include <CscNetLib/dnsCache.h>
+
+FILE *fout;
+
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+// ----------- A stub resolver ------------
+
+int nCalls = 0;
+const char *goodIp = "127.0.0.7";
+
+// "good.test" resolves to 'goodIp', "gone.test" does not exist, and
+// "flaky.test" cannot be looked up.
+int stubResolver( const char *node, const char *service
+                , const struct addrinfo *hints, struct addrinfo **res
+                )
+{   struct addrinfo numHints = *hints;
+    __sync_fetch_and_add(&nCalls, 1);
+    numHints.ai_flags |= AI_NUMERICHOST;
+    if (csc_streq(node, "good.test"))
+        return getaddrinfo(goodIp, service, &numHints, res);
+    else if (csc_streq(node, "flaky.test"))
+        return EAI_AGAIN;
+    else
+        return EAI_NONAME;
+}
+
+
+// Looks up 'node', and checks the answer.
+csc_bool_t lookup(const char *node, int expectRet, const char *expectIp, int portNo)
+{   struct addrinfo hints;
+    struct addrinfo *res;
+    struct sockaddr_in *sin;
+    char portStr[10];
+    char ip[INET_ADDRSTRLEN];
+    csc_bool_t isOk;
+    int ret;
+ 
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(portStr, "%d", portNo);
+    ret = csc_dnsCache_getaddrinfo(node, portStr, &hints, &res);
+    isOk = ret == expectRet;
+    if (isOk && ret==0)
+    {   sin = (struct sockaddr_in*)res->ai_addr;
+        inet_ntop(AF_INET, &sin->sin_addr, ip, sizeof(ip));
+        isOk = csc_streq(ip, expectIp) && ntohs(sin->sin_port)==portNo;
+    }
+    csc_dnsCache_freeaddrinfo(res);
+    return isOk;
+}
+
+
+// ----------- Tests ------------
+
+// Until turned on, every lookup resolves.
+void testOff()
+{   int isOk;
+    nCalls = 0;
+    isOk = lookup("good.test", 0, "127.0.0.7", 80);
+    isOk = isOk && lookup("good.test", 0, "127.0.0.7", 80);
+    report("off", isOk && nCalls==2);
+}
+
+
+// Answers are kept for their time, for any port.
+void testTtl()
+{   long hits, misses;
+    int isOk;
+ 
+    csc_dnsCache_setTtl(1, 1, 0);
+    nCalls = 0;
+    isOk = lookup("good.test", 0, "127.0.0.7", 80);
+    isOk = isOk && lookup("good.test", 0, "127.0.0.7", 8080);
+    isOk = isOk && nCalls==1;
+    csc_dnsCache_getStats(&hits, &misses, NULL);
+    isOk = isOk && hits==1 && misses==1;
+ 
+    sleep(2);
+    isOk = isOk && lookup("good.test", 0, "127.0.0.7", 80);
+    report("ttl", isOk && nCalls==2);
+}
+
+
+// Names that do not exist are remembered, but failures to find out are not.
+void testNegative()
+{   int isOk;
+    nCalls = 0;
+    isOk = lookup("gone.test", EAI_NONAME, NULL, 80);
+    isOk = isOk && lookup("gone.test", EAI_NONAME, NULL, 80);
+    isOk = isOk && nCalls==1;
+    isOk = isOk && lookup("flaky.test", EAI_AGAIN, NULL, 80);
+    isOk = isOk && lookup("flaky.test", EAI_AGAIN, NULL, 80);
+    report("negative", isOk && nCalls==3);
+}
+
+
+// A stale answer is given while the name is looked up again.
+void testStale()
+{   long nStale;
+    int isOk, i;
+ 
+    csc_dnsCache_clear();
+    csc_dnsCache_setTtl(1, 1, 10);
+    nCalls = 0;
+    isOk = lookup("good.test", 0, "127.0.0.7", 80);
+    sleep(2);
+    goodIp = "127.0.0.8";
+    isOk = isOk && lookup("good.test", 0, "127.0.0.7", 80);
+    csc_dnsCache_getStats(NULL, NULL, &nStale);
+    isOk = isOk && nStale==1;
+ 
+// Once refreshed, the new answer is given.
+    for (i=0; i<100 && nCalls<2; i++)
+        usleep(10000);
+    usleep(10000);
+    isOk = isOk && nCalls==2 && lookup("good.test", 0, "127.0.0.8", 80);
+    report("stale", isOk && nCalls==2);
+}
+
+
+// Names may be resolved ahead of time, for csc_cli_setServAddr().
+void testPrewarm()
+{   csc_cli_t *cli = csc_cli_new();
+    int isOk;
+ 
+    csc_dnsCache_clear();
+    csc_dnsCache_setTtl(60, 60, 0);
+    nCalls = 0;
+    isOk = csc_dnsCache_prewarm("good.test")==0 && nCalls==1;
+    isOk = isOk && csc_cli_setServAddr(cli, "good.test", 80) && nCalls==1;
+    isOk = isOk && csc_cli_setServAddr(cli, "good.test", 81) && nCalls==1;
+    isOk = isOk && !csc_cli_setServAddr(cli, "gone.test", 80);
+    isOk = isOk && !csc_cli_setServAddr(cli, "gone.test", 80) && nCalls==2;
+ 
+// Numeric addresses are not looked up.
+    isOk = isOk && csc_cli_setServAddr(cli, "127.0.0.1", 80) && nCalls==2;
+ 
+    csc_cli_free(cli);
+    report("prewarm", isOk);
+}
+
+
+// Names from /etc/hosts, with the real resolver.
+void testHosts()
+{   long hits1, hits2;
+    int isOk;
+ 
+    csc_dnsCache_setResolver(NULL);
+    csc_dnsCache_clear();
+    csc_dnsCache_setTtl(60, 60, 0);
+    csc_dnsCache_getStats(&hits1, NULL, NULL);
+    isOk = lookup("localhost", 0, "127.0.0.1", 80);
+    isOk = isOk && lookup("localhost", 0, "127.0.0.1", 80);
+    csc_dnsCache_getStats(&hits2, NULL, NULL);
+    report("hosts", isOk && hits2==hits1+1);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    csc_dnsCache_setResolver(stubResolver);
+    testOff();
+    testTtl();
+    testNegative();
+    testStale();
+    testPrewarm();
+    testHosts();
+    csc_dnsCache_clear();
+    fclose(fout);
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #include <CscNetLib/std.h>
@@ -387,6 +388,92 @@ void testPcent()
 }
 
 
+void testParse()
+{   csc_httpErr_t errCode;
+    csc_http_t *msg;
+    int headLen;
+ 
+// A request in a buffer with no '\0', with a body after it.
+    const char reqBuf[] =
+        "\r\nPOST /a%20b?x=1 HTTP/1.1\r\n"
+        "Host: h.com\r\n"
+        "X-Empty:\r\n"
+        "X-Spaced:   v w  \r\n"
+        "\r\n"
+        "body";
+    int reqLen = sizeof(reqBuf) - 1;
+    int reqHeadLen = reqLen - 4;
+ 
+    testReport_iVal(stdout, "http_parse_headLen", reqHeadLen, csc_http_headLen(reqBuf, reqLen));
+    testReport_iVal(stdout, "http_parse_headLenPart", -1, csc_http_headLen(reqBuf, reqHeadLen-1));
+    testReport_iVal(stdout, "http_parse_headLenLf", 8, csc_http_headLen("a\nb: c\n\nd", 10));
+ 
+    msg = csc_http_new();
+    errCode = csc_http_parseSrv(msg, reqBuf, reqLen, &headLen);
+    testReport_iVal(stdout, "http_parse_reqRetVal", csc_httpErr_Ok, errCode);
+    testReport_iVal(stdout, "http_parse_reqHeadLen", reqHeadLen, headLen);
+    testReport_sVal(stdout, "http_parse_method", "POST", csc_http_getSF(msg, csc_httpSF_method));
+    testReport_sVal(stdout, "http_parse_reqUri", "/a b", csc_http_getSF(msg, csc_httpSF_reqUri));
+    testReport_sVal(stdout, "http_parse_urlVal", "1", csc_http_getUrlVal(msg, "x", NULL));
+    testReport_sVal(stdout, "http_parse_host", "h.com", csc_http_getHdr(msg, "Host"));
+    testReport_sVal(stdout, "http_parse_empty", "", csc_http_getHdr(msg, "X-Empty"));
+    testReport_sVal(stdout, "http_parse_spaced", "v w", csc_http_getHdr(msg, "X-Spaced"));
+    testReport_sVal(stdout, "http_parse_notThere", NULL, csc_http_getHdr(msg, "Hos"));
+ 
+// Headers added later go with those parsed.
+    csc_http_addHdr(msg, "Added", "yes");
+    testReport_sVal(stdout, "http_parse_added", "yes", csc_http_getHdr(msg, "Added"));
+    testReport_sVal(stdout, "http_parse_hostAfter", "h.com", csc_http_getHdr(msg, "Host"));
+ 
+// Values got stay valid however many are added after.
+    const char *host = csc_http_getHdr(msg, "Host");
+    const char *added = csc_http_getHdr(msg, "Added");
+    char name[20];
+    for (int i=0; i<200; i++)
+    {   sprintf(name, "X-Many-%d", i);
+        csc_http_addHdr(msg, name, "a value to fill the header chunks");
+    }
+    testReport_sVal(stdout, "http_parse_hostKept", "h.com", host);
+    testReport_sVal(stdout, "http_parse_addedKept", "yes", added);
+    testReport_sVal(stdout, "http_parse_manyLast", "a value to fill the header chunks", csc_http_getHdr(msg, "X-Many-199"));
+    csc_http_free(msg);
+ 
+// A response, which stops at the blank line.
+    const char *resp = "HTTP/1.0 301 Moved Permanently\nLocation: /b\n\nLocation: /c\n";
+    msg = csc_http_new();
+    errCode = csc_http_parseCli(msg, resp, strlen(resp), &headLen);
+    testReport_iVal(stdout, "http_parse_respRetVal", csc_httpErr_Ok, errCode);
+    testReport_iVal(stdout, "http_parse_respHeadLen", 45, headLen);
+    testReport_sVal(stdout, "http_parse_statCode", "301", csc_http_getSF(msg, csc_httpSF_statCode));
+    testReport_sVal(stdout, "http_parse_reason", "Moved Permanently", csc_http_getSF(msg, csc_httpSF_reason));
+    testReport_sVal(stdout, "http_parse_location", "/b", csc_http_getHdr(msg, "Location"));
+    csc_http_free(msg);
+ 
+// Errors.
+    msg = csc_http_new();
+    errCode = csc_http_parseSrv(msg, "FETCH / HTTP/1.1\r\n\r\n", 20, NULL);
+    testReport_iVal(stdout, "http_parse_badMethod", csc_httpErr_BadMethod, errCode);
+    csc_http_free(msg);
+    msg = csc_http_new();
+    errCode = csc_http_parseCli(msg, "HTTP/1.1 200\r\n\r\n", 16, NULL);
+    testReport_iVal(stdout, "http_parse_noReason", csc_httpErr_UnexpectedEOF, errCode);
+    csc_http_free(msg);
+ 
+// A head without its blank line yet is not parsed.
+    msg = csc_http_new();
+    errCode = csc_http_parseSrv(msg, "GET /a HTTP/1.1\r\nHo", 19, &headLen);
+    testReport_iVal(stdout, "http_parse_incomplete", csc_httpErr_Incomplete, errCode);
+    testReport_iVal(stdout, "http_parse_incompleteLen", -1, headLen);
+    testReport_sVal(stdout, "http_parse_incompleteHdr", NULL, csc_http_getHdr(msg, "Ho"));
+    csc_http_free(msg);
+    msg = csc_http_new();
+    csc_http_setMaxInputChars(msg, 10);
+    errCode = csc_http_parseSrv(msg, "GET /a HTTP/1.1\r\nHo", 19, NULL);
+    testReport_iVal(stdout, "http_parse_tooLong", csc_httpErr_LineTooLong, errCode);
+    csc_http_free(msg);
+}
+
+
 int main(int argc, char **argv)
 {   testAddGet(stdout);
     testPcent();
@@ -394,6 +481,7 @@ int main(int argc, char **argv)
     testCliRcv2();
     testSrvRcv3();
     testSrvRcv4();
+    testParse();
     if (csc_mck_nchunks() == 0)
         fprintf(stdout, "pass (%s)\n", "http_memory");
     else
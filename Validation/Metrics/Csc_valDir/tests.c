@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/alloc.h>
+#include <CscNetLib/cstr.h>
+#include <CscNetLib/metrics.h>
+
+FILE *fout;
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+// The count on the bucket line for 'le' in 'text', or -1 if there is none.
+long long bucketCount(const char *text, const char *name, const char *le)
+{   char pattern[100];
+    const char *p;
+    sprintf(pattern, "%s_bucket{le=\"%s\"} ", name, le);
+    p = strstr(text, pattern);
+    if (p == NULL)
+        return -1;
+    return atoll(p + strlen(pattern));
+}
+
+
+void testCounters()
+{   csc_metrics_t *reg = csc_metrics_new(4);
+    csc_metric_t *counter = csc_metrics_counter(reg, "things_total", "Things done.");
+    csc_metric_t *gauge = csc_metrics_gauge(reg, "things_now", NULL);
+    int isOk;
+ 
+    csc_metric_add(counter, 5);
+    csc_metric_add(counter, 2);
+    csc_metric_add(gauge, 10);
+    csc_metric_add(gauge, -3);
+    isOk = csc_metric_get(counter)==7 && csc_metric_get(gauge)==7;
+    csc_metric_set(gauge, -4);
+    isOk = isOk && csc_metric_get(gauge)==-4;
+ 
+    csc_metrics_free(reg);
+    report("metrics_counters", isOk);
+}
+
+
+void testRegister()
+{   csc_metrics_t *reg = csc_metrics_new(3);
+    int isOk = csc_TRUE;
+ 
+// Invalid names.
+    isOk = isOk && csc_metrics_counter(reg, "9lives", NULL) == NULL;
+    isOk = isOk && csc_metrics_counter(reg, "has-dash", NULL) == NULL;
+    isOk = isOk && csc_metrics_counter(reg, "", NULL) == NULL;
+ 
+// Duplicates, and too many.
+    isOk = isOk && csc_metrics_counter(reg, "a:b_c", NULL) != NULL;
+    isOk = isOk && csc_metrics_gauge(reg, "a:b_c", NULL) == NULL;
+    isOk = isOk && csc_metrics_gauge(reg, "_two", NULL) != NULL;
+    isOk = isOk && csc_metrics_histogram(reg, "three", NULL, 1) != NULL;
+    isOk = isOk && csc_metrics_counter(reg, "four", NULL) == NULL;
+ 
+// A metric that failed to register may still be used.
+    csc_metric_add(NULL, 1);
+    csc_metric_set(NULL, 1);
+    csc_metric_observe(NULL, 1);
+    isOk = isOk && csc_metric_get(NULL) == 0;
+ 
+    csc_metrics_free(reg);
+    report("metrics_register", isOk);
+}
+
+
+void testText()
+{   csc_metrics_t *reg = csc_metrics_new(2);
+    csc_metric_t *counter = csc_metrics_counter(reg, "c_total", "Back\\slash and\nnewline.");
+    csc_metric_t *gauge = csc_metrics_gauge(reg, "g", NULL);
+    csc_str_t *out = csc_str_new(NULL);
+    const char *expect =
+        "# HELP c_total Back\\\\slash and\\nnewline.\n"
+        "# TYPE c_total counter\n"
+        "c_total 5\n"
+        "# TYPE g gauge\n"
+        "g -3\n";
+ 
+    csc_metric_add(counter, 5);
+    csc_metric_set(gauge, -3);
+    csc_metrics_write(reg, out);
+ 
+    report("metrics_text", csc_streq(csc_str_charr(out), expect));
+    csc_str_free(out);
+    csc_metrics_free(reg);
+}
+
+
+void testHistogram()
+{   csc_metrics_t *reg = csc_metrics_new(1);
+    csc_metric_t *hist = csc_metrics_histogram(reg, "h", "Values.", 1);
+    csc_str_t *out = csc_str_new(NULL);
+    uint64_t values[] = {0, 1, 3, 4, 5, 9, 100, 1000000, (uint64_t)1<<27};
+    const char *text;
+    int i, isOk;
+ 
+    for (i=0; i<sizeof(values)/sizeof(values[0]); i++)
+        csc_metric_observe(hist, values[i]);
+    csc_metrics_write(reg, out);
+    text = csc_str_charr(out);
+ 
+// Buckets are cumulative.  The largest value is only in "+Inf".
+    isOk = bucketCount(text, "h", "0") == 1
+        && bucketCount(text, "h", "1") == 2
+        && bucketCount(text, "h", "3") == 3
+        && bucketCount(text, "h", "4") == 4
+        && bucketCount(text, "h", "5") == 5
+        && bucketCount(text, "h", "9") == 6
+        && bucketCount(text, "h", "111") == 7
+        && bucketCount(text, "h", "1048575") == 8
+        && bucketCount(text, "h", "67108863") == 8
+        && bucketCount(text, "h", "+Inf") == 9
+        && strstr(text, "\nh_count 9\n") != NULL
+        && strstr(text, "\nh_sum 135217850\n") != NULL
+        && csc_metric_get(hist) == 9;
+ 
+    report("metrics_histogram", isOk);
+    csc_str_free(out);
+    csc_metrics_free(reg);
+}
+
+
+// Each value goes in the first bucket whose limit is not below it, and the
+// limits are within 25% of each other.
+void testBuckets()
+{   csc_metrics_t *reg;
+    csc_metric_t *hist;
+    csc_str_t *out = csc_str_new(NULL);
+    double le = 0, prevLe;
+    uint64_t value;
+    const char *p;
+    int i, isOk = csc_TRUE;
+ 
+    srandom(54321);
+    for (i=0; i<3000 && isOk; i++)
+    {   value = i<1000 ? i : random() % ((uint64_t)1<<26);
+        reg = csc_metrics_new(1);
+        hist = csc_metrics_histogram(reg, "h", NULL, 1);
+        csc_metric_observe(hist, value);
+        csc_str_reset(out);
+        csc_metrics_write(reg, out);
+ 
+    // Find the bucket that it went in.
+        p = csc_str_charr(out);
+        prevLe = -1;
+        while ((p=strstr(p,"h_bucket{le=\"")) != NULL)
+        {   p += strlen("h_bucket{le=\"");
+            if (*p == '+')
+                break;
+            le = atof(p);
+            if (atoll(strstr(p,"} ")+2) > 0)
+                break;
+            prevLe = le;
+        }
+        isOk = p!=NULL && *p!='+' && prevLe<value && value<=le
+            && (value<4 || le-prevLe <= 0.25*(prevLe+1));
+        csc_metrics_free(reg);
+    }
+ 
+    report("metrics_buckets", isOk);
+    csc_str_free(out);
+}
+
+
+// Forked processes add to the same metrics, without losing any.
+void testFork()
+{   csc_metrics_t *reg = csc_metrics_new(2);
+    csc_metric_t *counter = csc_metrics_counter(reg, "forked_total", NULL);
+    csc_metric_t *hist = csc_metrics_histogram(reg, "forked_values", NULL, 1);
+    int nProcs = 4, nAdds = 100000;
+    int i, j, status, isOk = csc_TRUE;
+    pid_t pid;
+ 
+    for (i=0; i<nProcs; i++)
+    {   pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+        {   for (j=0; j<nAdds; j++)
+            {   csc_metric_add(counter, 1);
+                csc_metric_observe(hist, j);
+            }
+            _exit(0);
+        }
+    }
+    for (i=0; i<nProcs; i++)
+    {   wait(&status);
+        isOk = isOk && WIFEXITED(status) && WEXITSTATUS(status)==0;
+    }
+ 
+    isOk = isOk && csc_metric_get(counter)==nProcs*nAdds && csc_metric_get(hist)==nProcs*nAdds;
+    csc_metrics_free(reg);
+    report("metrics_fork", isOk);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    testCounters();
+    testRegister();
+    testText();
+    testHistogram();
+    testBuckets();
+    testFork();
+    report("metrics_mem", csc_mck_nchunks()==0);
+    fclose(fout);
+}
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/netCli.h>
+#include <CscNetLib/dnsCache.h>
+
+FILE *fout;
+
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+long nowMs()
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+
+// Listens on 'ip', IPv4 or IPv6, at 'port'.  Returns the socket, or -1
+// if the port is taken.
+int listenOn(const char *ip, int port, int backlog)
+{   struct sockaddr_in addr;
+    struct sockaddr_in6 addr6;
+    int fd, isOk;
+ 
+    if (strchr(ip, ':') == NULL)
+    {   fd = socket(AF_INET, SOCK_STREAM, 0);  assert(fd >= 0);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, ip, &addr.sin_addr);
+        isOk = bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    }
+    else
+    {   fd = socket(AF_INET6, SOCK_STREAM, 0);  assert(fd >= 0);
+        memset(&addr6, 0, sizeof(addr6));
+        addr6.sin6_family = AF_INET6;
+        addr6.sin6_port = htons(port);
+        inet_pton(AF_INET6, ip, &addr6.sin6_addr);
+        isOk = bind(fd, (struct sockaddr*)&addr6, sizeof(addr6)) == 0;
+    }
+    if (!isOk)
+    {   close(fd);
+        return -1;
+    }
+    assert(listen(fd, backlog) == 0);
+    return fd;
+}
+
+
+// Listens on 127.0.0.1, on any free port.  Returns the socket.
+int listenAny(int backlog, int *port)
+{   int fd = -1, i;
+    *port = 20000 + (getpid()+backlog*1000)%20000;
+    for (i=0; i<100 && fd<0; i++)
+        fd = listenOn("127.0.0.1", ++*port, backlog);
+    assert(fd >= 0);
+    return fd;
+}
+
+
+// "dual.test" resolves to ::1 and then 127.0.0.1, as "localhost" does on a
+// dual stack host.  csc_cli_setServAddr() wants a name with a dot.
+int stubResolver( const char *node, const char *service
+                , const struct addrinfo *hints, struct addrinfo **res
+                )
+{   struct addrinfo numHints = *hints;
+    struct addrinfo *res4;
+    int ret;
+    if (!csc_streq(node, "dual.test"))
+        return EAI_NONAME;
+    numHints.ai_flags |= AI_NUMERICHOST;
+    numHints.ai_family = AF_INET6;
+    ret = getaddrinfo("::1", service, &numHints, res);
+    if (ret != 0)
+        return ret;
+    numHints.ai_family = AF_INET;
+    ret = getaddrinfo("127.0.0.1", service, &numHints, &res4);
+    if (ret != 0)
+    {   freeaddrinfo(*res);
+        return ret;
+    }
+    (*res)->ai_next = res4;
+    return 0;
+}
+
+
+// Connects, and says how.
+void testConnect()
+{   csc_cli_t *cli = csc_cli_new();
+    const csc_cli_attempt_t *at;
+    int port, fd;
+    int listenFd = listenAny(5, &port);
+    int isOk;
+ 
+    isOk = csc_cli_setServAddr(cli, "127.0.0.1", port);
+    fd = csc_cli_connectTimeout(cli, 1000);
+    isOk = isOk && fd>=0 && csc_cli_getNumAttempts(cli)==1;
+    at = csc_cli_getAttempt(cli, 0);
+    isOk = isOk && at!=NULL && at->errNo==0 && csc_streq(at->ip,"127.0.0.1");
+    isOk = isOk && csc_cli_getAttempt(cli, 1)==NULL;
+ 
+// It is blocking, as from csc_cli_connect().
+    isOk = isOk && (fcntl(fd, F_GETFL) & O_NONBLOCK) == 0;
+ 
+    if (fd >= 0)
+        close(fd);
+    close(listenFd);
+    csc_cli_free(cli);
+    report("connect", isOk);
+}
+
+
+// Nothing is listening.
+void testRefused()
+{   csc_cli_t *cli = csc_cli_new();
+    int port, fd;
+    int listenFd = listenAny(5, &port);
+    int isOk;
+ 
+    close(listenFd);
+    isOk = csc_cli_setServAddr(cli, "127.0.0.1", port);
+    fd = csc_cli_connectTimeout(cli, 1000);
+    isOk = isOk && fd<0 && csc_cli_getNumAttempts(cli)==1;
+    isOk = isOk && csc_cli_getAttempt(cli,0)->errNo==ECONNREFUSED;
+    isOk = isOk && strstr(csc_cli_getErrMsg(cli), strerror(ECONNREFUSED))!=NULL;
+ 
+// Nor is a socket left open by csc_cli_connect().
+    fd = dup(0);
+    close(fd);
+    isOk = isOk && csc_cli_connect(cli)<0;
+    isOk = isOk && dup(0)==fd;
+    close(fd);
+ 
+    csc_cli_free(cli);
+    report("refused", isOk);
+}
+
+
+// A server that does not answer is given up on in time.
+void testTimeout()
+{   csc_cli_t *cli = csc_cli_new();
+    int port, fd, i;
+    int listenFd = listenAny(0, &port);
+    int filler[4];
+    long startMs;
+    int isOk;
+ 
+// Fill the listen queue, so that more SYNs are dropped.
+    isOk = csc_cli_setServAddr(cli, "127.0.0.1", port);
+    for (i=0; i<4; i++)
+        filler[i] = csc_cli_connectTimeout(cli, 200);
+ 
+    startMs = nowMs();
+    fd = csc_cli_connectTimeout(cli, 300);
+    isOk = isOk && fd<0 && nowMs()-startMs>=290 && nowMs()-startMs<1000;
+    isOk = isOk && csc_cli_getNumAttempts(cli)==1;
+    isOk = isOk && csc_cli_getAttempt(cli,0)->errNo==ETIMEDOUT;
+    isOk = isOk && csc_cli_getAttempt(cli,0)->elapsedMs>=290;
+ 
+    for (i=0; i<4; i++)
+        if (filler[i] >= 0)
+            close(filler[i]);
+    close(listenFd);
+    csc_cli_free(cli);
+    report("timeout", isOk);
+}
+
+
+// Nothing is listening on ::1, so the attempt there fails, and 127.0.0.1
+// is tried at once.
+void testFallback()
+{   csc_cli_t *cli = csc_cli_new();
+    const csc_cli_attempt_t *at0, *at1;
+    int port, fd;
+    int listenFd = listenAny(5, &port);
+    int isOk;
+ 
+    csc_dnsCache_setResolver(stubResolver);
+    isOk = csc_cli_setServAddr(cli, "dual.test", port);
+    fd = csc_cli_connectTimeout(cli, 2000);
+    isOk = isOk && fd>=0 && csc_cli_getNumAttempts(cli)==2;
+    at0 = csc_cli_getAttempt(cli, 0);
+    at1 = csc_cli_getAttempt(cli, 1);
+    isOk = isOk && at0!=NULL && csc_streq(at0->ip,"::1") && at0->errNo==ECONNREFUSED;
+    isOk = isOk && at1!=NULL && csc_streq(at1->ip,"127.0.0.1") && at1->errNo==0;
+    isOk = isOk && at1->startMs < csc_cli_AttemptDelayMs;
+ 
+    if (fd >= 0)
+        close(fd);
+    close(listenFd);
+    csc_dnsCache_setResolver(NULL);
+    csc_cli_free(cli);
+    report("fallback", isOk);
+}
+
+
+// The server on ::1 does not answer, so 127.0.0.1 is tried once
+// csc_cli_AttemptDelayMs has passed, and wins.
+void testStagger()
+{   csc_cli_t *cli = csc_cli_new();
+    const csc_cli_attempt_t *at0, *at1;
+    int port, fd, i;
+    int listenFd = listenAny(5, &port);
+    int listenFd6 = listenOn("::1", port, 0);
+    int filler[4];
+    int isOk = listenFd6 >= 0;
+ 
+// Fill the queue on ::1, so that more SYNs are dropped.
+    isOk = isOk && csc_cli_setServAddr(cli, "::1", port);
+    for (i=0; i<4; i++)
+        filler[i] = isOk ? csc_cli_connectTimeout(cli, 200) : -1;
+ 
+    csc_dnsCache_setResolver(stubResolver);
+    isOk = isOk && csc_cli_setServAddr(cli, "dual.test", port);
+    fd = isOk ? csc_cli_connectTimeout(cli, 2000) : -1;
+    isOk = isOk && fd>=0 && csc_cli_getNumAttempts(cli)==2;
+    at0 = csc_cli_getAttempt(cli, 0);
+    at1 = csc_cli_getAttempt(cli, 1);
+    isOk = isOk && at0!=NULL && csc_streq(at0->ip,"::1") && at0->errNo==ECANCELED;
+    isOk = isOk && at1!=NULL && csc_streq(at1->ip,"127.0.0.1") && at1->errNo==0;
+    isOk = isOk && at1->startMs >= csc_cli_AttemptDelayMs-10
+                && at1->startMs < csc_cli_AttemptDelayMs+200;
+    isOk = isOk && at0->elapsedMs >= at1->startMs;
+ 
+    if (fd >= 0)
+        close(fd);
+    for (i=0; i<4; i++)
+        if (filler[i] >= 0)
+            close(filler[i]);
+    if (listenFd6 >= 0)
+        close(listenFd6);
+    close(listenFd);
+    csc_dnsCache_setResolver(NULL);
+    csc_cli_free(cli);
+    report("stagger", isOk);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    testConnect();
+    testRefused();
+    testTimeout();
+    testFallback();
+    testStagger();
+    fclose(fout);
+}
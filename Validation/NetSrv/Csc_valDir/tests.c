@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/netSrv.h>
+
+FILE *fout;
+
+
+// Format 'ipStr' as a binary address, and compare with 'expect'.
+void testFmtE(const char *testName, const char *ipStr, const char *expect)
+{   csc_srv_addr_t addr;
+    char buf[csc_srv_AddrStrSize];
+    unsigned char v4[4];
+ 
+    memset(&addr, 0, sizeof(addr));
+    if (inet_pton(AF_INET, ipStr, v4) == 1)
+    {   addr.ip[10] = addr.ip[11] = 0xff;
+        memcpy(addr.ip+12, v4, 4);
+    }
+    else
+        assert(inet_pton(AF_INET6, ipStr, addr.ip) == 1);
+ 
+    if (csc_streq(csc_srv_addrBinStr(&addr,buf), expect))
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+void testFmt()
+{   testFmtE("fmt_v4", "192.168.0.3", "192.168.0.3");
+    testFmtE("fmt_v4Zero", "0.0.0.0", "0.0.0.0");
+    testFmtE("fmt_v4Max", "255.255.255.255", "255.255.255.255");
+    testFmtE("fmt_v4Mapped", "::ffff:10.1.20.3", "10.1.20.3");
+    testFmtE("fmt_v6Loopback", "::1", "::1");
+    testFmtE("fmt_v6Any", "::", "::");
+    testFmtE("fmt_v6Full", "2001:0db8:c9d2:0012:0000:0000:0000:0051", "2001:db8:c9d2:12::51");
+    testFmtE("fmt_v6Trailing", "fe80::", "fe80::");
+    testFmtE("fmt_v6OneZero", "2001:db8:0:1:1:1:1:1", "2001:db8:0:1:1:1:1:1");
+    testFmtE("fmt_v6Longest", "2001:0:0:1:0:0:0:1", "2001:0:0:1::1");
+    testFmtE("fmt_v6FirstOfEqual", "2001:db8:0:0:1:0:0:1", "2001:db8::1:0:0:1");
+    testFmtE("fmt_v6Upper", "2001:DB8::ABCD", "2001:db8::abcd");
+}
+
+
+// Random addresses, compared with inet_ntop().
+void testFmtRandom()
+{   csc_srv_addr_t addr;
+    char buf[csc_srv_AddrStrSize];
+    char expect[INET6_ADDRSTRLEN];
+    int isOk = csc_TRUE;
+    int i, j;
+ 
+    srandom(12345);
+    for (i=0; i<100000 && isOk; i++)
+    {
+    // Plenty of zero groups, so that they get compressed.
+        for (j=0; j<8; j++)
+        {   int group = random()%3==0 ? random()&0xffff : 0;
+            addr.ip[2*j] = group >> 8;
+            addr.ip[2*j+1] = group & 0xff;
+        }
+ 
+    // inet_ntop() writes these with embedded IPv4, which we leave to mapped addresses.
+        if (memcmp(addr.ip, "\0\0\0\0\0\0\0\0\0\0\0\0", 12) == 0)
+            addr.ip[0] = 1;
+        else if (memcmp(addr.ip, "\0\0\0\0\0\0\0\0\0\0\xff\xff", 12) == 0)
+            continue;
+ 
+        inet_ntop(AF_INET6, addr.ip, expect, sizeof(expect));
+        isOk = csc_streq(csc_srv_addrBinStr(&addr,buf), expect);
+    }
+ 
+    if (isOk)
+        fprintf(fout, "pass (fmt_random)\n");
+    else
+        fprintf(fout, "FAIL (fmt_random)\n");
+}
+
+
+// A connection queued on one listening socket is accepted by another
+// netSrv object that adopts it, as in a hot restart.
+void testAdopt()
+{   csc_srv_t *srv1 = csc_srv_new();
+    csc_srv_t *srv2 = csc_srv_new();
+    csc_srv_t *srv3 = csc_srv_new();
+    struct sockaddr_in addr;
+    int port = 20000 + getpid()%10000;
+    int cliSock, rwSock, notListening, i;
+    int isOk = csc_FALSE;
+ 
+// Listen on any free port, and queue a connection.
+    for (i=0; i<100 && !isOk; i++)
+        isOk = csc_srv_setAddr(srv1, "127.0.0.1", ++port, 5);
+    cliSock = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    isOk = isOk && connect(cliSock, (struct sockaddr*)&addr, sizeof(addr))==0;
+ 
+// Hand it over, non-blocking as the last owner had it, and close the
+// original.  It stays non-blocking.
+    fcntl(csc_srv_getListenSock(srv1), F_SETFL, O_NONBLOCK);
+    isOk = isOk && csc_srv_adoptListenSock(srv2, dup(csc_srv_getListenSock(srv1)));
+    csc_srv_free(srv1);
+    rwSock = isOk ? csc_srv_accept(srv2) : -1;
+    isOk = isOk && rwSock>=0 && csc_streq(csc_srv_acceptAddr(srv2), "127.0.0.1");
+    isOk = isOk && (fcntl(csc_srv_getListenSock(srv2), F_GETFL) & O_NONBLOCK);
+    isOk = isOk && csc_srv_accept(srv2)==-3;
+    if (rwSock >= 0)
+        close(rwSock);
+    close(cliSock);
+ 
+// Only a listening socket will do.
+    notListening = socket(AF_INET, SOCK_STREAM, 0);
+    isOk = isOk && !csc_srv_adoptListenSock(srv3, notListening);
+    close(notListening);
+ 
+    csc_srv_free(srv2);
+    csc_srv_free(srv3);
+    if (isOk)
+        fprintf(fout, "pass (adopt)\n");
+    else
+        fprintf(fout, "FAIL (adopt)\n");
+}
+
+
+// The options are set on the listening socket and its connections, and
+// with TCP_DEFER_ACCEPT a connection is not accepted until it has data.
+void testSockOpts()
+{   csc_srv_t *srv = csc_srv_new();
+    csc_srv_sockOpts_t opts;
+    csc_srv_accepted_t accepted;
+    struct sockaddr_in addr;
+    struct pollfd pfd;
+    int port = 30000 + getpid()%10000;
+    int cliSock, listenSock, val, i;
+    socklen_t valLen = sizeof(val);
+    int isOk = csc_FALSE;
+ 
+// Listen on any free port, with the options.
+    csc_srv_sockOptsInit(&opts);
+    opts.deferAcceptSecs = 5;
+    opts.fastOpenQueue = 16;
+    opts.isNoDelay = csc_TRUE;
+    opts.isQuickAck = csc_TRUE;
+    opts.rcvBufSize = 65536;
+    csc_srv_setSockOpts(srv, &opts);
+    for (i=0; i<100 && !isOk; i++)
+        isOk = csc_srv_setAddr(srv, "127.0.0.1", ++port, 5);
+    listenSock = csc_srv_getListenSock(srv);
+    isOk = isOk && getsockopt(listenSock, IPPROTO_TCP, TCP_DEFER_ACCEPT, &val, &valLen)==0 && val>=5;
+    isOk = isOk && getsockopt(listenSock, IPPROTO_TCP, TCP_FASTOPEN, &val, &valLen)==0 && val==16;
+ 
+// A connection that has sent nothing is not ready.
+    cliSock = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    isOk = isOk && connect(cliSock, (struct sockaddr*)&addr, sizeof(addr))==0;
+    isOk = isOk && csc_srv_acceptMany(srv, &accepted, 1, 0, csc_FALSE) == -3;
+ 
+// Once it has, it is, and has the options.
+    isOk = isOk && write(cliSock, "x", 1)==1;
+    pfd.fd = listenSock;
+    pfd.events = POLLIN;
+    isOk = isOk && poll(&pfd, 1, 2000)==1;
+    isOk = isOk && csc_srv_acceptMany(srv, &accepted, 1, 0, csc_FALSE) == 1;
+    if (isOk)
+    {   isOk = getsockopt(accepted.fd, IPPROTO_TCP, TCP_NODELAY, &val, &valLen)==0 && val!=0;
+        isOk = isOk && getsockopt(accepted.fd, SOL_SOCKET, SO_RCVBUF, &val, &valLen)==0 && val>=65536;
+        close(accepted.fd);
+    }
+    close(cliSock);
+ 
+// Options that cannot be set fail csc_srv_setAddr().
+    csc_srv_free(srv);
+    srv = csc_srv_new();
+    opts.busyPollUs = -1;
+    csc_srv_setSockOpts(srv, &opts);
+    isOk = isOk && !csc_srv_setAddr(srv, "127.0.0.1", ++port, 5);
+    isOk = isOk && strstr(csc_srv_getErrMsg(srv), "SO_BUSY_POLL") != NULL;
+ 
+    csc_srv_free(srv);
+    if (isOk)
+        fprintf(fout, "pass (sockOpts)\n");
+    else
+        fprintf(fout, "FAIL (sockOpts)\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    testFmt();
+    testFmtRandom();
+    testAdopt();
+    testSockOpts();
+    fclose(fout);
+}
@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/udp.h>
+#include <CscNetLib/pktRing.h>
+#include <CscNetLib/pktPool.h>
+
+#define NPkts 2000
+#define Batch 50
+
+FILE *fout;
+
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+// A server on any free port.
+csc_udp_t *mkServer(int *port)
+{   csc_udp_t *srv = csc_udp_new();
+    int i;
+    *port = 20000 + getpid()%20000;
+    for (i=0; i<100; i++)
+    {   if (csc_udp_setSrv(srv, "127.0.0.1", ++*port))
+            return srv;
+    }
+    assert(csc_FALSE);
+    return NULL;
+}
+
+
+// Packets are aligned, and may all be taken and given back.
+void testGetPut()
+{   csc_pktPool_t *pool = csc_pktPool_new(10, 100);
+    csc_udpPkt_t *pkts[10];
+    int i;
+    int isOk = csc_TRUE;
+ 
+    isOk = isOk && csc_pktPool_nFree(pool)==10;
+    for (i=0; i<10; i++)
+    {   pkts[i] = csc_pktPool_get(pool);
+        isOk = isOk && pkts[i]!=NULL;
+        isOk = isOk && ((uintptr_t)pkts[i] % 64)==0;
+        isOk = isOk && ((uintptr_t)pkts[i]->buf % 64)==0;
+        isOk = isOk && pkts[i]->bufSiz==100 && pkts[i]->addr!=NULL;
+        memset(pkts[i]->buf, 'x', 100);
+    }
+    isOk = isOk && csc_pktPool_get(pool)==NULL;
+    isOk = isOk && csc_pktPool_nFree(pool)==0;
+    for (i=0; i<10; i++)
+        csc_pktPool_put(pool, pkts[i]);
+    isOk = isOk && csc_pktPool_nFree(pool)==10;
+    isOk = isOk && csc_pktPool_get(pool)==pkts[0];
+    isOk = isOk && csc_pktPool_new(0, 100)==NULL;
+ 
+    csc_pktPool_free(pool);
+    report("getPut", isOk);
+}
+
+
+// A worker takes the packets received, and gives them back.
+typedef struct
+{   csc_pktPool_t *pool;
+    csc_pktRing_t *ring;
+    int nGot;
+    csc_bool_t isOk;
+} worker_t;
+
+
+void *work(void *arg)
+{   worker_t *w = arg;
+    csc_udpPkt_t *pkt;
+    int i;
+    while (__atomic_load_n(&w->nGot, __ATOMIC_ACQUIRE) < NPkts)
+    {   pkt = csc_pktRing_pop(w->ring);
+        if (pkt == NULL)
+        {   sched_yield();
+            continue;
+        }
+        memcpy(&i, pkt->buf, sizeof(int));
+        if (pkt->len!=sizeof(int) || i!=w->nGot || csc_udpAddr_getPortNum(pkt->addr)==0)
+            w->isOk = csc_FALSE;
+        csc_pktPool_put(w->pool, pkt);
+        __atomic_store_n(&w->nGot, w->nGot+1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+
+// Packets received into a small pool pass to a worker, and come back to
+// be used again.
+void testRcv()
+{   csc_udpAddr_t *to = csc_udpAddr_new();
+    csc_udp_t *cli = csc_udp_new();
+    csc_udp_t *srv;
+    worker_t w;
+    pthread_t thread;
+    int port, nRcvd, i, j, n;
+    int isOk = csc_TRUE;
+ 
+    srv = mkServer(&port);
+    csc_udp_setCli(cli, AF_INET);
+    csc_udpAddr_setAddr(to, "127.0.0.1", port);
+    w.pool = csc_pktPool_new(16, 64);
+    w.ring = csc_pktRing_new(16);
+    w.nGot = 0;
+    w.isOk = csc_TRUE;
+    pthread_create(&thread, NULL, work, &w);
+ 
+// Send a batch at a time, and receive it before sending the next.
+    nRcvd = 0;
+    for (i=0; i<NPkts; i+=Batch)
+    {   for (j=i; j<i+Batch; j++)
+            csc_udp_snd(cli, (char*)&j, sizeof(int), to);
+        while (nRcvd < i+Batch)
+        {   n = csc_pktPool_rcv(w.pool, srv, w.ring, 32, 1000);
+            if (n < 0)
+            {   isOk = csc_FALSE;
+                break;
+            }
+            if (n == 0)
+                sched_yield();
+            nRcvd += n;
+        }
+    }
+    pthread_join(thread, NULL);
+    isOk = isOk && w.isOk && w.nGot==NPkts && nRcvd==NPkts;
+    isOk = isOk && csc_pktPool_nFree(w.pool)==16;
+ 
+    csc_pktRing_free(w.ring);
+    csc_pktPool_free(w.pool);
+    csc_udpAddr_free(to);
+    csc_udp_free(cli);
+    csc_udp_free(srv);
+    report("rcv", isOk);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    testGetPut();
+    testRcv();
+    fclose(fout);
+}
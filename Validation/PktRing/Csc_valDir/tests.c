@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/pktRing.h>
+
+#define NItems 1000000
+
+FILE *fout;
+
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+// Items in order, up to the capacity, which is rounded up.
+void testBasic()
+{   csc_pktRing_t *ring = csc_pktRing_new(5);
+    void *items[10];
+    int i, round;
+    int isOk = csc_TRUE;
+ 
+    isOk = isOk && csc_pktRing_capacity(ring)==8;
+    isOk = isOk && csc_pktRing_pop(ring)==NULL;
+    isOk = isOk && csc_pktRing_new(0)==NULL;
+ 
+// Many times around, so that the ends wrap.
+    for (round=0; round<100; round++)
+    {   for (i=0; i<8; i++)
+            isOk = isOk && csc_pktRing_push(ring, (void*)(intptr_t)(i+1));
+        isOk = isOk && !csc_pktRing_push(ring, (void*)1);
+        isOk = isOk && csc_pktRing_count(ring)==8;
+        isOk = isOk && csc_pktRing_room(ring)==0;
+        for (i=0; i<3; i++)
+            isOk = isOk && csc_pktRing_pop(ring)==(void*)(intptr_t)(i+1);
+        isOk = isOk && csc_pktRing_room(ring)==3;
+        isOk = isOk && csc_pktRing_popMany(ring, items, 10)==5;
+        for (i=0; i<5; i++)
+            isOk = isOk && items[i]==(void*)(intptr_t)(i+4);
+        isOk = isOk && csc_pktRing_count(ring)==0;
+    }
+ 
+// More than fit.
+    for (i=0; i<10; i++)
+        items[i] = (void*)(intptr_t)(i+1);
+    isOk = isOk && csc_pktRing_pushMany(ring, items, 10)==8;
+    isOk = isOk && csc_pktRing_pushMany(ring, items, 10)==0;
+    isOk = isOk && csc_pktRing_popMany(ring, items, 3)==3 && items[2]==(void*)3;
+ 
+    csc_pktRing_free(ring);
+    report("basic", isOk);
+}
+
+
+// One thread pushes numbers in order, another pops them.  Each yields
+// when it can do nothing, in case they share a CPU.
+void *produce(void *arg)
+{   csc_pktRing_t *ring = arg;
+    void *items[16];
+    intptr_t next = 1;
+    int n, i;
+    while (next <= NItems)
+    {   n = (next%3==0) ? 16 : 1;
+        if (next+n > NItems+1)
+            n = NItems+1 - next;
+        for (i=0; i<n; i++)
+            items[i] = (void*)(next+i);
+        n = csc_pktRing_pushMany(ring, items, n);
+        if (n == 0)
+            sched_yield();
+        next += n;
+    }
+    return NULL;
+}
+
+
+void testThreads()
+{   csc_pktRing_t *ring = csc_pktRing_new(64);
+    pthread_t thread;
+    void *items[7];
+    intptr_t expect = 1;
+    int n, i;
+    int isOk = csc_TRUE;
+ 
+    pthread_create(&thread, NULL, produce, ring);
+    while (expect <= NItems)
+    {   n = csc_pktRing_popMany(ring, items, 7);
+        if (n == 0)
+            sched_yield();
+        for (i=0; i<n; i++)
+        {   if (items[i] != (void*)expect)
+                isOk = csc_FALSE;
+            expect++;
+        }
+    }
+    pthread_join(thread, NULL);
+    isOk = isOk && csc_pktRing_count(ring)==0;
+ 
+    csc_pktRing_free(ring);
+    report("threads", isOk);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    testBasic();
+    testThreads();
+    fclose(fout);
+}
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/udp.h>
+#include <CscNetLib/rudp.h>
+
+#define NStreams 3
+#define NMsgs 300
+
+FILE *fout;
+
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+long nowMs()
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+
+// A server on any free port.
+csc_rudp_t *mkServer(int *port)
+{   csc_rudp_t *srv = csc_rudp_new();
+    int i;
+    *port = 20000 + getpid()%20000;
+    for (i=0; i<100; i++)
+    {   if (csc_rudp_setSrv(srv, "127.0.0.1", ++*port))
+            return srv;
+    }
+    assert(csc_FALSE);
+    return NULL;
+}
+
+
+// What a receiver has been given.
+typedef struct
+{   int nGot[NStreams];
+    int seen[NStreams][NMsgs];
+    csc_bool_t isInOrder;
+    int nLost;
+} got_t;
+
+
+void onMsg(void *arg, const csc_udpAddr_t *from, int stream, const char *msg, int len)
+{   got_t *got = arg;
+    int i;
+    assert(stream < NStreams);
+    assert(len == sizeof(int));
+    memcpy(&i, msg, sizeof(int));
+    assert(i>=0 && i<NMsgs);
+    if (stream!=2 && i!=got->nGot[stream])
+        got->isInOrder = csc_FALSE;
+    got->seen[stream][i]++;
+    got->nGot[stream]++;
+}
+
+
+void onLost(void *arg, const csc_udpAddr_t *to, int stream, const char *msg, int len)
+{   got_t *got = arg;
+    got->nLost++;
+}
+
+
+void initGot(got_t *got)
+{   memset(got, 0, sizeof(got_t));
+    got->isInOrder = csc_TRUE;
+}
+
+
+// Polls both until the sender has nothing unacknowledged, or time is up.
+void pollBoth(csc_rudp_t *snd, csc_rudp_t *rcv, int maxMs)
+{   long endMs = nowMs() + maxMs;
+    while (csc_rudp_nUnacked(snd)>0 && nowMs()<endMs)
+    {   csc_rudp_poll(rcv, 0);
+        csc_rudp_poll(snd, 1);
+    }
+}
+
+
+// Messages on several streams, with many packets lost each way, each
+// arrive once, and those on ordered streams in order.
+void testLossy()
+{   csc_udpAddr_t *to = csc_udpAddr_new();
+    csc_rudp_t *cli = csc_rudp_new();
+    csc_rudp_t *srv;
+    got_t got;
+    int port, i, j;
+    int isOk = csc_TRUE;
+ 
+    initGot(&got);
+    srv = mkServer(&port);
+    csc_rudp_setHandlers(srv, onMsg, NULL, &got);
+    csc_rudp_setLoss(srv, 0.3, 1);
+    csc_rudp_setCli(cli, AF_INET);
+    csc_rudp_setLoss(cli, 0.3, 2);
+    csc_rudp_setMaxTries(cli, 30);
+    csc_udpAddr_setAddr(to, "127.0.0.1", port);
+ 
+// Send them, stream 2 unordered.
+    for (i=0; i<NMsgs; i++)
+    {   for (j=0; j<NStreams; j++)
+            isOk = isOk && csc_rudp_send(cli, to, j, j!=2, (char*)&i, sizeof(int));
+    }
+    pollBoth(cli, srv, 20000);
+ 
+// Each once.
+    isOk = isOk && csc_rudp_nUnacked(cli)==0;
+    isOk = isOk && got.isInOrder;
+    for (j=0; j<NStreams; j++)
+    {   isOk = isOk && got.nGot[j]==NMsgs;
+        for (i=0; i<NMsgs; i++)
+            isOk = isOk && got.seen[j][i]==1;
+    }
+    isOk = isOk && csc_rudp_getRttUs(cli, to) >= 0;
+ 
+    csc_udpAddr_free(to);
+    csc_rudp_free(cli);
+    csc_rudp_free(srv);
+    report("lossy", isOk);
+}
+
+
+// A message lost on one ordered stream holds up later ones on that stream,
+// but not those on another.
+void testNoHol()
+{   csc_udpAddr_t *to = csc_udpAddr_new();
+    csc_rudp_t *cli = csc_rudp_new();
+    csc_rudp_t *srv;
+    got_t got;
+    int port, i;
+    long endMs;
+    int isOk = csc_TRUE;
+ 
+    initGot(&got);
+    srv = mkServer(&port);
+    csc_rudp_setHandlers(srv, onMsg, NULL, &got);
+    csc_rudp_setCli(cli, AF_INET);
+    csc_udpAddr_setAddr(to, "127.0.0.1", port);
+ 
+// The first on stream 0 is lost, the rest are not.
+    i = 0;
+    csc_rudp_setLoss(cli, 1.0, 1);
+    csc_rudp_send(cli, to, 0, csc_TRUE, (char*)&i, sizeof(int));
+    csc_rudp_setLoss(cli, 0, 1);
+    i = 1;
+    csc_rudp_send(cli, to, 0, csc_TRUE, (char*)&i, sizeof(int));
+    i = 0;
+    csc_rudp_send(cli, to, 1, csc_TRUE, (char*)&i, sizeof(int));
+ 
+// Stream 1 arrives at once, stream 0 waits.
+    endMs = nowMs() + 50;
+    while (got.nGot[1]==0 && nowMs()<endMs)
+        csc_rudp_poll(srv, 5);
+    isOk = isOk && got.nGot[1]==1 && got.nGot[0]==0;
+ 
+// Until the lost one is sent again.
+    pollBoth(cli, srv, 5000);
+    isOk = isOk && got.nGot[0]==2 && got.isInOrder;
+    isOk = isOk && csc_rudp_nUnacked(cli)==0;
+ 
+    csc_udpAddr_free(to);
+    csc_rudp_free(cli);
+    csc_rudp_free(srv);
+    report("noHol", isOk);
+}
+
+
+// Messages to a peer that never answers are given up on.
+void testLost()
+{   csc_udpAddr_t *to = csc_udpAddr_new();
+    csc_rudp_t *cli = csc_rudp_new();
+    csc_rudp_t *srv;
+    got_t got;
+    int port, i;
+    long endMs;
+    int isOk = csc_TRUE;
+ 
+// A server that is never polled.
+    initGot(&got);
+    srv = mkServer(&port);
+    csc_rudp_setCli(cli, AF_INET);
+    csc_rudp_setHandlers(cli, onMsg, onLost, &got);
+    csc_rudp_setMaxTries(cli, 3);
+    csc_rudp_setWindow(cli, 2);
+    csc_udpAddr_setAddr(to, "127.0.0.1", port);
+ 
+    for (i=0; i<5; i++)
+        csc_rudp_send(cli, to, 0, csc_TRUE, (char*)&i, sizeof(int));
+    isOk = isOk && csc_rudp_nUnacked(cli)==5;
+    endMs = nowMs() + 5000;
+    while (got.nLost<5 && nowMs()<endMs)
+        csc_rudp_poll(cli, 10);
+    isOk = isOk && got.nLost==5 && csc_rudp_nUnacked(cli)==0;
+ 
+// Too long.
+    isOk = isOk && !csc_rudp_send(cli, to, 0, csc_TRUE, (char*)&i, csc_rudp_MaxMsg+1);
+    isOk = isOk && !csc_rudp_send(cli, to, 65536, csc_TRUE, (char*)&i, sizeof(int));
+ 
+    csc_udpAddr_free(to);
+    csc_rudp_free(cli);
+    csc_rudp_free(srv);
+    report("lost", isOk);
+}
+
+
+// A receiver that starts again, part way through an ordered stream, is
+// given what is sent after, in order.
+void testRestart()
+{   csc_udpAddr_t *to = csc_udpAddr_new();
+    csc_rudp_t *cli = csc_rudp_new();
+    csc_rudp_t *srv;
+    got_t got;
+    int port, i;
+    int isOk = csc_TRUE;
+ 
+    initGot(&got);
+    srv = mkServer(&port);
+    csc_rudp_setHandlers(srv, onMsg, NULL, &got);
+    csc_rudp_setCli(cli, AF_INET);
+    csc_udpAddr_setAddr(to, "127.0.0.1", port);
+    for (i=0; i<5; i++)
+        csc_rudp_send(cli, to, 0, csc_TRUE, (char*)&i, sizeof(int));
+    pollBoth(cli, srv, 5000);
+    isOk = isOk && got.nGot[0]==5 && csc_rudp_nUnacked(cli)==0;
+ 
+// The same server starts again, and knows nothing of the client.
+    csc_rudp_free(srv);
+    initGot(&got);
+    srv = csc_rudp_new();
+    isOk = isOk && csc_rudp_setSrv(srv, "127.0.0.1", port);
+    csc_rudp_setHandlers(srv, onMsg, NULL, &got);
+    for (i=0; i<5; i++)
+        csc_rudp_send(cli, to, 0, csc_TRUE, (char*)&i, sizeof(int));
+    pollBoth(cli, srv, 5000);
+    isOk = isOk && got.nGot[0]==5 && got.isInOrder;
+    isOk = isOk && csc_rudp_nUnacked(cli)==0;
+ 
+    csc_udpAddr_free(to);
+    csc_rudp_free(cli);
+    csc_rudp_free(srv);
+    report("restart", isOk);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    testLossy();
+    testNoHol();
+    testLost();
+    testRestart();
+    fclose(fout);
+}
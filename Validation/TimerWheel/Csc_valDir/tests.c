@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/alloc.h>
+#include <CscNetLib/timerWheel.h>
+
+FILE *fout;
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+// A timer that records when it fired.
+typedef struct
+{   csc_timer_t timer;
+    uint64_t dueMs;
+    uint64_t firedMs;
+    int nFired;
+    int isCancelled;
+} rec_t;
+
+uint64_t nowMs;
+
+void onFire(csc_timer_t *timer, void *arg)
+{   rec_t *rec = arg;
+    rec->firedMs = nowMs;
+    rec->nFired++;
+}
+
+
+void testOrder()
+{   csc_timerWheel_t *tw = csc_timerWheel_new(10, 1000);
+    rec_t recs[3];
+    int delays[3] = {50, 5, 25};
+    int i, isOk = csc_TRUE;
+ 
+    nowMs = 1000;
+    for (i=0; i<3; i++)
+    {   csc_timer_init(&recs[i].timer, onFire, &recs[i]);
+        recs[i].nFired = 0;
+        csc_timerWheel_add(tw, &recs[i].timer, delays[i]);
+    }
+    isOk = isOk && csc_timerWheel_count(tw)==3;
+    isOk = isOk && csc_timerWheel_nextMs(tw, nowMs)==10;
+ 
+// Nothing is due yet.
+    nowMs = 1009;
+    isOk = isOk && csc_timerWheel_advance(tw, nowMs)==0;
+ 
+// The 5ms timer rounds up to a tick.
+    nowMs = 1010;
+    isOk = isOk && csc_timerWheel_advance(tw, nowMs)==1 && recs[1].nFired==1;
+    isOk = isOk && csc_timerWheel_nextMs(tw, nowMs)==20;
+ 
+    nowMs = 1049;
+    isOk = isOk && csc_timerWheel_advance(tw, nowMs)==1 && recs[2].nFired==1;
+    nowMs = 1050;
+    isOk = isOk && csc_timerWheel_advance(tw, nowMs)==1 && recs[0].nFired==1;
+    isOk = isOk && csc_timerWheel_count(tw)==0 && csc_timerWheel_nextMs(tw, nowMs)==-1;
+    isOk = isOk && !csc_timer_isArmed(&recs[0].timer);
+ 
+    csc_timerWheel_free(tw);
+    report("timerWheel_order", isOk);
+}
+
+
+void testCancel()
+{   csc_timerWheel_t *tw = csc_timerWheel_new(1, 0);
+    rec_t a, b;
+    int isOk = csc_TRUE;
+ 
+    nowMs = 0;
+    csc_timer_init(&a.timer, onFire, &a);
+    csc_timer_init(&b.timer, onFire, &b);
+    a.nFired = b.nFired = 0;
+    csc_timerWheel_add(tw, &a.timer, 100);
+    csc_timerWheel_add(tw, &b.timer, 100);
+    csc_timerWheel_cancel(tw, &a.timer);
+    csc_timerWheel_cancel(tw, &a.timer);  // Harmless.
+ 
+// Re-arming moves it.
+    csc_timerWheel_add(tw, &b.timer, 300);
+    isOk = isOk && csc_timerWheel_count(tw)==1;
+    nowMs = 299;
+    csc_timerWheel_advance(tw, nowMs);
+    isOk = isOk && a.nFired==0 && b.nFired==0;
+    nowMs = 300;
+    csc_timerWheel_advance(tw, nowMs);
+    isOk = isOk && a.nFired==0 && b.nFired==1;
+ 
+    csc_timerWheel_free(tw);
+    report("timerWheel_cancel", isOk);
+}
+
+
+// A timer that re-arms itself, and cancels its partner.
+typedef struct
+{   csc_timer_t timer;
+    csc_timerWheel_t *tw;
+    csc_timer_t *partner;
+    int nFired;
+} periodic_t;
+
+void onPeriodic(csc_timer_t *timer, void *arg)
+{   periodic_t *p = arg;
+    p->nFired++;
+    if (p->partner)
+        csc_timerWheel_cancel(p->tw, p->partner);
+    if (p->nFired < 10)
+        csc_timerWheel_add(p->tw, timer, 7);
+}
+
+
+void testRearm()
+{   csc_timerWheel_t *tw = csc_timerWheel_new(1, 0);
+    periodic_t p, q;
+    int isOk = csc_TRUE;
+ 
+// q is due in the same tick as p, but p cancels it first.
+    p.tw = q.tw = tw;
+    p.partner = &q.timer;
+    q.partner = NULL;
+    p.nFired = q.nFired = 0;
+    csc_timer_init(&p.timer, onPeriodic, &p);
+    csc_timer_init(&q.timer, onPeriodic, &q);
+    csc_timerWheel_add(tw, &p.timer, 7);
+    csc_timerWheel_add(tw, &q.timer, 7);
+ 
+    csc_timerWheel_advance(tw, 1000);
+    isOk = isOk && p.nFired==10 && q.nFired==0 && csc_timerWheel_count(tw)==0;
+ 
+    csc_timerWheel_free(tw);
+    report("timerWheel_rearm", isOk);
+}
+
+
+// Very many timers, over all levels of the wheel, with some cancelled.
+void testMany()
+{   const int nRecs = 100000;
+    const uint64_t maxDelay = (uint64_t)1 << 25;
+    csc_timerWheel_t *tw = csc_timerWheel_new(1, 0);
+    rec_t *recs = csc_allocMany(rec_t, nRecs);
+    uint64_t prevMs;
+    int nextMs;
+    int i, isOk = csc_TRUE;
+ 
+    srandom(4321);
+    nowMs = 0;
+    for (i=0; i<nRecs; i++)
+    {   int delay = random() % maxDelay;
+        if (i%10 == 0)
+            delay = random() % 300;
+        csc_timer_init(&recs[i].timer, onFire, &recs[i]);
+        recs[i].dueMs = delay;
+        recs[i].nFired = 0;
+        recs[i].isCancelled = (i%7 == 0);
+        csc_timerWheel_add(tw, &recs[i].timer, delay);
+    }
+    for (i=0; i<nRecs; i+=7)
+        csc_timerWheel_cancel(tw, &recs[i].timer);
+ 
+// Advance in uneven steps, no further than is asked for.
+    while (csc_timerWheel_count(tw) > 0)
+    {   prevMs = nowMs;
+        nextMs = csc_timerWheel_nextMs(tw, nowMs);
+        nowMs += 1 + random() % 5000;
+        if (nextMs>=0 && nowMs > prevMs+nextMs+1000)
+            nowMs = prevMs + nextMs + 1000;
+        csc_timerWheel_advance(tw, nowMs);
+    }
+ 
+// Each fired once, in the step when it fell due.
+    for (i=0; i<nRecs && isOk; i++)
+    {   if (recs[i].isCancelled)
+            isOk = recs[i].nFired == 0;
+        else
+            isOk = recs[i].nFired==1 && recs[i].firedMs>=recs[i].dueMs
+                && recs[i].firedMs<recs[i].dueMs+5000;
+    }
+ 
+    free(recs);
+    csc_timerWheel_free(tw);
+    report("timerWheel_many", isOk);
+}
+
+
+// nextMs() must never be later than the next timer.
+void testNext()
+{   csc_timerWheel_t *tw = csc_timerWheel_new(1, 0);
+    rec_t rec;
+    int delays[] = {1, 255, 256, 257, 1000, 65535, 65536, 70000, 2000000, 20000000};
+    uint64_t dueMs;
+    int i, nextMs, isOk = csc_TRUE;
+ 
+    nowMs = 0;
+    csc_timer_init(&rec.timer, onFire, &rec);
+    for (i=0; i<sizeof(delays)/sizeof(delays[0]); i++)
+    {   nowMs += 12345;
+        csc_timerWheel_advance(tw, nowMs);
+        dueMs = nowMs + delays[i];
+        rec.nFired = 0;
+        csc_timerWheel_add(tw, &rec.timer, delays[i]);
+        while (rec.nFired == 0 && isOk)
+        {   nextMs = csc_timerWheel_nextMs(tw, nowMs);
+            isOk = nextMs>=0 && nowMs+nextMs <= dueMs;
+            nowMs += nextMs;
+            csc_timerWheel_advance(tw, nowMs);
+        }
+        isOk = isOk && nowMs == dueMs;
+    }
+ 
+    csc_timerWheel_free(tw);
+    report("timerWheel_next", isOk);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    testOrder();
+    testCancel();
+    testRearm();
+    testMany();
+    testNext();
+    report("timerWheel_mem", csc_mck_nchunks()==0);
+    fclose(fout);
+}
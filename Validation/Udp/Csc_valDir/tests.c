@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include <CscNetLib/std.h>
+#include <CscNetLib/udp.h>
+
+#define NPkts 100
+#define BufSiz 100
+
+FILE *fout;
+
+
+void report(const char *testName, int isPass)
+{   if (isPass)
+        fprintf(fout, "pass (%s)\n", testName);
+    else
+        fprintf(fout, "FAIL (%s)\n", testName);
+}
+
+
+long nowMs()
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+
+// A server on any free port.
+csc_udp_t *mkServer(int *port)
+{   csc_udp_t *srv = csc_udp_new();
+    int i;
+    *port = 20000 + getpid()%20000;
+    for (i=0; i<100; i++)
+    {   if (csc_udp_setSrv(srv, "127.0.0.1", ++*port))
+            return srv;
+    }
+    assert(csc_FALSE);
+    return NULL;
+}
+
+
+// Packets sent in batches arrive in batches, in order, with where they
+// came from.
+void testMany()
+{   csc_udpPkt_t pkts[NPkts];
+    char bufs[NPkts][BufSiz];
+    char expect[BufSiz];
+    csc_udpAddr_t *srvAddr = csc_udpAddr_new();
+    csc_udp_t *cli = csc_udp_new();
+    csc_udp_t *srv;
+    int port, nGot, n, i;
+    int isOk;
+ 
+// Send them.
+    srv = mkServer(&port);
+    isOk = csc_udp_setCli(cli, AF_INET) && csc_udpAddr_setAddr(srvAddr, "127.0.0.1", port);
+    for (i=0; i<NPkts; i++)
+    {   pkts[i].buf = bufs[i];
+        pkts[i].len = sprintf(bufs[i], "packet %d", i);
+        pkts[i].addr = srvAddr;
+    }
+    isOk = isOk && csc_udp_sndMany(cli, pkts, NPkts) == NPkts;
+ 
+// Receive them.
+    for (i=0; i<NPkts; i++)
+    {   pkts[i].buf = bufs[i];
+        pkts[i].bufSiz = BufSiz;
+        pkts[i].len = -1;
+        pkts[i].addr = csc_udpAddr_new();
+    }
+    nGot = 0;
+    while (isOk && nGot<NPkts)
+    {   n = csc_udp_rcvMany(srv, pkts+nGot, NPkts-nGot, 1000);
+        isOk = n >= 1;
+        nGot += n;
+    }
+    for (i=0; i<NPkts && isOk; i++)
+    {   sprintf(expect, "packet %d", i);
+        isOk = pkts[i].len==strlen(expect) && memcmp(pkts[i].buf, expect, pkts[i].len)==0;
+        isOk = isOk && csc_udpAddr_getPortNum(pkts[i].addr)==csc_udpAddr_getPortNum(pkts[0].addr);
+    }
+ 
+// Reply to the first, from the address that it came from.
+    pkts[0].len = 2;
+    memcpy(pkts[0].buf, "ok", 2);
+    isOk = isOk && csc_udp_sndMany(srv, pkts, 1) == 1;
+    pkts[1].bufSiz = BufSiz;
+    pkts[1].addr = NULL;
+    isOk = isOk && csc_udp_rcvMany(cli, pkts+1, 1, 1000)==1;
+    isOk = isOk && pkts[1].len==2 && memcmp(pkts[1].buf, "ok", 2)==0;
+ 
+    for (i=0; i<NPkts; i++)
+        if (i != 1)
+            csc_udpAddr_free(pkts[i].addr);
+    csc_udpAddr_free(srvAddr);
+    csc_udp_free(cli);
+    csc_udp_free(srv);
+    report("many", isOk);
+}
+
+
+// Waiting for packets that do not come.
+void testTimeout()
+{   csc_udpPkt_t pkt;
+    char buf[BufSiz];
+    csc_udpAddr_t *addr = csc_udpAddr_new();
+    csc_udp_t *srv;
+    long startMs;
+    int port;
+    int isOk;
+ 
+    srv = mkServer(&port);
+    pkt.buf = buf;
+    pkt.bufSiz = BufSiz;
+    pkt.addr = NULL;
+    startMs = nowMs();
+    isOk = csc_udp_rcvMany(srv, &pkt, 1, 200) == -2;
+    isOk = isOk && nowMs()-startMs>=195 && nowMs()-startMs<500;
+    isOk = isOk && csc_udp_rcvMany(srv, &pkt, 1, 0) == -2;
+ 
+// Nor may packets be sent without an address.
+    isOk = isOk && csc_udp_sndMany(srv, &pkt, 1) == -1;
+    isOk = isOk && strstr(csc_udp_getErrMsg(srv), "address not set") != NULL;
+ 
+    csc_udpAddr_free(addr);
+    csc_udp_free(srv);
+    report("timeout", isOk);
+}
+
+
+// One address object is reused for packet after packet, and tells the
+// senders apart, in binary form, without strings.
+void testRcvInto()
+{   char buf[BufSiz];
+    csc_udpAddr_t *to = csc_udpAddr_new();
+    csc_udpAddr_t *from = csc_udpAddr_new();
+    csc_udpAddr_t *first = csc_udpAddr_new();
+    csc_udpAddr_t *blank = csc_udpAddr_new();
+    csc_udpAddr_t *fromPt = NULL;
+    csc_udpAddr_t *keep;
+    unsigned char bin[csc_udpAddr_BinSize];
+    csc_udp_t *srv, *cli1, *cli2;
+    int port;
+    int isOk;
+ 
+    srv = mkServer(&port);
+    csc_udp_setRcvTimeout(srv, 1);
+    cli1 = csc_udp_new();
+    cli2 = csc_udp_new();
+    csc_udp_setCli(cli1, AF_INET);
+    csc_udp_setCli(cli2, AF_INET);
+    csc_udpAddr_setAddr(to, "127.0.0.1", port);
+ 
+// Into the same object each time.
+    isOk = csc_udp_snd(cli1, "one", 3, to);
+    isOk = isOk && csc_udp_snd(cli2, "two", 3, to);
+    isOk = isOk && csc_udp_snd(cli1, "three", 5, to);
+    isOk = isOk && csc_udp_rcvInto(srv, buf, BufSiz, from) == 3;
+    isOk = isOk && strcmp(buf, "one") == 0;
+    csc_udpAddr_copy(first, from);
+    isOk = isOk && csc_udpAddr_cmp(first, from) == 0;
+    isOk = isOk && csc_udpAddr_hash(first) == csc_udpAddr_hash(from);
+    isOk = isOk && csc_udp_rcvInto(srv, buf, BufSiz, from) == 3;
+    isOk = isOk && strcmp(buf, "two") == 0;
+    isOk = isOk && csc_udpAddr_cmp(first, from) != 0;
+    isOk = isOk && csc_udpAddr_cmp(first, from) == -csc_udpAddr_cmp(from, first);
+    isOk = isOk && csc_udpAddr_hash(first) != csc_udpAddr_hash(from);
+ 
+// csc_udp_rcv() reuses the object it is given.
+    fromPt = from;
+    isOk = isOk && csc_udp_rcv(srv, buf, BufSiz, &fromPt) == 5;
+    isOk = isOk && fromPt == from;
+    isOk = isOk && csc_udpAddr_cmp(first, from) == 0;
+ 
+// Binary form of an IPv4 address is mapped into IPv6.
+    keep = csc_udpAddr_new();
+    csc_udpAddr_setAddr(keep, "127.0.0.1", 1026);
+    isOk = isOk && csc_udpAddr_getBin(keep, bin);
+    isOk = isOk && bin[10]==0xff && bin[11]==0xff;
+    isOk = isOk && bin[12]==127 && bin[13]==0 && bin[14]==0 && bin[15]==1;
+    isOk = isOk && bin[16]==4 && bin[17]==2;
+    isOk = isOk && !csc_udpAddr_getBin(blank, bin);
+ 
+// Timing out leaves the address alone.
+    isOk = isOk && csc_udp_rcvInto(srv, buf, BufSiz, from) == -2;
+    isOk = isOk && csc_udpAddr_cmp(first, from) == 0;
+ 
+    csc_udpAddr_free(keep);
+    csc_udpAddr_free(blank);
+    csc_udpAddr_free(first);
+    csc_udpAddr_free(from);
+    csc_udpAddr_free(to);
+    csc_udp_free(cli1);
+    csc_udp_free(cli2);
+    csc_udp_free(srv);
+    report("rcvInto", isOk);
+}
+
+
+// Receives 'len' bytes sent by csc_udp_sndSegs() in packets of 'segSize',
+// and checks them against 'data'.  Returns the number of packets.
+int rcvAllSegs(csc_udp_t *srv, const char *data, int len, int segSize)
+{   static char buf[65536];
+    int nPkts = 0;
+    int at = 0;
+    int nRead, size;
+ 
+    while (at < len)
+    {   nRead = csc_udp_rcvSegs(srv, buf, sizeof(buf), &size, NULL);
+        if (nRead<=0 || at+nRead>len || memcmp(buf, data+at, nRead)!=0)
+            return -1;
+        if (size != segSize && !(nRead<segSize && size==nRead))
+            return -1;
+        nPkts += (nRead + segSize - 1) / segSize;
+        at += nRead;
+    }
+    return nPkts;
+}
+
+
+// A buffer sent as many packets arrives whole, whether the kernel splits
+// and joins them or not.
+void testSegs()
+{   static char data[100000];
+    csc_udpAddr_t *to = csc_udpAddr_new();
+    csc_udp_t *srv, *cli;
+    int port, i;
+    int isOk;
+ 
+    for (i=0; i<sizeof(data); i++)
+        data[i] = 'a' + i%23;
+    srv = mkServer(&port);
+    csc_udp_setRcvTimeout(srv, 1);
+    csc_udp_setBufSizes(srv, 1000000, 0);
+    csc_udp_setGro(srv, csc_TRUE);
+    cli = csc_udp_new();
+    csc_udp_setCli(cli, AF_INET);
+    csc_udpAddr_setAddr(to, "127.0.0.1", port);
+ 
+// Split by the kernel, if it can, with a short last packet.
+    isOk = csc_udp_sndSegs(cli, data, 10500, 1000, to) == 11;
+    isOk = isOk && rcvAllSegs(srv, data, 10500, 1000) == 11;
+ 
+// More than go in one buffer.
+    isOk = isOk && csc_udp_sndSegs(cli, data, 100000, 1200, to) == 84;
+    isOk = isOk && rcvAllSegs(srv, data, 100000, 1200) == 84;
+ 
+// Split here.
+    csc_udp_setGso(cli, csc_FALSE);
+    isOk = isOk && csc_udp_sndSegs(cli, data, 10500, 1000, to) == 11;
+    isOk = isOk && rcvAllSegs(srv, data, 10500, 1000) == 11;
+ 
+// Received one at a time.
+    csc_udp_setGro(srv, csc_FALSE);
+    csc_udp_setGso(cli, csc_TRUE);
+    isOk = isOk && csc_udp_sndSegs(cli, data, 3000, 1000, to) == 3;
+    isOk = isOk && rcvAllSegs(srv, data, 3000, 1000) == 3;
+    isOk = isOk && csc_udp_sndSegs(cli, data, 100, 0, to) == -1;
+ 
+    csc_udpAddr_free(to);
+    csc_udp_free(cli);
+    csc_udp_free(srv);
+    report("segs", isOk);
+}
+
+
+int main(int argc, char **argv)
+{
+    fout = fopen("csc_testOut.txt", "a"); assert(fout);
+    testMany();
+    testTimeout();
+    testRcvInto();
+    testSegs();
+    fclose(fout);
+}
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <assert.h>
+#include <string.h>
 #include <time.h>
 #include "std.h"
 #include "alloc.h"
@@ -22,33 +23,58 @@ typedef struct csc_blacklist_t
 } csc_blacklist_t;
 
 
+// Identities are binary, so that e.g. IP addresses need not be formatted
+// as strings to be looked up.
+typedef struct
+{   const unsigned char *id;
+    int idLen;
+} blKey_t;
+
+
 typedef struct
 {   time_t lastEval;
     long blackness;
-    char *idStr;
+    blKey_t key;
 } blEntry_t;
 
 
 
-static blEntry_t *blEntry_new(const char *idStr)
+static blEntry_t *blEntry_new(const void *id, int idLen)
 {   blEntry_t *be = csc_allocOne(blEntry_t);  assert(be);
-    be->idStr = csc_allocStr(idStr);  assert(be->idStr);
+    unsigned char *idCopy = csc_allocMany(unsigned char, idLen+1);  assert(idCopy);
+    memcpy(idCopy, id, idLen);
+    idCopy[idLen] = '\0';
+    be->key.id = idCopy;
+    be->key.idLen = idLen;
     return be;
 }
 
 
 static void blEntry_free(void *bee)
 {   blEntry_t *be = bee;
-    free(be->idStr);
+    free((void*)be->key.id);
     free(be);
 }
 
 
+static int blKey_cmp(void *pt1, void *pt2)
+{   blKey_t *k1 = pt1;
+    blKey_t *k2 = pt2;
+    return k1->idLen!=k2->idLen || memcmp(k1->id, k2->id, k1->idLen)!=0;
+}
+
+
+static uint64_t blKey_hash(void *pt)
+{   blKey_t *k = pt;
+    return csc_hash_bytes(k->id, k->idLen);
+}
+
+
 csc_blacklist_t *csc_blacklist_new(int expireTime)
 {   csc_blacklist_t *bl = csc_allocOne(csc_blacklist_t);  assert(bl);
-    bl->hash = csc_hash_new( offsetof(blEntry_t, idStr)
-                           , csc_hash_StrPtCmpr
-                           , csc_hash_StrPt
+    bl->hash = csc_hash_new( offsetof(blEntry_t, key)
+                           , blKey_cmp
+                           , blKey_hash
                            , blEntry_free
                            );
     bl->expireTime = expireTime;
@@ -66,8 +92,14 @@ void csc_blacklist_free(csc_blacklist_t *bl)
 
 
 int csc_blacklist_blackness(csc_blacklist_t *bl, const char *idStr)
+{   return csc_blacklist_blacknessBin(bl, idStr, strlen(idStr));
+}
+
+
+int csc_blacklist_blacknessBin(csc_blacklist_t *bl, const void *id, int idLen)
 {   int ret;
     blEntry_t *be;
+    blKey_t key;
     long blackness;
     time_t now = 0 ;
 
@@ -78,11 +110,12 @@ int csc_blacklist_blackness(csc_blacklist_t *bl, const char *idStr)
         now = time(NULL);
  
     bl->accessCount++;
-    be = csc_hash_get(bl->hash, &idStr);
+    key.id = id;
+    key.idLen = idLen;
+    be = csc_hash_get(bl->hash, &key);
     if (be == NULL)
     {
-// fprintf(stdout, "new %s\n", idStr);
-        be = blEntry_new(idStr);
+        be = blEntry_new(id, idLen);
         blackness = 1;
         ret = csc_hash_addex(bl->hash, be); assert(ret);
     }
@@ -112,13 +145,13 @@ void csc_blacklist_clean(csc_blacklist_t *bl)
     else
         now = time(NULL);
  
-// Gather the ID strings of all with negative blackness.
+// Gather the entries with negative blackness.
     csc_hash_iter_t *iter = csc_hash_iter_new(bl->hash);
     while ((be = csc_hash_iter_next(iter)) != NULL)
     {
         blackness = be->blackness - (now - be->lastEval)/bl->expireTime;
         if (blackness < 0)
-        {   csc_list_add(&lstDelIds, be->idStr);
+        {   csc_list_add(&lstDelIds, be);
         }
         else
         {   be->lastEval = now;
@@ -129,8 +162,8 @@ void csc_blacklist_clean(csc_blacklist_t *bl)
  
 // Remove items with negative blackness from blacklist.
     for (csc_list_t *lp=lstDelIds; lp!=NULL; lp=lp->next)
-    {   char *idStr = lp->data;
-        ret = csc_hash_del(bl->hash, &idStr);
+    {   blKey_t key = ((blEntry_t*)lp->data)->key;
+        ret = csc_hash_del(bl->hash, &key);
         assert(ret);
     }
     csc_list_free(lstDelIds);
@@ -9,6 +9,7 @@ typedef struct csc_blacklist_t csc_blacklist_t;
 csc_blacklist_t *csc_blacklist_new(int expireTime);
 void csc_blacklist_free(csc_blacklist_t *bl);
 int csc_blacklist_blackness(csc_blacklist_t *bl, const char *idStr);
+int csc_blacklist_blacknessBin(csc_blacklist_t *bl, const void *id, int idLen);
 void csc_blacklist_clean(csc_blacklist_t *bl);
 int csc_blacklist_accessCount(csc_blacklist_t *bl);
 void csc_blacklist_setTimeFaked(csc_blacklist_t *bl, csc_bool_t isFaked);
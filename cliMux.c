@@ -0,0 +1,421 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "std.h"
+#include "alloc.h"
+#include "http.h"
+#include "isvalid.h"
+#include "timerWheel.h"
+#include "cliMux.h"
+
+#define TimerTickMs 5
+#define MaxEvents 64
+#define MaxRespSize (16*1024*1024)
+#define MaxHdrValSize 100
+
+
+// A request, being sent or its response read.
+typedef struct muxReq_t
+{   struct csc_cliMux_t *mux;
+    int fd;
+    int oldFlags;
+    char *out;            // The request.
+    int outLen;
+    int outPos;
+    char *in;             // The response so far.
+    int inLen;
+    int inSize;
+    int headLen;          // Up to the blank line, once read.
+    long bodyLen;         // Once known, or -1 to read till closed.
+    csc_bool_t isHead;    // A HEAD request, so no body.
+    csc_bool_t isClose;   // The server will close the connection.
+    csc_timer_t timer;
+    uint64_t startMs;
+    csc_cliMux_onDone_t *onDone;
+    void *arg;
+    struct muxReq_t *prev;
+    struct muxReq_t *next;
+} muxReq_t;
+
+
+typedef struct csc_cliMux_t
+{   char *errMsg;
+    int epfd;
+    csc_timerWheel_t *timers;
+    muxReq_t *reqs;
+    int nReqs;
+} csc_cliMux_t;
+
+
+
+static void setErrMsg(csc_cliMux_t *mux, char *newErrMsg)
+{   if (mux->errMsg != NULL)
+        free(mux->errMsg);
+    mux->errMsg = newErrMsg;
+}
+
+
+// --------------------  Finishing --------------------
+
+// Hands the outcome to the caller, and forgets the request.
+static void finish(muxReq_t *req, const char *errMsg)
+{   csc_cliMux_t *mux = req->mux;
+    csc_cliMux_result_t result;
+ 
+// Forget it.
+    epoll_ctl(mux->epfd, EPOLL_CTL_DEL, req->fd, NULL);
+    csc_timerWheel_cancel(mux->timers, &req->timer);
+    fcntl(req->fd, F_SETFL, req->oldFlags);
+    if (req->prev != NULL)
+        req->prev->next = req->next;
+    else
+        mux->reqs = req->next;
+    if (req->next != NULL)
+        req->next->prev = req->prev;
+    mux->nReqs--;
+ 
+// Parse the head.
+    result.fd = req->fd;
+    result.resp = NULL;
+    result.body = NULL;
+    result.bodyLen = 0;
+    result.isReusable = csc_FALSE;
+    result.errMsg = errMsg;
+    result.elapsedMs = (int)(csc_timerWheel_nowMs() - req->startMs);
+    if (errMsg == NULL)
+    {   result.resp = csc_http_new();
+        csc_http_setMaxInputChars(result.resp, req->headLen);
+        if (csc_http_parseCli(result.resp, req->in, req->headLen, NULL) != csc_httpErr_Ok)
+        {   result.errMsg = "Bad response head";
+            csc_http_free(result.resp);
+            result.resp = NULL;
+        }
+        else
+        {   req->in[req->inLen] = '\0';
+            result.body = req->in + req->headLen;
+            result.bodyLen = req->inLen - req->headLen;
+            result.isReusable = req->bodyLen>=0 && !req->isClose;
+        }
+    }
+ 
+// Tell the caller.
+    req->onDone(req->arg, &result);
+ 
+    if (result.resp != NULL)
+        csc_http_free(result.resp);
+    free(req->out);
+    free(req->in);
+    free(req);
+}
+
+
+static void timedOut(csc_timer_t *timer, void *arg)
+{   (void)timer;
+    finish(arg, "Timed out");
+}
+
+
+// --------------------  The head --------------------
+
+// Gets the value of header 'name' from the head, whatever its case, into
+// 'val'.  Returns csc_FALSE if there is no such header.
+static csc_bool_t rawHdr(const char *head, int headLen, const char *name, char *val)
+{   const char *pt = head;
+    const char *end = head + headLen;
+    const char *eol;
+    int nameLen = strlen(name);
+    int n;
+ 
+    while (pt < end)
+    {   eol = memchr(pt, '\n', end-pt);
+        if (eol == NULL)
+            eol = end;
+        if ( eol-pt>nameLen && pt[nameLen]==':'
+          && strncasecmp(pt, name, nameLen)==0
+           )
+        {   pt += nameLen + 1;
+            while (pt<eol && (*pt==' ' || *pt=='\t'))
+                pt++;
+            n = eol - pt;
+            while (n>0 && isspace((unsigned char)pt[n-1]))
+                n--;
+            if (n >= MaxHdrValSize)
+                n = MaxHdrValSize - 1;
+            memcpy(val, pt, n);
+            val[n] = '\0';
+            return csc_TRUE;
+        }
+        pt = eol + 1;
+    }
+    return csc_FALSE;
+}
+
+
+// Finds the end of the head, and so how long the body is.  Returns
+// csc_FALSE, with 'errMsg' set, if the response cannot be read.
+static csc_bool_t readHead(muxReq_t *req, const char **errMsg)
+{   char val[MaxHdrValSize];
+    int statCode;
+ 
+// Find the blank line.
+    *errMsg = NULL;
+    req->headLen = csc_http_headLen(req->in, req->inLen);
+    if (req->headLen < 0)
+    {   req->headLen = 0;
+        return csc_TRUE;
+    }
+ 
+// Some responses have no body.
+    if (sscanf(req->in, "HTTP/%*d.%*d %d", &statCode) != 1)
+    {   *errMsg = "Bad status line";
+        return csc_FALSE;
+    }
+    req->isClose = strncmp(req->in, "HTTP/1.0", 8) == 0;
+    if (rawHdr(req->in, req->headLen, "Connection", val))
+        req->isClose = strcasecmp(val,"close")==0
+                    || (req->isClose && strcasecmp(val,"keep-alive")!=0);
+    if (req->isHead || statCode/100==1 || statCode==204 || statCode==304)
+        req->bodyLen = 0;
+ 
+// Otherwise it is as long as it says, or lasts till the connection closes.
+    else if (rawHdr(req->in, req->headLen, "Transfer-Encoding", val))
+    {   *errMsg = "Chunked responses are not supported";
+        return csc_FALSE;
+    }
+    else if (rawHdr(req->in, req->headLen, "Content-Length", val))
+    {   req->bodyLen = atol(val);
+        if (!csc_isValid_int(val) || req->bodyLen<0 || req->bodyLen>MaxRespSize)
+        {   *errMsg = "Bad Content-Length";
+            return csc_FALSE;
+        }
+    }
+    else
+        req->bodyLen = -1;
+    return csc_TRUE;
+}
+
+
+// --------------------  I/O --------------------
+
+static void doWrite(muxReq_t *req)
+{   struct epoll_event ev;
+    ssize_t n;
+ 
+    while (req->outPos < req->outLen)
+    {   n = send(req->fd, req->out+req->outPos, req->outLen-req->outPos, MSG_NOSIGNAL);
+        if (n < 0)
+        {   if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                finish(req, strerror(errno));
+            return;
+        }
+        req->outPos += n;
+    }
+ 
+// All sent, so wait for the response.
+    ev.events = EPOLLIN;
+    ev.data.ptr = req;
+    epoll_ctl(req->mux->epfd, EPOLL_CTL_MOD, req->fd, &ev);
+}
+
+
+static void doRead(muxReq_t *req)
+{   const char *errMsg;
+    ssize_t n;
+ 
+    for (;;)
+    {
+    // Make room.
+        if (req->inSize-req->inLen < 4096)
+        {   if (req->inSize >= MaxRespSize)
+            {   finish(req, "Response too long");
+                return;
+            }
+            req->inSize *= 2;
+            req->in = csc_ck_ralloc(req->in, req->inSize+1);
+        }
+ 
+        n = recv(req->fd, req->in+req->inLen, req->inSize-req->inLen, 0);
+        if (n < 0)
+        {   if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                finish(req, strerror(errno));
+            return;
+        }
+ 
+    // Closed.  The end of the body, if it has no length.
+        if (n == 0)
+        {   if (req->headLen>0 && req->bodyLen<0)
+            {   req->isClose = csc_TRUE;
+                finish(req, NULL);
+            }
+            else
+                finish(req, "Connection closed");
+            return;
+        }
+        req->inLen += n;
+        req->in[req->inLen] = '\0';   // For sscanf() in readHead().
+ 
+    // The head, and then the body.
+        if (req->headLen==0 && !readHead(req, &errMsg))
+        {   finish(req, errMsg);
+            return;
+        }
+        if (req->headLen>0 && req->bodyLen>=0 && req->inLen-req->headLen>=req->bodyLen)
+        {   if (req->inLen-req->headLen > req->bodyLen)
+            {   req->isClose = csc_TRUE;
+                req->inLen = req->headLen + req->bodyLen;
+            }
+            finish(req, NULL);
+            return;
+        }
+    }
+}
+
+
+// --------------------  Public --------------------
+
+csc_cliMux_t *csc_cliMux_new()
+{   csc_cliMux_t *mux;
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        return NULL;
+ 
+    mux = csc_allocOne(csc_cliMux_t);
+    mux->errMsg = NULL;
+    mux->epfd = epfd;
+    mux->timers = csc_timerWheel_new(TimerTickMs, csc_timerWheel_nowMs());
+    mux->reqs = NULL;
+    mux->nReqs = 0;
+    return mux;
+}
+
+
+void csc_cliMux_free(csc_cliMux_t *mux)
+{   while (mux->reqs != NULL)
+        finish(mux->reqs, "Abandoned");
+    csc_timerWheel_free(mux->timers);
+    close(mux->epfd);
+    if (mux->errMsg != NULL)
+        free(mux->errMsg);
+    free(mux);
+}
+
+
+csc_bool_t csc_cliMux_add( csc_cliMux_t *mux
+                         , int fd
+                         , const void *req
+                         , int reqLen
+                         , int timeoutMs
+                         , csc_cliMux_onDone_t *onDone
+                         , void *arg
+                         )
+{   struct epoll_event ev;
+    muxReq_t *mr;
+    int flags;
+ 
+// Make the connection non blocking, and watch it.
+    flags = fcntl(fd, F_GETFL);
+    if (flags<0 || fcntl(fd, F_SETFL, flags|O_NONBLOCK)<0)
+    {   setErrMsg(mux, csc_alloc_str3("csc_cliMux_add(): fcntl(): ", strerror(errno), NULL));
+        return csc_FALSE;
+    }
+    mr = csc_allocOne(muxReq_t);
+    ev.events = EPOLLOUT;
+    ev.data.ptr = mr;
+    if (epoll_ctl(mux->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {   setErrMsg(mux, csc_alloc_str3("csc_cliMux_add(): epoll_ctl(): ", strerror(errno), NULL));
+        fcntl(fd, F_SETFL, flags);
+        free(mr);
+        return csc_FALSE;
+    }
+ 
+// Fill in the request.
+    mr->mux = mux;
+    mr->fd = fd;
+    mr->oldFlags = flags;
+    mr->out = csc_allocMany(char, reqLen);
+    memcpy(mr->out, req, reqLen);
+    mr->outLen = reqLen;
+    mr->outPos = 0;
+    mr->inSize = 4096;
+    mr->in = csc_allocMany(char, mr->inSize+1);
+    mr->inLen = 0;
+    mr->headLen = 0;
+    mr->bodyLen = -1;
+    mr->isHead = reqLen>=5 && memcmp(req, "HEAD ", 5)==0;
+    mr->isClose = csc_FALSE;
+    mr->startMs = csc_timerWheel_nowMs();
+    mr->onDone = onDone;
+    mr->arg = arg;
+    csc_timer_init(&mr->timer, timedOut, mr);
+    if (timeoutMs >= 0)
+    {   csc_timerWheel_setNow(mux->timers, mr->startMs);
+        csc_timerWheel_add(mux->timers, &mr->timer, timeoutMs);
+    }
+ 
+// Add it to the list.
+    mr->prev = NULL;
+    mr->next = mux->reqs;
+    if (mux->reqs != NULL)
+        mux->reqs->prev = mr;
+    mux->reqs = mr;
+    mux->nReqs++;
+    return csc_TRUE;
+}
+
+
+int csc_cliMux_nPending(const csc_cliMux_t *mux)
+{   return mux->nReqs;
+}
+
+
+csc_bool_t csc_cliMux_run(csc_cliMux_t *mux)
+{   struct epoll_event events[MaxEvents];
+    muxReq_t *req;
+    int nEvents, i;
+ 
+    while (mux->nReqs > 0)
+    {   nEvents = epoll_wait( mux->epfd, events, MaxEvents
+                            , csc_timerWheel_nextMs(mux->timers, csc_timerWheel_nowMs()));
+        if (nEvents < 0)
+        {   if (errno == EINTR)
+                continue;
+            setErrMsg(mux, csc_alloc_str3("csc_cliMux_run(): epoll_wait(): ", strerror(errno), NULL));
+            return csc_FALSE;
+        }
+ 
+    // Each ready connection does what it can.
+        csc_timerWheel_setNow(mux->timers, csc_timerWheel_nowMs());
+        for (i=0; i<nEvents; i++)
+        {   req = events[i].data.ptr;
+            if (req->outPos < req->outLen)
+                doWrite(req);
+            else
+                doRead(req);
+        }
+ 
+    // Then those out of time fail.
+        csc_timerWheel_advance(mux->timers, csc_timerWheel_nowMs());
+    }
+    return csc_TRUE;
+}
+
+
+const char *csc_cliMux_getErrMsg(const csc_cliMux_t *mux)
+{   return mux->errMsg;
+}
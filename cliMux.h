@@ -0,0 +1,84 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ======= cliMux =======================================================
+// Sends HTTP requests to many servers at once, from one thread, and
+// collects the responses as they come.  A fan out to several backends then
+// takes as long as the slowest of them, rather than as long as all of them
+// one after another.
+//
+// Each request is sent on a connection that the caller has made, e.g. with
+// csc_cli_mkConn() or csc_cliPool_get().  A function is called when its
+// response has been read, or it fails, or its time runs out.  The caller
+// gets the connection back then, to close or to reuse.
+//
+// The body of a response is read as given by Content-Length, or until the
+// server closes the connection.  Chunked responses are not understood, and
+// fail.
+//
+// A multiplexer is not thread safe.  Give each thread its own.
+// ======================================================================
+
+#ifndef csc_CLIMUX_H
+#define csc_CLIMUX_H 1
+
+#include "std.h"
+#include "http.h"
+
+typedef struct csc_cliMux_t csc_cliMux_t;
+
+
+// The outcome of a request, given to its function.  It, and what it points
+// to, are valid only until the function returns.
+typedef struct
+{   int fd;                   // The connection, blocking again.
+    csc_http_t *resp;         // The status line and headers, or NULL if
+                              // it failed.
+    const char *body;         // The body, with a '\0' after it.
+    int bodyLen;
+    csc_bool_t isReusable;    // Whether the connection may be used for
+                              // another request, e.g. by handing it back
+                              // to a csc_cliPool_t.
+    const char *errMsg;       // Why it failed, or NULL.
+    int elapsedMs;            // From csc_cliMux_add() until now.
+} csc_cliMux_result_t;
+
+typedef void csc_cliMux_onDone_t(void *arg, const csc_cliMux_result_t *result);
+
+
+// Constructor.  Returns NULL on failure.
+csc_cliMux_t *csc_cliMux_new();
+
+// Destructor.  Requests not yet done fail, and their functions are called,
+// so that their connections are returned.
+void csc_cliMux_free(csc_cliMux_t *mux);
+
+
+// Sends the 'reqLen' bytes of 'req' on connection 'fd', and reads the
+// response, calling 'onDone'('arg', result) when done.  'req' is copied.
+// The request fails if not done within 'timeoutMs' milliseconds, or never
+// times out if negative.  The work is done by csc_cliMux_run().  Returns
+// csc_FALSE on failure, in which case 'onDone' is not called.
+csc_bool_t csc_cliMux_add( csc_cliMux_t *mux
+                         , int fd
+                         , const void *req
+                         , int reqLen
+                         , int timeoutMs
+                         , csc_cliMux_onDone_t *onDone
+                         , void *arg
+                         );
+
+// Returns the number of requests not yet done.
+int csc_cliMux_nPending(const csc_cliMux_t *mux);
+
+
+// Does the requests, until all are done, including any added by the
+// functions called meanwhile.  Returns csc_FALSE if epoll_wait() fails.
+csc_bool_t csc_cliMux_run(csc_cliMux_t *mux);
+
+
+// Returns a string representation of details of a previous error.  The
+// string returned is valid until the next non const method call.
+const char *csc_cliMux_getErrMsg(const csc_cliMux_t *mux);
+
+#endif
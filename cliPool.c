@@ -0,0 +1,342 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "std.h"
+#include "alloc.h"
+#include "hash.h"
+#include "netCli.h"
+#include "cliPool.h"
+
+#define MaxKeySize 300
+
+
+struct cpHost_t;
+
+// A connection, whether idle or in use.  Idle ones are on their host's
+// list, most recently idle first.
+typedef struct cpConn_t
+{   int fd;
+    struct cpHost_t *host;
+    time_t createdSecs;
+    time_t idleSince;
+    csc_bool_t isIdle;
+    struct cpConn_t *prev;
+    struct cpConn_t *next;
+} cpConn_t;
+
+
+// An address and port.  The address is resolved once, and again only
+// after a connection to it fails.
+typedef struct cpHost_t
+{   char *key;
+    char *addr;
+    int portNo;
+    csc_cli_t *cli;
+    int nConns;
+    int nIdle;
+    cpConn_t *idleHead;
+    cpConn_t *idleTail;
+} cpHost_t;
+
+
+typedef struct csc_cliPool_t
+{   char *errMsg;
+    int maxPerHost;
+    int maxIdlePerHost;
+    int maxIdleSecs;
+    int maxAgeSecs;
+    csc_hash_t *hosts;
+    cpConn_t **byFd;
+    int nByFd;
+} csc_cliPool_t;
+
+
+
+static void setErrMsg(csc_cliPool_t *pool, char *newErrMsg)
+{   if (pool->errMsg != NULL)
+        free(pool->errMsg);
+    pool->errMsg = newErrMsg;
+}
+
+
+static time_t nowSecs()
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+
+static void mkKey(char *key, const char *addr, int portNo)
+{   snprintf(key, MaxKeySize, "%s %d", addr, portNo);
+}
+
+
+static cpHost_t *cpHost_new(const char *key, const char *addr, int portNo)
+{   cpHost_t *host = csc_allocOne(cpHost_t);
+    host->key = csc_alloc_str(key);
+    host->addr = csc_alloc_str(addr);
+    host->portNo = portNo;
+    host->cli = NULL;
+    host->nConns = 0;
+    host->nIdle = 0;
+    host->idleHead = NULL;
+    host->idleTail = NULL;
+    return host;
+}
+
+
+static void cpHost_free(void *pt)
+{   cpHost_t *host = pt;
+    free(host->key);
+    free(host->addr);
+    if (host->cli != NULL)
+        csc_cli_free(host->cli);
+    free(host);
+}
+
+
+static cpHost_t *getHost(csc_cliPool_t *pool, const char *addr, int portNo, csc_bool_t isMk)
+{   char keyBuf[MaxKeySize];
+    char *key = keyBuf;
+    cpHost_t *host;
+ 
+    mkKey(keyBuf, addr, portNo);
+    host = csc_hash_get(pool->hosts, &key);
+    if (host==NULL && isMk)
+    {   host = cpHost_new(keyBuf, addr, portNo);
+        csc_hash_addex(pool->hosts, host);
+    }
+    return host;
+}
+
+
+// --------------------  Idle list --------------------
+
+static void idlePush(cpHost_t *host, cpConn_t *conn)
+{   conn->isIdle = csc_TRUE;
+    conn->prev = NULL;
+    conn->next = host->idleHead;
+    if (host->idleHead != NULL)
+        host->idleHead->prev = conn;
+    else
+        host->idleTail = conn;
+    host->idleHead = conn;
+    host->nIdle++;
+}
+
+
+static void idleUnlink(cpHost_t *host, cpConn_t *conn)
+{   if (conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        host->idleHead = conn->next;
+    if (conn->next != NULL)
+        conn->next->prev = conn->prev;
+    else
+        host->idleTail = conn->prev;
+    conn->prev = conn->next = NULL;
+    conn->isIdle = csc_FALSE;
+    host->nIdle--;
+}
+
+
+// --------------------  Connections --------------------
+
+static cpConn_t *connAdd(csc_cliPool_t *pool, cpHost_t *host, int fd)
+{   cpConn_t *conn;
+    int newSize;
+ 
+// Make room to find it by its file descriptor.
+    if (fd >= pool->nByFd)
+    {   newSize = pool->nByFd*2 > fd ? pool->nByFd*2 : fd+64;
+        pool->byFd = csc_ck_ralloc(pool->byFd, newSize*sizeof(cpConn_t*));
+        memset(pool->byFd+pool->nByFd, 0, (newSize-pool->nByFd)*sizeof(cpConn_t*));
+        pool->nByFd = newSize;
+    }
+ 
+    conn = csc_allocOne(cpConn_t);
+    conn->fd = fd;
+    conn->host = host;
+    conn->createdSecs = nowSecs();
+    conn->idleSince = 0;
+    conn->isIdle = csc_FALSE;
+    conn->prev = conn->next = NULL;
+    pool->byFd[fd] = conn;
+    host->nConns++;
+    return conn;
+}
+
+
+static void connClose(csc_cliPool_t *pool, cpConn_t *conn)
+{   if (conn->isIdle)
+        idleUnlink(conn->host, conn);
+    conn->host->nConns--;
+    pool->byFd[conn->fd] = NULL;
+    close(conn->fd);
+    free(conn);
+}
+
+
+static csc_bool_t isTooOld(csc_cliPool_t *pool, cpConn_t *conn, time_t now)
+{   return pool->maxAgeSecs>0 && now-conn->createdSecs>=pool->maxAgeSecs;
+}
+
+
+// Whether the server has neither closed the connection nor sent anything
+// unasked.
+static csc_bool_t isHealthy(int fd)
+{   char c;
+    return recv(fd, &c, 1, MSG_PEEK|MSG_DONTWAIT) == -1
+        && (errno==EAGAIN || errno==EWOULDBLOCK);
+}
+
+
+// --------------------  Public --------------------
+
+csc_cliPool_t *csc_cliPool_new( int maxPerHost
+                              , int maxIdlePerHost
+                              , int maxIdleSecs
+                              , int maxAgeSecs
+                              )
+{   csc_cliPool_t *pool = csc_allocOne(csc_cliPool_t);
+    pool->errMsg = NULL;
+    pool->maxPerHost = maxPerHost;
+    pool->maxIdlePerHost = maxIdlePerHost;
+    pool->maxIdleSecs = maxIdleSecs;
+    pool->maxAgeSecs = maxAgeSecs;
+    pool->hosts = csc_hash_new( offsetof(cpHost_t, key)
+                              , csc_hash_StrPtCmpr
+                              , csc_hash_StrPt
+                              , cpHost_free
+                              );
+    pool->byFd = NULL;
+    pool->nByFd = 0;
+    return pool;
+}
+
+
+void csc_cliPool_free(csc_cliPool_t *pool)
+{   cpConn_t *conn;
+ 
+// Close the idle connections, and forget the rest.
+    for (int fd=0; fd<pool->nByFd; fd++)
+    {   conn = pool->byFd[fd];
+        if (conn != NULL)
+        {   if (conn->isIdle)
+                close(fd);
+            free(conn);
+        }
+    }
+    if (pool->byFd != NULL)
+        free(pool->byFd);
+ 
+    csc_hash_free(pool->hosts);
+    if (pool->errMsg != NULL)
+        free(pool->errMsg);
+    free(pool);
+}
+
+
+int csc_cliPool_get(csc_cliPool_t *pool, const char *addr, int portNo)
+{   cpHost_t *host = getHost(pool, addr, portNo, csc_TRUE);
+    time_t now = nowSecs();
+    cpConn_t *conn;
+    int fd;
+ 
+// Drop those that have been idle too long, the oldest being last.
+    while ( host->idleTail!=NULL && pool->maxIdleSecs>0
+         && now-host->idleTail->idleSince >= pool->maxIdleSecs
+          )
+    {   connClose(pool, host->idleTail);
+    }
+ 
+// Take the most recently idle that is still good.
+    while ((conn = host->idleHead) != NULL)
+    {   if (isTooOld(pool,conn,now) || !isHealthy(conn->fd))
+            connClose(pool, conn);
+        else
+        {   idleUnlink(host, conn);
+            return conn->fd;
+        }
+    }
+ 
+// Otherwise make a new one, if allowed.
+    if (pool->maxPerHost>0 && host->nConns>=pool->maxPerHost)
+    {   setErrMsg(pool, csc_alloc_str3("csc_cliPool_get(): Too many connections to \""
+                                      , host->key, "\""));
+        return -1;
+    }
+    if (host->cli == NULL)
+    {   host->cli = csc_cli_new();
+        if (!csc_cli_setServAddr(host->cli, addr, portNo))
+        {   setErrMsg(pool, csc_alloc_str(csc_cli_getErrMsg(host->cli)));
+            csc_cli_free(host->cli);
+            host->cli = NULL;
+            return -1;
+        }
+    }
+    fd = csc_cli_connect(host->cli);
+    if (fd < 0)
+    {   setErrMsg(pool, csc_alloc_str(csc_cli_getErrMsg(host->cli)));
+        csc_cli_free(host->cli);
+        host->cli = NULL;
+        return -1;
+    }
+ 
+    connAdd(pool, host, fd);
+    return fd;
+}
+
+
+csc_bool_t csc_cliPool_put(csc_cliPool_t *pool, int fd, csc_bool_t isReusable)
+{   cpConn_t *conn;
+    cpHost_t *host;
+    time_t now = nowSecs();
+ 
+// It is not one of ours.
+    if (fd < 0)
+        return csc_FALSE;
+    if (fd>=pool->nByFd || pool->byFd[fd]==NULL)
+    {   close(fd);
+        return csc_FALSE;
+    }
+    if (pool->byFd[fd]->isIdle)
+        return csc_FALSE;
+    conn = pool->byFd[fd];
+    host = conn->host;
+ 
+// Keep it, or close it.
+    if ( !isReusable
+      || (pool->maxIdlePerHost>0 && host->nIdle>=pool->maxIdlePerHost)
+      || isTooOld(pool, conn, now)
+       )
+    {   connClose(pool, conn);
+    }
+    else
+    {   conn->idleSince = now;
+        idlePush(host, conn);
+    }
+    return csc_TRUE;
+}
+
+
+int csc_cliPool_nIdle(csc_cliPool_t *pool, const char *addr, int portNo)
+{   cpHost_t *host = getHost(pool, addr, portNo, csc_FALSE);
+    return host==NULL ? 0 : host->nIdle;
+}
+
+
+const char *csc_cliPool_getErrMsg(const csc_cliPool_t *pool)
+{   return pool->errMsg;
+}
+
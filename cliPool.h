@@ -0,0 +1,66 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ======= cliPool ======================================================
+// A pool of TCP connections to servers, kept open between uses.  Taking a
+// connection that is already open saves the round trip of connecting, the
+// address lookup, and the TIME_WAIT left by each connection that the
+// client closes.
+//
+// Connections are kept for each address and port.  One is handed back to
+// the pool when done with, and kept if the caller says that it may be
+// reused, i.e. that the exchange on it went well and left nothing unread.
+// Whoever takes it next is given the one most recently handed back, once
+// it has been checked that the server has not closed it.
+//
+// A pool is not thread safe.  Give each thread its own, or guard it.
+// ======================================================================
+
+#ifndef csc_CLIPOOL_H
+#define csc_CLIPOOL_H 1
+
+#include "std.h"
+
+typedef struct csc_cliPool_t csc_cliPool_t;
+
+
+// Constructor.  Each limit is for one address and port, and 0 means no
+// limit:-
+//  *   maxPerHost - Connections, whether in use or idle.
+//  *   maxIdlePerHost - Idle connections kept.  Others handed back are
+//      closed.
+//  *   maxIdleSecs - How long an idle connection is kept.  It should be
+//      less than the time after which the server closes it.
+//  *   maxAgeSecs - How long a connection is used for, from when it was
+//      made, e.g. so that load is spread again to new servers.
+csc_cliPool_t *csc_cliPool_new( int maxPerHost
+                              , int maxIdlePerHost
+                              , int maxIdleSecs
+                              , int maxAgeSecs
+                              );
+
+// Destructor.  Closes the idle connections.  Those in use are left open,
+// for their users to close.
+void csc_cliPool_free(csc_cliPool_t *pool);
+
+
+// Returns a connection to 'addr' and 'portNo', as for csc_cli_mkConn(),
+// either an idle one or a new one.  Returns -1 on failure, e.g. if
+// maxPerHost are in use.  Use csc_cliPool_getErrMsg() to get details.
+int csc_cliPool_get(csc_cliPool_t *pool, const char *addr, int portNo);
+
+// Hands back a connection from csc_cliPool_get().  It is kept if
+// 'isReusable', and within the limits, and is closed otherwise.  Returns
+// csc_FALSE, having closed it, if it did not come from the pool.
+csc_bool_t csc_cliPool_put(csc_cliPool_t *pool, int fd, csc_bool_t isReusable);
+
+
+// Returns the number of connections to 'addr' and 'portNo' that are idle.
+int csc_cliPool_nIdle(csc_cliPool_t *pool, const char *addr, int portNo);
+
+
+// Returns a string representation of details of a previous error.  The
+// string returned is valid until the next non const method call.
+const char *csc_cliPool_getErrMsg(const csc_cliPool_t *pool);
+
+#endif
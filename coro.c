@@ -0,0 +1,411 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+#define _GNU_SOURCE  // For fopencookie().
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "std.h"
+#include "alloc.h"
+#include "timerWheel.h"
+#include "coro.h"
+
+#define coroMaxEvents 256
+#define coroTickMs 10
+#define coroMaxFree 64
+
+struct csc_coro_t
+{   ucontext_t ctx;
+    csc_coroSched_t *sched;
+    void (*fn)(void *arg);
+    void *arg;
+    char *mapping;             // The stack and its guard page.
+    csc_coro_t *next;          // In the run queue, or the free list.
+    csc_timer_t timer;
+    csc_bool_t isWaiting;      // For an fd or a timer.
+    csc_bool_t isSleeping;     // In csc_coro_sleep().
+    int waitResult;            // 1 if ready or woken, 0 if timed out.
+};
+
+
+struct csc_coroSched_t
+{   ucontext_t ctx;            // Where the coroutines yield to.
+    int epollFd;
+    csc_timerWheel_t *wheel;
+    csc_coro_t *runHead, *runTail;  // Ready to run.
+    csc_coro_t *current;
+    csc_coro_t *freeList;      // Finished, with their stacks kept for reuse.
+    int nFree;
+    int nCoros;
+    size_t stackSize;
+    size_t mappingSize;
+};
+
+
+// The scheduler being run by this thread.
+static __thread csc_coroSched_t *threadSched = NULL;
+
+
+// ------------------------ The scheduler ---------------------------
+
+csc_coroSched_t *csc_coroSched_new(size_t stackSize)
+{   csc_coroSched_t *sched;
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    int epollFd;
+ 
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1)
+        return NULL;
+ 
+    sched = csc_allocOne(csc_coroSched_t);
+    sched->epollFd = epollFd;
+    sched->wheel = csc_timerWheel_new(coroTickMs, csc_timerWheel_nowMs());
+    sched->runHead = sched->runTail = NULL;
+    sched->current = NULL;
+    sched->freeList = NULL;
+    sched->nFree = 0;
+    sched->nCoros = 0;
+    sched->stackSize = (stackSize + pageSize - 1) / pageSize * pageSize;
+    sched->mappingSize = sched->stackSize + pageSize;
+    return sched;
+}
+
+
+static void coroDestroy(csc_coro_t *coro)
+{   munmap(coro->mapping, coro->sched->mappingSize);
+    free(coro);
+}
+
+
+void csc_coroSched_free(csc_coroSched_t *sched)
+{   csc_coro_t *coro;
+    while ((coro=sched->freeList) != NULL)
+    {   sched->freeList = coro->next;
+        coroDestroy(coro);
+    }
+    csc_timerWheel_free(sched->wheel);
+    close(sched->epollFd);
+    free(sched);
+}
+
+
+static void coroReady(csc_coro_t *coro)
+{   csc_coroSched_t *sched = coro->sched;
+    coro->next = NULL;
+    if (sched->runTail)
+        sched->runTail->next = coro;
+    else
+        sched->runHead = coro;
+    sched->runTail = coro;
+}
+
+
+// Ends a wait, with the given result.
+static void coroEndWait(csc_coro_t *coro, int result)
+{   if (!coro->isWaiting)
+        return;
+    csc_timerWheel_cancel(coro->sched->wheel, &coro->timer);
+    coro->isWaiting = csc_FALSE;
+    coro->isSleeping = csc_FALSE;
+    coro->waitResult = result;
+    coroReady(coro);
+}
+
+
+static void coroTimedOut(csc_timer_t *timer, void *arg)
+{   (void)timer;
+    coroEndWait(arg, 0);
+}
+
+
+// Switches from the running coroutine back to the scheduler.
+static void coroSwitchOut(csc_coro_t *coro)
+{   swapcontext(&coro->ctx, &coro->sched->ctx);
+}
+
+
+// Each coroutine starts here.  On return, uc_link takes us back to the
+// scheduler.
+static void coroEntry(void)
+{   csc_coro_t *coro = threadSched->current;
+    coro->fn(coro->arg);
+    coro->fn = NULL;
+}
+
+
+// Finished with a coroutine.  Keep a few stacks for new coroutines.
+static void coroRecycle(csc_coroSched_t *sched, csc_coro_t *coro)
+{   sched->nCoros--;
+    if (sched->nFree < coroMaxFree)
+    {   coro->next = sched->freeList;
+        sched->freeList = coro;
+        sched->nFree++;
+    }
+    else
+        coroDestroy(coro);
+}
+
+
+csc_bool_t csc_coroSched_run(csc_coroSched_t *sched)
+{   struct epoll_event events[coroMaxEvents];
+    csc_coroSched_t *prevSched = threadSched;
+    csc_coro_t *coro;
+    csc_bool_t isOk = csc_TRUE;
+    int nEvents, i;
+ 
+    threadSched = sched;
+    while (sched->nCoros > 0)
+    {
+    // Run whatever is ready.  Anything made ready meanwhile runs too.
+        while ((coro=sched->runHead) != NULL)
+        {   sched->runHead = coro->next;
+            if (sched->runHead == NULL)
+                sched->runTail = NULL;
+            sched->current = coro;
+            swapcontext(&sched->ctx, &coro->ctx);
+            sched->current = NULL;
+            if (coro->fn == NULL)
+                coroRecycle(sched, coro);
+        }
+        if (sched->nCoros == 0)
+            break;
+ 
+    // Wait for a socket or a timer.
+        nEvents = epoll_wait( sched->epollFd, events, coroMaxEvents
+                            , csc_timerWheel_nextMs(sched->wheel, csc_timerWheel_nowMs()));
+        if (nEvents==-1 && errno!=EINTR)
+        {   isOk = csc_FALSE;
+            break;
+        }
+        for (i=0; i<nEvents; i++)
+            coroEndWait(events[i].data.ptr, 1);
+        csc_timerWheel_advance(sched->wheel, csc_timerWheel_nowMs());
+    }
+    threadSched = prevSched;
+    return isOk;
+}
+
+
+// ------------------------ Coroutines ------------------------------
+
+csc_coro_t *csc_coro_spawn(csc_coroSched_t *sched, void (*fn)(void *arg), void *arg)
+{   size_t pageSize = sched->mappingSize - sched->stackSize;
+    csc_coro_t *coro;
+ 
+// Reuse a finished coroutine, or make a new one.
+    if (sched->freeList != NULL)
+    {   coro = sched->freeList;
+        sched->freeList = coro->next;
+        sched->nFree--;
+    }
+    else
+    {   coro = csc_allocOne(csc_coro_t);
+        coro->sched = sched;
+        coro->mapping = mmap( NULL, sched->mappingSize, PROT_READ|PROT_WRITE
+                            , MAP_PRIVATE|MAP_ANONYMOUS|MAP_STACK, -1, 0);
+        if (coro->mapping == MAP_FAILED)
+        {   free(coro);
+            return NULL;
+        }
+ 
+    // Overflowing the stack faults rather than trampling something else.
+        mprotect(coro->mapping, pageSize, PROT_NONE);
+    }
+ 
+// Prepare it to start.
+    getcontext(&coro->ctx);
+    coro->ctx.uc_stack.ss_sp = coro->mapping + pageSize;
+    coro->ctx.uc_stack.ss_size = sched->stackSize;
+    coro->ctx.uc_link = &sched->ctx;
+    makecontext(&coro->ctx, coroEntry, 0);
+    coro->fn = fn;
+    coro->arg = arg;
+    coro->isWaiting = csc_FALSE;
+    coro->isSleeping = csc_FALSE;
+    csc_timer_init(&coro->timer, coroTimedOut, coro);
+ 
+    sched->nCoros++;
+    coroReady(coro);
+    return coro;
+}
+
+
+csc_coro_t *csc_coro_self(void)
+{   if (threadSched == NULL)
+        return NULL;
+    return threadSched->current;
+}
+
+
+void csc_coro_yield(void)
+{   csc_coro_t *coro = csc_coro_self();
+    if (coro == NULL)
+        return;
+    coroReady(coro);
+    coroSwitchOut(coro);
+}
+
+
+// Waits to be made ready, for at most 'timeoutMs' if not negative.
+static int coroWait(csc_coro_t *coro, int timeoutMs)
+{   if (timeoutMs >= 0)
+        csc_timerWheel_add(coro->sched->wheel, &coro->timer, timeoutMs);
+    coro->isWaiting = csc_TRUE;
+    coroSwitchOut(coro);
+    return coro->waitResult;
+}
+
+
+csc_bool_t csc_coro_sleep(int ms)
+{   csc_coro_t *coro = csc_coro_self();
+    if (coro == NULL)
+    {   if (ms >= 0)
+            poll(NULL, 0, ms);
+        else
+            pause();
+        return csc_FALSE;
+    }
+    coro->isSleeping = csc_TRUE;
+    return coroWait(coro, ms);
+}
+
+
+void csc_coro_wake(csc_coro_t *coro)
+{   if (coro->isSleeping)
+        coroEndWait(coro, 1);
+}
+
+
+int csc_coro_waitFd(int fd, int events, int timeoutMs)
+{   csc_coro_t *coro = csc_coro_self();
+    struct epoll_event ev;
+    struct pollfd pfd;
+    int result;
+ 
+// Not in a coroutine, so just wait.
+    if (coro == NULL)
+    {   pfd.fd = fd;
+        pfd.events = events;
+        do
+            result = poll(&pfd, 1, timeoutMs);
+        while (result==-1 && errno==EINTR);
+        return result;
+    }
+ 
+// Have the scheduler wake us.
+    ev.events = EPOLLONESHOT;
+    if (events & POLLIN)
+        ev.events |= EPOLLIN;
+    if (events & POLLOUT)
+        ev.events |= EPOLLOUT;
+    ev.data.ptr = coro;
+    if (epoll_ctl(coro->sched->epollFd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        return -1;
+    result = coroWait(coro, timeoutMs);
+    epoll_ctl(coro->sched->epollFd, EPOLL_CTL_DEL, fd, NULL);
+    return result;
+}
+
+
+// ------------------------ I/O -------------------------------------
+
+// The receive or send timeout of a socket in milliseconds, or -1 if none.
+static int sockTimeoutMs(int fd, int optName)
+{   struct timeval tv;
+    socklen_t len = sizeof(tv);
+    if (getsockopt(fd, SOL_SOCKET, optName, &tv, &len)==-1 || (tv.tv_sec==0 && tv.tv_usec==0))
+        return -1;
+    return tv.tv_sec*1000 + (tv.tv_usec+999)/1000;
+}
+
+
+ssize_t csc_coro_read(int fd, void *buf, size_t count)
+{   ssize_t nRead;
+    int result;
+ 
+    if (csc_coro_self() == NULL)
+        return read(fd, buf, count);
+ 
+// Try first, and only wait if there is nothing there.
+    for (;;)
+    {   nRead = recv(fd, buf, count, MSG_DONTWAIT);
+        if (nRead >= 0 || (errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR))
+            return nRead;
+        result = csc_coro_waitFd(fd, POLLIN, sockTimeoutMs(fd,SO_RCVTIMEO));
+        if (result == 0)
+        {   errno = EAGAIN;
+            return -1;
+        }
+        else if (result < 0)
+            return -1;
+    }
+}
+
+
+ssize_t csc_coro_write(int fd, const void *buf, size_t count)
+{   const char *p = buf;
+    size_t nWritten = 0;
+    ssize_t n;
+    int result;
+    int flags = MSG_NOSIGNAL;
+ 
+    if (csc_coro_self() != NULL)
+        flags |= MSG_DONTWAIT;
+ 
+    while (nWritten < count)
+    {   n = send(fd, p+nWritten, count-nWritten, flags);
+        if (n >= 0)
+        {   nWritten += n;
+            continue;
+        }
+        else if (errno == EINTR)
+            continue;
+        else if ((errno==EAGAIN || errno==EWOULDBLOCK) && (flags&MSG_DONTWAIT))
+        {   result = csc_coro_waitFd(fd, POLLOUT, sockTimeoutMs(fd,SO_SNDTIMEO));
+            if (result == 0)
+                errno = EAGAIN;
+            if (result > 0)
+                continue;
+        }
+        break;
+    }
+    if (nWritten==0 && count>0)
+        return -1;
+    return nWritten;
+}
+
+
+static ssize_t cookieRead(void *cookie, char *buf, size_t size)
+{   return csc_coro_read((int)(intptr_t)cookie, buf, size);
+}
+
+
+static ssize_t cookieWrite(void *cookie, const char *buf, size_t size)
+{   ssize_t n = csc_coro_write((int)(intptr_t)cookie, buf, size);
+    return n<0 ? 0 : n;
+}
+
+
+static int cookieClose(void *cookie)
+{   return close((int)(intptr_t)cookie);
+}
+
+
+FILE *csc_coro_fdopen(int fd, const char *mode)
+{   cookie_io_functions_t funcs;
+    funcs.read = cookieRead;
+    funcs.write = cookieWrite;
+    funcs.seek = NULL;
+    funcs.close = cookieClose;
+    return fopencookie((void*)(intptr_t)fd, mode, funcs);
+}
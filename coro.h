@@ -0,0 +1,84 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ======= coro =========================================================
+// Coroutines, each with its own stack, run by a scheduler on one thread.
+// Code in a coroutine is written as straight line blocking code, but when
+// it would block on a socket it yields instead, and the scheduler runs
+// other coroutines until epoll() says that the socket is ready.  Many
+// thousands of connections may then be handled by one thread, each
+// written as though it had a thread to itself.
+//
+// A scheduler and its coroutines belong to the thread that runs it.  There
+// may be one scheduler on each of several threads.
+//
+// The I/O functions below may be called from anywhere.  Outside a
+// coroutine they simply block, so that code using them works unchanged in
+// a thread or a process of its own.
+// ======================================================================
+
+#ifndef csc_CORO_H
+#define csc_CORO_H 1
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "std.h"
+
+typedef struct csc_coroSched_t csc_coroSched_t;
+typedef struct csc_coro_t csc_coro_t;
+
+
+// Constructor.  Each coroutine is given a stack of 'stackSize' bytes, with
+// a guard page below it.  The memory for a stack is only used as it is
+// touched, so a generous size costs little.  Returns NULL on failure.
+csc_coroSched_t *csc_coroSched_new(size_t stackSize);
+
+// Destructor.  It should have no coroutines left, e.g. once
+// csc_coroSched_run() has returned.
+void csc_coroSched_free(csc_coroSched_t *sched);
+
+// Runs the coroutines until all have finished.  Returns csc_FALSE if
+// epoll_wait() fails.
+csc_bool_t csc_coroSched_run(csc_coroSched_t *sched);
+
+
+// Creates a coroutine to call 'fn'('arg').  It starts when the scheduler
+// next gets to it, and finishes when 'fn' returns.  May be called from
+// within another coroutine of the same scheduler.  Returns NULL on
+// failure.
+csc_coro_t *csc_coro_spawn(csc_coroSched_t *sched, void (*fn)(void *arg), void *arg);
+
+// Returns the coroutine that is running, or NULL if we are not in one.
+csc_coro_t *csc_coro_self(void);
+
+// Lets the other coroutines that are ready run first.
+void csc_coro_yield(void);
+
+// Sleeps for 'ms' milliseconds, or until woken by csc_coro_wake() if 'ms'
+// is negative.  Returns csc_TRUE if woken, or csc_FALSE if the time was up.
+csc_bool_t csc_coro_sleep(int ms);
+
+// Wakes 'coro' if it is in csc_coro_sleep().  Must be called from the same
+// thread.
+void csc_coro_wake(csc_coro_t *coro);
+
+
+// Waits until 'fd' is ready for 'events', which are POLLIN and/or POLLOUT.
+// Waits at most 'timeoutMs' milliseconds, or for ever if negative.  Returns
+// 1 if ready (or in error, or hung up), 0 if timed out, or -1 on failure.
+int csc_coro_waitFd(int fd, int events, int timeoutMs);
+
+// Like read() on a socket.  Honours the socket's receive timeout, e.g. as
+// set by csc_sock_setTimeout(), failing with EAGAIN when it expires.
+ssize_t csc_coro_read(int fd, void *buf, size_t count);
+
+// Like write() on a socket, but writes all of 'buf' unless it fails, or
+// the socket's send timeout expires.  Returns the number of bytes written,
+// or -1 if there is an error before any are.  Does not raise SIGPIPE.
+ssize_t csc_coro_write(int fd, const void *buf, size_t count);
+
+// Like fdopen(), for a socket, with the reading and writing done through
+// csc_coro_read() and csc_coro_write().  fclose() closes 'fd'.
+FILE *csc_coro_fdopen(int fd, const char *mode);
+
+#endif
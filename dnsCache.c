@@ -0,0 +1,368 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "std.h"
+#include "alloc.h"
+#include "hash.h"
+#include "isvalid.h"
+#include "dnsCache.h"
+
+#define MaxKeySize 300
+
+
+typedef int resolver_t( const char *node
+                      , const char *service
+                      , const struct addrinfo *hints
+                      , struct addrinfo **res
+                      );
+
+
+// A name, as resolved with particular hints.  Those that do not exist have
+// no addresses, and the error from getaddrinfo().
+typedef struct
+{   char *key;
+    char *node;
+    struct addrinfo hints;
+    struct addrinfo *addrs;
+    int gaiErr;
+    time_t expires;
+    csc_bool_t isRefreshing;
+} dnsEntry_t;
+
+
+// The cache, and all else here, is guarded by the lock.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static csc_hash_t *cache = NULL;
+static int ttlSecs = 0;
+static int negTtlSecs = 0;
+static int staleSecs = 0;
+static long nHits = 0;
+static long nMisses = 0;
+static long nStale = 0;
+static resolver_t *resolver = getaddrinfo;
+
+
+
+static time_t nowSecs()
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+
+// --------------------  Address lists --------------------
+
+// Copies a list of addresses, with 'portNo' in each, or the port already
+// there if negative.  Each is allocated with its socket address, so that
+// it is freed in one.
+static struct addrinfo *copyAddrs(const struct addrinfo *src, int portNo)
+{   struct addrinfo *head = NULL;
+    struct addrinfo **tail = &head;
+    struct addrinfo *ai;
+ 
+    for (; src!=NULL; src=src->ai_next)
+    {   ai = csc_ck_malloc(sizeof(struct addrinfo) + src->ai_addrlen);
+        *ai = *src;
+        ai->ai_addr = (struct sockaddr*)(ai + 1);
+        memcpy(ai->ai_addr, src->ai_addr, src->ai_addrlen);
+        ai->ai_canonname = src->ai_canonname==NULL ? NULL : csc_alloc_str(src->ai_canonname);
+        ai->ai_next = NULL;
+        if (portNo >= 0)
+        {   if (ai->ai_family == AF_INET)
+                ((struct sockaddr_in*)ai->ai_addr)->sin_port = htons(portNo);
+            else if (ai->ai_family == AF_INET6)
+                ((struct sockaddr_in6*)ai->ai_addr)->sin6_port = htons(portNo);
+        }
+        *tail = ai;
+        tail = &ai->ai_next;
+    }
+    return head;
+}
+
+
+void csc_dnsCache_freeaddrinfo(struct addrinfo *res)
+{   struct addrinfo *next;
+    for (; res!=NULL; res=next)
+    {   next = res->ai_next;
+        if (res->ai_canonname != NULL)
+            free(res->ai_canonname);
+        free(res);
+    }
+}
+
+
+// Resolves, with the result copied so that it is freed like the cached
+// ones.
+static int resolve( resolver_t *fn, const char *node, const char *service
+                  , const struct addrinfo *hints, struct addrinfo **res
+                  )
+{   struct addrinfo *raw = NULL;
+    int ret = fn(node, service, hints, &raw);
+    *res = NULL;
+    if (ret == 0)
+    {   *res = copyAddrs(raw, -1);
+        freeaddrinfo(raw);
+    }
+    return ret;
+}
+
+
+// --------------------  Entries --------------------
+
+static void dnsEntry_free(void *pt)
+{   dnsEntry_t *e = pt;
+    free(e->key);
+    free(e->node);
+    csc_dnsCache_freeaddrinfo(e->addrs);
+    free(e);
+}
+
+
+static void mkKey(char *key, const char *node, const struct addrinfo *hints)
+{   snprintf( key, MaxKeySize, "%s %d %d %d %d", node, hints->ai_family
+            , hints->ai_socktype, hints->ai_protocol, hints->ai_flags);
+}
+
+
+// Whether getaddrinfo() says that the name has no addresses, rather than
+// that it could not find out.
+static csc_bool_t isDefinite(int gaiErr)
+{   if (gaiErr == EAI_NONAME)
+        return csc_TRUE;
+#ifdef EAI_NODATA
+    if (gaiErr == EAI_NODATA)
+        return csc_TRUE;
+#endif
+    return csc_FALSE;
+}
+
+
+// Records the result of resolving.  Takes the addresses.  Must hold the
+// lock.
+static void store( const char *key, const char *node, const struct addrinfo *hints
+                 , int gaiErr, struct addrinfo *addrs
+                 )
+{   dnsEntry_t *e;
+    int secs;
+ 
+// Keep what we had if the resolver let us down, or we are not to keep it.
+    if (gaiErr == 0)
+        secs = ttlSecs;
+    else if (isDefinite(gaiErr))
+        secs = negTtlSecs;
+    else
+        secs = 0;
+    if (secs <= 0)
+    {   csc_dnsCache_freeaddrinfo(addrs);
+        return;
+    }
+ 
+// Make or update the entry.
+    if (cache == NULL)
+        cache = csc_hash_new(offsetof(dnsEntry_t,key), csc_hash_StrPtCmpr, csc_hash_StrPt, dnsEntry_free);
+    e = csc_hash_get(cache, &key);
+    if (e == NULL)
+    {   e = csc_allocOne(dnsEntry_t);
+        e->key = csc_alloc_str(key);
+        e->node = csc_alloc_str(node);
+        e->hints = *hints;
+        e->hints.ai_addr = NULL;
+        e->hints.ai_canonname = NULL;
+        e->hints.ai_next = NULL;
+        e->addrs = NULL;
+        e->isRefreshing = csc_FALSE;
+        csc_hash_addex(cache, e);
+    }
+    csc_dnsCache_freeaddrinfo(e->addrs);
+    e->addrs = addrs;
+    e->gaiErr = gaiErr;
+    e->expires = nowSecs() + secs;
+}
+
+
+// --------------------  Refreshing --------------------
+
+typedef struct
+{   char *key;
+    char *node;
+    struct addrinfo hints;
+    resolver_t *fn;
+} refresh_t;
+
+
+static void *refreshThread(void *arg)
+{   refresh_t *rf = arg;
+    struct addrinfo *addrs;
+    dnsEntry_t *e;
+    int ret;
+ 
+    ret = resolve(rf->fn, rf->node, NULL, &rf->hints, &addrs);
+    pthread_mutex_lock(&lock);
+    store(rf->key, rf->node, &rf->hints, ret, addrs);
+    if (cache!=NULL && (e=csc_hash_get(cache,&rf->key))!=NULL)
+        e->isRefreshing = csc_FALSE;
+    pthread_mutex_unlock(&lock);
+ 
+    free(rf->key);
+    free(rf->node);
+    free(rf);
+    return NULL;
+}
+
+
+// Starts looking up a stale entry again.  Must hold the lock.
+static void startRefresh(dnsEntry_t *e)
+{   pthread_attr_t attr;
+    pthread_t thread;
+    refresh_t *rf = csc_allocOne(refresh_t);
+    rf->key = csc_alloc_str(e->key);
+    rf->node = csc_alloc_str(e->node);
+    rf->hints = e->hints;
+    rf->fn = resolver;
+ 
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, refreshThread, rf) == 0)
+        e->isRefreshing = csc_TRUE;
+    else
+    {   free(rf->key);
+        free(rf->node);
+        free(rf);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+
+// --------------------  Public --------------------
+
+void csc_dnsCache_setTtl(int ttl, int negTtl, int stale)
+{   pthread_mutex_lock(&lock);
+    ttlSecs = ttl;
+    negTtlSecs = negTtl;
+    staleSecs = stale;
+    pthread_mutex_unlock(&lock);
+}
+
+
+int csc_dnsCache_getaddrinfo( const char *node
+                            , const char *service
+                            , const struct addrinfo *hints
+                            , struct addrinfo **res
+                            )
+{   char keyBuf[MaxKeySize];
+    char *key = keyBuf;
+    unsigned char bin[sizeof(struct in6_addr)];
+    struct addrinfo *addrs;
+    resolver_t *fn;
+    dnsEntry_t *e;
+    time_t now;
+    int portNo = 0;
+    int ret;
+ 
+// Numeric addresses need no resolver.
+    if ( node==NULL
+      || inet_pton(AF_INET,node,bin)==1 || inet_pton(AF_INET6,node,bin)==1
+       )
+    {   return resolve(getaddrinfo, node, service, hints, res);
+    }
+ 
+// Only names, with port numbers, are cached.
+    pthread_mutex_lock(&lock);
+    fn = resolver;
+    if ( (ttlSecs<=0 && negTtlSecs<=0)
+      || hints==NULL || strlen(node)>MaxKeySize/2
+      || (service!=NULL && !csc_isValid_int(service))
+       )
+    {   pthread_mutex_unlock(&lock);
+        return resolve(fn, node, service, hints, res);
+    }
+    if (service != NULL)
+        portNo = atoi(service);
+ 
+// Answer from the cache if we can, even if stale.
+    mkKey(keyBuf, node, hints);
+    e = cache==NULL ? NULL : csc_hash_get(cache, &key);
+    now = nowSecs();
+    if (e!=NULL && now<e->expires)
+    {   nHits++;
+        ret = e->gaiErr;
+        *res = copyAddrs(e->addrs, portNo);
+        pthread_mutex_unlock(&lock);
+        return ret;
+    }
+    if (e!=NULL && e->addrs!=NULL && now<e->expires+staleSecs)
+    {   nStale++;
+        if (!e->isRefreshing)
+            startRefresh(e);
+        *res = copyAddrs(e->addrs, portNo);
+        pthread_mutex_unlock(&lock);
+        return 0;
+    }
+    nMisses++;
+    pthread_mutex_unlock(&lock);
+ 
+// Otherwise resolve it, without holding up others meanwhile.
+    ret = resolve(fn, node, NULL, hints, &addrs);
+    pthread_mutex_lock(&lock);
+    *res = copyAddrs(addrs, portNo);
+    store(key, node, hints, ret, addrs);
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+
+int csc_dnsCache_prewarm(const char *node)
+{   struct addrinfo hints;
+    struct addrinfo *res;
+    int ret;
+ 
+// The hints used by csc_cli_setServAddr().
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_flags = AI_PASSIVE;
+    hints.ai_socktype = SOCK_STREAM;
+    ret = csc_dnsCache_getaddrinfo(node, NULL, &hints, &res);
+    csc_dnsCache_freeaddrinfo(res);
+    return ret;
+}
+
+
+void csc_dnsCache_clear()
+{   pthread_mutex_lock(&lock);
+    if (cache != NULL)
+    {   csc_hash_free(cache);
+        cache = NULL;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+void csc_dnsCache_getStats(long *hits, long *misses, long *stale)
+{   pthread_mutex_lock(&lock);
+    if (hits != NULL)
+        *hits = nHits;
+    if (misses != NULL)
+        *misses = nMisses;
+    if (stale != NULL)
+        *stale = nStale;
+    pthread_mutex_unlock(&lock);
+}
+
+
+void csc_dnsCache_setResolver(resolver_t *fn)
+{   pthread_mutex_lock(&lock);
+    resolver = fn==NULL ? getaddrinfo : fn;
+    pthread_mutex_unlock(&lock);
+}
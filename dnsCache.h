@@ -0,0 +1,73 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ======= dnsCache =====================================================
+// A cache of name resolutions, shared by all threads of the process, so
+// that connecting to the same server again does not wait on the resolver.
+// csc_cli_setServAddr() resolves through it.
+//
+// getaddrinfo() does not say how long an answer is good for, so the times
+// are set here.  A name that resolved is kept for 'ttlSecs', and one that
+// does not exist for 'negTtlSecs'.  After that, for up to 'staleSecs'
+// more, the old answer is still given, while it is looked up again on
+// another thread.  Failures that may be temporary, e.g. a resolver that
+// did not answer, are not kept, and a stale answer is kept in their place.
+//
+// The cache is off until csc_dnsCache_setTtl() turns it on, so that by
+// default names are resolved afresh every time, as getaddrinfo() would.
+// Addresses in numeric form are never cached.
+// ======================================================================
+
+#ifndef csc_DNSCACHE_H
+#define csc_DNSCACHE_H 1
+
+#include <netdb.h>
+#include "std.h"
+
+
+// Sets how long answers are kept, and so turns the cache on, or off if
+// both 'ttlSecs' and 'negTtlSecs' are 0.  Answers already cached are kept
+// for as long as they were to be.
+void csc_dnsCache_setTtl(int ttlSecs, int negTtlSecs, int staleSecs);
+
+
+// Like getaddrinfo(), but through the cache.  The service, if any, must
+// be a port number.  The result must be freed with
+// csc_dnsCache_freeaddrinfo(), not freeaddrinfo().
+int csc_dnsCache_getaddrinfo( const char *node
+                            , const char *service
+                            , const struct addrinfo *hints
+                            , struct addrinfo **res
+                            );
+
+// Frees the result of csc_dnsCache_getaddrinfo().
+void csc_dnsCache_freeaddrinfo(struct addrinfo *res);
+
+
+// Resolves 'node' into the cache ahead of need, e.g. at startup, for
+// csc_cli_setServAddr().  Returns 0 on success, or the error from
+// getaddrinfo().
+int csc_dnsCache_prewarm(const char *node);
+
+
+// Empties the cache.
+void csc_dnsCache_clear();
+
+
+// Gets counts of the lookups answered from the cache, those that were
+// not, and those answered with a stale answer while it was refreshed.
+// Any of the pointers may be NULL.
+void csc_dnsCache_getStats(long *nHits, long *nMisses, long *nStale);
+
+
+// Resolves names with 'resolver' instead of getaddrinfo(), or with
+// getaddrinfo() again if NULL.  Meant for testing.  The result of
+// 'resolver' is freed with freeaddrinfo().
+void csc_dnsCache_setResolver(
+                int (*resolver)( const char *node
+                               , const char *service
+                               , const struct addrinfo *hints
+                               , struct addrinfo **res
+                               ));
+
+#endif
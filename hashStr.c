@@ -19,9 +19,8 @@
 // csc_hash_str128() is MurmurHash3 written by Austin Appleby, and placed
 // in the public domain. The author disclaims copyright to this source code.
 //-----------------------------------------------------------------------------
-csc_hash_hval128_t csc_hash_str128(const char *key)
-{   int len = strlen(key);
-    const uint32_t seed = 10457;
+csc_hash_hval128_t csc_hash_bytes128(const void *key, int len)
+{   const uint32_t seed = 10457;
     const uint8_t *data = (const uint8_t*)key;
     const int nblocks = len / 16;
  
@@ -100,6 +99,17 @@ csc_hash_hval128_t csc_hash_str128(const char *key)
 }
 
 
+csc_hash_hval128_t csc_hash_str128(const char *key)
+{   return csc_hash_bytes128(key, strlen(key));
+}
+
+
+uint64_t csc_hash_bytes(const void *key, int len)
+{	csc_hash_hval128_t hval = csc_hash_bytes128(key, len);
+	return (uint64_t)hval.h0;
+}
+
+
 uint64_t csc_hash_str(void *key)
 {	csc_hash_hval128_t hval = csc_hash_str128((const char*)key);
 	return (uint64_t)hval.h0;
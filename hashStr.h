@@ -6,6 +6,10 @@ typedef struct
 } csc_hash_hval128_t;
 
 
+// Hashes 'len' bytes of binary data at 'key'.
+csc_hash_hval128_t csc_hash_bytes128(const void *key, int len);
+uint64_t csc_hash_bytes(const void *key, int len);
+
 // Its really a char*, coz we use strlen() to find the length of the key.
 csc_hash_hval128_t csc_hash_str128(const char *key);
 
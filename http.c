@@ -2,17 +2,31 @@
 // This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
 
 #include <ctype.h>
+#include <string.h>
 
 #include "http.h"
 #include "hash.h"
 #include "alloc.h"
 #include "isvalid.h"
-#include "dynArray.h"
 
 
-#define staticKeyword static
-csc_dynArray_headers(nameValArr, csc_nameVal)
-csc_dynArray_code(nameValArr, csc_nameVal)
+// Where a header's name and value are, in one of the message's chunks.
+typedef struct
+{   const char *name;
+    int nameLen;
+    const char *val;
+    int valLen;
+} hdrSlice_t;
+
+
+// Room for headers.  A chunk is never moved or grown, so the values that
+// csc_http_getHdr() returns stay valid until the message is freed.
+typedef struct hdrChunk_t
+{   struct hdrChunk_t *next;
+    int len;
+    int size;
+    char buf[];
+} hdrChunk_t;
 
 
 typedef struct csc_http_t
@@ -24,8 +38,12 @@ typedef struct csc_http_t
 // Start line.
     char *startFields[csc_httpSF_numSF];
  
-// Headers.
-    nameValArr_t *headers;
+// Headers.  Their names and values, each '\0' terminated, are all in
+// 'hdrChunks', newest first, and 'hdrs' says where.
+    hdrChunk_t *hdrChunks;
+    hdrSlice_t *hdrs;
+    int nHdrs;
+    int maxHdrs;
  
 // URI args: Name value string string pairs.
     csc_mapSS_t *uriArgs;
@@ -50,7 +68,10 @@ csc_http_t *csc_http_new()
         msg->startFields[i] = NULL;
  
 // Headers.
-    msg->headers = nameValArr_new();
+    msg->hdrChunks = NULL;
+    msg->hdrs = NULL;
+    msg->nHdrs = 0;
+    msg->maxHdrs = 0;
  
 // URI args.
     msg->uriArgs = csc_mapSS_new();
@@ -69,7 +90,8 @@ void csc_http_setMaxInputChars(csc_http_t *msg, int maxChars)
 
 
 void csc_http_free(csc_http_t *msg)
-{   
+{   hdrChunk_t *chunk, *next;
+ 
 // Errors.
     if (msg->errMsg)
         free(msg->errMsg);
@@ -81,8 +103,12 @@ void csc_http_free(csc_http_t *msg)
     }
  
 // Http Headers.
-    if (msg->headers)
-        nameValArr_free(msg->headers);
+    for (chunk=msg->hdrChunks; chunk!=NULL; chunk=next)
+    {   next = chunk->next;
+        free(chunk);
+    }
+    if (msg->hdrs)
+        free(msg->hdrs);
  
 // URI args.
     csc_mapSS_free(msg->uriArgs);
@@ -132,9 +158,51 @@ csc_httpErr_t csc_http_addSF(csc_http_t *msg, csc_httpSF_t fldNdx, const char *v
 }
 
 
+// Makes room for 'len' more chars for headers, in a new chunk if the
+// newest has not the room.  Returns the room.
+static char *hdrRoom(csc_http_t *msg, int len)
+{   hdrChunk_t *chunk = msg->hdrChunks;
+    int size;
+    if (chunk==NULL || chunk->len+len>chunk->size)
+    {   size = chunk==NULL ? 256 : 2*chunk->size;
+        size = csc_max(size, len);
+        chunk = csc_ck_malloc(sizeof(hdrChunk_t) + size);
+        chunk->next = msg->hdrChunks;
+        chunk->len = 0;
+        chunk->size = size;
+        msg->hdrChunks = chunk;
+    }
+    chunk->len += len;
+    return chunk->buf + chunk->len - len;
+}
+
+
+// Notes where a header is.
+static void addSlice(csc_http_t *msg, const char *name, int nameLen, const char *val, int valLen)
+{   hdrSlice_t *hdr;
+    if (msg->nHdrs == msg->maxHdrs)
+    {   msg->maxHdrs = csc_max(2*msg->maxHdrs, 16);
+        msg->hdrs = csc_ck_ralloc(msg->hdrs, msg->maxHdrs*sizeof(hdrSlice_t));
+    }
+    hdr = &msg->hdrs[msg->nHdrs++];
+    hdr->name = name;
+    hdr->nameLen = nameLen;
+    hdr->val = val;
+    hdr->valLen = valLen;
+}
+
+
 csc_httpErr_t csc_http_addHdr(csc_http_t *msg, const char *name, const char *value)
-{   csc_nameVal_t *nv = csc_nameVal_new(name, value);
-    nameValArr_add(msg->headers, nv);
+{   int nameLen, valLen;
+    char *pt;
+    if (value == NULL)
+        value = "";
+    nameLen = strlen(name);
+    valLen = strlen(value);
+    pt = hdrRoom(msg, nameLen+valLen+2);
+    memcpy(pt, name, nameLen+1);
+    memcpy(pt+nameLen+1, value, valLen+1);
+    addSlice(msg, pt, nameLen, pt+nameLen+1, valLen);
     return csc_httpErr_Ok;
 }
 
@@ -147,16 +215,17 @@ const char *csc_http_getSF(csc_http_t *msg, csc_httpSF_t fldNdx)
 
 
 const char *csc_http_getHdr(csc_http_t *msg, const char *name)
-{   const char *val = NULL;
-    csc_nameVal_t **els = msg->headers->els;
-    int nEls = msg->headers->nEls;
-    for (int i=0; i<nEls; i++)
-    {   if (csc_streq(els[i]->name, name))
-        {   val = els[i]->val;
-            break;
+{   int nameLen = strlen(name);
+    hdrSlice_t *hdr;
+    for (int i=0; i<msg->nHdrs; i++)
+    {   hdr = &msg->hdrs[i];
+        if ( hdr->nameLen == nameLen
+          && memcmp(hdr->name, name, nameLen) == 0
+           )
+        {   return hdr->val;
         }
     }
-    return val;
+    return NULL;
 }
 
 
@@ -170,294 +239,6 @@ const char *csc_http_getErrStr(csc_http_t *msg)
 }
 
 
-// ------------------------------------------------
-// ---------- Class for input of HTTP -------------
-// ------------------------------------------------
-
-typedef enum
-{   httpIn_OK = 0,
-    httpIn_done,
-    httpIn_EOF,
-    httpIn_lineTooLong,
-    httpIn_error
-} httpIn_result_t;
-
-
-typedef struct httpIn_t
-{
-// Input stream.
-    csc_ioAnyRead_t *rca;
- 
-// Characters stored reading in.
-    int nextCh;
-    int lastCh;
-    csc_bool_t isNextCh;
- 
-// Count and limit.
-    int maxChars;
-    int countChars;
-} httpIn_t;
- 
-const int httpIn_bufLen = 255;
-
-
-static httpIn_t *httpIn_new(csc_ioAnyRead_t *rca, int maxChars)
-{
-// Allocate the structure.
-    httpIn_t *hin = csc_allocOne(httpIn_t);
-    hin->rca = rca;
-    hin->nextCh = 0;
-    hin->lastCh = 0;
-    hin->isNextCh = csc_FALSE;
- 
-// Count and limit.
-    hin->maxChars = maxChars;
-    hin->countChars = 0;
- 
-// Bye.
-    return hin;
-}
-
-
-static void httpIn_free(httpIn_t *hin)
-{   free(hin);
-}
-
-
-static int httpIn_getc(httpIn_t *hin)
-{   int ch;
-    if (hin->countChars++ >= hin->maxChars)
-        ch = EOF;
-    else
-    {   ch = csc_ioAnyRead_getc(hin->rca);
-        if (ch == '\r')
-            ch = csc_ioAnyRead_getc(hin->rca);
-    }
-    return ch;
-}
-
-// The previous just ignores a single '\r' anywhere.
-// It does not bother handling continuation lines.
-// 
-// The following tries to only ignore '\r' if it is followed by a '\n'.
-// It also tries to join continued lines.
-// It turned out to be complicated, and sadly does not work too well.  It blocks.
-// To make this work, it has to be careful not to look ahead whenever it
-// has had an empty line.
-
-// static int httpIn_getc(httpIn_t *hin)
-// // Intended for http.
-// // * Replaces \r\n[\s|\t] by \s.
-// // * Replaces \n[\s|\t] by \s.
-// // * Replaces \r\n by \n.
-// // * Does not ask for the next char if it got
-// //       the end, cos that would block.
-// {    int ch = 0;
-//  
-// // Substitute saved char, if one is waiting
-//  if (hin->isNextCh)
-//  {   hin->isNextCh = csc_FALSE;
-//      ch = hin->nextCh;
-//  }
-//  else
-//  {   ch = csc_ioAnyRead_getc(hin->rca);
-//  }
-//  
-//  if (ch == '\r')
-//  {   ch = csc_ioAnyRead_getc(hin->rca);
-//      if (ch == '\n')
-//      {   ch = csc_ioAnyRead_getc(hin->rca);
-//          if (ch==' ' || ch=='\t')
-//          {   hin->lastCh = ' ';
-//          }
-//          else
-//          {   hin->nextCh = ch;
-//              hin->isNextCh = csc_TRUE;
-//              hin->lastCh = '\n';
-//          }
-//      }
-//      else
-//      {   hin->nextCh = ch;
-//          hin->isNextCh = csc_TRUE;
-//          hin->lastCh = '\r';
-//      }
-//  }
-//  else if (ch == '\n')
-//  {   ch = csc_ioAnyRead_getc(hin->rca);
-//      if (ch==' ' || ch=='\t')
-//          hin->lastCh = ' ';
-//      else
-//      {   hin->nextCh = ch;
-//          hin->isNextCh = csc_TRUE;
-//          hin->lastCh = '\n';
-//      }
-//  }
-//  else if (ch == '\t')
-//      hin->lastCh = ' ';
-//  else if (ch == -1)
-//  {   hin->nextCh = ch;
-//      hin->isNextCh = csc_TRUE;
-//      hin->lastCh = -1;
-//  }
-//  else
-//      hin->lastCh = ch;
-//  
-// // Return char.
-//  return hin->lastCh;
-// }
-
-
-static int httpIn_getline(httpIn_t *hin, csc_str_t *line)
-{   int ch;
-    csc_str_reset(line);
- 
-// Skip leading space.
-    ch = httpIn_getc(hin);
-    while (ch==' ' || ch=='\t')
-    ch = httpIn_getc(hin);
- 
-// Read in line. 
-    while (ch!=EOF && ch!='\n')
-    {   if (ch != '\r')
-            csc_str_append_ch(line, ch);
-        ch = httpIn_getc(hin);
-    }
- 
-// Trim space from end of line.
-    const char *buf = csc_str_charr(line);
-    int bufLen = csc_str_length(line);
-    while (bufLen>0 && buf[bufLen-1]==' ')
-        bufLen--;
-    csc_str_truncate(line, bufLen);
- 
-// Return result. 
-    if (ch == EOF)
-        return -1;
-    else
-        return csc_str_length(line);
-}
-
-
-static void httpIn_skipTillBlankLine(httpIn_t *hin)
-{   int prevCh = ' ';
-    int ch = '\n';
-    while (ch!=EOF && (ch!='\n' || prevCh!='\n'))
-    {   prevCh = ch;
-        ch = httpIn_getc(hin);
-        if (ch == '\r')
-            ch = httpIn_getc(hin);
-    }
-}
-
-
-static int httpIn_getwd(httpIn_t *hin, csc_str_t *word)
-{
-    int ch = httpIn_getc(hin);
-    csc_str_reset(word);
- 
-/* Skip whitespace */
-    while(isspace(ch))
-        ch = httpIn_getc(hin);
- 
-/* Deal with a possible EOF */
-    if(ch==EOF)
-        return -1;
- 
-/* read in the word */
-    while(!isspace(ch) && ch!=EOF)
-    {   csc_str_append_ch(word, ch);
-        ch = httpIn_getc(hin);
-    }
- 
-/* Return the length. */
-    return csc_str_length(word);
-}
-
-
-
-static httpIn_result_t httpIn_getHdr( httpIn_t *hin
-                                      , csc_str_t *headName
-                                      , csc_str_t *content
-                                      )
-{   httpIn_result_t result = httpIn_OK;
-    int ch;
- 
-// Resources.
-    csc_str_t *buf = csc_str_new("------ make initial size suitable to avoid unnecessary realloc -----");
- 
-// Skip whitespace.
-    ch = httpIn_getc(hin);
-    while (ch==' ')
-        ch = httpIn_getc(hin);
- 
-// Read in the head word.
-    csc_str_truncate(buf, 0); 
-    while (  ch!=-1
-          && ch!='\n'
-          && ch!=' '
-          && ch!=':'
-          )
-    {   csc_str_append_ch(buf, ch);
-        ch = httpIn_getc(hin);
-    }
- 
-// If it is empty, we are done.
-    if (csc_str_length(buf) == 0)
-    {   result = httpIn_done;
-        goto freeResources;
-    }
- 
-// Assign the header name.
-    csc_str_assign_str(headName, buf);
- 
-// Get the remainder of the line.
-    httpIn_getline(hin, buf);
-    csc_str_assign_str(content, buf);
- 
-freeResources:
-    csc_str_free(buf);
- 
-// Bye.
-    return result;
-}
-
-// ------------------------------------------------
-
-
-static csc_httpErr_t readHeaders(csc_http_t *msg, httpIn_t *hin)
-{   
-// Resources.
-    csc_str_t *headName = csc_str_new(NULL);
-    csc_str_t *content = csc_str_new(NULL);
-            
-// Read in the headers.
-    httpIn_result_t getLineResult = httpIn_OK;
-    while (getLineResult==httpIn_OK || getLineResult==csc_httpErr_LineTooLong)
-    {   getLineResult = httpIn_getHdr(hin, headName, content);
- 
-    // Set error code.
-        if (getLineResult == httpIn_error)
-            setErr(msg, csc_httpErr_syntaxErr, "Error reading header");
-        else if (getLineResult == httpIn_lineTooLong)
-            setErr(msg, csc_httpErr_LineTooLong, "Header line too long");
- 
-    // Add the header.
-        if (  getLineResult == httpIn_OK
-           || getLineResult == httpIn_lineTooLong
-           )
-        {   csc_http_addHdr(msg, csc_str_charr(headName), csc_str_charr(content));
-        }
-    }
-            
-// Free resouces.
-    csc_str_free(headName);
-    csc_str_free(content);
- 
-// Return the restlt.
-    return csc_http_getErrCode(msg);
-}
-
-
 static csc_bool_t isUrlUnres(int ch, csc_bool_t isSlashOk)
 {   csc_bool_t result;
     switch(ch)
@@ -693,36 +474,83 @@ static csc_httpErr_t parseUri(csc_http_t *msg, char *uri)
 }
 
 
-// Receive a HTTP message from whatever as a server.
-csc_httpErr_t csc_http_rcvSrv(csc_http_t *msg, csc_ioAnyRead_t *rca)
-{   int wdLen;
-    csc_httpErr_t errCode;
-    const char *wd;
- 
-// Resources.
-    csc_str_t *word = NULL;
-    char *uri = NULL;
-    httpIn_t *hin = NULL;
- 
-// Input processing.
-    hin = httpIn_new(rca, msg->maxInputChars);
+// ------------------------------------------------
+// ------------- Parsing a message head -----------
+// ------------------------------------------------
+
+int csc_http_headLen(const char *buf, int len)
+{   const char *end = buf + len;
+    const char *pt = buf;
+    const char *eol;
+    while ((eol = memchr(pt, '\n', end-pt)) != NULL)
+    {   if (eol+1<end && eol[1]=='\n')
+            return eol + 2 - buf;
+        if (eol+2<end && eol[1]=='\r' && eol[2]=='\n')
+            return eol + 3 - buf;
+        pt = eol + 1;
+    }
+    return -1;
+}
+
+
+// Returns the next word from '*pt', skipping any white space, including
+// line ends, before it.  The word is '\0' terminated in place, over the
+// char after it, and '*pt' is left after that.  Returns NULL if there is
+// no word before 'end'.
+static char *nextWord(char **pt, char *end)
+{   char *p = *pt;
+    char *wd;
+    while (p<end && isspace((unsigned char)*p))
+        p++;
+    if (p == end)
+        return NULL;
+    wd = p;
+    while (p<end && !isspace((unsigned char)*p))
+        p++;
+    *pt = p<end ? p+1 : end;
+    *p = '\0';
+    return wd;
+}
+
+
+// Returns the rest of the line from '*pt', without white space at either
+// end, '\0' terminated in place, and its length in *'len'.  '*pt' is left
+// at the start of the next line.
+static char *restOfLine(char **pt, char *end, int *len)
+{   char *p = *pt;
+    char *eol = memchr(p, '\n', end-p);
+    char *e;
+    if (eol == NULL)
+        eol = end;
+    e = eol;
+    while (p<e && (*p==' ' || *p=='\t'))
+        p++;
+    while (e>p && (e[-1]==' ' || e[-1]=='\t' || e[-1]=='\r'))
+        e--;
+    *pt = eol<end ? eol+1 : end;
+    *e = '\0';
+    *len = e - p;
+    return p;
+}
+
+
+static csc_httpErr_t parseReqLine(csc_http_t *msg, char **pt, char *end)
+{   csc_httpErr_t errCode;
+    char *wd;
+    int wdLen;
  
 // Get the method.
-    word = csc_str_new(NULL);
-    wdLen = httpIn_getwd(hin, word);
-    if (wdLen < 1)
+    wd = nextWord(pt, end);
+    if (wd == NULL)
     {   setErr( msg, csc_httpErr_UnexpectedEOF
               , "Unexpected EOF reading method of request line");
-        goto freeResources;
+        return csc_httpErr_UnexpectedEOF;
     }
  
 // Add the method.
-    wd = csc_str_charr(word);
     errCode = csc_http_addSF(msg, csc_httpSF_method, wd);
     if (errCode != csc_httpErr_Ok)
-    {   httpIn_skipTillBlankLine(hin);
-        goto freeResources;
-    }
+        return errCode;
  
 // Check the method
     if (  strcmp(wd,"GET") && strcmp(wd,"POST")   && strcmp(wd,"HEAD") 
@@ -730,208 +558,284 @@ csc_httpErr_t csc_http_rcvSrv(csc_http_t *msg, csc_ioAnyRead_t *rca)
        && strcmp(wd,"OPTIONS") 
        )
     {   setErr(msg, csc_httpErr_BadMethod, "Bad method in request line");
-        httpIn_skipTillBlankLine(hin);
-        goto freeResources;
+        return csc_httpErr_BadMethod;
     }
  
-// Get the resource URI.
-    wdLen = httpIn_getwd(hin, word);
-    if (wdLen < 1)
+// Get and add the resource URI.
+    wd = nextWord(pt, end);
+    if (wd == NULL)
     {   setErr( msg, csc_httpErr_UnexpectedEOF
               , "Unexpected EOF reading resource in request line");
-        goto freeResources;
+        return csc_httpErr_UnexpectedEOF;
     }
- 
-// Add the resource URI.
-    uri = csc_str_alloc_charr(word);
-    errCode = parseUri(msg, uri);
+    errCode = parseUri(msg, wd);
     if (errCode != csc_httpErr_Ok)
-    {   httpIn_skipTillBlankLine(hin);
-        goto freeResources;
-    }
- 
-// Check the resource URI.
-//  wd = csc_str_charr(word);
-//  if (  !csc_isValid_decentAbsPath(wd))
-//  {   setErr(msg, csc_httpErr_BadReqUri, "Bad requested resource in request line");
-//      httpIn_skipTillBlankLine(hin);
-//      goto freeResources;
-//  }
+        return errCode;
  
 // Get the protocol.
-    wdLen = httpIn_getline(hin, word);
+    wd = restOfLine(pt, end, &wdLen);
     if (wdLen < 1)
     {   setErr( msg, csc_httpErr_UnexpectedEOF
               , "Unexpected EOF reading protocol in request line");
-        goto freeResources;
+        return csc_httpErr_UnexpectedEOF;
     }
  
 // Add the protocol.
-    errCode = csc_http_addSF(msg, csc_httpSF_protocol, csc_str_charr(word));
+    errCode = csc_http_addSF(msg, csc_httpSF_protocol, wd);
     if (errCode != csc_httpErr_Ok)
-    {   httpIn_skipTillBlankLine(hin);
-        goto freeResources;
-    }
+        return errCode;
  
 // Check the protocol
-    if (strcmp(csc_str_charr(word),"HTTP/1.1") && strcmp(csc_str_charr(word),"HTTP/1.0"))
+    if (strcmp(wd,"HTTP/1.1") && strcmp(wd,"HTTP/1.0"))
     {   setErr(msg, csc_httpErr_BadProtocol, "Bad protocol in request line");
-        httpIn_skipTillBlankLine(hin);
-        goto freeResources;
+        return csc_httpErr_BadProtocol;
     }
  
-// Read in all the other headers.
-    readHeaders(msg, hin);
- 
-// Free resources.
-freeResources:
-    if (word)
-        csc_str_free(word);
-    if (uri)
-        free(uri);
-    if (hin)
-        httpIn_free(hin);
- 
-// Bye.
-    return csc_http_getErrCode(msg);
+    return csc_httpErr_Ok;
 }
 
 
-// Receive a HTTP message from whatever as a client.
-csc_httpErr_t csc_http_rcvCli(csc_http_t *msg, csc_ioAnyRead_t *rca)
-{   int wdLen;
-    csc_httpErr_t errCode;
- 
-// Resources.
-    csc_str_t *word = NULL;
-    httpIn_t *hin = NULL;
- 
-// Input processing.
-    hin = httpIn_new(rca, msg->maxInputChars);
+static csc_httpErr_t parseStatLine(csc_http_t *msg, char **pt, char *end)
+{   csc_httpErr_t errCode;
+    char *wd;
+    int wdLen;
  
 // Get the protocol.
-    word = csc_str_new(NULL);
-    wdLen = httpIn_getwd(hin, word);
-    if (wdLen < 1)
+    wd = nextWord(pt, end);
+    if (wd == NULL)
     {   setErr(msg, csc_httpErr_UnexpectedEOF, "Unexpected EOF reading status line");
-        goto freeResources;
+        return csc_httpErr_UnexpectedEOF;
     }
  
 // Add the protocol.
-    errCode = csc_http_addSF(msg, csc_httpSF_protocol, csc_str_charr(word));
+    errCode = csc_http_addSF(msg, csc_httpSF_protocol, wd);
     if (errCode != csc_httpErr_Ok)
-    {   httpIn_skipTillBlankLine(hin);
-        goto freeResources;
-    }
+        return errCode;
  
 // Check the protocol
-    if (strcmp(csc_str_charr(word),"HTTP/1.1") && strcmp(csc_str_charr(word),"HTTP/1.0"))
+    if (strcmp(wd,"HTTP/1.1") && strcmp(wd,"HTTP/1.0"))
     {   setErr(msg, csc_httpErr_BadProtocol, "Bad protocol in status line");
-        httpIn_skipTillBlankLine(hin);
-        goto freeResources;
+        return csc_httpErr_BadProtocol;
     }
  
 // Get the response code.
-    wdLen = httpIn_getwd(hin, word);
-    if (wdLen < 1)
+    wd = nextWord(pt, end);
+    if (wd == NULL)
     {   setErr(msg, csc_httpErr_UnexpectedEOF, "Unexpected EOF reading status line");
-        goto freeResources;
+        return csc_httpErr_UnexpectedEOF;
     }
  
 // Add the response code.
-    errCode = csc_http_addSF(msg, csc_httpSF_statCode, csc_str_charr(word));
+    errCode = csc_http_addSF(msg, csc_httpSF_statCode, wd);
     if (errCode != csc_httpErr_Ok)
-    {   httpIn_skipTillBlankLine(hin);
-        goto freeResources;
-    }
+        return errCode;
  
 // Check the response code
-    if (!csc_isValidRange_int(csc_str_charr(word), 100, 599, NULL))
-    {
-        setErr(msg, csc_httpErr_BadStatCode, "Bad status code in status line");
-        httpIn_skipTillBlankLine(hin);
-        goto freeResources;
+    if (!csc_isValidRange_int(wd, 100, 599, NULL))
+    {   setErr(msg, csc_httpErr_BadStatCode, "Bad status code in status line");
+        return csc_httpErr_BadStatCode;
     }
  
 // Get the reason phrase.
-    wdLen = httpIn_getline(hin, word);
+    wd = restOfLine(pt, end, &wdLen);
     if (wdLen < 1)
     {   setErr(msg, csc_httpErr_UnexpectedEOF, "Unexpected EOF 3 reading status line");
-        goto freeResources;
+        return csc_httpErr_UnexpectedEOF;
     }
  
 // Add the reason phrase.
-    errCode = csc_http_addSF(msg, csc_httpSF_reason, csc_str_charr(word));
-    if (errCode != csc_httpErr_Ok)
-    {   httpIn_skipTillBlankLine(hin);
-        goto freeResources;
-    }
- 
-// Read in all the other headers.
-    readHeaders(msg, hin);
+    return csc_http_addSF(msg, csc_httpSF_reason, wd);
+}
+
+
+// Reads the header lines from 'pt' up to an empty line, or 'end'.  They
+// are in a header chunk, and each name and value is '\0' terminated
+// in place and noted as a slice of it.
+static void parseHdrs(csc_http_t *msg, char *pt, char *end)
+{   char *name, *nameEnd, *val;
+    int valLen;
  
-// Free resources.
-freeResources:
-    if (word)
-        csc_str_free(word);
-    if (hin)
-        httpIn_free(hin);
+    while (pt < end)
+    {   
+    // The name.  If it is empty, we are done.
+        while (pt<end && *pt==' ')
+            pt++;
+        name = pt;
+        while (  pt<end && *pt!=':' && *pt!=' ' && *pt!='\t'
+              && *pt!='\r' && *pt!='\n'
+              )
+            pt++;
+        if (pt == name)
+            break;
+        nameEnd = pt;
+ 
+    // The value is the rest of the line.
+        if (pt<end && *pt!='\n')
+            pt++;
+        val = restOfLine(&pt, end, &valLen);
+        *nameEnd = '\0';
+        addSlice(msg, name, nameEnd-name, val, valLen);
+    }
+}
+
+
+// Parses the head of a message from the 'len' chars of 'buf', as a request
+// if 'isReq', or else as a response.  If 'isAll', 'buf' is all there will
+// be, so a head without a blank line is taken as it is.
+static csc_httpErr_t parseHead( csc_http_t *msg
+                              , const char *buf, int len
+                              , csc_bool_t isReq, csc_bool_t isAll
+                              , int *headLen
+                              )
+{   char *pt, *end;
+    int nSkipped = 0;
+    int hLen;
+    csc_bool_t isTooLong = len >= msg->maxInputChars;
+ 
+// Only as much as is allowed, from the first word, up to the blank line.
+    len = csc_min(len, msg->maxInputChars);
+    while (nSkipped<len && isspace((unsigned char)buf[nSkipped]))
+        nSkipped++;
+    buf += nSkipped;
+    len -= nSkipped;
+    hLen = csc_http_headLen(buf, len);
+    if (hLen<0 && !isAll)
+    {   if (headLen != NULL)
+            *headLen = -1;
+        if (isTooLong)
+            setErr(msg, csc_httpErr_LineTooLong, "Message head too long");
+        else
+            setErr(msg, csc_httpErr_Incomplete, "Message head incomplete");
+        return csc_http_getErrCode(msg);
+    }
+    if (hLen < 0)
+        hLen = len;
+    if (headLen != NULL)
+        *headLen = nSkipped + hLen;
+ 
+// Copy it into a header chunk in one go.  Its parts are then '\0'
+// terminated in place.
+    pt = hdrRoom(msg, hLen+1);
+    memcpy(pt, buf, hLen);
+    end = pt + hLen;
+    *end = '\0';
+ 
+// The start line, then the headers.
+    if (isReq)
+        parseReqLine(msg, &pt, end);
+    else
+        parseStatLine(msg, &pt, end);
+    if (csc_http_getErrCode(msg) == csc_httpErr_Ok)
+        parseHdrs(msg, pt, end);
  
-// Bye.
     return csc_http_getErrCode(msg);
 }
 
 
-// Receive a HTTP message from an input string as a client.
-csc_httpErr_t csc_http_rcvCliStr(csc_http_t *msg, const char *str)
-{   
-// Create the stream.
-    csc_ioAny_readChStr_t *inStr = csc_ioAny_readChStr_new(str);
-    csc_ioAnyRead_t *rca = csc_ioAnyRead_new(csc_ioAny_readCharStr, inStr);
- 
-// Read the HTTP.
-    csc_httpErr_t errCode = csc_http_rcvCli(msg, rca);
+csc_httpErr_t csc_http_parseSrv(csc_http_t *msg, const char *buf, int len, int *headLen)
+{   return parseHead(msg, buf, len, csc_TRUE, csc_FALSE, headLen);
+}
+
+
+csc_httpErr_t csc_http_parseCli(csc_http_t *msg, const char *buf, int len, int *headLen)
+{   return parseHead(msg, buf, len, csc_FALSE, csc_FALSE, headLen);
+}
+
+
+// ------------------------------------------------
+// --------- Reading a message head in ------------
+// ------------------------------------------------
+
+// Reads the head of a message into 'buf', which has room for 'maxChars',
+// up to and including the empty line that ends it, or to EOF, or
+// 'maxChars'.  White space before it is skipped.  Returns its length.
+static int readHeadAny(csc_ioAnyRead_t *rca, char *buf, int maxChars)
+{   int nRead = 0;
+    int n = 0;
+    int lineLen = 0;      // Not counting white space.
+    int ch;
  
-// Free the stream.
-    csc_ioAnyRead_free(rca);
-    csc_ioAny_readChStr_free(inStr);
+    while (nRead++<maxChars && (ch=csc_ioAnyRead_getc(rca))!=EOF)
+    {   if (n==0 && isspace(ch))
+            continue;
+        buf[n++] = ch;
+        if (ch == '\n')
+        {   if (lineLen == 0)
+                break;
+            lineLen = 0;
+        }
+        else if (!isspace(ch))
+            lineLen++;
+    }
+    return n;
+}
+
+
+// As readHeadAny(), but a line at a time.
+static int readHeadFILE(FILE *fin, char *buf, int maxChars)
+{   int n = 0;
+    size_t lineLen;
+    csc_bool_t isEmpty;
  
-// Return the error code.
+    while (n<maxChars && fgets(buf+n, maxChars+1-n, fin)!=NULL)
+    {   lineLen = strlen(buf+n);
+        isEmpty = strspn(buf+n, " \t\r\n") == lineLen;
+        if (isEmpty && n==0)
+            continue;
+        n += lineLen;
+        if (isEmpty && buf[n-1]=='\n')
+            break;
+    }
+    return n;
+}
+
+
+// Receive a HTTP message from whatever as a server.
+csc_httpErr_t csc_http_rcvSrv(csc_http_t *msg, csc_ioAnyRead_t *rca)
+{   char *buf = csc_allocMany(char, msg->maxInputChars+1);
+    int len = readHeadAny(rca, buf, msg->maxInputChars);
+    csc_httpErr_t errCode = parseHead(msg, buf, len, csc_TRUE, csc_TRUE, NULL);
+    free(buf);
+    return errCode;
+}
+
+
+// Receive a HTTP message from whatever as a client.
+csc_httpErr_t csc_http_rcvCli(csc_http_t *msg, csc_ioAnyRead_t *rca)
+{   char *buf = csc_allocMany(char, msg->maxInputChars+1);
+    int len = readHeadAny(rca, buf, msg->maxInputChars);
+    csc_httpErr_t errCode = parseHead(msg, buf, len, csc_FALSE, csc_TRUE, NULL);
+    free(buf);
     return errCode;
 }
 
+
+// Receive a HTTP message from an input string as a client.
+csc_httpErr_t csc_http_rcvCliStr(csc_http_t *msg, const char *str)
+{   return parseHead(msg, str, strnlen(str, msg->maxInputChars), csc_FALSE, csc_TRUE, NULL);
+}
+
 // Receive a HTTP message from an input FILE stream as a client.
 csc_httpErr_t csc_http_rcvCliFILE(csc_http_t *msg, FILE *fin)
-{   csc_ioAnyRead_t *rca = csc_ioAnyRead_new(csc_ioAny_readCharFILE, fin);
-    csc_httpErr_t errCode = csc_http_rcvCli(msg, rca);
-    csc_ioAnyRead_free(rca);
+{   char *buf = csc_allocMany(char, msg->maxInputChars+1);
+    int len = readHeadFILE(fin, buf, msg->maxInputChars);
+    csc_httpErr_t errCode = parseHead(msg, buf, len, csc_FALSE, csc_TRUE, NULL);
+    free(buf);
     return errCode;
 }
 
 
-// Receive a HTTP message from an input string as a client.
+// Receive a HTTP message from an input string as a server.
 csc_httpErr_t csc_http_rcvSrvStr(csc_http_t *msg, const char *str)
-{   
-// Create the stream.
-    csc_ioAny_readChStr_t *inStr = csc_ioAny_readChStr_new(str);
-    csc_ioAnyRead_t *rca = csc_ioAnyRead_new(csc_ioAny_readCharStr, inStr);
- 
-// Read the HTTP.
-    csc_httpErr_t errCode = csc_http_rcvSrv(msg, rca);
- 
-// Free the stream.
-    csc_ioAnyRead_free(rca);
-    csc_ioAny_readChStr_free(inStr);
- 
-// Return the error code.
-    return errCode;
+{   return parseHead(msg, str, strnlen(str, msg->maxInputChars), csc_TRUE, csc_TRUE, NULL);
 }
 
-// Receive a HTTP message from an input FILE stream as a client.
+// Receive a HTTP message from an input FILE stream as a server.
 csc_httpErr_t csc_http_rcvSrvFILE(csc_http_t *msg, FILE *fin)
-{   csc_ioAnyRead_t *rca = csc_ioAnyRead_new(csc_ioAny_readCharFILE, fin);
-    csc_httpErr_t errCode = csc_http_rcvSrv(msg, rca);
-    csc_ioAnyRead_free(rca);
+{   char *buf = csc_allocMany(char, msg->maxInputChars+1);
+    int len = readHeadFILE(fin, buf, msg->maxInputChars);
+    csc_httpErr_t errCode = parseHead(msg, buf, len, csc_TRUE, csc_TRUE, NULL);
+    free(buf);
     return errCode;
 }
 
@@ -1008,14 +912,10 @@ csc_httpErr_t csc_http_sendCli(csc_http_t *msg, csc_ioAnyWrite_t* out)
     csc_ioAnyWrite_puts(out, "\r\n");
  
 // Send each header.
-    const char *val = NULL;
-    csc_nameVal_t **els = msg->headers->els;
-    int nEls = msg->headers->nEls;
-    for (int i=0; i<nEls; i++)
-    {   csc_nameVal_t *nv = els[i];
-        csc_ioAnyWrite_puts(out, nv->name);
+    for (int i=0; i<msg->nHdrs; i++)
+    {   csc_ioAnyWrite_puts(out, msg->hdrs[i].name);
         csc_ioAnyWrite_puts(out, ": ");
-        csc_ioAnyWrite_puts(out, nv->val);
+        csc_ioAnyWrite_puts(out, msg->hdrs[i].val);
         csc_ioAnyWrite_puts(out, "\r\n");
     }
  
@@ -1085,14 +985,10 @@ csc_httpErr_t csc_http_sendSrv(csc_http_t *msg, csc_ioAnyWrite_t *out)
     csc_ioAnyWrite_puts(out, "\r\n");
  
 // Send each header.
-    const char *val = NULL;
-    csc_nameVal_t **els = msg->headers->els;
-    int nEls = msg->headers->nEls;
-    for (int i=0; i<nEls; i++)
-    {   csc_nameVal_t *nv = els[i];
-        csc_ioAnyWrite_puts(out, nv->name);
+    for (int i=0; i<msg->nHdrs; i++)
+    {   csc_ioAnyWrite_puts(out, msg->hdrs[i].name);
         csc_ioAnyWrite_puts(out, ": ");
-        csc_ioAnyWrite_puts(out, nv->val);
+        csc_ioAnyWrite_puts(out, msg->hdrs[i].val);
         csc_ioAnyWrite_puts(out, "\r\n");
     }
  
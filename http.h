@@ -38,6 +38,7 @@ typedef enum csc_httpErr_e
 ,   csc_httpErr_BadStartLine
 ,   csc_httpErr_LineTooLong
 ,   csc_httpErr_syntaxErr
+,   csc_httpErr_Incomplete
 } csc_httpErr_t;
 
 
@@ -112,6 +113,24 @@ csc_httpErr_t csc_http_rcvSrvStr(csc_http_t *msg, const char *str);
 csc_httpErr_t csc_http_rcvSrv(csc_http_t *msg, csc_ioAnyRead_t *rca);
 
 
+// Returns the length of the head of a message at the start of the 'len'
+// chars of 'buf', up to and including the blank line that ends it, or -1
+// if the blank line is not there yet.  Any body follows the head.
+int csc_http_headLen(const char *buf, int len);
+
+// Receive a HTTP message from the 'len' chars of 'buf', which need not be
+// '\0' terminated, as a client or as a server.  The head, up to the blank
+// line, or else all of 'buf', is copied into the message in one go, and
+// the headers are slices of that copy, so 'buf' may be reused at once.
+// If 'headLen' is not NULL, *'headLen' is set to the length of the head,
+// so that any body is from 'buf'+*'headLen'.  If the blank line is not
+// there yet, nothing is parsed, csc_httpErr_Incomplete is returned, and
+// *'headLen' is set to -1, or csc_httpErr_LineTooLong if it never can be,
+// within csc_http_setMaxInputChars().
+csc_httpErr_t csc_http_parseCli(csc_http_t *msg, const char *buf, int len, int *headLen);
+csc_httpErr_t csc_http_parseSrv(csc_http_t *msg, const char *buf, int len, int *headLen);
+
+
 // Sends a HTTP message, as a client, to whatever.  The 3 request line
 // parameters must have already been set.  The server will requires some
 // headers also, e.g. "Host".  Returns error code.  csc_httpErr_Ok
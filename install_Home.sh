@@ -13,6 +13,7 @@ fi
 cp std.h isvalid.h iniFile.h logger.h netCli.h netSrv.h aes.h \
    ioAny.h servBase.h fileProperties.h cstr.h alloc.h list.h \
    http.h hash.h signal.h dynArray.h json.h udp.h blacklist.h dtour.h \
+   timerWheel.h metrics.h coro.h cliPool.h dnsCache.h cliMux.h rudp.h pktRing.h pktPool.h \
    $INCDIR
 
 if [ ! -d $LIBDIR ]
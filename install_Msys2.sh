@@ -29,6 +29,7 @@
 cp std.h isvalid.h iniFile.h logger.h netCli.h netSrv.h dtour.h aes.h\
    ioAny.h servBase.h fileProperties.h cstr.h alloc.h list.h \
    http.h hash.h hashStr.h signal.h dynArray.h json.h udp.h blacklist.h \
+   timerWheel.h metrics.h coro.h cliPool.h dnsCache.h cliMux.h rudp.h pktRing.h pktPool.h \
    $INCDIR
 cp libCscNet.a $LIBDIR
 
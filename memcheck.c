@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #define EXTRA_SIZE (sizeof(memchk_type) + sizeof(csc_ulong))
 #define CKVAL (1431655765)
@@ -41,6 +42,29 @@ static memchk_type anchor = { &anchor, &anchor, (char*)NULL, 0 };
 static memchk_type *lo_adr = (memchk_type*)NULL;
 static memchk_type *hi_adr = (memchk_type*)NULL;
 
+// The allocation list is shared by all threads of the process.  The lock
+// is recursive because realloc() may call malloc() or free().  It is held
+// across fork() so that the list is consistent in the child, where it is
+// then created afresh because the child's thread does not own it.
+static pthread_mutex_t mckMutex;
+static pthread_once_t mckOnce = PTHREAD_ONCE_INIT;
+
+static void mckLock(void) { pthread_mutex_lock(&mckMutex); }
+static void mckUnlock(void) { pthread_mutex_unlock(&mckMutex); }
+
+static void mckMutexInit(void)
+{   pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&mckMutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static void mckInit(void)
+{   mckMutexInit();
+    pthread_atfork(mckLock, mckUnlock, mckMutexInit);
+}
+
 static void freecheck(memchk_type *header, int line, char *file);
 static void msg_quit(char *msg, char *file, int line);
 int csc_mck_checkmem(int flag, int line, char *file);
@@ -63,11 +87,19 @@ char *csc_mck_malloc(csc_uint size, int line, char *file)
     memchk_type *header;
     memchk_type *hi;
  
+/* Lock the allocation list. */
+    pthread_once(&mckOnce, mckInit);
+    mckLock();
+ 
 /* Get the memory. */
     if (nmlc >= mck_maxchunks)
+    {   mckUnlock();
         return NULL;
+    }
     if ((header=(memchk_type*)malloc((csc_uint)(size+EXTRA_SIZE))) == NULL)
+    {   mckUnlock();
         return NULL;
+    }
     csc_assert(!align_err(header));
  
 /* Set upper and lower boundaries. */
@@ -112,6 +144,7 @@ char *csc_mck_malloc(csc_uint size, int line, char *file)
  
 /* OK. */
     nmlc++;
+    mckUnlock();
     return block;
 }
 
@@ -142,6 +175,7 @@ void csc_mck_free(char *block, int line, char *file)
 {   memchk_type *header;
  
     header = (memchk_type*)(block - sizeof(memchk_type));
+    mckLock();
     freecheck(header, line,file);
     (header->next)->prev = header->prev;
     (header->prev)->next = header->next;
@@ -149,6 +183,7 @@ void csc_mck_free(char *block, int line, char *file)
     /* header->next = NULL; */
     free((char*)header);
     nmlc--;
+    mckUnlock();
 }
 
 
@@ -168,6 +203,7 @@ char *csc_mck_realloc(char *block, csc_uint size, int line, char *file)
 
 /* Check the old memory. */
     header = (memchk_type*)(block - sizeof(memchk_type));
+    mckLock();
     freecheck(header, line,file);
  
 /* The mark. */
@@ -176,7 +212,9 @@ char *csc_mck_realloc(char *block, csc_uint size, int line, char *file)
 /* Get the memory. */
     header = (memchk_type*)realloc((char*)header, (csc_uint)(size+EXTRA_SIZE));
     if (header == NULL)
+    {   mckUnlock();
         return NULL;
+    }
  
 /* Set upper and lower boundaries. */
     hi = (memchk_type*)((char*)header + size + EXTRA_SIZE);
@@ -200,6 +238,7 @@ char *csc_mck_realloc(char *block, csc_uint size, int line, char *file)
  
  
 /* OK. */
+    mckUnlock();
     return block;
 }
 
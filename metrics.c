@@ -0,0 +1,254 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "std.h"
+#include "cstr.h"
+#include "metrics.h"
+
+#define metNameSize 64
+#define metHelpSize 160
+
+#define metType_Counter 0
+#define metType_Gauge 1
+#define metType_Histogram 2
+
+// Histogram buckets.  Values below hgSub each have their own bucket.
+// After that, each power of two from 2^hgSubBits up to 2^hgMaxExp is
+// split into hgSub buckets.
+#define hgSubBits 2
+#define hgSub (1<<hgSubBits)
+#define hgMaxExp 26
+#define hgNumBuckets (hgSub + (hgMaxExp-hgSubBits)*hgSub)
+
+// Each metric has its own cache lines, so that processes updating
+// different metrics do not contend.
+struct csc_metric_t
+{   int64_t value;             // Counter or gauge value.  Histogram count.
+    uint64_t sum;              // Histogram only.  Sum of values.
+    uint64_t buckets[hgNumBuckets];  // Histogram only.  Not cumulative.
+    double scale;              // Histogram only.
+    int type;
+    char name[metNameSize];
+    char help[metHelpSize];
+} __attribute__((aligned(64)));
+
+
+// All of this is in the shared memory.
+struct csc_metrics_t
+{   size_t size;               // Of the mapping.
+    int maxMetrics;
+    int nMetrics;
+    csc_metric_t metrics[];
+};
+
+
+// ------------------------ The registry ----------------------------
+
+csc_metrics_t *csc_metrics_new(int maxMetrics)
+{   csc_metrics_t *reg;
+    size_t size;
+ 
+    if (maxMetrics < 1)
+        maxMetrics = 1;
+    size = sizeof(csc_metrics_t) + maxMetrics*sizeof(csc_metric_t);
+    reg = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (reg == MAP_FAILED)
+        return NULL;
+ 
+// The mapping starts zeroed.
+    reg->size = size;
+    reg->maxMetrics = maxMetrics;
+    reg->nMetrics = 0;
+    return reg;
+}
+
+
+void csc_metrics_free(csc_metrics_t *reg)
+{   munmap(reg, reg->size);
+}
+
+
+// Prometheus metric names are [a-zA-Z_:][a-zA-Z0-9_:]*.
+static csc_bool_t isValidName(const char *name)
+{   const char *p;
+    if (name==NULL || *name=='\0' || strlen(name)>=metNameSize)
+        return csc_FALSE;
+    if (isdigit((unsigned char)*name))
+        return csc_FALSE;
+    for (p=name; *p!='\0'; p++)
+    {   if (!isalnum((unsigned char)*p) && *p!='_' && *p!=':')
+            return csc_FALSE;
+    }
+    return csc_TRUE;
+}
+
+
+static csc_metric_t *addMetric(csc_metrics_t *reg, const char *name, const char *help, int type)
+{   csc_metric_t *metric;
+    int i;
+ 
+// Check.
+    if (!isValidName(name) || reg->nMetrics==reg->maxMetrics)
+        return NULL;
+    for (i=0; i<reg->nMetrics; i++)
+    {   if (csc_streq(reg->metrics[i].name, name))
+            return NULL;
+    }
+ 
+// Add it.
+    metric = &reg->metrics[reg->nMetrics++];
+    metric->type = type;
+    metric->scale = 1;
+    csc_strncpy(metric->name, name, metNameSize-1);
+    csc_strncpy(metric->help, help ? help : "", metHelpSize-1);
+    return metric;
+}
+
+
+csc_metric_t *csc_metrics_counter(csc_metrics_t *reg, const char *name, const char *help)
+{   return addMetric(reg, name, help, metType_Counter);
+}
+
+
+csc_metric_t *csc_metrics_gauge(csc_metrics_t *reg, const char *name, const char *help)
+{   return addMetric(reg, name, help, metType_Gauge);
+}
+
+
+csc_metric_t *csc_metrics_histogram( csc_metrics_t *reg, const char *name
+                                   , const char *help, double scale)
+{   csc_metric_t *metric = addMetric(reg, name, help, metType_Histogram);
+    if (metric)
+        metric->scale = scale;
+    return metric;
+}
+
+
+// ------------------------ Updating --------------------------------
+
+void csc_metric_add(csc_metric_t *metric, int64_t n)
+{   if (metric)
+        __atomic_add_fetch(&metric->value, n, __ATOMIC_RELAXED);
+}
+
+
+void csc_metric_set(csc_metric_t *metric, int64_t n)
+{   if (metric)
+        __atomic_store_n(&metric->value, n, __ATOMIC_RELAXED);
+}
+
+
+// The bucket for 'value', or hgNumBuckets if it is too large for any.
+static int hgBucket(uint64_t value)
+{   int exp;
+    if (value < hgSub)
+        return value;
+    exp = 63 - __builtin_clzll(value);
+    if (exp >= hgMaxExp)
+        return hgNumBuckets;
+    return hgSub + (exp-hgSubBits)*hgSub + ((value >> (exp-hgSubBits)) & (hgSub-1));
+}
+
+
+// The largest value that goes in bucket 'iBucket'.
+static uint64_t hgBucketMax(int iBucket)
+{   int exp, sub;
+    if (iBucket < hgSub)
+        return iBucket;
+    exp = (iBucket-hgSub)/hgSub + hgSubBits;
+    sub = (iBucket-hgSub)%hgSub;
+    return ((uint64_t)(hgSub+sub+1) << (exp-hgSubBits)) - 1;
+}
+
+
+void csc_metric_observe(csc_metric_t *metric, uint64_t value)
+{   int iBucket;
+    if (metric == NULL)
+        return;
+    iBucket = hgBucket(value);
+    if (iBucket < hgNumBuckets)
+        __atomic_add_fetch(&metric->buckets[iBucket], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&metric->sum, value, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&metric->value, 1, __ATOMIC_RELAXED);
+}
+
+
+int64_t csc_metric_get(const csc_metric_t *metric)
+{   if (metric == NULL)
+        return 0;
+    return __atomic_load_n(&metric->value, __ATOMIC_RELAXED);
+}
+
+
+// ------------------------ Output ----------------------------------
+
+// Help text escapes backslashes and newlines.
+static void writeHelp(csc_str_t *out, const char *help)
+{   const char *p;
+    for (p=help; *p!='\0'; p++)
+    {   if (*p == '\\')
+            csc_str_append(out, "\\\\");
+        else if (*p == '\n')
+            csc_str_append(out, "\\n");
+        else
+            csc_str_append_ch(out, *p);
+    }
+}
+
+
+static void writeHistogram(csc_str_t *out, const csc_metric_t *metric)
+{   uint64_t cumulative = 0;
+    int64_t count;
+    int iBucket;
+ 
+// Each bucket counts all the values up to its limit.
+    for (iBucket=0; iBucket<hgNumBuckets; iBucket++)
+    {   cumulative += __atomic_load_n(&metric->buckets[iBucket], __ATOMIC_RELAXED);
+        csc_str_append_f( out, "%s_bucket{le=\"%.9g\"} %llu\n", metric->name
+                        , hgBucketMax(iBucket)*metric->scale
+                        , (unsigned long long)cumulative);
+    }
+ 
+// Values may be counted while we write, so keep the total consistent.
+    count = __atomic_load_n(&metric->value, __ATOMIC_RELAXED);
+    if (count < (int64_t)cumulative)
+        count = cumulative;
+    csc_str_append_f(out, "%s_bucket{le=\"+Inf\"} %lld\n", metric->name, (long long)count);
+    csc_str_append_f( out, "%s_sum %.9g\n", metric->name
+                    , __atomic_load_n(&metric->sum, __ATOMIC_RELAXED)*metric->scale);
+    csc_str_append_f(out, "%s_count %lld\n", metric->name, (long long)count);
+}
+
+
+void csc_metrics_write(csc_metrics_t *reg, csc_str_t *out)
+{   static const char *typeNames[] = {"counter", "gauge", "histogram"};
+    const csc_metric_t *metric;
+    int i;
+ 
+    for (i=0; i<reg->nMetrics; i++)
+    {   metric = &reg->metrics[i];
+        if (metric->help[0] != '\0')
+        {   csc_str_append_many(out, "# HELP ", metric->name, " ", NULL);
+            writeHelp(out, metric->help);
+            csc_str_append_ch(out, '\n');
+        }
+        csc_str_append_many(out, "# TYPE ", metric->name, " ", typeNames[metric->type], "\n", NULL);
+        if (metric->type == metType_Histogram)
+            writeHistogram(out, metric);
+        else
+            csc_str_append_f(out, "%s %lld\n", metric->name, (long long)csc_metric_get(metric));
+    }
+}
+
+
+uint64_t csc_metrics_nowUs(void)
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
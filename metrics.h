@@ -0,0 +1,76 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ======= metrics ======================================================
+// A registry of counters, gauges and histograms, for reporting how a
+// server is doing, e.g. to Prometheus.
+//
+// The registry lives in memory that is shared with any processes forked
+// after it was created, so that the workers of a forking server all add
+// to the same metrics.  Updating a metric is a single atomic operation,
+// with no lock, so it may be done freely from any thread or process.
+// Metrics must be registered before any threads are started or processes
+// forked.
+//
+// A histogram counts whole number values, e.g. microseconds, in buckets
+// that are log-linear: each power of two is split into four equal
+// buckets, so that any value is placed to within 25%, from 0 up to 2^26.
+// Larger values are only counted in the "+Inf" bucket.
+// ======================================================================
+
+#ifndef csc_METRICS_H
+#define csc_METRICS_H 1
+
+#include <stdint.h>
+#include "std.h"
+#include "cstr.h"
+
+typedef struct csc_metrics_t csc_metrics_t;
+typedef struct csc_metric_t csc_metric_t;
+
+
+// Constructor.  The registry holds up to 'maxMetrics' metrics.  Returns
+// NULL on failure.
+csc_metrics_t *csc_metrics_new(int maxMetrics);
+
+// Destructor.  Each process that has the registry should free it.  The
+// metrics belonging to it may not be used afterwards.
+void csc_metrics_free(csc_metrics_t *reg);
+
+
+// Register a metric.  'name' must be a valid Prometheus metric name, and
+// 'help' describes it.  Returns NULL if the name is invalid, is already
+// registered, or the registry is full.  The functions that update or read
+// a metric do nothing with a NULL metric, so a failure to register does
+// not need to be handled where the metric is used.
+csc_metric_t *csc_metrics_counter(csc_metrics_t *reg, const char *name, const char *help);
+csc_metric_t *csc_metrics_gauge(csc_metrics_t *reg, const char *name, const char *help);
+
+// As above, but for a histogram.  Each value is multiplied by 'scale' in
+// the output, e.g. 1e-6 for values in microseconds to be shown in seconds.
+csc_metric_t *csc_metrics_histogram( csc_metrics_t *reg, const char *name
+                                   , const char *help, double scale);
+
+
+// Adds 'n' to a counter or gauge.  'n' may only be negative for a gauge.
+void csc_metric_add(csc_metric_t *metric, int64_t n);
+
+// Sets a gauge to 'n'.
+void csc_metric_set(csc_metric_t *metric, int64_t n);
+
+// Counts 'value' in a histogram.
+void csc_metric_observe(csc_metric_t *metric, uint64_t value);
+
+// Returns the value of a counter or gauge, or the number of values that a
+// histogram has counted.  Returns 0 for a NULL metric.
+int64_t csc_metric_get(const csc_metric_t *metric);
+
+
+// Appends all the metrics to 'out', in the Prometheus text format.
+void csc_metrics_write(csc_metrics_t *reg, csc_str_t *out);
+
+// Returns the time in microseconds from a clock that does not jump, for
+// timing things to be counted in a histogram.
+uint64_t csc_metrics_nowUs(void);
+
+#endif
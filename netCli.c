@@ -12,15 +12,21 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "std.h"
 #include "alloc.h"
 #include "isvalid.h"
+#include "dnsCache.h"
 #include "netCli.h"
 
 #define MinPortNo 1
 #define MaxPortNo 65535
 #define MaxPortNoStrSize 5
+#define MaxAttempts 16
 
 
 typedef struct csc_cli_t
@@ -28,6 +34,8 @@ typedef struct csc_cli_t
     int portNo;
     struct addrinfo *servAddresses; 
     struct addrinfo sockHints;
+    csc_cli_attempt_t attempts[MaxAttempts];
+    int nAttempts;
 } csc_cli_t ;
 
 
@@ -38,6 +46,7 @@ csc_cli_t *csc_cli_new()
     csc_cli_t *this = csc_allocOne(csc_cli_t);
     this->errMsg = NULL;
     this->servAddresses = NULL; 
+    this->nAttempts = 0;
  
 // Return the goods.
     return this;
@@ -81,10 +90,10 @@ int csc_cli_setServAddr(csc_cli_t *this, const char *addr, int portNo)
  
 // Free old address resolution results
     if (this->servAddresses != NULL)
-        freeaddrinfo(this->servAddresses);
+        csc_dnsCache_freeaddrinfo(this->servAddresses);
  
-// Resolve the address.
-    result = getaddrinfo(addr,portStr,&this->sockHints,&this->servAddresses);
+// Resolve the address, through the cache.
+    result = csc_dnsCache_getaddrinfo(addr,portStr,&this->sockHints,&this->servAddresses);
     if (result != 0)
     {   setErrMsg(this, csc_alloc_str3("netcli_setServAddr(): getaddrinfo():"
                                   , gai_strerror(result), NULL));
@@ -118,6 +127,7 @@ int csc_cli_connect(csc_cli_t *this)
     result = connect(sockfd, res->ai_addr, res->ai_addrlen);
     if (result == -1)
     {   setErrMsg(this, csc_alloc_str3("netcli_connect(): ", strerror(errno), NULL));
+        close(sockfd);
         return -1;
     }
  
@@ -125,6 +135,180 @@ int csc_cli_connect(csc_cli_t *this)
 }
 
 
+static int64_t nowMs()
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+
+// Orders the addresses alternately by family, starting with the family of
+// the first.  Returns the number of them.
+static int orderAddrs(struct addrinfo *addrs, struct addrinfo **ordered)
+{   struct addrinfo *first[MaxAttempts], *other[MaxAttempts];
+    int nFirst=0, nOther=0, n=0, i;
+ 
+    for (struct addrinfo *res=addrs; res!=NULL; res=res->ai_next)
+    {   if (res->ai_family == addrs->ai_family)
+        {   if (nFirst < MaxAttempts)
+                first[nFirst++] = res;
+        }
+        else if (nOther < MaxAttempts)
+            other[nOther++] = res;
+    }
+    for (i=0; n<MaxAttempts && (i<nFirst || i<nOther); i++)
+    {   if (i < nFirst)
+            ordered[n++] = first[i];
+        if (i<nOther && n<MaxAttempts)
+            ordered[n++] = other[i];
+    }
+    return n;
+}
+
+
+// Starts a non blocking connection to 'res', and records the attempt.
+// Returns the socket, connected or connecting, or -1 if it failed at once.
+static int startAttempt(csc_cli_t *this, struct addrinfo *res, int64_t startMs)
+{   csc_cli_attempt_t *at = &this->attempts[this->nAttempts++];
+    int fd;
+ 
+    at->startMs = (int)(nowMs() - startMs);
+    at->elapsedMs = 0;
+    at->errNo = EINPROGRESS;
+    if (getnameinfo( res->ai_addr, res->ai_addrlen, at->ip, sizeof(at->ip)
+                   , NULL, 0, NI_NUMERICHOST) != 0)
+        strcpy(at->ip, "?");
+ 
+    fd = socket(res->ai_family, res->ai_socktype|SOCK_NONBLOCK, res->ai_protocol);
+    if (fd < 0)
+    {   at->errNo = errno;
+        return -1;
+    }
+    if (connect(fd, res->ai_addr, res->ai_addrlen) == 0)
+        at->errNo = 0;
+    else if (errno != EINPROGRESS)
+    {   at->errNo = errno;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+// Records how an attempt ended.
+static void endAttempt(csc_cli_t *this, int iAttempt, int errNo, int64_t startMs)
+{   csc_cli_attempt_t *at = &this->attempts[iAttempt];
+    at->errNo = errNo;
+    at->elapsedMs = (int)(nowMs() - startMs) - at->startMs;
+}
+
+
+int csc_cli_connectTimeout(csc_cli_t *this, int timeoutMs)
+{   struct addrinfo *ordered[MaxAttempts];
+    struct pollfd pfds[MaxAttempts];
+    int iAttempt[MaxAttempts];
+    int64_t startMs = nowMs();
+    int64_t now = startMs;
+    int64_t nextMs = startMs;
+    int nAddrs, iNext=0, nActive=0, winner=-1, lastErr=ETIMEDOUT;
+    int waitMs, soErr, i, fd;
+    socklen_t soErrLen;
+ 
+    this->nAttempts = 0;
+    if (this->servAddresses == NULL)
+    {   setErrMsg(this, csc_alloc_str("netcli_connectTimeout(): No server address"));
+        return -1;
+    }
+    nAddrs = orderAddrs(this->servAddresses, ordered);
+ 
+    while (winner < 0)
+    {
+    // Start the next attempt when due, or at once if none is in progress.
+        if (iNext<nAddrs && (now>=nextMs || nActive==0))
+        {   fd = startAttempt(this, ordered[iNext++], startMs);
+            if (fd < 0)
+            {   lastErr = this->attempts[this->nAttempts-1].errNo;
+                nextMs = now;
+            }
+            else
+            {   pfds[nActive].fd = fd;
+                pfds[nActive].events = POLLOUT;
+                pfds[nActive].revents = 0;
+                iAttempt[nActive++] = this->nAttempts - 1;
+                nextMs = now + csc_cli_AttemptDelayMs;
+                if (this->attempts[this->nAttempts-1].errNo == 0)
+                {   winner = nActive - 1;
+                    endAttempt(this, iAttempt[winner], 0, startMs);
+                    break;
+                }
+            }
+            now = nowMs();
+            continue;
+        }
+ 
+    // Out of addresses or time.
+        if (nActive==0 || (timeoutMs>=0 && now-startMs>=timeoutMs))
+            break;
+ 
+    // Wait for a connection, the next attempt, or the end.
+        waitMs = -1;
+        if (timeoutMs >= 0)
+            waitMs = (int)(startMs + timeoutMs - now);
+        if (iNext<nAddrs && (waitMs<0 || nextMs-now<waitMs))
+            waitMs = (int)(nextMs - now);
+        if (poll(pfds, nActive, waitMs) < 0)
+        {   if (errno == EINTR)  // Nothing has finished.  Wait again.
+            {   now = nowMs();
+                continue;
+            }
+            lastErr = errno;
+            break;
+        }
+        now = nowMs();
+ 
+    // See which have finished.
+        for (i=0; i<nActive && winner<0; i++)
+        {   if (pfds[i].revents == 0)
+                continue;
+            soErr = 0;
+            soErrLen = sizeof(soErr);
+            if (getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &soErr, &soErrLen) < 0)
+                soErr = errno;
+            endAttempt(this, iAttempt[i], soErr, startMs);
+            if (soErr == 0)
+                winner = i;
+            else
+            {   lastErr = soErr;
+                close(pfds[i].fd);
+                pfds[i] = pfds[nActive-1];
+                iAttempt[i] = iAttempt[nActive-1];
+                nActive--;
+                i--;
+                nextMs = now;
+            }
+        }
+    }
+ 
+// Abandon the others.
+    for (i=0; i<nActive; i++)
+    {   if (i != winner)
+        {   endAttempt(this, iAttempt[i], winner>=0 ? ECANCELED : ETIMEDOUT, startMs);
+            close(pfds[i].fd);
+        }
+    }
+ 
+    if (winner < 0)
+    {   setErrMsg(this, csc_alloc_str3("netcli_connectTimeout(): ", strerror(lastErr), NULL));
+        return -1;
+    }
+ 
+// Hand it over blocking, like csc_cli_connect().
+    fd = pfds[winner].fd;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    return fd;
+}
+
+
 int csc_cli_mkConn(csc_cli_t *cli, const char *addr, int portNo)
 {   if (!csc_cli_setServAddr(cli, addr, portNo))
         return -1;
@@ -141,7 +325,7 @@ void csc_cli_free(csc_cli_t *this)
     
 // Free the address resolution results
     if (this->servAddresses != NULL)
-        freeaddrinfo(this->servAddresses);
+        csc_dnsCache_freeaddrinfo(this->servAddresses);
  
 // Free the parent structure.
     free(this);
@@ -153,4 +337,16 @@ const char *csc_cli_getErrMsg(const csc_cli_t *this)
 }
 
 
+int csc_cli_getNumAttempts(const csc_cli_t *this)
+{   return this->nAttempts;
+}
+
+
+const csc_cli_attempt_t *csc_cli_getAttempt(const csc_cli_t *this, int iAttempt)
+{   if (iAttempt<0 || iAttempt>=this->nAttempts)
+        return NULL;
+    return &this->attempts[iAttempt];
+}
+
+
 #endif
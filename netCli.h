@@ -25,6 +25,9 @@ csc_cli_t *csc_cli_new();
 // e.g. "2001:0db8:c9d2:0012:0000:0000:0000:0051" or
 // "2001:db8:c9d2:12::51".
 // 
+// Names are resolved through the cache of dnsCache.h, once it is turned on
+// with csc_dnsCache_setTtl().
+// 
 // Returns 1 on success, and 0 on failure.  Use csc_cli_getErrMsg() 
 // to get details of failure.
 int csc_cli_setServAddr( csc_cli_t *cli
@@ -41,6 +44,23 @@ int csc_cli_setServAddr( csc_cli_t *cli
 int csc_cli_connect(csc_cli_t *cli);
 
 
+// Like csc_cli_connect(), but tries each of the addresses found by
+// csc_cli_setServAddr(), and gives up after 'timeoutMs' milliseconds, or
+// never if negative.  The addresses are tried alternately IPv6 and IPv4,
+// starting with the family of the first, and each attempt is started
+// csc_cli_AttemptDelayMs after the one before, or as soon as that fails, so
+// that one dead route does not hold up the others (RFC 8305).  The first
+// to connect wins, and the others are abandoned.  The socket returned is
+// blocking, as from csc_cli_connect().
+// 
+// Returns a file descriptor on success, and -1 on failure.  Use
+// csc_cli_getErrMsg() to get details of failure, and
+// csc_cli_getAttempt() to get details of each attempt.
+int csc_cli_connectTimeout(csc_cli_t *cli, int timeoutMs);
+
+#define csc_cli_AttemptDelayMs 250
+
+
 // Combines csc_cli_setServAddr() and csc_cli_connect().
 // Returns a file descriptor on success, and -1 on failure.  Use
 // csc_cli_getErrMsg() to get details of failure.
@@ -59,6 +79,31 @@ void csc_cli_free(csc_cli_t *cli);
 const char *csc_cli_getErrMsg(const csc_cli_t *cli);
 
 
+// ---------------------  Timing of connection attempts ------------------
+
+#define csc_cli_IpStrSize 46
+
+// An attempt by csc_cli_connectTimeout() to connect to one address.
+typedef struct
+{   char ip[csc_cli_IpStrSize];   // The address tried.
+    int startMs;                  // When started, after the call began.
+    int elapsedMs;                // How long it took to succeed or fail.
+    int errNo;                    // 0 if it connected.  Otherwise the errno
+                                  // from connect(), or ETIMEDOUT if the
+                                  // time ran out, or ECANCELED if another
+                                  // attempt connected first.
+} csc_cli_attempt_t;
+
+// Returns the number of attempts made by the last call to
+// csc_cli_connectTimeout().
+int csc_cli_getNumAttempts(const csc_cli_t *cli);
+
+// Returns the iAttempt'th attempt made by the last call to
+// csc_cli_connectTimeout(), in the order started.  Returns NULL if there is
+// no such attempt.  Valid until the next non const method call.
+const csc_cli_attempt_t *csc_cli_getAttempt(const csc_cli_t *cli, int iAttempt);
+
+
 // ---------------------  Might not need ------------------
 
 // TODO
@@ -6,13 +6,18 @@
 // ===============================================
 
 
+#define _GNU_SOURCE  // For accept4().
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <netdb.h>
 #include <errno.h>
 #include <sys/wait.h>
@@ -33,9 +38,14 @@ typedef struct csc_srv_t
     int portNo;
     struct addrinfo *servAddresses; 
     struct addrinfo sockHints;
-    struct sockaddr cliDetails;
+    struct sockaddr_storage cliDetails;
+    socklen_t cliDetailsSize;
     char cliAddr[INET6_ADDRSTRLEN+1];
+    csc_bool_t isCliAddrSet;      // cliAddr is formatted for this connection.
     int listenSock;
+    csc_bool_t isListenNonBlock;  // Made non-blocking by csc_srv_acceptMany().
+    csc_bool_t isReusePort;
+    csc_srv_sockOpts_t sockOpts;
 } csc_srv_t ;
 
 
@@ -46,6 +56,11 @@ csc_srv_t *csc_srv_new()
     csc_srv_t *this = csc_allocOne(csc_srv_t);
     this->errMsg = NULL;
     this->servAddresses = NULL; 
+    this->isCliAddrSet = csc_FALSE;
+    this->listenSock = -1;
+    this->isListenNonBlock = csc_FALSE;
+    this->isReusePort = csc_FALSE;
+    csc_srv_sockOptsInit(&this->sockOpts);
  
 // Return the goods.
     return this;
@@ -64,6 +79,31 @@ const char *csc_srv_getErrMsg(const csc_srv_t *this)
 }
 
 
+// Sets one option, if it is wanted.
+static csc_bool_t setOpt(csc_srv_t *this, int sockfd, int level, int optName, const char *name, int val)
+{   if (val == 0)
+        return csc_TRUE;
+    if (setsockopt(sockfd, level, optName, &val, sizeof(val)) != 0)
+    {   setErrMsg(this, csc_alloc_str7("setsockopt(", name, "):", strerror(errno), NULL, NULL, NULL));
+        return csc_FALSE;
+    }
+    return csc_TRUE;
+}
+
+
+// Sets the options for the listening socket, and those that its
+// connections inherit.
+static csc_bool_t setListenOpts(csc_srv_t *this, int sockfd)
+{   const csc_srv_sockOpts_t *opts = &this->sockOpts;
+    return setOpt(this, sockfd, SOL_SOCKET, SO_RCVBUF, "SO_RCVBUF", opts->rcvBufSize)
+        && setOpt(this, sockfd, SOL_SOCKET, SO_SNDBUF, "SO_SNDBUF", opts->sndBufSize)
+        && setOpt(this, sockfd, SOL_SOCKET, SO_BUSY_POLL, "SO_BUSY_POLL", opts->busyPollUs)
+        && setOpt(this, sockfd, IPPROTO_TCP, TCP_NODELAY, "TCP_NODELAY", opts->isNoDelay)
+        && setOpt(this, sockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, "TCP_DEFER_ACCEPT", opts->deferAcceptSecs)
+        && setOpt(this, sockfd, IPPROTO_TCP, TCP_FASTOPEN, "TCP_FASTOPEN", opts->fastOpenQueue);
+}
+
+
 int csc_srv_setAddr(csc_srv_t *this, const char *addr, int portNo, int backlog)
 {   int result;
     char portStr[MaxPortNoStrSize + 1];
@@ -109,6 +149,21 @@ int csc_srv_setAddr(csc_srv_t *this, const char *addr, int portNo, int backlog)
     }
     this->listenSock = sockfd;
  
+// Share the port with other listening sockets.
+    if (this->isReusePort)
+    {   int isOn = 1;
+        result = setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &isOn, sizeof(isOn));
+        if (result != 0)
+        {   setErrMsg(this, csc_alloc_str3("setsockopt(SO_REUSEPORT):", strerror(errno), NULL));
+            return 0;
+        }
+    }
+ 
+// Options, before listening, so that the buffer sizes are known when
+// window scaling is agreed with each client.
+    if (!setListenOpts(this, sockfd))
+        return 0;
+ 
 // Bind the socket to the address.
     result = bind(sockfd, addrInfo->ai_addr, addrInfo->ai_addrlen);
     if (result != 0)
@@ -130,43 +185,282 @@ int csc_srv_setAddr(csc_srv_t *this, const char *addr, int portNo, int backlog)
 }
 
 
+int csc_srv_adoptListenSock(csc_srv_t *this, int sockfd)
+{   int isListening = 0;
+    socklen_t optLen = sizeof(isListening);
+ 
+// It must be a listening socket.
+    if (getsockopt(sockfd, SOL_SOCKET, SO_ACCEPTCONN, &isListening, &optLen) != 0)
+    {   setErrMsg(this, csc_alloc_str3("getsockopt(SO_ACCEPTCONN):", strerror(errno), NULL));
+        return 0;
+    }
+    if (!isListening)
+    {   setErrMsg(this, csc_alloc_str("netSrv: Adopted socket is not listening"));
+        return 0;
+    }
+ 
+// Leave it blocking or not, as it is.  The flag is shared by every
+// descriptor for the socket, and the last owner may still be accepting on
+// it.
+    this->isListenNonBlock = (fcntl(sockfd, F_GETFL) & O_NONBLOCK) != 0;
+ 
+// Take it.
+    if (this->listenSock != -1)
+        close(this->listenSock);
+    this->listenSock = sockfd;
+    return 1;
+}
+
+
 int csc_srv_accept(csc_srv_t *this)
-{   int cliDetailsSize = sizeof(this->cliDetails);
-    int rwSock;
+{   int rwSock;
  
 // Accept the connection.
-    rwSock = accept(this->listenSock, &this->cliDetails, &cliDetailsSize);
+    this->isCliAddrSet = csc_FALSE;
+    this->cliDetailsSize = sizeof(this->cliDetails);
+    rwSock = accept( this->listenSock, (struct sockaddr*)&this->cliDetails
+                   , &this->cliDetailsSize);
     if (rwSock == -1)
-    {   setErrMsg(this, csc_alloc_str3("accept:", strerror(errno), NULL));
-        if (errno == EINTR)
+    {   int err = errno;
+        setErrMsg(this, csc_alloc_str3("accept:", strerror(err), NULL));
+        if (err == EINTR)
             rwSock = -2;
+        else if (err==EAGAIN || err==EWOULDBLOCK)
+            rwSock = -3;
     }
+    else
+        csc_srv_tuneAccepted(this, rwSock);
  
 // Return the socket or error indication.
     return rwSock;
 }
 
 
+int csc_srv_acceptMany( csc_srv_t *this
+                      , csc_srv_accepted_t *accepted
+                      , int maxAccepted
+                      , int sockFlags
+                      , csc_bool_t isWait
+                      )
+{   struct pollfd pfd;
+    int nAccepted = 0;
+    int rwSock, err;
+ 
+// Make the listening socket non-blocking, once only.
+    if (!this->isListenNonBlock)
+    {   fcntl(this->listenSock, F_SETFL, fcntl(this->listenSock, F_GETFL) | O_NONBLOCK);
+        this->isListenNonBlock = csc_TRUE;
+    }
+ 
+// Take connections until none are left waiting.
+    while (nAccepted < maxAccepted)
+    {   accepted[nAccepted].addrLen = sizeof(accepted[nAccepted].addr);
+        rwSock = accept4( this->listenSock
+                        , (struct sockaddr*)&accepted[nAccepted].addr
+                        , &accepted[nAccepted].addrLen
+                        , sockFlags
+                        );
+        if (rwSock >= 0)
+        {   csc_srv_tuneAccepted(this, rwSock);
+            accepted[nAccepted++].fd = rwSock;
+            continue;
+        }
+ 
+    // The client gave up before we got to it.
+        err = errno;
+        if (err == ECONNABORTED)
+            continue;
+ 
+    // Report any failure next time, if we have something to return now.
+        if (nAccepted > 0)
+            break;
+ 
+    // Wait for a connection.
+        if ((err==EAGAIN || err==EWOULDBLOCK) && isWait)
+        {   pfd.fd = this->listenSock;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, -1) >= 0)
+                continue;
+            err = errno;
+        }
+ 
+    // Failed.
+        setErrMsg(this, csc_alloc_str3("accept:", strerror(err), NULL));
+        if (err == EINTR)
+            return -2;
+        else if (err==EAGAIN || err==EWOULDBLOCK)
+            return -3;
+        else
+            return -1;
+    }
+ 
+    return nAccepted;
+}
+
+
+static csc_bool_t isInetAddr(const struct sockaddr_storage *ss)
+{   return ss->ss_family==AF_INET || ss->ss_family==AF_INET6;
+}
+
+
+// Converts a socket address to a binary address.
+static void addrBin(const struct sockaddr_storage *ss, csc_srv_addr_t *addr)
+{   if (ss->ss_family == AF_INET6)
+    {   const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6*)ss;
+        memcpy(addr->ip, &sin6->sin6_addr, 16);
+        addr->port = ntohs(sin6->sin6_port);
+    }
+    else if (ss->ss_family == AF_INET)
+    {   const struct sockaddr_in *sin = (const struct sockaddr_in*)ss;
+        memset(addr->ip, 0, 10);
+        addr->ip[10] = addr->ip[11] = 0xff;
+        memcpy(addr->ip+12, &sin->sin_addr, 4);
+        addr->port = ntohs(sin->sin_port);
+    }
+    else
+        memset(addr, 0, sizeof(*addr));
+}
+
+
+void csc_srv_acceptAddrBin(const csc_srv_t *this, csc_srv_addr_t *addr)
+{   addrBin(&this->cliDetails, addr);
+}
+
+
+void csc_srv_acceptedAddrBin(const csc_srv_accepted_t *accepted, csc_srv_addr_t *addr)
+{   addrBin(&accepted->addr, addr);
+}
+
+
+// Writes 'n', 0 to 255, in decimal.  Returns the end.
+static char *fmtDec(char *pt, int n)
+{   if (n >= 100)
+        *pt++ = '0' + n/100;
+    if (n >= 10)
+        *pt++ = '0' + n/10%10;
+    *pt++ = '0' + n%10;
+    return pt;
+}
+
+
+// Writes 'n', 0 to 0xffff, in hex without leading zeros.  Returns the end.
+static char *fmtHex(char *pt, unsigned n)
+{   static const char hexDigits[] = "0123456789abcdef";
+    int shift = 12;
+    while (shift>0 && (n>>shift)==0)
+        shift -= 4;
+    for (; shift>=0; shift-=4)
+        *pt++ = hexDigits[(n>>shift) & 0xf];
+    return pt;
+}
+
+
+const char *csc_srv_addrBinStr(const csc_srv_addr_t *addr, char *buf)
+{   static const unsigned char v4Prefix[12] = {0,0,0,0,0,0,0,0,0,0,0xff,0xff};
+    const unsigned char *ip = addr->ip;
+    unsigned groups[8];
+    int bestStart = -1, bestLen = 1;
+    int runStart, i;
+    char *pt = buf;
+ 
+// Mapped IPv4.
+    if (memcmp(ip, v4Prefix, 12) == 0)
+    {   for (i=12; i<16; i++)
+        {   if (i > 12)
+                *pt++ = '.';
+            pt = fmtDec(pt, ip[i]);
+        }
+        *pt = '\0';
+        return buf;
+    }
+ 
+// Find the longest run of two or more zero groups, to be written as "::".
+    for (i=0; i<8; i++)
+        groups[i] = ip[2*i]<<8 | ip[2*i+1];
+    for (i=0; i<8; i++)
+    {   if (groups[i] == 0)
+        {   runStart = i;
+            while (i<8 && groups[i]==0)
+                i++;
+            if (i-runStart > bestLen)
+            {   bestStart = runStart;
+                bestLen = i - runStart;
+            }
+        }
+    }
+ 
+// Write the groups.
+    for (i=0; i<8; i++)
+    {   if (i == bestStart)
+        {   *pt++ = ':';
+            *pt++ = ':';
+            i += bestLen - 1;
+        }
+        else
+        {   if (i>0 && i!=bestStart+bestLen)
+                *pt++ = ':';
+            pt = fmtHex(pt, groups[i]);
+        }
+    }
+    *pt = '\0';
+    return buf;
+}
+
+
+const char *csc_srv_addrStr(const csc_srv_accepted_t *accepted, char *buf, int bufSize)
+{   csc_srv_addr_t addr;
+    if (bufSize<csc_srv_AddrStrSize || !isInetAddr(&accepted->addr))
+        return NULL;
+    addrBin(&accepted->addr, &addr);
+    return csc_srv_addrBinStr(&addr, buf);
+}
+
+
+void csc_srv_setReusePort(csc_srv_t *this, csc_bool_t isReusePort)
+{   this->isReusePort = isReusePort;
+}
+
+
+void csc_srv_sockOptsInit(csc_srv_sockOpts_t *opts)
+{   memset(opts, 0, sizeof(*opts));
+    opts->isNoDelay = csc_FALSE;
+    opts->isQuickAck = csc_FALSE;
+}
+
+
+void csc_srv_setSockOpts(csc_srv_t *this, const csc_srv_sockOpts_t *opts)
+{   this->sockOpts = *opts;
+}
+
+
+void csc_srv_tuneAccepted(const csc_srv_t *this, int fd)
+{   int isOn = 1;
+    if (this->sockOpts.isQuickAck)
+        setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &isOn, sizeof(isOn));
+}
+
+
+int csc_srv_getListenSock(const csc_srv_t *this)
+{   return this->listenSock;
+}
+
+
 const char *csc_srv_acceptAddr(csc_srv_t *this)
-{
-// Get the IP number.
-    int result = getnameinfo( &this->cliDetails, sizeof(this->cliDetails),
-                              this->cliAddr, sizeof(this->cliAddr),
-                              0,0,NI_NUMERICHOST
-                            );
-    if (result != 0) 
+{   csc_srv_addr_t addr;
+    if (!isInetAddr(&this->cliDetails))
         return NULL;
- 
-// Terminate the IP number.
-    this->cliAddr[INET6_ADDRSTRLEN] = '\0';
-    
-// return the string.
+    if (!this->isCliAddrSet)
+    {   addrBin(&this->cliDetails, &addr);
+        csc_srv_addrBinStr(&addr, this->cliAddr);
+        this->isCliAddrSet = csc_TRUE;
+    }
     return this->cliAddr;
 }
 
 
 void csc_srv_free(csc_srv_t *this)
-{   close(this->listenSock);
+{   if (this->listenSock != -1)
+        close(this->listenSock);
  
 // Free any error message.
     if (this->errMsg != NULL)
@@ -9,6 +9,7 @@
 #ifndef csc_SRV_H
 #define csc_SRV_H 1
 
+#include <sys/socket.h>
 #include "std.h"
 #include "logger.h"
 
@@ -48,13 +49,136 @@ int csc_srv_setAddr( csc_srv_t *srv
                   , int backlog);     // -1, or how many connections to queue.
 
 
+// Use 'sockfd', which is already bound and listening, instead of calling
+// csc_srv_setAddr(), e.g. a socket inherited from the process that ran the
+// server before this one.  Connections queued on it are kept.  The
+// socket then belongs to 'srv', but is left blocking or not, as its last
+// owner had it, since that may still be accepting on it.  If it is not
+// blocking, csc_srv_accept() returns -3 when no connection is waiting.
+// Returns 1 on success, and 0 on failure, e.g. if 'sockfd' is not a
+// listening socket.
+int csc_srv_adoptListenSock(csc_srv_t *srv, int sockfd);
+
+
+// Ask for the listening socket to be created with SO_REUSEPORT, so that
+// several processes or threads can each have their own listening socket on
+// the same address and port, and the kernel spreads connections between
+// them.  Call before csc_srv_setAddr().
+void csc_srv_setReusePort(csc_srv_t *srv, csc_bool_t isReusePort);
+
+
+// Options for the listening socket, and for the connections accepted on
+// it.  Each is off, or left as the system has it, when 0.
+typedef struct
+{   int deferAcceptSecs;       // TCP_DEFER_ACCEPT.  Connections are only
+                               // accepted once the client has sent something,
+                               // or this long has passed.
+    int fastOpenQueue;         // TCP_FASTOPEN.  How many connections may be
+                               // waiting whose first data came with the SYN.
+    int busyPollUs;            // SO_BUSY_POLL.  How long a read may spin on
+                               // the device queue before sleeping.  Raising
+                               // it usually needs CAP_NET_ADMIN.
+    csc_bool_t isNoDelay;      // TCP_NODELAY on accepted connections.
+    csc_bool_t isQuickAck;     // TCP_QUICKACK on accepted connections.
+    int rcvBufSize;            // SO_RCVBUF, in bytes.
+    int sndBufSize;            // SO_SNDBUF, in bytes.
+} csc_srv_sockOpts_t;
+
+// Sets 'opts' to leave every option as the system has it.
+void csc_srv_sockOptsInit(csc_srv_sockOpts_t *opts);
+
+// Ask for these options.  Call before csc_srv_setAddr(), which fails if
+// any of them cannot be set.  The options for the listening socket, and
+// TCP_NODELAY and the buffer sizes, which its connections inherit, are set
+// by csc_srv_setAddr().  TCP_QUICKACK is set on each connection as it is
+// accepted.  An adopted socket keeps the options that it was given by its
+// last owner.
+void csc_srv_setSockOpts(csc_srv_t *srv, const csc_srv_sockOpts_t *opts);
+
+// Sets the options for accepted connections on 'fd', e.g. a connection
+// that was not accepted by 'srv' itself, but from its listening socket.
+// csc_srv_accept() and csc_srv_acceptMany() do this already.
+void csc_srv_tuneAccepted(const csc_srv_t *srv, int fd);
+
+
 // Accept a connection.  On success, returns a file descriptor associated
 // with a connection.  On failure returns a negative value.  -2 indicates
-// interrupt due to signal.  -1 indicates other errors.
+// interrupt due to signal.  -3 indicates that the listening socket has
+// been made non-blocking, and there is no connection waiting.  -1
+// indicates other errors.
 int csc_srv_accept(csc_srv_t *srv);
 
 
+// A connection accepted by csc_srv_acceptMany().  The client address is
+// kept in binary, and only turned into a string by csc_srv_addrStr() if
+// and when that is needed.
+typedef struct
+{   int fd;
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+} csc_srv_accepted_t;
+
+// Enough room for any client address string.
+#define csc_srv_AddrStrSize 46
+
+// Accept as many waiting connections as will fit in 'accepted', which has
+// room for 'maxAccepted' of them.  This makes the listening socket
+// non-blocking, and drains its queue with accept4() until none is left
+// waiting, saving a round trip for each connection in a burst.  The new
+// sockets are given 'sockFlags', which may be 0, or SOCK_NONBLOCK and/or
+// SOCK_CLOEXEC.
+// 
+// If no connection is waiting and 'isWait' is true, it waits for one.
+// Returns the number of connections accepted, which is at least 1, or as
+// for csc_srv_accept() on failure, i.e. -2 for an interrupt due to a
+// signal, -3 if 'isWait' is false and no connection is waiting, or -1 for
+// other errors.  An error after some connections have been accepted is not
+// reported until the next call.
+int csc_srv_acceptMany( csc_srv_t *srv
+                      , csc_srv_accepted_t *accepted
+                      , int maxAccepted
+                      , int sockFlags
+                      , csc_bool_t isWait
+                      );
+
+// Writes the numeric client address of 'accepted' into 'buf', which should
+// have room for csc_srv_AddrStrSize characters.  Returns 'buf', or NULL
+// on failure.
+const char *csc_srv_addrStr(const csc_srv_accepted_t *accepted, char *buf, int bufSize);
+
+
+// A client address as a fixed size binary key, e.g. for hashing or
+// blacklisting without first formatting it as a string.  IPv4 addresses
+// are mapped into IPv6, as in ::ffff:192.168.0.3, so that every address
+// has the same 16 bytes.  An address of an unknown family is all zeros.
+typedef struct
+{   unsigned char ip[16];
+    unsigned short port;  // In host byte order.
+} csc_srv_addr_t;
+
+// Gets the binary address of the client whose connection was just
+// accepted by csc_srv_accept().
+void csc_srv_acceptAddrBin(const csc_srv_t *srv, csc_srv_addr_t *addr);
+
+// Gets the binary address of a connection from csc_srv_acceptMany().
+void csc_srv_acceptedAddrBin(const csc_srv_accepted_t *accepted, csc_srv_addr_t *addr);
+
+// Formats the IP of a binary address into 'buf', which must have room for
+// csc_srv_AddrStrSize characters, and returns 'buf'.  Mapped IPv4
+// addresses are written as IPv4, e.g. "192.168.0.3", and IPv6 addresses
+// in their shortest form, e.g. "2001:db8::51".  This is much cheaper than
+// getnameinfo(), so only call it when the string is actually needed.
+const char *csc_srv_addrBinStr(const csc_srv_addr_t *addr, char *buf);
+
+
+// Returns the listening socket, e.g. so that it may be made non-blocking
+// and watched with poll() or epoll().  Returns -1 if csc_srv_setAddr() has
+// not succeeded.  The socket still belongs to 'srv'.
+int csc_srv_getListenSock(const csc_srv_t *srv);
+
+
 // Returns address of client whose connection was just accepted.  Returns NULL on failure.
+// The string is only formatted on the first call after each accept.
 const char *csc_srv_acceptAddr(csc_srv_t *srv);
 
 
@@ -0,0 +1,142 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "std.h"
+#include "alloc.h"
+#include "udp.h"
+#include "pktRing.h"
+#include "pktPool.h"
+
+#define CacheLine 64
+#define MaxBatch 64
+
+// A packet, on cache lines of its own.
+typedef struct
+{   csc_udpPkt_t pkt;
+} __attribute__((aligned(CacheLine))) poolPkt_t;
+
+
+struct csc_pktPool_t
+{   int nPkts;
+    int bufSiz;
+    poolPkt_t *pkts;
+    char *bufs;                // Each starts on a cache line.
+    char *mem;                 // Both, as allocated, before aligning.
+    csc_pktRing_t *free;       // The packets not in use.
+ 
+// Packets that the taking thread has taken from 'free' but not used.
+    csc_udpPkt_t *spare[MaxBatch];
+    int nSpare;
+};
+
+
+csc_pktPool_t *csc_pktPool_new(int nPkts, int bufSiz)
+{   csc_pktPool_t *pool;
+    size_t stride;
+    int i;
+ 
+    if (nPkts<1 || bufSiz<1)
+        return NULL;
+    stride = (bufSiz + CacheLine - 1) / CacheLine * CacheLine;
+    pool = csc_allocOne(csc_pktPool_t);
+    pool->nPkts = nPkts;
+    pool->bufSiz = bufSiz;
+    pool->nSpare = 0;
+    pool->free = csc_pktRing_new(nPkts);
+    if (pool->free == NULL)
+    {   free(pool);
+        return NULL;
+    }
+ 
+// The packets, and then their buffers, from the first cache line.
+    pool->mem = csc_allocMany(char, nPkts*(sizeof(poolPkt_t)+stride) + CacheLine - 1);
+    pool->pkts = (poolPkt_t*)(((uintptr_t)pool->mem + CacheLine - 1) & ~(uintptr_t)(CacheLine - 1));
+    pool->bufs = (char*)(pool->pkts + nPkts);
+ 
+// All are free to start with.
+    for (i=0; i<nPkts; i++)
+    {   pool->pkts[i].pkt.buf = pool->bufs + i*stride;
+        pool->pkts[i].pkt.bufSiz = bufSiz;
+        pool->pkts[i].pkt.len = 0;
+        pool->pkts[i].pkt.addr = csc_udpAddr_new();
+        csc_pktRing_push(pool->free, &pool->pkts[i].pkt);
+    }
+    return pool;
+}
+
+
+void csc_pktPool_free(csc_pktPool_t *pool)
+{   int i;
+    for (i=0; i<pool->nPkts; i++)
+        csc_udpAddr_free(pool->pkts[i].pkt.addr);
+    csc_pktRing_free(pool->free);
+    free(pool->mem);
+    free(pool);
+}
+
+
+// ------------ The taking thread ----------
+
+csc_udpPkt_t *csc_pktPool_get(csc_pktPool_t *pool)
+{   csc_udpPkt_t *pkt;
+    if (pool->nSpare > 0)
+        pkt = pool->spare[--pool->nSpare];
+    else
+        pkt = csc_pktRing_pop(pool->free);
+    if (pkt != NULL)
+        pkt->len = 0;
+    return pkt;
+}
+
+
+int csc_pktPool_nFree(csc_pktPool_t *pool)
+{   return pool->nSpare + csc_pktRing_count(pool->free);
+}
+
+
+int csc_pktPool_rcv( csc_pktPool_t *pool
+                   , csc_udp_t *udp
+                   , csc_pktRing_t *ring
+                   , int maxPkts
+                   , int timeoutMs
+                   )
+{   csc_udpPkt_t pkts[MaxBatch];
+    int nPkts, nGot, i;
+ 
+// As many as there are free packets and room for.
+    nPkts = csc_min(maxPkts, MaxBatch);
+    nPkts = csc_min(nPkts, csc_pktRing_room(ring));
+    if (pool->nSpare < nPkts)
+        pool->nSpare += csc_pktRing_popMany( pool->free
+                                           , (void**)pool->spare+pool->nSpare
+                                           , nPkts-pool->nSpare);
+    nPkts = csc_min(nPkts, pool->nSpare);
+    if (nPkts <= 0)
+        return 0;
+ 
+// Receive into the pool's buffers.  Only the descriptions are copied.
+    for (i=0; i<nPkts; i++)
+        pkts[i] = *pool->spare[i];
+    nGot = csc_udp_rcvMany(udp, pkts, nPkts, timeoutMs);
+    if (nGot <= 0)
+        return nGot;
+    for (i=0; i<nGot; i++)
+        pool->spare[i]->len = pkts[i].len;
+ 
+// Pass them on.
+    csc_pktRing_pushMany(ring, (void**)pool->spare, nGot);
+    pool->nSpare -= nGot;
+    memmove(pool->spare, pool->spare+nGot, pool->nSpare*sizeof(csc_udpPkt_t*));
+    return nGot;
+}
+
+
+// ------------ The giving thread ----------
+
+void csc_pktPool_put(csc_pktPool_t *pool, csc_udpPkt_t *pkt)
+{   csc_pktRing_push(pool->free, pkt);
+}
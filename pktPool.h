@@ -0,0 +1,68 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ======= pktPool ======================================================
+// A fixed number of packet buffers, allocated once, to receive UDP
+// packets into and hand to other threads, so that nothing is allocated or
+// copied for each packet.
+//
+// Each packet is a csc_udpPkt_t whose 'buf' is the pool's, and whose
+// 'addr' is its own.  Buffers start on cache lines, and so do the
+// csc_udpPkt_t, so that threads working on different packets do not
+// contend.
+//
+// The packets that are free are kept in a csc_pktRing_t.  So one thread
+// may take packets from the pool, and one other thread may give them back,
+// without locks.  Typically a receiving thread takes them, and receives
+// into them with csc_pktPool_rcv(), which passes them on in another
+// csc_pktRing_t to a worker thread, which gives each back when done with
+// it.  Use a pool and a pair of rings for each worker.
+// ======================================================================
+
+#ifndef csc_PKTPOOL_H
+#define csc_PKTPOOL_H 1
+
+#include "std.h"
+#include "udp.h"
+#include "pktRing.h"
+
+typedef struct csc_pktPool_t csc_pktPool_t;
+
+
+// Constructor.  Makes 'nPkts' packets, each with room for 'bufSiz' bytes.
+// Returns NULL on failure.
+csc_pktPool_t *csc_pktPool_new(int nPkts, int bufSiz);
+
+// Destructor.  Packets not yet given back are freed too.
+void csc_pktPool_free(csc_pktPool_t *pool);
+
+
+// ------------ The taking thread only ----------
+
+// Returns a free packet, with its 'len' 0, or NULL if there are none.
+csc_udpPkt_t *csc_pktPool_get(csc_pktPool_t *pool);
+
+// Returns how many packets are free, at least.
+int csc_pktPool_nFree(csc_pktPool_t *pool);
+
+// Receives up to 'maxPkts' packets from 'udp' into free packets, and
+// pushes them onto 'ring', as csc_udpPkt_t pointers, in the order
+// received.  No more are received than there are free packets, nor than
+// there is room for on 'ring'.  Waits for the first as csc_udp_rcvMany().
+// Returns the number received, or 0 if there were no free packets or no
+// room, or -2 on timeout, or -1 on error - use csc_udp_getErrMsg().
+int csc_pktPool_rcv( csc_pktPool_t *pool
+                   , csc_udp_t *udp
+                   , csc_pktRing_t *ring
+                   , int maxPkts
+                   , int timeoutMs
+                   );
+
+
+// ------------ The giving thread only ----------
+
+// Gives back 'pkt', which must have come from this pool.  This may be
+// the taking thread, or one other.
+void csc_pktPool_put(csc_pktPool_t *pool, csc_udpPkt_t *pkt);
+
+#endif
@@ -0,0 +1,136 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "std.h"
+#include "alloc.h"
+#include "pktRing.h"
+
+#define CacheLine 64
+
+// 'head' and 'tail' only ever increase, wrapping at 2^32, so the count is
+// always 'tail'-'head'.  The producer writes 'tail' and reads 'head', and
+// the consumer the opposite.  Each keeps the last value that it read of
+// the other's, and reads it again only when that is not enough.
+struct csc_pktRing_t
+{   uint32_t tail __attribute__((aligned(CacheLine)));
+    uint32_t headSeen;         // The producer's copy of 'head'.
+ 
+    uint32_t head __attribute__((aligned(CacheLine)));
+    uint32_t tailSeen;         // The consumer's copy of 'tail'.
+ 
+    uint32_t mask __attribute__((aligned(CacheLine)));
+    void **slots;
+    void *mem;                 // As allocated, before aligning.
+};
+
+
+csc_pktRing_t *csc_pktRing_new(int capacity)
+{   csc_pktRing_t *ring;
+    uint32_t size = 1;
+    char *mem;
+ 
+    if (capacity<1 || capacity>(1<<30))
+        return NULL;
+    while (size < (uint32_t)capacity)
+        size <<= 1;
+    mem = csc_allocMany(char, sizeof(csc_pktRing_t) + CacheLine - 1);
+    ring = (csc_pktRing_t*)(((uintptr_t)mem + CacheLine - 1) & ~(uintptr_t)(CacheLine - 1));
+    ring->mem = mem;
+    ring->tail = 0;
+    ring->headSeen = 0;
+    ring->head = 0;
+    ring->tailSeen = 0;
+    ring->mask = size - 1;
+    ring->slots = csc_allocMany(void*, size);
+    return ring;
+}
+
+
+void csc_pktRing_free(csc_pktRing_t *ring)
+{   free(ring->slots);
+    free(ring->mem);
+}
+
+
+int csc_pktRing_capacity(const csc_pktRing_t *ring)
+{   return ring->mask + 1;
+}
+
+
+// ------------ The producer ----------
+
+int csc_pktRing_room(csc_pktRing_t *ring)
+{   uint32_t size = ring->mask + 1;
+    uint32_t room = size - (ring->tail - ring->headSeen);
+    if (room == 0)
+    {   ring->headSeen = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        room = size - (ring->tail - ring->headSeen);
+    }
+    return room;
+}
+
+
+int csc_pktRing_pushMany(csc_pktRing_t *ring, void **items, int nItems)
+{   uint32_t size = ring->mask + 1;
+    uint32_t tail = ring->tail;
+    uint32_t room = size - (tail - ring->headSeen);
+    int i;
+ 
+    if (room < (uint32_t)nItems)
+    {   ring->headSeen = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        room = size - (tail - ring->headSeen);
+    }
+    if (room < (uint32_t)nItems)
+        nItems = room;
+ 
+// Fill the slots, then publish them.
+    for (i=0; i<nItems; i++)
+        ring->slots[(tail+i) & ring->mask] = items[i];
+    __atomic_store_n(&ring->tail, tail+nItems, __ATOMIC_RELEASE);
+    return nItems;
+}
+
+
+csc_bool_t csc_pktRing_push(csc_pktRing_t *ring, void *item)
+{   return csc_pktRing_pushMany(ring, &item, 1) == 1;
+}
+
+
+// ------------ The consumer ----------
+
+int csc_pktRing_popMany(csc_pktRing_t *ring, void **items, int nItems)
+{   uint32_t head = ring->head;
+    uint32_t count = ring->tailSeen - head;
+    int i;
+ 
+    if (count < (uint32_t)nItems)
+    {   ring->tailSeen = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        count = ring->tailSeen - head;
+    }
+    if (count < (uint32_t)nItems)
+        nItems = count;
+ 
+// Take them, then free the slots.
+    for (i=0; i<nItems; i++)
+        items[i] = ring->slots[(head+i) & ring->mask];
+    __atomic_store_n(&ring->head, head+nItems, __ATOMIC_RELEASE);
+    return nItems;
+}
+
+
+void *csc_pktRing_pop(csc_pktRing_t *ring)
+{   void *item;
+    if (csc_pktRing_popMany(ring, &item, 1) == 0)
+        return NULL;
+    return item;
+}
+
+
+int csc_pktRing_count(const csc_pktRing_t *ring)
+{   uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return tail - head;
+}
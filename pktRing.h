@@ -0,0 +1,66 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ======= pktRing ======================================================
+// A ring of pointers with a fixed capacity, for handing items, such as
+// packets from a csc_pktPool_t, from one thread to another without locks
+// and without copying what they point to.
+//
+// Exactly one thread may push, and exactly one thread, the same or
+// another, may pop.  The ends that each writes are on cache lines of
+// their own, and each keeps its own copy of the other's end, so that they
+// contend only when the ring is nearly empty or nearly full.
+//
+// Neither pushing nor popping waits.  A consumer with nothing to pop must
+// wait some other way.
+// ======================================================================
+
+#ifndef csc_PKTRING_H
+#define csc_PKTRING_H 1
+
+#include "std.h"
+
+typedef struct csc_pktRing_t csc_pktRing_t;
+
+
+// Constructor.  The capacity is 'capacity' rounded up to a power of two.
+// Returns NULL on failure.
+csc_pktRing_t *csc_pktRing_new(int capacity);
+
+// Destructor.  What the items point to is not freed.
+void csc_pktRing_free(csc_pktRing_t *ring);
+
+// Returns the most items that the ring can hold.
+int csc_pktRing_capacity(const csc_pktRing_t *ring);
+
+
+// ------------ The producer only ----------
+
+// Adds 'item' to the ring.  Returns csc_FALSE if the ring is full.
+csc_bool_t csc_pktRing_push(csc_pktRing_t *ring, void *item);
+
+// Adds as many of the 'nItems' items as there is room for, in order.
+// Returns the number added.
+int csc_pktRing_pushMany(csc_pktRing_t *ring, void **items, int nItems);
+
+// Returns how many items may be pushed now, at least.
+int csc_pktRing_room(csc_pktRing_t *ring);
+
+
+// ------------ The consumer only ----------
+
+// Removes and returns the oldest item, or NULL if the ring is empty.
+void *csc_pktRing_pop(csc_pktRing_t *ring);
+
+// Removes up to 'nItems' items, oldest first, into 'items'.  Returns the
+// number removed.
+int csc_pktRing_popMany(csc_pktRing_t *ring, void **items, int nItems);
+
+
+// ------------ Either ----------
+
+// Returns how many items are in the ring.  It may change at once if the
+// other thread pushes or pops.
+int csc_pktRing_count(const csc_pktRing_t *ring);
+
+#endif
@@ -0,0 +1,822 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "std.h"
+#include "alloc.h"
+#include "hash.h"
+#include "timerWheel.h"
+#include "udp.h"
+#include "rudp.h"
+
+#define TimerTickMs 5
+#define BatchSize 32
+#define HdrSize 20
+#define PktSize (HdrSize + csc_rudp_MaxMsg)
+#define InitRtoMs 200
+#define MinRtoMs 10
+#define MaxRtoMs 2000
+
+// A message is sent again without waiting for its timer once this many
+// sent after it have been acknowledged, as TCP's fast retransmit.
+#define FastResendGap 3
+
+// A peer with nothing unacknowledged is forgotten after this long without
+// a packet to or from it.  Before then, the next message to it starts a
+// new epoch, in case it has forgotten us.
+#define PeerIdleMs 60000
+
+// The header.  All in network byte order.
+//   Message:         type, flags, stream(2), epoch(4), seq(4), base(4), streamSeq(4)
+//   Acknowledgement: type, flags, 0(2), epoch(4), cumSeq(4), bits(8)
+// 'epoch' tells one run of messages to a peer from the next, after they
+// were given up on, or the sender started again.  'base' is the lowest
+// sequence number that the sender has not had acknowledged.  In 'bits',
+// bit i says that cumSeq+i has been received.
+//
+// A message flagged as Started says that some of its epoch have been
+// acknowledged already.  A receiver that has not had that epoch has lost
+// its place in the streams, so it answers with a Reset acknowledgement
+// instead, and the sender starts a new epoch.
+#define PktType_Msg 1
+#define PktType_Ack 2
+#define PktFlag_Ordered 1
+#define PktFlag_Started 2
+#define AckFlag_Reset 1
+
+
+// A message sent, or waiting to be.
+typedef struct rudpMsg_t
+{   struct rudpPeer_t *peer;
+    uint32_t seq;
+    int stream;
+    char *pkt;                 // The header and message.
+    int pktLen;
+    int nTries;
+    uint64_t sentUs;
+    csc_timer_t timer;
+    struct rudpMsg_t *next;    // Waiting for the window.
+} rudpMsg_t;
+
+
+// A message received ahead of its turn on an ordered stream.
+typedef struct rudpHeld_t
+{   uint32_t streamSeq;
+    char *msg;
+    int len;
+    struct rudpHeld_t *next;
+} rudpHeld_t;
+
+
+// A stream to or from a peer.
+typedef struct rudpStream_t
+{   int stream;
+    uint32_t sndNext;          // Next ordered message to send.
+    uint32_t rcvNext;          // Next ordered message to deliver.
+    rudpHeld_t *held;          // In order of streamSeq.
+    struct rudpStream_t *next;
+} rudpStream_t;
+
+
+typedef struct rudpPeer_t
+{   unsigned char key[csc_udpAddr_BinSize];
+    csc_udpAddr_t *addr;
+    struct csc_rudp_t *rudp;
+    rudpStream_t *streams;
+    csc_timer_t idleTimer;
+ 
+// Sending.
+    uint32_t epoch;
+    csc_bool_t isStarted;      // Some of this epoch have been acknowledged.
+    uint32_t sndNext;          // Sequence number of the next message sent.
+    uint32_t sndUna;           // Lowest not acknowledged.
+    rudpMsg_t *inFlight[csc_rudp_MaxWindow];  // By seq, NULL once acknowledged.
+    rudpMsg_t *waitHead, *waitTail;
+    uint64_t lastSndUs;
+    double srttUs, rttVarUs;
+    int rtoMs;
+    csc_bool_t hasRtt;
+ 
+// Receiving.
+    csc_bool_t isRcv;          // Received anything yet.
+    uint32_t rcvEpoch;
+    uint32_t rcvNext;          // Lowest not received.
+    uint64_t rcvBits;          // Bit i says rcvNext+i has been received.
+    csc_bool_t isAckDue;
+    struct rudpPeer_t *nextAck;
+} rudpPeer_t;
+
+
+typedef struct csc_rudp_t
+{   char *errMsg;
+    csc_udp_t *udp;
+    csc_hash_t *peers;
+    csc_timerWheel_t *timers;
+    csc_rudp_onMsg_t *onMsg;
+    csc_rudp_onLost_t *onLost;
+    void *arg;
+    int window;
+    int maxTries;
+    int nUnacked;
+    int nDelivered;
+    uint32_t lastEpoch;
+    rudpPeer_t *acksDue;
+    double lossRate;
+    unsigned int lossSeed;
+ 
+// Buffers for receiving a batch.
+    csc_udpPkt_t pkts[BatchSize];
+    char bufs[BatchSize][PktSize];
+    csc_udpAddr_t *froms[BatchSize];
+} csc_rudp_t;
+
+
+
+static void setErrMsg(csc_rudp_t *rudp, const char *errMsg)
+{   if (rudp->errMsg != NULL)
+        free(rudp->errMsg);
+    rudp->errMsg = csc_alloc_str(errMsg);
+}
+
+
+static uint64_t nowUs()
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+
+// Whether sequence number 'a' is before 'b', allowing for wrapping.
+static csc_bool_t seqBefore(uint32_t a, uint32_t b)
+{   return (int32_t)(a - b) < 0;
+}
+
+
+static void put16(char *pt, uint16_t val)
+{   val = htons(val);
+    memcpy(pt, &val, 2);
+}
+
+static void put32(char *pt, uint32_t val)
+{   val = htonl(val);
+    memcpy(pt, &val, 4);
+}
+
+static uint16_t get16(const char *pt)
+{   uint16_t val;
+    memcpy(&val, pt, 2);
+    return ntohs(val);
+}
+
+static uint32_t get32(const char *pt)
+{   uint32_t val;
+    memcpy(&val, pt, 4);
+    return ntohl(val);
+}
+
+
+// Sends a packet, unless the loss simulator drops it.
+static void sndPkt(csc_rudp_t *rudp, rudpPeer_t *peer, char *pkt, int len)
+{   if (rudp->lossRate>0 && rand_r(&rudp->lossSeed) < rudp->lossRate*((double)RAND_MAX+1))
+        return;
+    csc_udp_snd(rudp->udp, pkt, len, peer->addr);
+}
+
+
+// --------------------  Peers --------------------
+
+static int keyCmp(void *key1, void *key2)
+{   return memcmp(key1, key2, csc_udpAddr_BinSize);
+}
+
+
+static uint64_t keyHash(void *key)
+{   return csc_hash_bytes(key, csc_udpAddr_BinSize);
+}
+
+
+static void freeHeld(rudpStream_t *st)
+{   rudpHeld_t *held, *next;
+    for (held=st->held; held!=NULL; held=next)
+    {   next = held->next;
+        free(held->msg);
+        free(held);
+    }
+    st->held = NULL;
+}
+
+
+static void msgFree(rudpMsg_t *msg)
+{   csc_timerWheel_cancel(msg->peer->rudp->timers, &msg->timer);
+    msg->peer->rudp->nUnacked--;
+    free(msg->pkt);
+    free(msg);
+}
+
+
+static void peerFree(void *pt)
+{   rudpPeer_t *peer = pt;
+    rudpStream_t *st, *nextSt;
+    rudpMsg_t *msg, *next;
+    int i;
+ 
+    csc_timerWheel_cancel(peer->rudp->timers, &peer->idleTimer);
+    for (i=0; i<csc_rudp_MaxWindow; i++)
+    {   if (peer->inFlight[i] != NULL)
+            msgFree(peer->inFlight[i]);
+    }
+    for (msg=peer->waitHead; msg!=NULL; msg=next)
+    {   next = msg->next;
+        msgFree(msg);
+    }
+    for (st=peer->streams; st!=NULL; st=nextSt)
+    {   nextSt = st->next;
+        freeHeld(st);
+        free(st);
+    }
+    csc_udpAddr_free(peer->addr);
+    free(peer);
+}
+
+
+// An epoch later than any before, from the clock, so that one from a
+// process started again is later too.
+static uint32_t newEpoch(csc_rudp_t *rudp)
+{   struct timespec ts;
+    uint32_t epoch;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    epoch = (uint32_t)(ts.tv_sec*1000 + ts.tv_nsec/1000000);
+    if (!seqBefore(rudp->lastEpoch, epoch))
+        epoch = rudp->lastEpoch + 1;
+    rudp->lastEpoch = epoch;
+    return epoch;
+}
+
+
+static csc_bool_t isIdle(const rudpPeer_t *peer)
+{   return peer->sndUna==peer->sndNext && peer->waitHead==NULL;
+}
+
+
+static void idleTimedOut(csc_timer_t *timer, void *arg)
+{   rudpPeer_t *peer = arg;
+    (void)timer;
+    if (isIdle(peer))
+        csc_hash_del(peer->rudp->peers, peer->key);
+    else
+        csc_timerWheel_add(peer->rudp->timers, &peer->idleTimer, PeerIdleMs);
+}
+
+
+// Gets the peer at 'addr', making it if it is new.
+static rudpPeer_t *getPeer(csc_rudp_t *rudp, const csc_udpAddr_t *addr)
+{   unsigned char key[csc_udpAddr_BinSize];
+    rudpPeer_t *peer;
+ 
+    csc_udpAddr_getBin(addr, key);
+    peer = csc_hash_get(rudp->peers, key);
+    if (peer != NULL)
+    {   csc_timerWheel_add(rudp->timers, &peer->idleTimer, PeerIdleMs);
+        return peer;
+    }
+ 
+    peer = csc_allocOne(rudpPeer_t);
+    memset(peer, 0, sizeof(rudpPeer_t));
+    memcpy(peer->key, key, csc_udpAddr_BinSize);
+    peer->addr = csc_udpAddr_new();
+    csc_udpAddr_copy(peer->addr, addr);
+    peer->rudp = rudp;
+    peer->epoch = newEpoch(rudp);
+    peer->isStarted = csc_FALSE;
+    peer->rtoMs = InitRtoMs;
+    peer->hasRtt = csc_FALSE;
+    peer->isRcv = csc_FALSE;
+    peer->isAckDue = csc_FALSE;
+    csc_timer_init(&peer->idleTimer, idleTimedOut, peer);
+    csc_timerWheel_add(rudp->timers, &peer->idleTimer, PeerIdleMs);
+    csc_hash_addex(rudp->peers, peer);
+    return peer;
+}
+
+
+static rudpStream_t *getStream(rudpPeer_t *peer, int stream)
+{   rudpStream_t *st;
+    for (st=peer->streams; st!=NULL; st=st->next)
+    {   if (st->stream == stream)
+            return st;
+    }
+    st = csc_allocOne(rudpStream_t);
+    st->stream = stream;
+    st->sndNext = 0;
+    st->rcvNext = 0;
+    st->held = NULL;
+    st->next = peer->streams;
+    peer->streams = st;
+    return st;
+}
+
+
+// Gives up on a peer, and every message to it.  It is forgotten first, so
+// that anything sent to it from onLost() starts afresh.
+static void peerFail(rudpPeer_t *peer)
+{   csc_rudp_t *rudp = peer->rudp;
+    rudpMsg_t *msg;
+    uint32_t seq;
+ 
+    csc_hash_out(rudp->peers, peer->key);
+    if (rudp->onLost != NULL)
+    {   for (seq=peer->sndUna; seq!=peer->sndNext; seq++)
+        {   msg = peer->inFlight[seq % csc_rudp_MaxWindow];
+            if (msg != NULL)
+                rudp->onLost(rudp->arg, peer->addr, msg->stream, msg->pkt+HdrSize, msg->pktLen-HdrSize);
+        }
+        for (msg=peer->waitHead; msg!=NULL; msg=msg->next)
+            rudp->onLost(rudp->arg, peer->addr, msg->stream, msg->pkt+HdrSize, msg->pktLen-HdrSize);
+    }
+    peerFree(peer);
+}
+
+
+// --------------------  Sending --------------------
+
+// Sends a message, or sends it again, and waits for its acknowledgement.
+static void transmit(rudpMsg_t *msg)
+{   rudpPeer_t *peer = msg->peer;
+    int waitMs = peer->rtoMs << csc_min(msg->nTries, 8);
+ 
+    put32(msg->pkt+12, peer->sndUna);
+    if (peer->isStarted)
+        msg->pkt[1] |= PktFlag_Started;
+    else
+        msg->pkt[1] &= ~PktFlag_Started;
+    msg->nTries++;
+    msg->sentUs = nowUs();
+    peer->lastSndUs = msg->sentUs;
+    sndPkt(peer->rudp, peer, msg->pkt, msg->pktLen);
+    csc_timerWheel_add(peer->rudp->timers, &msg->timer, csc_min(waitMs, MaxRtoMs));
+}
+
+
+static void timedOut(csc_timer_t *timer, void *arg)
+{   rudpMsg_t *msg = arg;
+    (void)timer;
+    if (msg->nTries >= msg->peer->rudp->maxTries)
+        peerFail(msg->peer);
+    else
+        transmit(msg);
+}
+
+
+// Sends what is waiting, as far as the window allows.
+static void pump(rudpPeer_t *peer)
+{   rudpMsg_t *msg;
+    while ( peer->waitHead!=NULL
+          && (int)(peer->sndNext - peer->sndUna) < peer->rudp->window
+          )
+    {   msg = peer->waitHead;
+        peer->waitHead = msg->next;
+        if (peer->waitHead == NULL)
+            peer->waitTail = NULL;
+        msg->seq = peer->sndNext++;
+        put32(msg->pkt+8, msg->seq);
+        peer->inFlight[msg->seq % csc_rudp_MaxWindow] = msg;
+        transmit(msg);
+    }
+}
+
+
+// Gives a message the peer's epoch, and its next place on its stream.
+static void renumber(rudpPeer_t *peer, rudpMsg_t *msg)
+{   put32(msg->pkt+4, peer->epoch);
+    if (msg->pkt[1] & PktFlag_Ordered)
+        put32(msg->pkt+16, getStream(peer,msg->stream)->sndNext++);
+}
+
+
+// Starts a new epoch, which the peer will take as a fresh start.  Those
+// not yet acknowledged are put in it, in the order that they were sent.
+static void newRun(rudpPeer_t *peer)
+{   rudpStream_t *st;
+    rudpMsg_t *msg;
+    uint32_t seq;
+ 
+    peer->epoch = newEpoch(peer->rudp);
+    peer->isStarted = csc_FALSE;
+    for (st=peer->streams; st!=NULL; st=st->next)
+        st->sndNext = 0;
+    for (seq=peer->sndUna; seq!=peer->sndNext; seq++)
+    {   msg = peer->inFlight[seq % csc_rudp_MaxWindow];
+        if (msg != NULL)
+            renumber(peer, msg);
+    }
+    for (msg=peer->waitHead; msg!=NULL; msg=msg->next)
+        renumber(peer, msg);
+}
+
+
+// Takes a round trip time measured, as RFC 6298.
+static void takeRtt(rudpPeer_t *peer, double rttUs)
+{   if (!peer->hasRtt)
+    {   peer->srttUs = rttUs;
+        peer->rttVarUs = rttUs / 2;
+        peer->hasRtt = csc_TRUE;
+    }
+    else
+    {   peer->rttVarUs = 0.75*peer->rttVarUs + 0.25*(peer->srttUs>rttUs ? peer->srttUs-rttUs : rttUs-peer->srttUs);
+        peer->srttUs = 0.875*peer->srttUs + 0.125*rttUs;
+    }
+    peer->rtoMs = (int)((peer->srttUs + 4*peer->rttVarUs) / 1000) + 1;
+    peer->rtoMs = csc_max(MinRtoMs, csc_min(peer->rtoMs, MaxRtoMs));
+}
+
+
+// Forgets the messages that the peer says it has, and slides the window.
+// Those that it says are missing, with enough after them received, are
+// sent again at once, but no more than once a round trip.
+static void rcvAck(rudpPeer_t *peer, const char *pkt)
+{   uint32_t cumSeq = get32(pkt+8);
+    uint64_t bits = (uint64_t)get32(pkt+12)<<32 | get32(pkt+16);
+    uint64_t now = nowUs();
+    uint32_t top = cumSeq;
+    rudpMsg_t *msg;
+    uint32_t seq;
+    int i;
+ 
+    if (get32(pkt+4) != peer->epoch)
+        return;
+ 
+// The peer has lost its place, so start again with what it has not had.
+    if (pkt[1] & AckFlag_Reset)
+    {   newRun(peer);
+        for (seq=peer->sndUna; seq!=peer->sndNext; seq++)
+        {   msg = peer->inFlight[seq % csc_rudp_MaxWindow];
+            if (msg != NULL)
+                transmit(msg);
+        }
+        return;
+    }
+ 
+// Forget those it has.
+    for (seq=peer->sndUna; seq!=peer->sndNext; seq++)
+    {   msg = peer->inFlight[seq % csc_rudp_MaxWindow];
+        if (msg == NULL)
+            continue;
+        if ( seqBefore(seq, cumSeq)
+          || ((uint32_t)(seq-cumSeq)<64 && (bits>>(seq-cumSeq) & 1))
+           )
+        {   if (msg->nTries == 1)   // Karn's algorithm.
+                takeRtt(peer, now - msg->sentUs);
+            peer->inFlight[seq % csc_rudp_MaxWindow] = NULL;
+            peer->isStarted = csc_TRUE;
+            msgFree(msg);
+        }
+    }
+    while (peer->sndUna!=peer->sndNext && peer->inFlight[peer->sndUna % csc_rudp_MaxWindow]==NULL)
+        peer->sndUna++;
+ 
+// Send again those missing.
+    for (i=63; i>=0; i--)
+    {   if (bits>>i & 1)
+        {   top = cumSeq + i;
+            break;
+        }
+    }
+    for (seq=peer->sndUna; seqBefore(seq, top) && top-seq>=FastResendGap; seq++)
+    {   msg = peer->inFlight[seq % csc_rudp_MaxWindow];
+        if (msg!=NULL && peer->hasRtt && now-msg->sentUs > peer->srttUs)
+            transmit(msg);
+    }
+    pump(peer);
+}
+
+
+// --------------------  Receiving --------------------
+
+static void sndAck(csc_rudp_t *rudp, rudpPeer_t *peer)
+{   char pkt[HdrSize];
+    pkt[0] = PktType_Ack;
+    pkt[1] = 0;
+    put16(pkt+2, 0);
+    put32(pkt+4, peer->rcvEpoch);
+    put32(pkt+8, peer->rcvNext);
+    put32(pkt+12, (uint32_t)(peer->rcvBits>>32));
+    put32(pkt+16, (uint32_t)peer->rcvBits);
+    sndPkt(rudp, peer, pkt, HdrSize);
+}
+
+
+// Asks the peer to start epoch 'epoch' again.
+static void sndReset(csc_rudp_t *rudp, rudpPeer_t *peer, uint32_t epoch)
+{   char pkt[HdrSize];
+    memset(pkt, 0, HdrSize);
+    pkt[0] = PktType_Ack;
+    pkt[1] = AckFlag_Reset;
+    put32(pkt+4, epoch);
+    sndPkt(rudp, peer, pkt, HdrSize);
+}
+
+
+static void deliver(csc_rudp_t *rudp, rudpPeer_t *peer, int stream, const char *msg, int len)
+{   rudp->nDelivered++;
+    rudp->onMsg(rudp->arg, peer->addr, stream, msg, len);
+}
+
+
+// Delivers an ordered message in its turn, with any held for it.
+static void deliverOrdered( csc_rudp_t *rudp, rudpPeer_t *peer, int stream
+                          , uint32_t streamSeq, const char *msg, int len
+                          )
+{   rudpStream_t *st = getStream(peer, stream);
+    rudpHeld_t *held, **pt;
+ 
+// Not yet its turn, so hold it.
+    if (seqBefore(st->rcvNext, streamSeq))
+    {   for (pt=&st->held; *pt!=NULL && seqBefore((*pt)->streamSeq,streamSeq); pt=&(*pt)->next)
+            ;
+        held = csc_allocOne(rudpHeld_t);
+        held->streamSeq = streamSeq;
+        held->msg = csc_allocMany(char, len);
+        memcpy(held->msg, msg, len);
+        held->len = len;
+        held->next = *pt;
+        *pt = held;
+        return;
+    }
+ 
+// Its turn, and then that of those held.
+    st->rcvNext++;
+    deliver(rudp, peer, stream, msg, len);
+    while (st->held!=NULL && st->held->streamSeq==st->rcvNext)
+    {   held = st->held;
+        st->held = held->next;
+        st->rcvNext++;
+        deliver(rudp, peer, stream, held->msg, held->len);
+        free(held->msg);
+        free(held);
+    }
+}
+
+
+static void rcvMsg(csc_rudp_t *rudp, rudpPeer_t *peer, const char *pkt, int len)
+{   uint32_t epoch = get32(pkt+4);
+    uint32_t seq = get32(pkt+8);
+    uint32_t dist;
+    rudpStream_t *st;
+ 
+// A new run of messages from the peer starts afresh, unless we have
+// missed its start.  Those from an old run are ignored.
+    if (!peer->isRcv || seqBefore(peer->rcvEpoch, epoch))
+    {   if (pkt[1] & PktFlag_Started)
+        {   sndReset(rudp, peer, epoch);
+            return;
+        }
+        peer->isRcv = csc_TRUE;
+        peer->rcvEpoch = epoch;
+        peer->rcvNext = get32(pkt+12);
+        peer->rcvBits = 0;
+        for (st=peer->streams; st!=NULL; st=st->next)
+        {   st->rcvNext = 0;
+            freeHeld(st);
+        }
+    }
+    else if (epoch != peer->rcvEpoch)
+        return;
+ 
+// Acknowledge it, whether we had it already or not.
+    if (!peer->isAckDue)
+    {   peer->isAckDue = csc_TRUE;
+        peer->nextAck = rudp->acksDue;
+        rudp->acksDue = peer;
+    }
+ 
+// Have we had it?
+    dist = seq - peer->rcvNext;
+    if (seqBefore(seq, peer->rcvNext) || dist>=64 || (peer->rcvBits>>dist & 1))
+        return;
+    peer->rcvBits |= (uint64_t)1 << dist;
+    while (peer->rcvBits & 1)
+    {   peer->rcvBits >>= 1;
+        peer->rcvNext++;
+    }
+ 
+// Deliver it.
+    if (pkt[1] & PktFlag_Ordered)
+        deliverOrdered(rudp, peer, get16(pkt+2), get32(pkt+16), pkt+HdrSize, len-HdrSize);
+    else
+        deliver(rudp, peer, get16(pkt+2), pkt+HdrSize, len-HdrSize);
+}
+
+
+// --------------------  Public --------------------
+
+csc_rudp_t *csc_rudp_new()
+{   csc_rudp_t *rudp = csc_allocOne(csc_rudp_t);
+    int i;
+    rudp->errMsg = NULL;
+    rudp->udp = csc_udp_new();
+    rudp->peers = csc_hash_new(offsetof(rudpPeer_t,key), keyCmp, keyHash, peerFree);
+    rudp->timers = csc_timerWheel_new(TimerTickMs, csc_timerWheel_nowMs());
+    rudp->onMsg = NULL;
+    rudp->onLost = NULL;
+    rudp->arg = NULL;
+    rudp->window = 32;
+    rudp->maxTries = 10;
+    rudp->nUnacked = 0;
+    rudp->nDelivered = 0;
+    rudp->lastEpoch = 0;
+    rudp->acksDue = NULL;
+    rudp->lossRate = 0;
+    rudp->lossSeed = 0;
+    for (i=0; i<BatchSize; i++)
+    {   rudp->froms[i] = csc_udpAddr_new();
+        rudp->pkts[i].buf = rudp->bufs[i];
+        rudp->pkts[i].bufSiz = PktSize;
+        rudp->pkts[i].addr = rudp->froms[i];
+    }
+    return rudp;
+}
+
+
+void csc_rudp_free(csc_rudp_t *rudp)
+{   int i;
+    csc_hash_free(rudp->peers);
+    csc_timerWheel_free(rudp->timers);
+    csc_udp_free(rudp->udp);
+    for (i=0; i<BatchSize; i++)
+        csc_udpAddr_free(rudp->froms[i]);
+    if (rudp->errMsg != NULL)
+        free(rudp->errMsg);
+    free(rudp);
+}
+
+
+csc_bool_t csc_rudp_setSrv(csc_rudp_t *rudp, const char *ipStr, int portNo)
+{   if (!csc_udp_setSrv(rudp->udp, ipStr, portNo))
+    {   setErrMsg(rudp, csc_udp_getErrMsg(rudp->udp));
+        return csc_FALSE;
+    }
+    return csc_TRUE;
+}
+
+
+csc_bool_t csc_rudp_setCli(csc_rudp_t *rudp, int ipType)
+{   if (!csc_udp_setCli(rudp->udp, ipType))
+    {   setErrMsg(rudp, csc_udp_getErrMsg(rudp->udp));
+        return csc_FALSE;
+    }
+    csc_udp_cliNoConnect(rudp->udp);
+    return csc_TRUE;
+}
+
+
+void csc_rudp_setHandlers( csc_rudp_t *rudp
+                         , csc_rudp_onMsg_t *onMsg
+                         , csc_rudp_onLost_t *onLost
+                         , void *arg
+                         )
+{   rudp->onMsg = onMsg;
+    rudp->onLost = onLost;
+    rudp->arg = arg;
+}
+
+
+void csc_rudp_setWindow(csc_rudp_t *rudp, int window)
+{   rudp->window = csc_max(1, csc_min(window, csc_rudp_MaxWindow));
+}
+
+
+void csc_rudp_setMaxTries(csc_rudp_t *rudp, int maxTries)
+{   rudp->maxTries = csc_max(1, maxTries);
+}
+
+
+csc_bool_t csc_rudp_send( csc_rudp_t *rudp
+                        , const csc_udpAddr_t *to
+                        , int stream
+                        , csc_bool_t isOrdered
+                        , const char *msgBuf, int len
+                        )
+{   rudpPeer_t *peer;
+    rudpMsg_t *msg;
+ 
+// Check it.
+    if (len<0 || len>csc_rudp_MaxMsg)
+    {   setErrMsg(rudp, "csc_rudp_send(): message too long");
+        return csc_FALSE;
+    }
+    if (stream<0 || stream>65535)
+    {   setErrMsg(rudp, "csc_rudp_send(): invalid stream");
+        return csc_FALSE;
+    }
+    csc_timerWheel_setNow(rudp->timers, csc_timerWheel_nowMs());
+    peer = getPeer(rudp, to);
+ 
+// After a while with nothing sent, the peer may have forgotten us, so
+// start a new epoch, which it will take as a fresh start.
+    if ( isIdle(peer) && peer->lastSndUs!=0
+      && nowUs()-peer->lastSndUs > (uint64_t)PeerIdleMs/2*1000
+       )
+        newRun(peer);
+ 
+// Make the packet.  Its sequence number is given when it is sent.
+    msg = csc_allocOne(rudpMsg_t);
+    msg->peer = peer;
+    msg->stream = stream;
+    msg->pktLen = HdrSize + len;
+    msg->pkt = csc_allocMany(char, msg->pktLen);
+    msg->pkt[0] = PktType_Msg;
+    msg->pkt[1] = isOrdered ? PktFlag_Ordered : 0;
+    put16(msg->pkt+2, stream);
+    put32(msg->pkt+4, peer->epoch);
+    put32(msg->pkt+16, isOrdered ? getStream(peer,stream)->sndNext++ : 0);
+    memcpy(msg->pkt+HdrSize, msgBuf, len);
+    msg->nTries = 0;
+    csc_timer_init(&msg->timer, timedOut, msg);
+    msg->next = NULL;
+    rudp->nUnacked++;
+ 
+// Send it, if the window allows.
+    if (peer->waitTail == NULL)
+        peer->waitHead = msg;
+    else
+        peer->waitTail->next = msg;
+    peer->waitTail = msg;
+    pump(peer);
+    return csc_TRUE;
+}
+
+
+int csc_rudp_poll(csc_rudp_t *rudp, int timeoutMs)
+{   int waitMs = csc_timerWheel_nextMs(rudp->timers, csc_timerWheel_nowMs());
+    rudpPeer_t *peer;
+    csc_udpPkt_t *pkt;
+    int nPkts, i;
+ 
+// Wait for packets, or until a timer is due.
+    if (waitMs<0 || (timeoutMs>=0 && timeoutMs<waitMs))
+        waitMs = timeoutMs;
+    nPkts = csc_udp_rcvMany(rudp->udp, rudp->pkts, BatchSize, waitMs);
+    if (nPkts == -1)
+    {   setErrMsg(rudp, csc_udp_getErrMsg(rudp->udp));
+        return -1;
+    }
+ 
+// Take what arrived.
+    rudp->nDelivered = 0;
+    csc_timerWheel_setNow(rudp->timers, csc_timerWheel_nowMs());
+    for (i=0; i<nPkts; i++)
+    {   pkt = &rudp->pkts[i];
+        if (pkt->len < HdrSize)
+            continue;
+        peer = getPeer(rudp, pkt->addr);
+        if (pkt->buf[0]==PktType_Msg && rudp->onMsg!=NULL)
+            rcvMsg(rudp, peer, pkt->buf, pkt->len);
+        else if (pkt->buf[0] == PktType_Ack)
+            rcvAck(peer, pkt->buf);
+    }
+ 
+// Acknowledge them, once for each peer.
+    while (rudp->acksDue != NULL)
+    {   peer = rudp->acksDue;
+        rudp->acksDue = peer->nextAck;
+        peer->isAckDue = csc_FALSE;
+        sndAck(rudp, peer);
+    }
+ 
+// Send again what is overdue.
+    csc_timerWheel_advance(rudp->timers, csc_timerWheel_nowMs());
+    return rudp->nDelivered;
+}
+
+
+int csc_rudp_nUnacked(const csc_rudp_t *rudp)
+{   return rudp->nUnacked;
+}
+
+
+int csc_rudp_getRttUs(csc_rudp_t *rudp, const csc_udpAddr_t *to)
+{   unsigned char key[csc_udpAddr_BinSize];
+    rudpPeer_t *peer;
+    csc_udpAddr_getBin(to, key);
+    peer = csc_hash_get(rudp->peers, key);
+    if (peer==NULL || !peer->hasRtt)
+        return -1;
+    return (int)peer->srttUs;
+}
+
+
+void csc_rudp_setLoss(csc_rudp_t *rudp, double lossRate, unsigned int seed)
+{   rudp->lossRate = lossRate;
+    rudp->lossSeed = seed;
+}
+
+
+const char *csc_rudp_getErrMsg(const csc_rudp_t *rudp)
+{   return rudp->errMsg;
+}
@@ -0,0 +1,124 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ======= rudp =========================================================
+// Reliable messages over UDP, between endpoints that both use this.  Each
+// message is one packet, and is sent again until its peer acknowledges it.
+//
+// Each message has a sequence number for its peer.  The receiver says
+// which it has, with a cumulative acknowledgement and a bitmap of those
+// after it, so only those missing are sent again.  Each is sent again
+// after a time estimated from the round trip times measured, doubling
+// each time, until MaxTries, or sooner, once several sent after it have
+// been acknowledged.  No more than the window of messages to a peer are
+// unacknowledged at once.  The rest wait their turn.
+//
+// Messages are sent on streams.  Those marked as ordered are delivered in
+// the order that they were sent on their stream, but a message missing on
+// one stream does not hold up any other stream, nor any unordered message.
+// Unordered messages are delivered as they arrive.  Each message is
+// delivered once.
+//
+// A receiver that starts again, or forgets a peer, makes that peer start
+// its streams afresh, so that no ordered message sent after is held up.
+//
+// An endpoint is not thread safe.  Nothing happens unless csc_rudp_poll()
+// is called, and it should be called often.
+// ======================================================================
+
+#ifndef csc_RUDP_H
+#define csc_RUDP_H 1
+
+#include "std.h"
+#include "udp.h"
+
+// The longest message.  It, and a header, fit in the smallest MTU of IPv6.
+#define csc_rudp_MaxMsg 1200
+
+// The most messages that may be unacknowledged at once, for each peer.
+#define csc_rudp_MaxWindow 64
+
+typedef struct csc_rudp_t csc_rudp_t;
+
+// Called for each message received.  'from' is valid until it returns.
+typedef void csc_rudp_onMsg_t( void *arg, const csc_udpAddr_t *from
+                             , int stream, const char *msg, int len);
+
+// Called for each message given up on, when its peer has not acknowledged
+// it after MaxTries.  Every other message to that peer is given up on too.
+typedef void csc_rudp_onLost_t( void *arg, const csc_udpAddr_t *to
+                              , int stream, const char *msg, int len);
+
+
+// Constructor.
+csc_rudp_t *csc_rudp_new();
+
+// Destructor.  Messages not yet acknowledged are dropped.
+void csc_rudp_free(csc_rudp_t *rudp);
+
+
+// Receive on port 'portNo' of interface 'ipStr', or of all if NULL, as
+// csc_udp_setSrv().  Returns csc_FALSE on failure.
+csc_bool_t csc_rudp_setSrv(csc_rudp_t *rudp, const char *ipStr, int portNo);
+
+// Or receive only from those sent to, on a port chosen by the system.
+// 'ipType' is AF_INET or AF_INET6.  Returns csc_FALSE on failure.
+csc_bool_t csc_rudp_setCli(csc_rudp_t *rudp, int ipType);
+
+
+// Sets the functions called for messages received and lost, and what to
+// pass to them.  'onLost' may be NULL.
+void csc_rudp_setHandlers( csc_rudp_t *rudp
+                         , csc_rudp_onMsg_t *onMsg
+                         , csc_rudp_onLost_t *onLost
+                         , void *arg
+                         );
+
+// Sets the most messages to a peer that may be unacknowledged at once,
+// from 1 to csc_rudp_MaxWindow.  The default is 32.
+void csc_rudp_setWindow(csc_rudp_t *rudp, int window);
+
+// Sets how many times a message is sent before it is given up on.  The
+// default is 10.
+void csc_rudp_setMaxTries(csc_rudp_t *rudp, int maxTries);
+
+
+// Sends the 'len' bytes of 'msg' to 'to', on stream 'stream', from 0 to
+// 65535.  If 'isOrdered', the message is delivered after those sent
+// before it on the same stream that were also ordered.  'msg' is copied,
+// and is sent at once, or when the window allows.  Returns csc_FALSE if
+// 'len' is more than csc_rudp_MaxMsg, or the stream is not valid.
+csc_bool_t csc_rudp_send( csc_rudp_t *rudp
+                        , const csc_udpAddr_t *to
+                        , int stream
+                        , csc_bool_t isOrdered
+                        , const char *msg, int len
+                        );
+
+// Receives what has arrived, waiting up to 'timeoutMs' milliseconds, or
+// indefinitely if negative, for something to happen.  Delivers messages,
+// sends acknowledgements, and sends again what has not been acknowledged
+// in time.  Returns the number of messages delivered, or -1 on error.
+int csc_rudp_poll(csc_rudp_t *rudp, int timeoutMs);
+
+
+// Returns the number of messages sent or waiting to be sent, but not yet
+// acknowledged, to all peers.
+int csc_rudp_nUnacked(const csc_rudp_t *rudp);
+
+// Returns the smoothed round trip time to 'to' in microseconds, or -1 if
+// it has not been measured.
+int csc_rudp_getRttUs(csc_rudp_t *rudp, const csc_udpAddr_t *to);
+
+
+// Drops each packet sent, messages and acknowledgements alike, with
+// probability 'lossRate', from 0 to 1, as decided by rand_r() from
+// 'seed'.  Meant for testing.
+void csc_rudp_setLoss(csc_rudp_t *rudp, double lossRate, unsigned int seed);
+
+
+// Returns a string representation of details of a previous error.  The
+// string returned is valid until the next non const method call.
+const char *csc_rudp_getErrMsg(const csc_rudp_t *rudp);
+
+#endif
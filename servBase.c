@@ -1,6 +1,7 @@
 // Author: Dr Stephen Braithwaite.
 // This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
 
+#define _GNU_SOURCE  // For accept4().
 #include <stdlib.h>
 #include <signal.h>
 #include <string.h>
@@ -10,6 +11,16 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <limits.h>
+#include <ctype.h>
+#include <sched.h>
 
 #include "std.h"
 #include "alloc.h"
@@ -19,6 +30,10 @@
 #include "iniFile.h"
 #include "logger.h"
 #include "blacklist.h"
+#include "timerWheel.h"
+#include "metrics.h"
+#include "coro.h"
+#include "http.h"
 #include "servBase.h"
 
 #define ConfSection "ServerBase"
@@ -30,6 +45,28 @@
 #define configId_BlacklistMax "BlacklistMax"
 #define configId_BlacklistExpire "BlacklistExpire"
 #define configId_Backlog "Backlog"
+#define configId_QueueSize "QueueSize"
+#define configId_MaxConns "MaxConns"
+#define configId_MaxConnsPerChild "MaxConnsPerChild"
+#define configId_EventModel "EventModel"
+#define configId_MetricsPort "MetricsPort"
+#define configId_OverloadAction "OverloadAction"
+#define configId_CoroThreads "CoroThreads"
+#define configId_CoroStackKb "CoroStackKb"
+#define configId_CpuAffinity "CpuAffinity"
+#define configId_NumaNode "NumaNode"
+#define configId_MaxQueueWaitMs "MaxQueueWaitMs"
+#define configId_DrainSecs "DrainSecs"
+#define configId_DeferAccept "DeferAccept"
+#define configId_FastOpen "FastOpen"
+#define configId_BusyPoll "BusyPoll"
+#define configId_NoDelay "NoDelay"
+#define configId_QuickAck "QuickAck"
+#define configId_RcvBuf "RcvBuf"
+#define configId_SndBuf "SndBuf"
+#define configId_UdpThreads "UdpThreads"
+#define configId_UdpBatch "UdpBatch"
+#define configId_UdpMaxPkt "UdpMaxPkt"
 #define configId_LogLevel "LogLevel"
 #define configId_errPath "StdErrPath"
 
@@ -37,12 +74,43 @@
 #define srvModel_OneByOne 1
 #define srvModelStr_Forking "Forking"
 #define srvModel_Forking 2
+#define srvModelStr_ThreadPool "ThreadPool"
+#define srvModel_ThreadPool 3
+#define srvModelStr_EventLoop "EventLoop"
+#define srvModel_EventLoop 4
+#define srvModelStr_PreFork "PreFork"
+#define srvModel_PreFork 5
+#define srvModelStr_Uring "Uring"
+#define srvModel_Uring 6
+#define srvModelStr_Coro "Coro"
+#define srvModel_Coro 7
+#define srvModelStr_Udp "Udp"
+#define srvModel_Udp 8
+
+// What "Forking" does with new connections when it is full.
+#define overloadStr_Wait "Wait"
+#define overload_Wait 0
+#define overloadStr_Close "Close"
+#define overload_Close 1
+#define overloadStr_503 "503"
+#define overload_503 2
+
+#define forkAcceptBatch 16
+#define forkPollMs 1000
+
+// Exit status of a PreFork worker that could not start listening.
+#define preForkExit_NoListen 2
 
 #define initialLogLevel csc_log_NOTICE
 
 
 typedef struct
 {   int isQuit;
+    int isRestart;             // Asked for a hot restart.
+    int hotFd;                 // The new process says on this when it is serving.  -1 if none.
+    pid_t hotPid;              // The new process.
+    uint64_t hotUntilMs;       // When to give up on it.
+    unsigned hotGen;           // Counts the new processes started.
     csc_log_t *log;
 } servSig_t;
 
@@ -51,22 +119,844 @@ typedef struct
 {   int readTimeoutSecs, writeTimeoutSecs;
     int blacklistMax, blacklistExpire;
     int backlog, maxThreads;
+    int queueSize;
+    int maxConns;
+    int maxConnsPerChild;
+    int metricsPort;
+    int overloadAction;
+    void (*onShed)(int fd, void *local);  // NULL for OverloadAction's response.
+    int maxQueueWaitMs;        // 0 for no limit.
+    int drainSecs;
+    int coroThreads;
+    int coroStackKb;
+    int numaNode;              // -1 for none.
+    cpu_set_t nodeCpus;        // Those of numaNode.
+    cpu_set_t workerCpus;      // Workers are pinned to these in turn.
+    int nWorkerCpus;           // 0 if workers are not pinned.
+    csc_srv_sockOpts_t sockOpts;
+    csc_bool_t isUring;
+    int udpThreads;
+    int udpBatch;
+    int udpMaxPkt;
     int portNum;
     const char *ipStr;
 } config_t;
 
 static void sigHandler(int sigNum, void *context)
 {   servSig_t *servSig = context;
-    servSig->isQuit = csc_TRUE;
+    if (sigNum==SIGHUP || sigNum==SIGUSR2)
+        servSig->isRestart = csc_TRUE;
+    else
+        servSig->isQuit = csc_TRUE;
     csc_log_printf(servSig->log, csc_log_NOTICE,
                 "Received SIGNAL %d", sigNum);
 }
 
 
+// Blackness of the client's IP.  Uses the binary address, so that nothing
+// needs to be formatted to look it up.
+static int ipBlackness(csc_blacklist_t *blacklist, const csc_srv_addr_t *cliBin)
+{   return csc_blacklist_blacknessBin(blacklist, cliBin->ip, sizeof(cliBin->ip));
+}
+
+
+// ------------------------------------------------------------------
+// ------------------------ Hot restart -----------------------------
+
+// On SIGHUP or SIGUSR2, the program is run again as a new process, which
+// inherits the listening socket.  The environment tells it which
+// descriptors it has inherited.  Once it is serving, it writes a byte to
+// the ready pipe, and only then does this process stop accepting.  The
+// socket stays open throughout, so nothing queued on it is lost.  This
+// process goes on serving while it waits, watching the ready pipe along
+// with everything else.
+
+#define hotEnv_ListenFd "CSC_SERVBASE_LISTENFD"
+#define hotEnv_ReadyFd "CSC_SERVBASE_READYFD"
+#define hotReadyTimeoutSecs 30
+#define hotPollMs 1000
+#define hotDeletedSuffix " (deleted)"
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+extern char **environ;
+
+
+// Returns the path of this program, or NULL.  If the file has been
+// replaced since we started, this is the path of the replacement.
+static char *hotExePath(void)
+{   char path[PATH_MAX+1];
+    int len, suffixLen = strlen(hotDeletedSuffix);
+ 
+    len = readlink("/proc/self/exe", path, PATH_MAX);
+    if (len <= 0)
+        return NULL;
+    path[len] = '\0';
+    if (len>suffixLen && csc_streq(path+len-suffixLen, hotDeletedSuffix))
+        path[len-suffixLen] = '\0';
+    return csc_alloc_str(path);
+}
+
+
+// Returns the arguments this program was run with, as a NULL terminated
+// array, or NULL.  Free with hotFreeArgs().
+static char **hotReadArgs(void)
+{   char *buf = NULL;
+    char **args;
+    int bufSize = 0, len = 0, nRead, nArgs, i;
+    int fd = open("/proc/self/cmdline", O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+ 
+// Read them all.  They are separated by NULs.
+    do
+    {   if (len == bufSize)
+        {   bufSize = bufSize ? 2*bufSize : 1024;
+            buf = csc_ck_ralloc(buf, bufSize+1);
+        }
+        nRead = read(fd, buf+len, bufSize-len);
+        if (nRead > 0)
+            len += nRead;
+    } while (nRead>0 || (nRead==-1 && errno==EINTR));
+    close(fd);
+    if (len == 0)
+    {   free(buf);
+        return NULL;
+    }
+    buf[len] = '\0';
+ 
+// Point to each.
+    for (nArgs=0, i=0; i<len; i++)
+    {   if (buf[i] == '\0')
+            nArgs++;
+    }
+    args = csc_allocMany(char*, nArgs+1);
+    for (nArgs=0, i=0; i<len; i+=strlen(buf+i)+1)
+        args[nArgs++] = buf+i;
+    args[nArgs] = NULL;
+    return args;
+}
+
+
+static void hotFreeArgs(char **args)
+{   if (args != NULL)
+    {   free(args[0]);
+        free(args);
+    }
+}
+
+
+// Returns a copy of the environment, with 'vars' (NULL terminated) in
+// place of any variables for a hot restart.  Free with free().
+static char **hotEnv(char **vars)
+{   char **env;
+    int nEnv, nVars, i, j;
+ 
+    for (nEnv=0; environ[nEnv]!=NULL; nEnv++)
+        ;
+    for (nVars=0; vars[nVars]!=NULL; nVars++)
+        ;
+    env = csc_allocMany(char*, nEnv+nVars+1);
+    for (i=0, j=0; i<nEnv; i++)
+    {   if ( strncmp(environ[i], hotEnv_ListenFd "=", strlen(hotEnv_ListenFd)+1) != 0
+           && strncmp(environ[i], hotEnv_ReadyFd "=", strlen(hotEnv_ReadyFd)+1) != 0
+           )
+            env[j++] = environ[i];
+    }
+    for (i=0; i<nVars; i++)
+        env[j++] = vars[i];
+    env[j] = NULL;
+    return env;
+}
+
+
+// In the child about to run the new program.  Only 'fd1' and 'fd2' are to
+// be inherited, not whatever else this process has open.
+static void hotInherit(int fd1, int fd2)
+{   int fd, maxFd;
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3, ~0U, CLOSE_RANGE_CLOEXEC) != 0)
+#endif
+    {   maxFd = sysconf(_SC_OPEN_MAX);
+        if (maxFd<0 || maxFd>65536)
+            maxFd = 65536;
+        for (fd=3; fd<maxFd; fd++)
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    if (fd1 >= 0)
+        fcntl(fd1, F_SETFD, 0);
+    if (fd2 >= 0)
+        fcntl(fd2, F_SETFD, 0);
+}
+
+
+// Runs the program again, handing it 'listenSock' (or -1 for none), and
+// does not wait for it to be serving, but sets servSig->hotFd, on which it
+// will say so.  Logs why if it does not start.
+static void hotStart(servSig_t *servSig, int listenSock)
+{   char listenVar[sizeof(hotEnv_ListenFd)+12], readyVar[sizeof(hotEnv_ReadyFd)+12];
+    char *vars[3];
+    int readyPipe[2] = {-1, -1};
+    int nRead;
+    sigset_t noSigs;
+    pid_t pid, newPid = -1;
+    csc_log_t *log = servSig->log;
+ 
+// Resources.
+    char *exePath = NULL;
+    char **args = NULL;
+    char **env = NULL;
+ 
+// What to run, and how.  The ready pipe is a socket pair, so that the new
+// process can write to it with MSG_NOSIGNAL, in case we have gone.
+    exePath = hotExePath();
+    args = hotReadArgs();
+    if (exePath==NULL || args==NULL)
+    {   csc_log_str(log, csc_log_ERROR, "Hot restart: Cannot find how this program was run");
+        goto cleanup;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, readyPipe) != 0)
+    {   csc_log_printf(log, csc_log_ERROR, "Hot restart: socketpair: %s", strerror(errno));
+        goto cleanup;
+    }
+    sprintf(listenVar, "%s=%d", hotEnv_ListenFd, listenSock);
+    sprintf(readyVar, "%s=%d", hotEnv_ReadyFd, readyPipe[1]);
+    vars[0] = readyVar;
+    vars[1] = listenSock>=0 ? listenVar : NULL;
+    vars[2] = NULL;
+    env = hotEnv(vars);
+ 
+// Start it as a grandchild, so that it is not our child, and so outlives
+// us without being waited for.  The child tells us its process id.  It
+// starts with no signals blocked, whatever the model that started it
+// blocks.
+    pid = fork();
+    if (pid == 0)
+    {   newPid = fork();
+        if (newPid == 0)
+        {   hotInherit(listenSock, readyPipe[1]);
+            sigemptyset(&noSigs);
+            sigprocmask(SIG_SETMASK, &noSigs, NULL);
+            execve(exePath, args, env);
+            _exit(127);
+        }
+        write(readyPipe[1], &newPid, sizeof(newPid));
+        _exit(0);
+    }
+    close(readyPipe[1]);
+    readyPipe[1] = -1;
+    if (pid < 0)
+    {   csc_log_printf(log, csc_log_ERROR, "Hot restart: fork: %s", strerror(errno));
+        goto cleanup;
+    }
+    while (waitpid(pid, NULL, 0)==-1 && errno==EINTR)
+        ;
+    do
+    {   nRead = read(readyPipe[0], &newPid, sizeof(newPid));
+    } while (nRead==-1 && errno==EINTR);
+    if (nRead!=sizeof(newPid) || newPid<0)
+    {   csc_log_str(log, csc_log_ERROR, "Hot restart: Failed to start the new process");
+        goto cleanup;
+    }
+ 
+// It will say when it is serving, or close the pipe if it fails.
+    fcntl(readyPipe[0], F_SETFL, fcntl(readyPipe[0], F_GETFL) | O_NONBLOCK);
+    servSig->hotFd = readyPipe[0];
+    servSig->hotPid = newPid;
+    servSig->hotUntilMs = csc_timerWheel_nowMs() + hotReadyTimeoutSecs*1000;
+    servSig->hotGen++;
+    readyPipe[0] = -1;
+ 
+cleanup:
+    if (readyPipe[0] >= 0)
+        close(readyPipe[0]);
+    if (readyPipe[1] >= 0)
+        close(readyPipe[1]);
+    if (exePath)
+        free(exePath);
+    hotFreeArgs(args);
+    if (env)
+        free(env);
+}
+
+
+// Sees, without waiting, whether the new process has said that it is
+// serving.  If it has, or it has failed, or run out of time, closes
+// servSig->hotFd, having logged which.  Returns csc_TRUE if it is serving.
+static csc_bool_t hotIsReady(servSig_t *servSig)
+{   char ready;
+    int nRead = read(servSig->hotFd, &ready, 1);
+ 
+// Still waiting.
+    if (nRead==-1 && (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR))
+    {   if (csc_timerWheel_nowMs() < servSig->hotUntilMs)
+            return csc_FALSE;
+        kill(servSig->hotPid, SIGTERM);
+    }
+ 
+    if (nRead == 1)
+        csc_log_printf( servSig->log, csc_log_NOTICE
+                      , "Hot restart: New process %d is serving", (int)servSig->hotPid);
+    else
+        csc_log_printf( servSig->log, csc_log_ERROR
+                      , "Hot restart: New process %d did not start serving", (int)servSig->hotPid);
+    close(servSig->hotFd);
+    servSig->hotFd = -1;
+    return nRead == 1;
+}
+
+
+// If a hot restart has been asked for, starts a new process.  Then, each
+// time it is called, sees whether the new process is serving yet, without
+// waiting.  The loop calling it must also wake when servSig->hotFd is
+// readable, and at least every hotPollMs while it is open.  Returns
+// csc_TRUE once the new process is serving, so that this one should stop
+// accepting, and finish the connections that it has.
+static csc_bool_t hotHandOver(servSig_t *servSig, int listenSock)
+{   if (servSig->isRestart)
+    {   servSig->isRestart = csc_FALSE;
+        if (servSig->hotFd < 0)
+            hotStart(servSig, listenSock);
+    }
+    if (servSig->hotFd<0 || !hotIsReady(servSig))
+        return csc_FALSE;
+    csc_log_str(servSig->log, csc_log_NOTICE
+               , "Server finishing connections after hot restart");
+    return csc_TRUE;
+}
+
+
+// Waits for 'fd' (-1 for none) to be readable, or for the new process of a
+// hot restart to say whether it is serving, for 'timeoutMs', or for ever
+// if negative, but no more than hotPollMs while there is a new process.
+// Returns csc_TRUE if 'fd' is readable.
+static csc_bool_t hotPoll(servSig_t *servSig, int fd, int timeoutMs)
+{   struct pollfd pfds[2];
+    pfds[0].fd = fd;
+    pfds[1].fd = servSig->hotFd;
+    pfds[0].events = pfds[1].events = POLLIN;
+    pfds[0].revents = pfds[1].revents = 0;
+    if (servSig->hotFd>=0 && (timeoutMs<0 || timeoutMs>hotPollMs))
+        timeoutMs = hotPollMs;
+    if (poll(pfds, 2, timeoutMs) <= 0)
+        return csc_FALSE;
+    return pfds[0].revents != 0;
+}
+
+
+// Gives up on the new process of a hot restart, if there is one, when
+// this one quits.  If it starts, it serves alone.
+static void hotCancel(servSig_t *servSig)
+{   if (servSig->hotFd >= 0)
+    {   close(servSig->hotFd);
+        servSig->hotFd = -1;
+    }
+}
+
+
+// In the new process.  Returns the descriptor that was inherited under
+// the environment variable 'name', or -1, and removes the variable so
+// that it is not passed on.
+static int hotTakeFd(const char *name)
+{   const char *str = getenv(name);
+    int fd = -1;
+    if (str!=NULL && csc_isValid_int(str))
+        fd = atoi(str);
+    unsetenv(name);
+    if (fd>=0 && fcntl(fd, F_SETFD, FD_CLOEXEC)!=0)
+        fd = -1;
+    return fd;
+}
+
+
+// In the new process.  Tells the old one that we are serving.  It may have
+// gone, so this must not raise SIGPIPE.
+static void hotSignalReady(int *readyFd)
+{   char ready = 'R';
+    if (*readyFd >= 0)
+    {   send(*readyFd, &ready, 1, MSG_NOSIGNAL);
+        close(*readyFd);
+        *readyFd = -1;
+    }
+}
+
+
+// ------------------------------------------------------------------
+// ------------------------ CPU placement ---------------------------
+
+// NumaNode keeps the whole process on the CPUs of a node, and prefers the
+// node's memory.  CpuAffinity pins each worker to a CPU of its own, in
+// turn.  A worker is pinned before it allocates anything, so that with
+// Linux's first touch policy its buffers come from its own node.
+
+#define cpuAffinityStr_None "none"
+#define cpuAffinityStr_Auto "auto"
+#define cpuNodeCpuListPath "/sys/devices/system/node/node%d/cpulist"
+#define cpuMaxNodes 1024
+#define cpuMpolPreferred 1     // MPOL_PREFERRED in <linux/mempolicy.h>.
+
+
+// Parses a list of CPUs such as "0-3,8,10-11" into 'set'.
+static csc_bool_t cpuParseList(const char *str, cpu_set_t *set)
+{   const char *p = str;
+    char *end;
+    long first, last, cpu;
+ 
+    CPU_ZERO(set);
+    for (;;)
+    {   if (!isdigit((unsigned char)*p))
+            return csc_FALSE;
+        first = last = strtol(p, &end, 10);
+        p = end;
+        if (*p == '-')
+        {   p++;
+            if (!isdigit((unsigned char)*p))
+                return csc_FALSE;
+            last = strtol(p, &end, 10);
+            p = end;
+        }
+        if (first>last || last>=CPU_SETSIZE)
+            return csc_FALSE;
+        for (cpu=first; cpu<=last; cpu++)
+            CPU_SET(cpu, set);
+        if (*p != ',')
+            break;
+        p++;
+    }
+ 
+// The kernel's lists end with a new line.
+    while (isspace((unsigned char)*p))
+        p++;
+    return *p == '\0';
+}
+
+
+// Gets the CPUs of NUMA node 'node'.  Returns csc_FALSE if there is no
+// such node, or it has no CPUs.
+static csc_bool_t cpuNodeCpus(int node, cpu_set_t *set)
+{   char path[sizeof(cpuNodeCpuListPath) + 20];
+    char line[4096];
+    FILE *fp;
+    csc_bool_t isOk;
+ 
+    sprintf(path, cpuNodeCpuListPath, node);
+    fp = fopen(path, "r");
+    if (fp == NULL)
+        return csc_FALSE;
+    isOk = fgets(line, sizeof(line), fp) != NULL && cpuParseList(line, set);
+    fclose(fp);
+    return isOk && CPU_COUNT(set)>0;
+}
+
+
+// Keeps this process, and so every thread and process that it starts, on
+// the CPUs and memory of the configured NUMA node.
+static void cpuPlaceProcess(csc_log_t *log, const config_t *conf)
+{   unsigned long nodeMask[cpuMaxNodes / (8*sizeof(unsigned long))];
+    int bitsPerLong = 8 * sizeof(unsigned long);
+ 
+    if (conf->numaNode < 0)
+        return;
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &conf->nodeCpus) == -1)
+        csc_log_printf(log, csc_log_WARN, "sched_setaffinity: %s", strerror(errno));
+    memset(nodeMask, 0, sizeof(nodeMask));
+    nodeMask[conf->numaNode/bitsPerLong] |= 1UL << (conf->numaNode%bitsPerLong);
+    if (syscall(SYS_set_mempolicy, cpuMpolPreferred, nodeMask, (unsigned long)cpuMaxNodes+1) == -1)
+        csc_log_printf(log, csc_log_WARN, "set_mempolicy: %s", strerror(errno));
+}
+
+
+// Returns the CPU for worker 'iWorker', or -1 if workers are not pinned.
+static int cpuForWorker(const config_t *conf, int iWorker)
+{   int n, cpu;
+    if (conf->nWorkerCpus == 0)
+        return -1;
+    n = iWorker % conf->nWorkerCpus;
+    for (cpu=0; cpu<CPU_SETSIZE; cpu++)
+    {   if (CPU_ISSET(cpu, &conf->workerCpus) && n--==0)
+            return cpu;
+    }
+    return -1;
+}
+
+
+// Pins this thread to the CPU for worker 'iWorker', if workers are pinned.
+static void cpuPinSelf(csc_log_t *log, const config_t *conf, int iWorker)
+{   int cpu = cpuForWorker(conf, iWorker);
+    cpu_set_t set;
+    if (cpu < 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        csc_log_printf(log, csc_log_WARN, "sched_setaffinity: %s", strerror(errno));
+}
+
+
+// Sets up 'attr' for worker thread 'iWorker', pinned if workers are
+// pinned, so that it starts on its own CPU.
+static pthread_attr_t *cpuThreadAttr(const config_t *conf, int iWorker, pthread_attr_t *attr)
+{   int cpu = cpuForWorker(conf, iWorker);
+    cpu_set_t set;
+    pthread_attr_init(attr);
+    if (cpu >= 0)
+    {   CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+    }
+    return attr;
+}
+
+
+// ------------------------------------------------------------------
+// ------------------------ Metrics ---------------------------------
+
+// The registry is shared with forked processes, so the children of
+// "Forking" and the workers of "PreFork" add to the same metrics.  If
+// MetricsPort is set, a thread serves them in the Prometheus text format.
+
+#define metMaxMetrics 16
+#define metBacklog 10
+#define metTimeoutSecs 5
+
+
+typedef struct
+{   csc_metrics_t *reg;
+    csc_metric_t *accepted;    // Connections accepted.
+    csc_metric_t *blacklisted; // Connections rejected by the blacklist.
+    csc_metric_t *active;      // Connections being handled.
+    csc_metric_t *connSecs;    // How long each connection took.
+    csc_metric_t *forks;       // Processes forked.
+    csc_metric_t *shed;        // Connections turned away.
+    csc_metric_t *workers;     // Worker threads or processes running.
+    csc_metric_t *udpPackets;  // Packets received by "Udp".
+    csc_metric_t *udpReplies;  // Replies sent by "Udp".
+} srvMetrics_t;
+
+
+typedef struct
+{   csc_srv_t *srv;
+    csc_metrics_t *reg;
+    csc_log_t *log;
+    volatile int isQuit;
+    pthread_t thread;
+} metServer_t;
+
+
+// Registers our metrics.  Without a registry, the metrics are NULL, and
+// updating them does nothing.
+static void metInit(srvMetrics_t *met)
+{   csc_metrics_t *reg = csc_metrics_new(metMaxMetrics);
+    met->reg = reg;
+    met->accepted = met->blacklisted = met->active = NULL;
+    met->connSecs = met->forks = met->shed = met->workers = NULL;
+    met->udpPackets = met->udpReplies = NULL;
+    if (reg == NULL)
+        return;
+    met->accepted = csc_metrics_counter( reg, "csc_servbase_accepted_total"
+                                       , "Connections accepted.");
+    met->blacklisted = csc_metrics_counter( reg, "csc_servbase_blacklisted_total"
+                                          , "Connections rejected by the blacklist.");
+    met->active = csc_metrics_gauge( reg, "csc_servbase_active_connections"
+                                   , "Connections being handled.");
+    met->connSecs = csc_metrics_histogram( reg, "csc_servbase_connection_duration_seconds"
+                                         , "Time taken to handle each connection.", 1e-6);
+    met->forks = csc_metrics_counter( reg, "csc_servbase_forks_total"
+                                    , "Processes forked for connections or as workers.");
+    met->shed = csc_metrics_counter( reg, "csc_servbase_shed_total"
+                                   , "Connections turned away when full, or kept waiting too long.");
+    met->workers = csc_metrics_gauge( reg, "csc_servbase_workers"
+                                    , "Worker threads or processes running.");
+}
+
+
+// Registers the metrics of the "Udp" model.
+static void metInitUdp(srvMetrics_t *met)
+{   if (met->reg == NULL)
+        return;
+    met->udpPackets = csc_metrics_counter( met->reg, "csc_servbase_udp_packets_total"
+                                         , "UDP packets received.");
+    met->udpReplies = csc_metrics_counter( met->reg, "csc_servbase_udp_replies_total"
+                                         , "UDP replies sent.");
+}
+
+
+// Calls doConn(), counting it as active while it runs, and timing it.
+static void metDoConn( srvMetrics_t *met
+                     , int (*doConn)( int fd            // client file descriptor
+                                    , const char *clientIp   // IP of client, or NULL
+                                    , csc_ini_t *ini // Configuration object.
+                                    , csc_log_t *log  // Logging object.
+                                    , void *local
+                                    )
+                     , int fd, const char *cliAddr, csc_ini_t *ini, csc_log_t *log, void *local
+                     )
+{   uint64_t startUs = csc_metrics_nowUs();
+    csc_metric_add(met->active, 1);
+    doConn(fd, cliAddr, ini, log, local);
+    csc_metric_add(met->active, -1);
+    csc_metric_observe(met->connSecs, csc_metrics_nowUs()-startUs);
+}
+
+
+// Answers one request for the metrics, and closes the connection.
+static void metServe(metServer_t *ms, int fd)
+{   csc_httpErr_t errCode;
+    const char *statCode = "200";
+    const char *reason = csc_http_reason_200;
+    const char *method, *buf;
+    char lenStr[16];
+    int len, off, nSent;
+ 
+// Resources.
+    FILE *fin = NULL;
+    csc_http_t *req = csc_http_new();
+    csc_http_t *resp = csc_http_new();
+    csc_str_t *body = csc_str_new(NULL);
+    csc_str_t *out = csc_str_new(NULL);
+ 
+// Read the request.
+    csc_sock_setTimeout(fd, "r", metTimeoutSecs);
+    csc_sock_setTimeout(fd, "w", metTimeoutSecs);
+    fin = fdopen(fd, "r");
+    if (fin == NULL)
+    {   csc_log_printf(ms->log, csc_log_ERROR, "fdopen: %s", strerror(errno));
+        goto cleanup;
+    }
+    errCode = csc_http_rcvSrvFILE(req, fin);
+    method = csc_http_getSF(req, csc_httpSF_method);
+ 
+// Decide on the response.
+    if (errCode != csc_httpErr_Ok)
+    {   statCode = "400";
+        reason = csc_http_reason_400;
+    }
+    else if (!csc_streq(method,"GET") && !csc_streq(method,"HEAD"))
+    {   statCode = "405";
+        reason = csc_http_reason_405;
+    }
+    else if (!csc_streq(csc_http_getSF(req,csc_httpSF_reqUri), "/metrics"))
+    {   statCode = "404";
+        reason = csc_http_reason_404;
+    }
+    if (csc_streq(statCode, "200"))
+        csc_metrics_write(ms->reg, body);
+    else
+        csc_str_append_many(body, reason, "\n", NULL);
+ 
+// Compose it.
+    sprintf(lenStr, "%d", csc_str_length(body));
+    csc_http_addSF(resp, csc_httpSF_protocol, "HTTP/1.1");
+    csc_http_addSF(resp, csc_httpSF_statCode, statCode);
+    csc_http_addSF(resp, csc_httpSF_reason, reason);
+    csc_http_addHdr(resp, "Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+    csc_http_addHdr(resp, "Content-Length", lenStr);
+    csc_http_addHdr(resp, "Connection", "close");
+    csc_http_sendSrvStr(resp, out);
+    if (errCode!=csc_httpErr_Ok || !csc_streq(method,"HEAD"))
+        csc_str_append_str(out, body);
+ 
+// Send it.
+    buf = csc_str_charr(out);
+    len = csc_str_length(out);
+    for (off=0; off<len; off+=nSent)
+    {   nSent = send(fd, buf+off, len-off, MSG_NOSIGNAL);
+        if (nSent==-1 && errno==EINTR)
+            nSent = 0;
+        else if (nSent <= 0)
+            break;
+    }
+ 
+cleanup:  // Free resources.
+    if (fin)
+        fclose(fin);
+    else
+        close(fd);
+    csc_http_free(req);
+    csc_http_free(resp);
+    csc_str_free(body);
+    csc_str_free(out);
+}
+
+
+static void *metThread(void *arg)
+{   metServer_t *ms = arg;
+    int rwSock;
+ 
+    while (!ms->isQuit)
+    {   rwSock = csc_srv_accept(ms->srv);
+        if (ms->isQuit)
+        {   if (rwSock >= 0)
+                close(rwSock);
+        }
+        else if (rwSock >= 0)
+            metServe(ms, rwSock);
+        else if (rwSock != -2)
+        {   csc_log_str(ms->log, csc_log_ERROR, csc_srv_getErrMsg(ms->srv));
+            sleep(1);  // Do not spin on a lasting error.
+        }
+    }
+ 
+    return NULL;
+}
+
+
+// Starts serving the metrics.  Returns NULL on failure, having logged why.
+static metServer_t *metStart(csc_log_t *log, config_t *conf, csc_metrics_t *reg)
+{   sigset_t sigMask, oldSigMask;
+    metServer_t *ms;
+    int result;
+ 
+    if (reg == NULL)
+    {   csc_log_str(log, csc_log_FATAL, "Failed to create the metrics registry");
+        return NULL;
+    }
+    ms = csc_allocOne(metServer_t);
+    ms->reg = reg;
+    ms->log = log;
+    ms->isQuit = csc_FALSE;
+ 
+// Listen.  After a hot restart, the old process may still be listening
+// too, until it has finished.
+    ms->srv = csc_srv_new();
+    csc_srv_setReusePort(ms->srv, csc_TRUE);
+    if (!csc_srv_setAddr(ms->srv, conf->ipStr, conf->metricsPort, metBacklog))
+    {   csc_log_printf( log, csc_log_FATAL, "Metrics: %s"
+                      , csc_srv_getErrMsg(ms->srv));
+        csc_srv_free(ms->srv);
+        free(ms);
+        return NULL;
+    }
+ 
+// The thread blocks our signals, so that they interrupt the main thread,
+// and SIGCHLD, which "Forking" takes from a signalfd.
+    sigemptyset(&sigMask);
+    sigaddset(&sigMask, SIGINT);
+    sigaddset(&sigMask, SIGTERM);
+    sigaddset(&sigMask, SIGHUP);
+    sigaddset(&sigMask, SIGUSR2);
+    sigaddset(&sigMask, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &sigMask, &oldSigMask);
+    result = pthread_create(&ms->thread, NULL, metThread, ms);
+    pthread_sigmask(SIG_SETMASK, &oldSigMask, NULL);
+    if (result != 0)
+    {   csc_log_printf(log, csc_log_FATAL, "pthread_create: %s", strerror(result));
+        csc_srv_free(ms->srv);
+        free(ms);
+        return NULL;
+    }
+ 
+    csc_log_printf(log, csc_log_NOTICE, "Serving metrics on port %d", conf->metricsPort);
+    return ms;
+}
+
+
+static void metStop(metServer_t *ms)
+{
+// Shutting down the listening socket wakes the thread from accept().
+    ms->isQuit = csc_TRUE;
+    shutdown(csc_srv_getListenSock(ms->srv), SHUT_RDWR);
+    pthread_join(ms->thread, NULL);
+    csc_srv_free(ms->srv);
+    free(ms);
+}
+
+
+// ------------------------------------------------------------------
+// ------------------------ Admission -------------------------------
+
+// Connections that we cannot serve soon are turned away at once, rather
+// than left to time out, as OverloadAction says.  When told to quit, we
+// stop accepting, and give the connections that we have DrainSecs to
+// finish before cutting them off.
+
+#define shedReadSize 4096
+#define drainPollMs 50
+
+
+// Turns away a connection, e.g. because we are full.  'local' is for
+// conf->onShed().
+static void shedConn(srvMetrics_t *met, const config_t *conf, int fd, void *local)
+{   static const char resp503[] = "HTTP/1.1 503 " csc_http_reason_503 "\r\n"
+                                  "Content-Length: 0\r\n"
+                                  "Retry-After: 1\r\n"
+                                  "Connection: close\r\n"
+                                  "\r\n";
+    char buf[shedReadSize];
+ 
+// Take what the client has already sent, or closing would reset the
+// connection before it could read the response.
+    if (conf->onShed!=NULL || conf->overloadAction==overload_503)
+    {   if (conf->onShed != NULL)
+            conf->onShed(fd, local);
+        else
+            send(fd, resp503, sizeof(resp503)-1, MSG_DONTWAIT|MSG_NOSIGNAL);
+        shutdown(fd, SHUT_WR);
+        recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    }
+    close(fd);
+    csc_metric_add(met->shed, 1);
+}
+
+
+// The time by which draining must end, in csc_timerWheel_nowMs() terms, or
+// UINT64_MAX if 'drainSecs' is negative, i.e. for no limit.
+static uint64_t drainUntil(int drainSecs)
+{   if (drainSecs < 0)
+        return UINT64_MAX;
+    return csc_timerWheel_nowMs() + (uint64_t)drainSecs*1000;
+}
+
+
+// Waits for the child processes in 'pids' to finish, clearing their slots,
+// until 'untilMs', and then kills any that are left.  Returns the number
+// killed.
+static int drainChildren(pid_t *pids, int nPids, uint64_t untilMs)
+{   int nLeft = 0, nKilled, i;
+    pid_t pid;
+ 
+    for (i=0; i<nPids; i++)
+    {   if (pids[i] != 0)
+            nLeft++;
+    }
+    while (nLeft > 0)
+    {   pid = waitpid(-1, NULL, WNOHANG);
+        if (pid == -1 && errno != EINTR)
+            break;
+        else if (pid <= 0)
+        {   if (csc_timerWheel_nowMs() >= untilMs)
+                break;
+            poll(NULL, 0, drainPollMs);
+            continue;
+        }
+        for (i=0; i<nPids; i++)
+        {   if (pids[i] == pid)
+            {   pids[i] = 0;
+                nLeft--;
+            }
+        }
+    }
+ 
+// Cut off the rest.
+    nKilled = nLeft;
+    for (i=0; i<nPids; i++)
+    {   if (pids[i] != 0)
+        {   kill(pids[i], SIGKILL);
+            waitpid(pids[i], NULL, 0);
+            pids[i] = 0;
+        }
+    }
+    return nKilled;
+}
+
+
 static int serv_OneByOne( csc_log_t *log
                         , csc_ini_t *ini
                         , csc_srv_t *srv
                         , config_t *conf
+                        , srvMetrics_t *met
                         , int (*doConn)( int fd            // client file descriptor
                                        , const char *clientIp   // IP of client, or NULL
                                        , csc_ini_t *ini // Configuration object.
@@ -77,6 +967,7 @@ static int serv_OneByOne( csc_log_t *log
                         )
 {   int rwSock = -1;
     const char *cliAddr = NULL;
+    csc_srv_addr_t cliBin;
     int retVal = -2;
  
 // Resources.
@@ -89,18 +980,37 @@ static int serv_OneByOne( csc_log_t *log
 // Set up the signal handling.
     servSig_t servSig;
     servSig.isQuit = csc_FALSE;
+    servSig.isRestart = csc_FALSE;
+    servSig.hotFd = -1;
+    servSig.hotGen = 0;
     servSig.log = log;
     csc_signal_addHndl(SIGINT, sigHandler, &servSig);
     csc_signal_addHndl(SIGTERM, sigHandler, &servSig);
+    csc_signal_addHndl(SIGHUP, sigHandler, &servSig);
+    csc_signal_addHndl(SIGUSR2, sigHandler, &servSig);
  
 // Call accept.
     while (!servSig.isQuit)
-    {   rwSock = csc_srv_accept(srv);
+    {
+    // Let a new process take over, if asked.
+        if (hotHandOver(&servSig, csc_srv_getListenSock(srv)))
+        {   retVal = 1;
+            break;
+        }
+ 
+    // Wait for a connection, or for the new process to answer.  An adopted
+    // socket might not block.
+        if (hotPoll(&servSig, csc_srv_getListenSock(srv), -1))
+            rwSock = csc_srv_accept(srv);
+        else
+            rwSock = -2;
         if (rwSock==-2 && servSig.isQuit)   // Interrupted.
         {   retVal = 1;
             csc_log_str(log, csc_log_NOTICE
                         , "Server terminating due to caught signal");
         }
+        else if (rwSock==-2 || rwSock==-3)   // Interrupted, e.g. to restart, or none waiting.
+            continue;
         else if (rwSock < 0)   // Some sort of error.
         {   csc_log_str(log, csc_log_FATAL, csc_srv_getErrMsg(srv)); 
             servSig.isQuit = csc_TRUE;
@@ -110,11 +1020,14 @@ static int serv_OneByOne( csc_log_t *log
         {
         // Accept the connection.
             cliAddr = csc_srv_acceptAddr(srv);
+            csc_metric_add(met->accepted, 1);
  
         // Blacklisting.
-            if (blacklist && csc_blacklist_blackness(blacklist,cliAddr) > conf->blacklistMax)
+            csc_srv_acceptAddrBin(srv, &cliBin);
+            if (blacklist && ipBlackness(blacklist,&cliBin) > conf->blacklistMax)
             { // That IP has been blacklisted. Reject the connection.
                 close(rwSock);
+                csc_metric_add(met->blacklisted, 1);
                 csc_log_printf(log, csc_log_NOTICE, "Connection blacklisted %s", cliAddr);
             }
             else
@@ -132,14 +1045,17 @@ static int serv_OneByOne( csc_log_t *log
                 csc_sock_setTimeout(rwSock, "w", conf->writeTimeoutSecs);
      
             // Handle the connection.
-                doConn(rwSock, cliAddr, ini, log, local);
+                metDoConn(met, doConn, rwSock, cliAddr, ini, log, local);
             }
         }
     }
  
 // We are finished here, so remove the signal handling.
+    hotCancel(&servSig);
     csc_signal_delHndl(SIGINT, &servSig);
     csc_signal_delHndl(SIGTERM, &servSig);
+    csc_signal_delHndl(SIGHUP, &servSig);
+    csc_signal_delHndl(SIGUSR2, &servSig);
  
 // Free resources.
     if (blacklist)
@@ -149,10 +1065,27 @@ static int serv_OneByOne( csc_log_t *log
 }
 
 
+// Buries whatever children have finished, without blocking, clearing
+// their slots in 'pids'.  Returns the number buried.
+static int forkReap(pid_t *pids, int nPids)
+{   int nReaped = 0, i;
+    pid_t pid;
+    while ((pid=waitpid(-1, NULL, WNOHANG)) > 0)
+    {   for (i=0; i<nPids && pids[i]!=pid; i++)
+            ;
+        if (i < nPids)
+            pids[i] = 0;
+        nReaped++;
+    }
+    return nReaped;
+}
+
+
 static int serv_Forking( csc_log_t *log
                        , csc_ini_t *ini
                        , csc_srv_t *srv
                        , config_t *conf
+                       , srvMetrics_t *met
                        , int (*doConn)( int fd            // client file descriptor
                                       , const char *clientIp   // IP of client, or NULL
                                       , csc_ini_t *ini // Configuration object.
@@ -161,16 +1094,46 @@ static int serv_Forking( csc_log_t *log
                                       )
                        , void *local
                        )
-{   int rwSock = -1;
+{   csc_srv_accepted_t accepted[forkAcceptBatch];
+    char cliAddrBuf[csc_srv_AddrStrSize];
+    struct signalfd_siginfo sigInfo;
+    struct pollfd pollFds[3];
+    sigset_t chldMask, oldSigMask;
+    int rwSock = -1;
     const char *cliAddr = NULL;
+    csc_srv_addr_t cliBin;
     int retVal = -2;
     int numThreads = 0;
-    int isMoreDeadChildren = csc_FALSE;
+    int nReady, nAccepted, maxAccepted, i, iSlot;
+    int listenSock = csc_srv_getListenSock(srv);
+    int nForked = 0, nKilled;
+    int sigFd = -1;
     pid_t newChildProcId = 0;
     pid_t deadChildProcId = 0;
+    csc_bool_t isHandedOver = csc_FALSE;
     
 // Resources.
     csc_blacklist_t *blacklist = NULL;
+    pid_t *children = NULL;
+ 
+// Learn of children finishing through a descriptor that we poll along with
+// the listening socket, so that they are buried as soon as they finish,
+// even while we are full and not accepting.
+    sigemptyset(&chldMask);
+    sigaddset(&chldMask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chldMask, &oldSigMask);
+    sigFd = signalfd(-1, &chldMask, SFD_NONBLOCK|SFD_CLOEXEC);
+    if (sigFd == -1)
+    {   csc_log_printf(log, csc_log_FATAL, "signalfd: %s", strerror(errno)); 
+        sigprocmask(SIG_SETMASK, &oldSigMask, NULL);
+        return 0;
+    }
+ 
+// A slot for each child running, so that they can be cut off if they
+// take too long to finish when we quit.
+    children = csc_allocMany(pid_t, conf->maxThreads);
+    for (iSlot=0; iSlot<conf->maxThreads; iSlot++)
+        children[iSlot] = 0;
     
 // Set up blacklisting.
     if (conf->blacklistMax > 0)
@@ -179,119 +1142,2589 @@ static int serv_Forking( csc_log_t *log
 // Set up the signal handling.
     servSig_t servSig;
     servSig.isQuit = csc_FALSE;
+    servSig.isRestart = csc_FALSE;
+    servSig.hotFd = -1;
+    servSig.hotGen = 0;
     servSig.log = log;
     csc_signal_addHndl(SIGINT, sigHandler, &servSig);
     csc_signal_addHndl(SIGTERM, sigHandler, &servSig);
+    csc_signal_addHndl(SIGHUP, sigHandler, &servSig);
+    csc_signal_addHndl(SIGUSR2, sigHandler, &servSig);
  
-// Call accept.
+// Wait for connections, for children to finish, and for the new process
+// of a hot restart to answer.
+    pollFds[0].events = POLLIN;
+    pollFds[1].fd = sigFd;
+    pollFds[1].events = POLLIN;
+    pollFds[2].events = POLLIN;
     while (!servSig.isQuit)
-    {   rwSock = csc_srv_accept(srv);
-        if (rwSock==-2 && servSig.isQuit) // Interrupted.
+    {
+    // Let a new process take over, if asked.
+        if (hotHandOver(&servSig, listenSock))
+        {   isHandedOver = csc_TRUE;
+            retVal = 1;
+            break;
+        }
+ 
+    // When full, leave connections queued, unless told to turn them away.
+        if (numThreads>=conf->maxThreads && conf->overloadAction==overload_Wait)
+            pollFds[0].fd = -1;
+        else
+            pollFds[0].fd = listenSock;
+        pollFds[2].fd = servSig.hotFd;
+        nReady = poll(pollFds, 3, forkPollMs);
+        if (nReady==-1 && errno!=EINTR)
+        {   csc_log_printf(log, csc_log_FATAL, "poll: %s", strerror(errno)); 
+            servSig.isQuit = csc_TRUE;
+            retVal = 0;
+            break;
+        }
+        else if (servSig.isQuit)   // Interrupted.
         {   retVal = 1;
             csc_log_str(log, csc_log_NOTICE
                         , "Server terminating due to caught signal");
+            break;
         }
-        else if (rwSock < 0)  // Some sort of error.
+        else if (nReady <= 0)   // Interrupted, e.g. to restart, or timed out.
+        {   numThreads -= forkReap(children, conf->maxThreads);
+            continue;
+        }
+ 
+    // Bury the children that have finished.
+        if (pollFds[1].revents)
+        {   while (read(sigFd, &sigInfo, sizeof(sigInfo)) == sizeof(sigInfo))
+                ;
+            numThreads -= forkReap(children, conf->maxThreads);
+        }
+        if (!(pollFds[0].revents & POLLIN))
+            continue;
+ 
+    // Take the waiting connections, but no more than we can serve unless
+    // we are turning the rest away.
+        maxAccepted = forkAcceptBatch;
+        if (conf->overloadAction == overload_Wait)
+            maxAccepted = csc_min(maxAccepted, conf->maxThreads-numThreads);
+        nAccepted = csc_srv_acceptMany( srv, accepted, maxAccepted
+                                      , SOCK_CLOEXEC, csc_FALSE);
+        if (nAccepted==-2 || nAccepted==-3)   // Interrupted, or none left waiting.
+            continue;
+        else if (nAccepted < 0)  // Some sort of error.
         {   csc_log_str(log, csc_log_FATAL, csc_srv_getErrMsg(srv)); 
             servSig.isQuit = csc_TRUE;
             retVal = 0;
         }
-        else
+ 
+        for (i=0; i<nAccepted; i++)
         { // Successful accept.
+            rwSock = accepted[i].fd;
+            if (servSig.isQuit)
+            {   close(rwSock);
+                continue;
+            }
  
         // Log the start of the processing.
-            cliAddr = csc_srv_acceptAddr(srv);
+            csc_srv_acceptedAddrBin(&accepted[i], &cliBin);
+            cliAddr = csc_srv_addrBinStr(&cliBin, cliAddrBuf);
+            csc_metric_add(met->accepted, 1);
  
         // Blacklisting.
-            if (blacklist && csc_blacklist_blackness(blacklist, cliAddr) > conf->blacklistMax)
+            if (blacklist && ipBlackness(blacklist,&cliBin) > conf->blacklistMax)
             { // That IP has been blacklisted. Reject the connection.
                 close(rwSock);
+                csc_metric_add(met->blacklisted, 1);
                 csc_log_printf(log, csc_log_NOTICE, "Connection blacklisted %s", cliAddr);
+                continue;
             }
-            else
-            {
-            // Clean blacklist.
-                if (blacklist && csc_blacklist_accessCount(blacklist) > 200)
-                    csc_blacklist_clean(blacklist);
  
-            // Logging.
-                csc_log_printf(log, csc_log_NOTICE,
-                        "Accepted connection from %s", cliAddr);
- 
-            // Do the forking.
-                newChildProcId = fork();  // One process splits into two.
-                if (newChildProcId < 0)  // Error.  Fork failed.
-                {   csc_log_printf(log, csc_log_ERROR,
-                                    "fork: %s", strerror(errno)); 
-                    servSig.isQuit = csc_TRUE;
-                    retVal = 0;
-                }
-                else if (newChildProcId == 0)  // This is the child process.
-                {   
-                // Only parent accepts connections.  Remove signal handling for accept.
-                    csc_signal_delHndl(SIGINT, &servSig);
-                    csc_signal_delHndl(SIGTERM, &servSig);
-     
-                // Impose read/write timeouts.
-                    csc_sock_setTimeout(rwSock, "r", conf->readTimeoutSecs);
-                    csc_sock_setTimeout(rwSock, "w", conf->writeTimeoutSecs);
+        // Clean blacklist.
+            if (blacklist && csc_blacklist_accessCount(blacklist) > 200)
+                csc_blacklist_clean(blacklist);
+ 
+        // Turn it away if we are full.
+            if (numThreads >= conf->maxThreads)
+            {   shedConn(met, conf, rwSock, local);
+                csc_log_printf(log, csc_log_NOTICE, "Full.  Connection turned away %s", cliAddr);
+                continue;
+            }
+ 
+        // Logging.
+            csc_log_printf(log, csc_log_NOTICE,
+                    "Accepted connection from %s", cliAddr);
+ 
+        // Do the forking.  The child counts itself out as it finishes.
+            csc_metric_add(met->workers, 1);
+            newChildProcId = fork();  // One process splits into two.
+            if (newChildProcId < 0)  // Error.  Fork failed.
+            {   csc_metric_add(met->workers, -1);
+                csc_log_printf(log, csc_log_ERROR,
+                                "fork: %s", strerror(errno)); 
+                close(rwSock);
+                servSig.isQuit = csc_TRUE;
+                retVal = 0;
+            }
+            else if (newChildProcId == 0)  // This is the child process.
+            {   
+            // Only parent accepts connections.  Remove signal handling for accept.
+                csc_signal_delHndl(SIGINT, &servSig);
+                csc_signal_delHndl(SIGTERM, &servSig);
+                csc_signal_delHndl(SIGHUP, &servSig);
+                csc_signal_delHndl(SIGUSR2, &servSig);
+ 
+            // Nor does it watch for children.  Give doConn() the signal mask
+            // that we were given.
+                close(sigFd);
+                sigprocmask(SIG_SETMASK, &oldSigMask, NULL);
      
-                // Handle the connection.
-                    doConn(rwSock, cliAddr, ini, log, local);
+            // Take the next CPU in turn, if pinning.
+                cpuPinSelf(log, conf, nForked);
      
-                // Child finished therefore child dies.
-                    exit(0);
-                }
-                else  // This is the parent process.
-                {   numThreads++;  // The parent has created another thread.
-                    close(rwSock);  // Must close or else have socket for every child started.
+            // Impose read/write timeouts.
+                csc_sock_setTimeout(rwSock, "r", conf->readTimeoutSecs);
+                csc_sock_setTimeout(rwSock, "w", conf->writeTimeoutSecs);
      
-                // If we are up to the maximum number of threads, then block until a child dies.
-                    if (numThreads == conf->maxThreads)
-                    {   deadChildProcId = wait(NULL);
-                        // fprintf(csc_stderr, "Full up child buried.\n");
-                        numThreads--;  // One thread died.
-                    }
+            // Handle the connection.
+                metDoConn(met, doConn, rwSock, cliAddr, ini, log, local);
+                csc_metric_add(met->workers, -1);
      
-                // Collect all available dead children without blocking.
-                    isMoreDeadChildren = csc_TRUE;
-                    while (isMoreDeadChildren && numThreads>0)
-                    {   deadChildProcId = waitpid(-1,NULL,WNOHANG);
-                        if (deadChildProcId == 0)
-                        {   isMoreDeadChildren = csc_FALSE;  // Failed.  No more dead.  Terminate loop.
-                            // fprintf(csc_stderr, "No more dead children.\n");
-                        }
-                        else
-                        {   numThreads --;  // One child died.
-                            // fprintf(csc_stderr, "Child buried.\n");
-                        }
-                    }
-                } // Parent process.
-            } // Not blacklisted.
-        } // Successful accept.
+            // Child finished therefore child dies.
+                exit(0);
+            }
+            else  // This is the parent process.
+            {   for (iSlot=0; children[iSlot]!=0; iSlot++)
+                    ;
+                children[iSlot] = newChildProcId;
+                numThreads++;  // The parent has created another thread.
+                nForked++;
+                csc_metric_add(met->forks, 1);
+                close(rwSock);  // Must close or else have socket for every child started.
+            }
+        } // For each connection.
     } // While we are not quitting.
  
-// Collect all available dead children without blocking.
-    isMoreDeadChildren = csc_TRUE;
-    while (isMoreDeadChildren && numThreads>0)
-    {   deadChildProcId = waitpid(-1,NULL,WNOHANG);
-        if (deadChildProcId == 0)
-        {   isMoreDeadChildren = csc_FALSE;  // Failed.  No more dead.  Terminate loop.
-            // fprintf(csc_stderr, "No more dead children.\n");
+// After a hot restart, wait for the connections in progress, unless told
+// to quit.
+    while (isHandedOver && numThreads>0 && !servSig.isQuit)
+    {   deadChildProcId = wait(NULL);
+        if (deadChildProcId > 0)
+        {   for (iSlot=0; iSlot<conf->maxThreads && children[iSlot]!=deadChildProcId; iSlot++)
+                ;
+            if (iSlot < conf->maxThreads)
+                children[iSlot] = 0;
+            numThreads--;
         }
-        else
-        {   numThreads --;  // One child died.
-            // fprintf(csc_stderr, "Child buried.\n");
+        else if (errno != EINTR)
+            break;
+    }
+ 
+// Give the rest DrainSecs to finish.  Those cut off do not count
+// themselves out.
+    nKilled = drainChildren(children, conf->maxThreads, drainUntil(conf->drainSecs));
+    if (nKilled > 0)
+    {   csc_metric_add(met->workers, -nKilled);
+        csc_log_printf( log, csc_log_WARN, "%d connections cut off after %d seconds of draining"
+                      , nKilled, conf->drainSecs);
+    }
+ 
+// Restore the signal handling.
+    hotCancel(&servSig);
+    csc_signal_delHndl(SIGINT, &servSig);
+    csc_signal_delHndl(SIGTERM, &servSig);
+    csc_signal_delHndl(SIGHUP, &servSig);
+    csc_signal_delHndl(SIGUSR2, &servSig);
+    close(sigFd);
+    sigprocmask(SIG_SETMASK, &oldSigMask, NULL);
+ 
+// Free resources.
+    if (blacklist)
+        csc_blacklist_free(blacklist);
+    free(children);
+ 
+    return retVal;
+}
+
+
+// ------------------------------------------------------------------
+// ---------------------- ThreadPool model --------------------------
+
+#define poolAcceptBatch 64
+
+
+typedef struct
+{   csc_srv_accepted_t accepted;
+    uint64_t queuedMs;         // When it was queued, if MaxQueueWaitMs.
+} poolEntry_t;
+
+
+typedef struct
+{   pthread_mutex_t mutex;
+    pthread_cond_t notEmpty;   // Signalled when a connection is queued.
+    pthread_cond_t notFull;    // Signalled when a connection is dequeued.
+    pthread_cond_t allDone;    // Signalled when a worker finishes.
+    poolEntry_t *conns;        // Circular queue of accepted connections.
+    int queueSize, head, count;
+    int isQuit;
+    int isCut;                 // Draining took too long.
+    int nRunning;              // Workers that have not finished.
+    csc_log_t *log;
+    csc_ini_t *ini;
+    config_t *conf;
+    srvMetrics_t *met;
+    int (*doConn)( int fd, const char *clientIp
+                 , csc_ini_t *ini, csc_log_t *log, void *local);
+    void *local;
+} pool_t;
+
+
+typedef struct
+{   pool_t *pool;
+    int cutFd;                 // A duplicate of the connection's descriptor,
+                               // so that it can be cut off, or -1.
+    pthread_t thread;
+} poolWorker_t;
+
+
+static void *poolWorker(void *arg)
+{   poolWorker_t *worker = arg;
+    pool_t *pool = worker->pool;
+    poolEntry_t entry;
+    csc_srv_accepted_t conn;
+    char cliAddrBuf[csc_srv_AddrStrSize];
+    const char *cliAddr;
+    csc_bool_t isStale;
+ 
+    for (;;)
+    {
+    // Wait for a connection to arrive in the queue.  We are no longer
+    // handling the last one, so it can no longer be cut off.
+        pthread_mutex_lock(&pool->mutex);
+        if (worker->cutFd >= 0)
+        {   close(worker->cutFd);
+            worker->cutFd = -1;
+        }
+        while (pool->count==0 && !pool->isQuit)
+            pthread_cond_wait(&pool->notEmpty, &pool->mutex);
+ 
+    // Queue is empty and we are quitting, so we are done.
+        if (pool->count == 0)
+        {   pool->nRunning--;
+            pthread_cond_signal(&pool->allDone);
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+ 
+    // Take the connection from the head of the queue.
+        entry = pool->conns[pool->head];
+        conn = entry.accepted;
+        pool->head = (pool->head + 1) % pool->queueSize;
+        pool->count--;
+        isStale = pool->isCut || ( pool->conf->maxQueueWaitMs > 0
+                                 && csc_timerWheel_nowMs()-entry.queuedMs > (uint64_t)pool->conf->maxQueueWaitMs);
+        if (!isStale)
+            worker->cutFd = dup(conn.fd);
+        pthread_cond_signal(&pool->notFull);
+        pthread_mutex_unlock(&pool->mutex);
+ 
+    // Logging.  The address is formatted here, rather than by the accepting thread.
+        cliAddr = csc_srv_addrStr(&conn, cliAddrBuf, sizeof(cliAddrBuf));
+ 
+    // Turn it away if it has waited too long for its answer to be of use,
+    // or we are giving up.
+        if (isStale)
+        {   shedConn(pool->met, pool->conf, conn.fd, pool->local);
+            csc_log_printf(pool->log, csc_log_NOTICE,
+                        "Waited too long.  Connection turned away %s", cliAddr);
+            continue;
+        }
+        csc_log_printf(pool->log, csc_log_NOTICE,
+                    "Accepted connection from %s", cliAddr);
+ 
+    // Impose read/write timeouts.
+        csc_sock_setTimeout(conn.fd, "r", pool->conf->readTimeoutSecs);
+        csc_sock_setTimeout(conn.fd, "w", pool->conf->writeTimeoutSecs);
+ 
+    // Handle the connection.
+        metDoConn(pool->met, pool->doConn, conn.fd, cliAddr, pool->ini, pool->log, pool->local);
+    }
+ 
+    return NULL;
+}
+
+
+// Places a connection on the queue, waiting for room if the queue is full,
+// unless OverloadAction says to turn it away.  Returns FALSE without
+// queuing if we are asked to quit while waiting, or it is turned away.
+static csc_bool_t poolPut(pool_t *pool, servSig_t *servSig, const csc_srv_accepted_t *accepted)
+{   struct timespec until;
+    poolEntry_t *entry;
+ 
+    pthread_mutex_lock(&pool->mutex);
+ 
+// Wait for room.  Wake once a second to check for signals.
+    while ( pool->count==pool->queueSize && !servSig->isQuit
+          && pool->conf->overloadAction==overload_Wait)
+    {   clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += 1;
+        pthread_cond_timedwait(&pool->notFull, &pool->mutex, &until);
+    }
+    if (servSig->isQuit || pool->count==pool->queueSize)
+    {   pthread_mutex_unlock(&pool->mutex);
+        return csc_FALSE;
+    }
+ 
+// Add the connection to the tail of the queue.
+    entry = &pool->conns[(pool->head + pool->count) % pool->queueSize];
+    entry->accepted = *accepted;
+    if (pool->conf->maxQueueWaitMs > 0)
+        entry->queuedMs = csc_timerWheel_nowMs();
+    pool->count++;
+    pthread_cond_signal(&pool->notEmpty);
+ 
+    pthread_mutex_unlock(&pool->mutex);
+    return csc_TRUE;
+}
+
+
+static int serv_ThreadPool( csc_log_t *log
+                          , csc_ini_t *ini
+                          , csc_srv_t *srv
+                          , config_t *conf
+                          , srvMetrics_t *met
+                          , int (*doConn)( int fd            // client file descriptor
+                                         , const char *clientIp   // IP of client, or NULL
+                                         , csc_ini_t *ini // Configuration object.
+                                         , csc_log_t *log  // Logging object.
+                                         , void *local
+                                         )
+                          , void *local
+                          )
+{   csc_srv_accepted_t accepted[poolAcceptBatch];
+    char cliAddrBuf[csc_srv_AddrStrSize];
+    csc_srv_addr_t cliBin;
+    int nAccepted, i;
+    int retVal = -2;
+    int iThread, nThreads = 0;
+    int result;
+    sigset_t sigMask, oldSigMask;
+    pthread_attr_t attr;
+    struct timespec until;
+    uint64_t drainUntilMs;
+    csc_bool_t isHandedOver = csc_FALSE;
+    pool_t pool;
+ 
+// Resources.
+    csc_blacklist_t *blacklist = NULL;
+    poolWorker_t *workers = NULL;
+ 
+// Check the configuration.
+    if (conf->maxThreads < 1)
+    {   csc_log_printf(log, csc_log_FATAL
+                      , "\"%s\" must be at least 1 for the %s model"
+                      , configId_MaxThreads, srvModelStr_ThreadPool);
+        return 0;
+    }
+ 
+// Set up the connection queue.
+    pool.queueSize = conf->queueSize;
+    pool.conns = csc_allocMany(poolEntry_t, pool.queueSize);
+    pool.head = 0;
+    pool.count = 0;
+    pool.isQuit = csc_FALSE;
+    pool.isCut = csc_FALSE;
+    pool.nRunning = 0;
+    pool.log = log;
+    pool.ini = ini;
+    pool.conf = conf;
+    pool.met = met;
+    pool.doConn = doConn;
+    pool.local = local;
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.notEmpty, NULL);
+    pthread_cond_init(&pool.notFull, NULL);
+    pthread_cond_init(&pool.allDone, NULL);
+    
+// Set up blacklisting.
+    if (conf->blacklistMax > 0)
+        blacklist = csc_blacklist_new(conf->blacklistExpire);
+ 
+// Set up the signal handling.
+    servSig_t servSig;
+    servSig.isQuit = csc_FALSE;
+    servSig.isRestart = csc_FALSE;
+    servSig.hotFd = -1;
+    servSig.hotGen = 0;
+    servSig.log = log;
+    csc_signal_addHndl(SIGINT, sigHandler, &servSig);
+    csc_signal_addHndl(SIGTERM, sigHandler, &servSig);
+    csc_signal_addHndl(SIGHUP, sigHandler, &servSig);
+    csc_signal_addHndl(SIGUSR2, sigHandler, &servSig);
+ 
+// Start the workers.  They block our signals, so that these are
+// delivered to this thread, and interrupt accept().
+    sigemptyset(&sigMask);
+    sigaddset(&sigMask, SIGINT);
+    sigaddset(&sigMask, SIGTERM);
+    sigaddset(&sigMask, SIGHUP);
+    sigaddset(&sigMask, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &sigMask, &oldSigMask);
+    workers = csc_allocMany(poolWorker_t, conf->maxThreads);
+    for (iThread=0; iThread<conf->maxThreads; iThread++)
+    {   workers[iThread].pool = &pool;
+        workers[iThread].cutFd = -1;
+        pool.nRunning++;
+        result = pthread_create( &workers[iThread].thread, cpuThreadAttr(conf, iThread, &attr)
+                               , poolWorker, &workers[iThread]);
+        pthread_attr_destroy(&attr);
+        if (result != 0)
+        {   csc_log_printf(log, csc_log_ERROR,
+                            "pthread_create: %s", strerror(result)); 
+            pool.nRunning--;
+            servSig.isQuit = csc_TRUE;
+            retVal = 0;
+            break;
+        }
+        nThreads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &oldSigMask, NULL);
+    csc_metric_set(met->workers, nThreads);
+ 
+// Call accept.  Take whatever connections are waiting in one go.
+    while (!servSig.isQuit)
+    {
+    // Let a new process take over, if asked.
+        if (hotHandOver(&servSig, csc_srv_getListenSock(srv)))
+        {   isHandedOver = csc_TRUE;
+            retVal = 1;
+            break;
+        }
+ 
+    // Wait for connections, or for the new process to answer.
+        if (hotPoll(&servSig, csc_srv_getListenSock(srv), -1))
+            nAccepted = csc_srv_acceptMany( srv, accepted, poolAcceptBatch
+                                          , SOCK_CLOEXEC, csc_FALSE);
+        else
+            nAccepted = -2;
+        if (nAccepted==-2 && servSig.isQuit)   // Interrupted.
+        {   retVal = 1;
+            csc_log_str(log, csc_log_NOTICE
+                        , "Server terminating due to caught signal");
+        }
+        else if (nAccepted==-2 || nAccepted==-3)   // Interrupted, e.g. to restart, or none waiting.
+            continue;
+        else if (nAccepted < 0)   // Some sort of error.
+        {   csc_log_str(log, csc_log_FATAL, csc_srv_getErrMsg(srv)); 
+            servSig.isQuit = csc_TRUE;
+            retVal = 0;
+        }
+        else for (i=0; i<nAccepted; i++)  // The sockets are OK.
+        {   csc_metric_add(met->accepted, 1);
+ 
+        // Blacklisting.
+            if (blacklist)
+            {   csc_srv_acceptedAddrBin(&accepted[i], &cliBin);
+                if (ipBlackness(blacklist,&cliBin) > conf->blacklistMax)
+                { // That IP has been blacklisted. Reject the connection.
+                    close(accepted[i].fd);
+                    csc_metric_add(met->blacklisted, 1);
+                    csc_log_printf( log, csc_log_NOTICE, "Connection blacklisted %s"
+                                  , csc_srv_addrBinStr(&cliBin, cliAddrBuf));
+                    continue;
+                }
+ 
+            // Clean blacklist.
+                if (csc_blacklist_accessCount(blacklist) > 200)
+                    csc_blacklist_clean(blacklist);
+            }
+ 
+        // Hand the connection to a worker.
+            if (servSig.isQuit)
+                close(accepted[i].fd);
+            else if (poolPut(&pool, &servSig, &accepted[i]))
+                ;
+            else if (servSig.isQuit)
+            {   close(accepted[i].fd);
+                retVal = 1;
+                csc_log_str(log, csc_log_NOTICE
+                            , "Server terminating due to caught signal");
+            }
+            else  // Full, and told to turn it away.
+            {   shedConn(met, conf, accepted[i].fd, local);
+                csc_log_printf( log, csc_log_NOTICE, "Full.  Connection turned away %s"
+                              , csc_srv_addrStr(&accepted[i], cliAddrBuf, sizeof(cliAddrBuf)));
+            }
+        }
+    }
+ 
+// Tell the workers to finish the queued connections and then quit.  Unless
+// handing over, give them DrainSecs, and then cut off the connections that
+// they have, and turn away those queued.
+    drainUntilMs = drainUntil(isHandedOver ? -1 : conf->drainSecs);
+    pthread_mutex_lock(&pool.mutex);
+    pool.isQuit = csc_TRUE;
+    pthread_cond_broadcast(&pool.notEmpty);
+    while (pool.nRunning>0 && csc_timerWheel_nowMs()<drainUntilMs)
+    {   clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += 1;
+        pthread_cond_timedwait(&pool.allDone, &pool.mutex, &until);
+    }
+    if (pool.nRunning > 0)
+    {   pool.isCut = csc_TRUE;
+        for (iThread=0; iThread<nThreads; iThread++)
+        {   if (workers[iThread].cutFd >= 0)
+                shutdown(workers[iThread].cutFd, SHUT_RD);
+        }
+        csc_log_printf( log, csc_log_WARN, "Connections cut off after %d seconds of draining"
+                      , conf->drainSecs);
+    }
+    pthread_mutex_unlock(&pool.mutex);
+    for (iThread=0; iThread<nThreads; iThread++)
+        pthread_join(workers[iThread].thread, NULL);
+    csc_metric_set(met->workers, 0);
+ 
+// A queued connection can only be left if there were no workers.
+    while (pool.count > 0)
+    {   close(pool.conns[pool.head].accepted.fd);
+        pool.head = (pool.head + 1) % pool.queueSize;
+        pool.count--;
+    }
+ 
+// We are finished here, so remove the signal handling.
+    hotCancel(&servSig);
+    csc_signal_delHndl(SIGINT, &servSig);
+    csc_signal_delHndl(SIGTERM, &servSig);
+    csc_signal_delHndl(SIGHUP, &servSig);
+    csc_signal_delHndl(SIGUSR2, &servSig);
+ 
+// Free resources.
+    if (blacklist)
+        csc_blacklist_free(blacklist);
+    free(workers);
+    free(pool.conns);
+    pthread_cond_destroy(&pool.allDone);
+    pthread_cond_destroy(&pool.notFull);
+    pthread_cond_destroy(&pool.notEmpty);
+    pthread_mutex_destroy(&pool.mutex);
+ 
+    return retVal;
+}
+
+
+// ------------------------------------------------------------------
+// ---------------------- Coro model --------------------------------
+
+// A few threads, each running a coroutine for each of its connections,
+// and one that accepts them.  doConn() is written as blocking code, but
+// does its I/O with csc_coro_read(), csc_coro_write() or csc_coro_fdopen(),
+// so that it yields to the other coroutines rather than blocking the
+// thread.
+
+#define coroWaitMs 1000
+
+
+typedef struct
+{   csc_srv_t *srv;
+    int listenSock;
+    int maxConns;              // For each thread.
+    volatile int isStop;
+    uint64_t drainUntilMs;     // When to cut off connections once stopped.
+    pthread_mutex_t blacklistMutex;
+    csc_blacklist_t *blacklist;
+    csc_log_t *log;
+    csc_ini_t *ini;
+    config_t *conf;
+    srvMetrics_t *met;
+    int (*doConn)( int fd, const char *clientIp
+                 , csc_ini_t *ini, csc_log_t *log, void *local);
+    void *local;
+} coroPool_t;
+
+
+typedef struct coroConn_t coroConn_t;
+
+
+typedef struct
+{   coroPool_t *pool;
+    csc_coroSched_t *sched;
+    csc_coro_t *acceptor;
+    int nConns;
+    coroConn_t *conns;         // Those being handled.
+    pthread_t thread;
+} coroWorker_t;
+
+
+struct coroConn_t
+{   coroWorker_t *worker;
+    csc_srv_accepted_t accepted;
+    int cutFd;                 // A duplicate of the descriptor, so that the
+                               // connection can be cut off.
+    coroConn_t *prev, *next;
+};
+
+
+// Handles one connection.
+static void coroConn(void *arg)
+{   coroConn_t *conn = arg;
+    coroWorker_t *worker = conn->worker;
+    coroPool_t *pool = worker->pool;
+    char cliAddrBuf[csc_srv_AddrStrSize];
+    const char *cliAddr;
+    int fd = conn->accepted.fd;
+ 
+// Logging.
+    cliAddr = csc_srv_addrStr(&conn->accepted, cliAddrBuf, sizeof(cliAddrBuf));
+    csc_log_printf(pool->log, csc_log_NOTICE,
+                "Accepted connection from %s", cliAddr);
+ 
+// Impose read/write timeouts.  The coroutine I/O honours them.
+    csc_sock_setTimeout(fd, "r", pool->conf->readTimeoutSecs);
+    csc_sock_setTimeout(fd, "w", pool->conf->writeTimeoutSecs);
+ 
+// Handle the connection.
+    metDoConn(pool->met, pool->doConn, fd, cliAddr, pool->ini, pool->log, pool->local);
+ 
+// Make room for another.
+    if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        worker->conns = conn->next;
+    if (conn->next)
+        conn->next->prev = conn->prev;
+    close(conn->cutFd);
+    free(conn);
+    worker->nConns--;
+    if (worker->acceptor != NULL)
+        csc_coro_wake(worker->acceptor);
+}
+
+
+// Returns csc_TRUE if the client is blacklisted.  The blacklist is shared
+// by the threads.
+static csc_bool_t coroIsBlack(coroPool_t *pool, csc_srv_accepted_t *accepted)
+{   char cliAddrBuf[csc_srv_AddrStrSize];
+    csc_srv_addr_t cliBin;
+    csc_bool_t isBlack;
+ 
+    if (pool->blacklist == NULL)
+        return csc_FALSE;
+    csc_srv_acceptedAddrBin(accepted, &cliBin);
+    pthread_mutex_lock(&pool->blacklistMutex);
+    isBlack = ipBlackness(pool->blacklist,&cliBin) > pool->conf->blacklistMax;
+    if (csc_blacklist_accessCount(pool->blacklist) > 200)
+        csc_blacklist_clean(pool->blacklist);
+    pthread_mutex_unlock(&pool->blacklistMutex);
+ 
+    if (isBlack)
+    {   csc_metric_add(pool->met->blacklisted, 1);
+        csc_log_printf( pool->log, csc_log_NOTICE, "Connection blacklisted %s"
+                      , csc_srv_addrBinStr(&cliBin, cliAddrBuf));
+    }
+    return isBlack;
+}
+
+
+// Accepts connections for one thread, starting a coroutine for each.
+// Wakes at least once a second to see whether to stop.  Then gives the
+// connections DrainSecs to finish before cutting them off.
+static void coroAcceptor(void *arg)
+{   coroWorker_t *worker = arg;
+    coroPool_t *pool = worker->pool;
+    char cliAddrBuf[csc_srv_AddrStrSize];
+    csc_srv_accepted_t accepted;
+    coroConn_t *conn;
+    uint64_t nowMs;
+    int rwSock;
+ 
+    while (!pool->isStop)
+    {
+    // When full, wait for a connection to finish, unless told to turn
+    // connections away.
+        if ( worker->nConns >= pool->maxConns
+           && pool->conf->overloadAction == overload_Wait)
+        {   csc_coro_sleep(coroWaitMs);
+            continue;
+        }
+ 
+    // The listening socket is shared by the threads, and does not block.
+        accepted.addrLen = sizeof(accepted.addr);
+        rwSock = accept4( pool->listenSock, (struct sockaddr*)&accepted.addr
+                        , &accepted.addrLen, SOCK_CLOEXEC);
+        if (rwSock < 0)
+        {   if (errno==EAGAIN || errno==EWOULDBLOCK)
+                csc_coro_waitFd(pool->listenSock, POLLIN, coroWaitMs);
+            else if (errno!=ECONNABORTED && errno!=EINTR)
+            {   csc_log_printf(pool->log, csc_log_ERROR, "accept: %s", strerror(errno));
+                csc_coro_sleep(coroWaitMs);
+            }
+            continue;
+        }
+        accepted.fd = rwSock;
+        csc_srv_tuneAccepted(pool->srv, rwSock);
+        csc_metric_add(pool->met->accepted, 1);
+ 
+    // Blacklisting.
+        if (coroIsBlack(pool, &accepted))
+        {   close(rwSock);
+            continue;
+        }
+ 
+    // Turn it away if we are full.
+        if (worker->nConns >= pool->maxConns)
+        {   shedConn(pool->met, pool->conf, rwSock, pool->local);
+            csc_log_printf( pool->log, csc_log_NOTICE, "Full.  Connection turned away %s"
+                          , csc_srv_addrStr(&accepted, cliAddrBuf, sizeof(cliAddrBuf)));
+            continue;
+        }
+ 
+    // Start a coroutine for it.
+        conn = csc_allocOne(coroConn_t);
+        conn->worker = worker;
+        conn->accepted = accepted;
+        conn->cutFd = dup(rwSock);
+        if (csc_coro_spawn(worker->sched, coroConn, conn) == NULL)
+        {   csc_log_str(pool->log, csc_log_ERROR, "Failed to start a coroutine");
+            close(conn->cutFd);
+            close(rwSock);
+            free(conn);
+            continue;
+        }
+        conn->prev = NULL;
+        conn->next = worker->conns;
+        if (worker->conns)
+            worker->conns->prev = conn;
+        worker->conns = conn;
+        worker->nConns++;
+    }
+ 
+// Wait for the connections to finish.  Each wakes us as it does.
+    while (worker->nConns>0 && (nowMs=csc_timerWheel_nowMs())<pool->drainUntilMs)
+        csc_coro_sleep(pool->drainUntilMs-nowMs < coroWaitMs ? pool->drainUntilMs-nowMs : coroWaitMs);
+ 
+// Cut off those that are left.  Their reads see the end of their input.
+    if (worker->nConns > 0)
+    {   csc_log_printf( pool->log, csc_log_WARN, "%d connections cut off after %d seconds of draining"
+                      , worker->nConns, pool->conf->drainSecs);
+        for (conn=worker->conns; conn!=NULL; conn=conn->next)
+            shutdown(conn->cutFd, SHUT_RD);
+    }
+ 
+// We are about to end, and may be freed or reused, so those connections
+// must not wake us.
+    worker->acceptor = NULL;
+}
+
+
+static void *coroThread(void *arg)
+{   coroWorker_t *worker = arg;
+    if (!csc_coroSched_run(worker->sched))
+        csc_log_printf(worker->pool->log, csc_log_ERROR, "epoll_wait: %s", strerror(errno));
+    return NULL;
+}
+
+
+static int serv_Coro( csc_log_t *log
+                    , csc_ini_t *ini
+                    , csc_srv_t *srv
+                    , config_t *conf
+                    , srvMetrics_t *met
+                    , int (*doConn)( int fd            // client file descriptor
+                                   , const char *clientIp   // IP of client, or NULL
+                                   , csc_ini_t *ini // Configuration object.
+                                   , csc_log_t *log  // Logging object.
+                                   , void *local
+                                   )
+                    , void *local
+                    )
+{   int listenSock = csc_srv_getListenSock(srv);
+    int retVal = -2;
+    int iThread, nThreads = 0;
+    int result;
+    sigset_t sigMask, oldSigMask;
+    pthread_attr_t attr;
+    coroPool_t pool;
+ 
+// Resources.
+    coroWorker_t *workers = NULL;
+ 
+// The threads share the listening socket, so none may block on it.
+    fcntl(listenSock, F_SETFL, fcntl(listenSock, F_GETFL) | O_NONBLOCK);
+ 
+// Set up what the threads share.
+    pool.srv = srv;
+    pool.listenSock = listenSock;
+    pool.maxConns = (conf->maxConns + conf->coroThreads - 1) / conf->coroThreads;
+    pool.isStop = csc_FALSE;
+    pool.drainUntilMs = UINT64_MAX;
+    pool.blacklist = NULL;
+    pool.log = log;
+    pool.ini = ini;
+    pool.conf = conf;
+    pool.met = met;
+    pool.doConn = doConn;
+    pool.local = local;
+    pthread_mutex_init(&pool.blacklistMutex, NULL);
+    
+// Set up blacklisting.
+    if (conf->blacklistMax > 0)
+        pool.blacklist = csc_blacklist_new(conf->blacklistExpire);
+ 
+// Set up the signal handling.
+    servSig_t servSig;
+    servSig.isQuit = csc_FALSE;
+    servSig.isRestart = csc_FALSE;
+    servSig.hotFd = -1;
+    servSig.hotGen = 0;
+    servSig.log = log;
+    csc_signal_addHndl(SIGINT, sigHandler, &servSig);
+    csc_signal_addHndl(SIGTERM, sigHandler, &servSig);
+    csc_signal_addHndl(SIGHUP, sigHandler, &servSig);
+    csc_signal_addHndl(SIGUSR2, sigHandler, &servSig);
+ 
+// Start the threads, each with its own scheduler.  They block our
+// signals, so that these are delivered to this thread.
+    sigemptyset(&sigMask);
+    sigaddset(&sigMask, SIGINT);
+    sigaddset(&sigMask, SIGTERM);
+    sigaddset(&sigMask, SIGHUP);
+    sigaddset(&sigMask, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &sigMask, &oldSigMask);
+    workers = csc_allocMany(coroWorker_t, conf->coroThreads);
+    for (iThread=0; iThread<conf->coroThreads; iThread++)
+    {   coroWorker_t *worker = &workers[iThread];
+        worker->pool = &pool;
+        worker->nConns = 0;
+        worker->conns = NULL;
+        worker->sched = csc_coroSched_new(conf->coroStackKb * 1024);
+        worker->acceptor = NULL;
+        if (worker->sched != NULL)
+            worker->acceptor = csc_coro_spawn(worker->sched, coroAcceptor, worker);
+        if (worker->acceptor == NULL)
+        {   csc_log_str(log, csc_log_ERROR, "Failed to create a coroutine scheduler");
+            if (worker->sched != NULL)
+                csc_coroSched_free(worker->sched);
+            servSig.isQuit = csc_TRUE;
+            retVal = 0;
+            break;
+        }
+        result = pthread_create( &worker->thread, cpuThreadAttr(conf, iThread, &attr)
+                               , coroThread, worker);
+        pthread_attr_destroy(&attr);
+        if (result != 0)
+        {   csc_log_printf(log, csc_log_ERROR,
+                            "pthread_create: %s", strerror(result)); 
+            pool.isStop = csc_TRUE;
+            coroThread(worker);
+            csc_coroSched_free(worker->sched);
+            servSig.isQuit = csc_TRUE;
+            retVal = 0;
+            break;
+        }
+        nThreads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &oldSigMask, NULL);
+    csc_metric_set(met->workers, nThreads);
+ 
+// The threads do the work.  We wait for a signal.
+    while (!servSig.isQuit)
+    {
+    // Let a new process take over, if asked.
+        if (hotHandOver(&servSig, listenSock))
+        {   retVal = 1;
+            break;
+        }
+        hotPoll(&servSig, -1, coroWaitMs);
+    }
+    if (retVal == -2)
+    {   retVal = 1;
+        csc_log_str(log, csc_log_NOTICE
+                    , "Server terminating due to caught signal");
+        pool.drainUntilMs = drainUntil(conf->drainSecs);
+    }
+ 
+// Tell the threads to stop accepting, and wait for them to finish the
+// connections that they have, or cut them off.
+    pool.isStop = csc_TRUE;
+    for (iThread=0; iThread<nThreads; iThread++)
+    {   pthread_join(workers[iThread].thread, NULL);
+        csc_coroSched_free(workers[iThread].sched);
+    }
+    csc_metric_set(met->workers, 0);
+ 
+// We are finished here, so remove the signal handling.
+    hotCancel(&servSig);
+    csc_signal_delHndl(SIGINT, &servSig);
+    csc_signal_delHndl(SIGTERM, &servSig);
+    csc_signal_delHndl(SIGHUP, &servSig);
+    csc_signal_delHndl(SIGUSR2, &servSig);
+ 
+// Free resources.
+    if (pool.blacklist)
+        csc_blacklist_free(pool.blacklist);
+    pthread_mutex_destroy(&pool.blacklistMutex);
+    free(workers);
+ 
+    return retVal;
+}
+
+
+// ------------------------------------------------------------------
+// ---------------------- EventLoop model ---------------------------
+
+#define evMaxEvents 256
+#define evMinOutSize 1024
+#define evAcceptBatch 64
+#define evTimerTickMs 100
+#define evMaxWaitMs 1000
+
+typedef struct evLoop_t evLoop_t;
+
+typedef struct csc_servBase_conn_t
+{   int fd;
+    char cliAddr[INET6_ADDRSTRLEN+1];
+    void *ctx;                 // The user's per connection context.
+    uint32_t events;           // Events currently registered with epoll.
+    csc_bool_t isWantWrite;    // Call onWritable() when output is flushed.
+    csc_bool_t isClosing;      // Close once output is flushed.
+    char *out;                 // Output not yet taken by the socket.
+    int outOff, outLen, outSize;
+    char *in;                  // Uring only.  Input received but not yet read.
+    int inOff, inLen;
+    csc_bool_t isEof;          // Uring only.  The peer has closed.
+    csc_bool_t isRecving, isSending, isPolling;  // Uring only.  Operations in flight.
+    csc_bool_t isDead;         // Uring only.  Closing once operations end.
+    csc_timer_t readTimer;     // Nothing read for ReadTimeout.
+    csc_timer_t writeTimer;    // Output stuck for WriteTimeout.
+    uint64_t openUs;           // When it was accepted.
+    struct csc_servBase_conn_t *prev, *next;  // All connections.
+    evLoop_t *loop;
+} csc_servBase_conn_t;
+
+
+struct evLoop_t
+{   int epfd;
+    csc_bool_t isUring;        // Using io_uring rather than epoll.
+    void *ring;                // The io_uring, if isUring.
+    unsigned acceptGen;        // Uring only.  Identifies the current accept.
+    int nDead;                 // Uring only.  Closed, awaiting operations.
+    unsigned hotGen;           // The new process of a hot restart being watched.
+    csc_srv_t *srv;
+    int listenSock;
+    csc_bool_t isListening;
+    csc_bool_t isDraining;     // Finishing connections, not accepting.
+    uint64_t drainUntilMs;     // When to cut them off.  UINT64_MAX for never.
+    int nConns;
+    csc_servBase_conn_t *conns;
+    csc_timerWheel_t *timers;
+    csc_log_t *log;
+    csc_ini_t *ini;
+    config_t *conf;
+    srvMetrics_t *met;
+    const csc_servBase_evHandlers_t *handlers;
+    void *local;
+};
+
+
+static void evUnlink(evLoop_t *loop, csc_servBase_conn_t *conn)
+{   if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        loop->conns = conn->next;
+    if (conn->next)
+        conn->next->prev = conn->prev;
+    conn->prev = conn->next = NULL;
+}
+
+
+// Restart the read timeout, as there has been input.
+static void evTouch(csc_servBase_conn_t *conn)
+{   evLoop_t *loop = conn->loop;
+    if (loop->conf->readTimeoutSecs > 0)
+        csc_timerWheel_add(loop->timers, &conn->readTimer, loop->conf->readTimeoutSecs*1000);
+}
+
+
+// Run the write timeout while there is output waiting.  It restarts
+// whenever some of the output goes.
+static void evSetWriteTimer(csc_servBase_conn_t *conn, csc_bool_t isProgress)
+{   evLoop_t *loop = conn->loop;
+    if (conn->outOff==conn->outLen || loop->conf->writeTimeoutSecs<=0)
+        csc_timerWheel_cancel(loop->timers, &conn->writeTimer);
+    else if (isProgress || !csc_timer_isArmed(&conn->writeTimer))
+        csc_timerWheel_add(loop->timers, &conn->writeTimer, loop->conf->writeTimeoutSecs*1000);
+}
+
+
+// Pause or resume accepting connections.
+static void evSetListening(evLoop_t *loop, csc_bool_t isListening)
+{   struct epoll_event ev;
+    if (loop->isListening != isListening)
+    {   ev.events = isListening ? EPOLLIN : 0;
+        ev.data.ptr = NULL;
+        epoll_ctl(loop->epfd, EPOLL_CTL_MOD, loop->listenSock, &ev);
+        loop->isListening = isListening;
+    }
+}
+
+
+// Register with epoll whatever events the connection now needs.
+static void evSetEvents(csc_servBase_conn_t *conn)
+{   struct epoll_event ev;
+    uint32_t events = 0;
+ 
+    if (!conn->isClosing)
+        events |= EPOLLIN | EPOLLRDHUP;
+    if (conn->outLen > conn->outOff || conn->isWantWrite)
+        events |= EPOLLOUT;
+    if (events != conn->events)
+    {   ev.events = events;
+        ev.data.ptr = conn;
+        epoll_ctl(conn->loop->epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->events = events;
+    }
+}
+
+
+static void evClose(csc_servBase_conn_t *conn)
+{   evLoop_t *loop = conn->loop;
+ 
+    if (loop->handlers->onClose)
+        loop->handlers->onClose(conn, conn->ctx);
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    evUnlink(loop, conn);
+    csc_timerWheel_cancel(loop->timers, &conn->readTimer);
+    csc_timerWheel_cancel(loop->timers, &conn->writeTimer);
+    csc_metric_add(loop->met->active, -1);
+    csc_metric_observe(loop->met->connSecs, csc_metrics_nowUs()-conn->openUs);
+    if (conn->out)
+        free(conn->out);
+    free(conn);
+ 
+// There is room for another connection.
+    loop->nConns--;
+    if (loop->nConns<loop->conf->maxConns && !loop->isDraining)
+        evSetListening(loop, csc_TRUE);
+}
+
+
+// Send as much of the pending output as the socket will take.
+// Returns csc_FALSE if the connection has failed.
+static csc_bool_t evFlush(csc_servBase_conn_t *conn)
+{   int nSent;
+    while (conn->outOff < conn->outLen)
+    {   nSent = send( conn->fd, conn->out+conn->outOff
+                    , conn->outLen-conn->outOff, MSG_NOSIGNAL);
+        if (nSent > 0)
+            conn->outOff += nSent;
+        else if (nSent==-1 && errno==EINTR)
+            continue;
+        else if (nSent==-1 && (errno==EAGAIN || errno==EWOULDBLOCK))
+            break;
+        else
+            return csc_FALSE;
+    }
+    if (conn->outOff == conn->outLen)
+        conn->outOff = conn->outLen = 0;
+    return csc_TRUE;
+}
+
+
+// Deal with the outcome of calling a handler.
+// Returns csc_FALSE if the connection has been closed.
+static csc_bool_t evAfter(csc_servBase_conn_t *conn, int handlerRet)
+{   if (handlerRet < 0 || (conn->isClosing && conn->outLen==0))
+    {   evClose(conn);
+        return csc_FALSE;
+    }
+    evSetEvents(conn);
+    evSetWriteTimer(conn, csc_FALSE);
+    return csc_TRUE;
+}
+
+
+#ifdef csc_HAVE_LIBURING
+static void urClose(csc_servBase_conn_t *conn);
+static void urSetListening(evLoop_t *loop, csc_bool_t isListening);
+#endif
+
+// A connection has timed out.
+static void evTimedOut(csc_timer_t *timer, void *arg)
+{   csc_servBase_conn_t *conn = arg;
+    csc_log_printf( conn->loop->log, csc_log_TRACE, "%s connection from %s timed out"
+                  , timer==&conn->readTimer ? "Idle" : "Stuck", conn->cliAddr);
+#ifdef csc_HAVE_LIBURING
+    if (conn->loop->isUring)
+    {   urClose(conn);
+        return;
+    }
+#endif
+    evClose(conn);
+}
+
+
+static csc_servBase_conn_t *evNewConn(evLoop_t *loop, int fd, const char *cliAddr)
+{   csc_servBase_conn_t *conn = csc_allocOne(csc_servBase_conn_t);
+    conn->fd = fd;
+    if (cliAddr == NULL)
+        conn->cliAddr[0] = '\0';
+    else
+        csc_strncpy(conn->cliAddr, cliAddr, INET6_ADDRSTRLEN);
+    conn->ctx = NULL;
+    conn->events = 0;
+    conn->isWantWrite = csc_FALSE;
+    conn->isClosing = csc_FALSE;
+    conn->out = NULL;
+    conn->outOff = conn->outLen = conn->outSize = 0;
+    conn->in = NULL;
+    conn->inOff = conn->inLen = 0;
+    conn->isEof = csc_FALSE;
+    conn->isRecving = conn->isSending = conn->isPolling = csc_FALSE;
+    conn->isDead = csc_FALSE;
+    conn->loop = loop;
+    conn->openUs = csc_metrics_nowUs();
+    csc_metric_add(loop->met->active, 1);
+    csc_timer_init(&conn->readTimer, evTimedOut, conn);
+    csc_timer_init(&conn->writeTimer, evTimedOut, conn);
+    evTouch(conn);
+ 
+// Keep a list of them all, to close at the end.
+    conn->prev = NULL;
+    conn->next = loop->conns;
+    if (loop->conns)
+        loop->conns->prev = conn;
+    loop->conns = conn;
+    loop->nConns++;
+    return conn;
+}
+
+
+// Blacklisting and logging for a newly accepted connection.  Returns
+// csc_FALSE, having closed it, if the connection is rejected.
+static csc_bool_t evAdmit( evLoop_t *loop, csc_blacklist_t *blacklist, int rwSock
+                         , const csc_srv_addr_t *cliBin, const char *cliAddr)
+{   csc_metric_add(loop->met->accepted, 1);
+ 
+// Blacklisting.
+    if (blacklist && ipBlackness(blacklist,cliBin) > loop->conf->blacklistMax)
+    { // That IP has been blacklisted. Reject the connection.
+        close(rwSock);
+        csc_metric_add(loop->met->blacklisted, 1);
+        csc_log_printf(loop->log, csc_log_NOTICE, "Connection blacklisted %s", cliAddr);
+        return csc_FALSE;
+    }
+ 
+// Clean blacklist.
+    if (blacklist && csc_blacklist_accessCount(blacklist) > 200)
+        csc_blacklist_clean(blacklist);
+ 
+// Turn it away if we are full.  We only accept when full if told to.
+    if (loop->nConns >= loop->conf->maxConns)
+    {   shedConn(loop->met, loop->conf, rwSock, loop->local);
+        csc_log_printf(loop->log, csc_log_NOTICE, "Full.  Connection turned away %s", cliAddr);
+        return csc_FALSE;
+    }
+ 
+// Logging.
+    csc_log_printf(loop->log, csc_log_NOTICE,
+                "Accepted connection from %s", cliAddr);
+    return csc_TRUE;
+}
+
+
+static void evAccept(evLoop_t *loop, csc_srv_t *srv, csc_blacklist_t *blacklist)
+{   csc_srv_accepted_t accepted[evAcceptBatch];
+    char cliAddrBuf[csc_srv_AddrStrSize];
+    csc_srv_addr_t cliBin;
+    struct epoll_event ev;
+    csc_servBase_conn_t *conn;
+    const char *cliAddr;
+    csc_bool_t isWait = loop->conf->overloadAction == overload_Wait;
+    int nAccepted, maxAccepted, i, rwSock, ret;
+ 
+    while (loop->nConns<loop->conf->maxConns || !isWait)
+    {
+    // Accept whatever is waiting, as long as there is room for it, unless
+    // we are turning the rest away.
+        maxAccepted = evAcceptBatch;
+        if (isWait)
+            maxAccepted = csc_min(maxAccepted, loop->conf->maxConns-loop->nConns);
+        nAccepted = csc_srv_acceptMany( srv, accepted, maxAccepted
+                                      , SOCK_NONBLOCK|SOCK_CLOEXEC, csc_FALSE);
+        if (nAccepted == -3 || nAccepted == -2)  // None waiting, or interrupted.
+            break;
+        else if (nAccepted < 0)  // Some sort of error, e.g. out of descriptors.
+        {   csc_log_str(loop->log, csc_log_ERROR, csc_srv_getErrMsg(srv)); 
+            break;
+        }
+ 
+        for (i=0; i<nAccepted; i++)
+        {   rwSock = accepted[i].fd;
+            csc_srv_acceptedAddrBin(&accepted[i], &cliBin);
+            cliAddr = csc_srv_addrBinStr(&cliBin, cliAddrBuf);
+            if (!evAdmit(loop, blacklist, rwSock, &cliBin, cliAddr))
+                continue;
+ 
+        // Create the connection.
+            conn = evNewConn(loop, rwSock, cliAddr);
+            conn->events = EPOLLIN | EPOLLRDHUP;
+ 
+        // Watch it.
+            ev.events = conn->events;
+            ev.data.ptr = conn;
+            epoll_ctl(loop->epfd, EPOLL_CTL_ADD, rwSock, &ev);
+ 
+        // Tell the user.
+            ret = 0;
+            if (loop->handlers->onOpen)
+                ret = loop->handlers->onOpen(conn, cliAddr, loop->ini, loop->log, loop->local);
+            evAfter(conn, ret);
+        }
+    }
+ 
+// Pause accepting if we are full.
+    if (loop->nConns>=loop->conf->maxConns && isWait)
+        evSetListening(loop, csc_FALSE);
+}
+
+
+static void evHandle(evLoop_t *loop, csc_servBase_conn_t *conn, uint32_t events)
+{   const csc_servBase_evHandlers_t *handlers = loop->handlers;
+ 
+// Errors.
+    if ((events & EPOLLERR) && !(events & EPOLLIN))
+    {   evClose(conn);
+        return;
+    }
+ 
+// The socket will take more output.
+    if (events & EPOLLOUT)
+    {   int outOff = conn->outOff;
+        if (!evFlush(conn))
+        {   evClose(conn);
+            return;
+        }
+        if (conn->outOff != outOff)
+            evSetWriteTimer(conn, csc_TRUE);
+        if (conn->outLen == 0 && conn->isWantWrite && handlers->onWritable)
+        {   if (!evAfter(conn, handlers->onWritable(conn, conn->ctx)))
+                return;
+        }
+        else if (!evAfter(conn, 0))
+            return;
+    }
+ 
+// There is input, or the peer has hung up.
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+    {   evTouch(conn);
+        evAfter(conn, handlers->onReadable(conn, conn->ctx));
+    }
+}
+
+
+// Stops accepting, and finishes the connections that we have, giving them
+// 'drainSecs', or for ever if negative.
+static void evDrain(evLoop_t *loop, int drainSecs)
+{   loop->isDraining = csc_TRUE;
+    loop->drainUntilMs = drainUntil(drainSecs);
+#ifdef csc_HAVE_LIBURING
+    if (loop->isUring)
+    {   urSetListening(loop, csc_FALSE);
+        return;
+    }
+#endif
+    evSetListening(loop, csc_FALSE);
+}
+
+
+// Whether we have finished draining, or run out of time for it.
+static csc_bool_t evIsDrained(evLoop_t *loop)
+{   return loop->isDraining
+        && (loop->nConns==0 || csc_timerWheel_nowMs()>=loop->drainUntilMs);
+}
+
+
+// How long to wait for something to happen, i.e. until the next timer is
+// due, or draining must end, but no longer than evMaxWaitMs.
+static int evWaitMs(evLoop_t *loop)
+{   uint64_t nowMs = csc_timerWheel_nowMs();
+    int waitMs = csc_timerWheel_nextMs(loop->timers, nowMs);
+    if (waitMs<0 || waitMs>evMaxWaitMs)
+        waitMs = evMaxWaitMs;
+    if (loop->isDraining && loop->drainUntilMs < nowMs+waitMs)
+        waitMs = loop->drainUntilMs>nowMs ? loop->drainUntilMs-nowMs : 0;
+    return waitMs;
+}
+
+
+// When told to quit, stop accepting, and give the connections that we have
+// DrainSecs.  Returns csc_TRUE if we have just been told.
+static csc_bool_t evQuit(evLoop_t *loop, servSig_t *servSig, csc_bool_t *isQuitting)
+{   if (!servSig->isQuit || *isQuitting)
+        return csc_FALSE;
+    *isQuitting = csc_TRUE;
+    csc_log_str(loop->log, csc_log_NOTICE
+                , "Server terminating due to caught signal");
+    hotCancel(servSig);
+    evDrain(loop, loop->conf->drainSecs);
+    return csc_TRUE;
+}
+
+
+// Wake when the new process of a hot restart answers.  Its descriptor
+// leaves the epoll set when it is closed.
+static void evWatchHot(evLoop_t *loop, servSig_t *servSig)
+{   struct epoll_event ev;
+    if (servSig->hotFd<0 || servSig->hotGen==loop->hotGen)
+        return;
+    loop->hotGen = servSig->hotGen;
+    ev.events = EPOLLIN;
+    ev.data.ptr = loop;
+    epoll_ctl(loop->epfd, EPOLL_CTL_ADD, servSig->hotFd, &ev);
+}
+
+
+// Logs the connections cut off by draining.
+static void evLogCut(evLoop_t *loop)
+{   if (loop->isDraining && loop->nConns>0)
+        csc_log_printf( loop->log, csc_log_WARN, "%d connections cut off after %d seconds of draining"
+                      , loop->nConns, loop->conf->drainSecs);
+}
+
+
+static int serv_EventLoop( csc_log_t *log
+                         , csc_ini_t *ini
+                         , csc_srv_t *srv
+                         , config_t *conf
+                         , srvMetrics_t *met
+                         , const csc_servBase_evHandlers_t *handlers
+                         , void *local
+                         )
+{   struct epoll_event ev, events[evMaxEvents];
+    int nEvents, iEvent;
+    int retVal = -2;
+    csc_bool_t isQuitting = csc_FALSE;
+    evLoop_t loop;
+ 
+// Resources.
+    csc_blacklist_t *blacklist = NULL;
+ 
+// Set up the loop.
+    loop.isUring = csc_FALSE;
+    loop.ring = NULL;
+    loop.hotGen = 0;
+    loop.srv = srv;
+    loop.listenSock = csc_srv_getListenSock(srv);
+    loop.isListening = csc_TRUE;
+    loop.isDraining = csc_FALSE;
+    loop.drainUntilMs = UINT64_MAX;
+    loop.nConns = 0;
+    loop.conns = NULL;
+    loop.timers = csc_timerWheel_new(evTimerTickMs, csc_timerWheel_nowMs());
+    loop.log = log;
+    loop.ini = ini;
+    loop.conf = conf;
+    loop.met = met;
+    loop.handlers = handlers;
+    loop.local = local;
+    loop.epfd = epoll_create1(0);
+    if (loop.epfd == -1)
+    {   csc_log_printf(log, csc_log_FATAL, "epoll_create1: %s", strerror(errno)); 
+        csc_timerWheel_free(loop.timers);
+        return 0;
+    }
+ 
+// Watch the listening socket.
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(loop.epfd, EPOLL_CTL_ADD, loop.listenSock, &ev);
+    
+// Set up blacklisting.
+    if (conf->blacklistMax > 0)
+        blacklist = csc_blacklist_new(conf->blacklistExpire);
+ 
+// Set up the signal handling.
+    servSig_t servSig;
+    servSig.isQuit = csc_FALSE;
+    servSig.isRestart = csc_FALSE;
+    servSig.hotFd = -1;
+    servSig.hotGen = 0;
+    servSig.log = log;
+    csc_signal_addHndl(SIGINT, sigHandler, &servSig);
+    csc_signal_addHndl(SIGTERM, sigHandler, &servSig);
+    csc_signal_addHndl(SIGHUP, sigHandler, &servSig);
+    csc_signal_addHndl(SIGUSR2, sigHandler, &servSig);
+ 
+// Wait for things to happen, or for the next timeout.  After a hot
+// restart, until the last connection has finished, and when told to quit,
+// for DrainSecs at most.
+    while (!evIsDrained(&loop))
+    {   if (!loop.isDraining && hotHandOver(&servSig, loop.listenSock))
+        {   evDrain(&loop, -1);
+            retVal = 1;
+        }
+        if (evQuit(&loop, &servSig, &isQuitting))
+        {   retVal = 1;
+            continue;
+        }
+        evWatchHot(&loop, &servSig);
+ 
+        nEvents = epoll_wait(loop.epfd, events, evMaxEvents, evWaitMs(&loop));
+        if (nEvents==-1 && errno!=EINTR)
+        {   csc_log_printf(log, csc_log_FATAL, "epoll_wait: %s", strerror(errno)); 
+            retVal = 0;
+            break;
+        }
+        else if (nEvents >= 0)
+        {   csc_timerWheel_setNow(loop.timers, csc_timerWheel_nowMs());
+            for (iEvent=0; iEvent<nEvents; iEvent++)
+            {   if (events[iEvent].data.ptr == &loop)  // The new process answered.
+                    continue;
+                if (events[iEvent].data.ptr == NULL)
+                    evAccept(&loop, srv, blacklist);
+                else
+                    evHandle(&loop, events[iEvent].data.ptr, events[iEvent].events);
+            }
+ 
+        // Close connections that have timed out.
+            csc_timerWheel_advance(loop.timers, csc_timerWheel_nowMs());
+        }
+    }
+ 
+// Close all remaining connections.
+    evLogCut(&loop);
+    while (loop.conns != NULL)
+        evClose(loop.conns);
+    close(loop.epfd);
+    csc_timerWheel_free(loop.timers);
+ 
+// We are finished here, so remove the signal handling.
+    hotCancel(&servSig);
+    csc_signal_delHndl(SIGINT, &servSig);
+    csc_signal_delHndl(SIGTERM, &servSig);
+    csc_signal_delHndl(SIGHUP, &servSig);
+    csc_signal_delHndl(SIGUSR2, &servSig);
+ 
+// Free resources.
+    if (blacklist)
+        csc_blacklist_free(blacklist);
+ 
+    return retVal;
+}
+
+
+// ------------------------------------------------------------------
+// ------------------------ Uring model -----------------------------
+
+// Like EventLoop, and uses the same handlers, but accepts, receives and
+// sends through io_uring.  Operations requested while handling one batch of
+// completions are submitted together with one system call.
+
+#ifdef csc_HAVE_LIBURING
+
+#include <liburing.h>
+
+#define urRingEntries 1024
+#define urInSize 4096
+
+// The kind of operation is kept in the low bits of its user data.  The
+// rest is the connection, which is suitably aligned.
+#define urOp_Accept 0
+#define urOp_Recv 1
+#define urOp_Send 2
+#define urOp_Poll 3
+#define urOp_Mask 7
+#define urAcceptData(gen) ((uint64_t)(gen) << 3 | urOp_Accept)
+
+
+static struct io_uring_sqe *urGetSqe(evLoop_t *loop)
+{   struct io_uring *ring = loop->ring;
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    if (sqe == NULL)  // Queue full.  Make room.
+    {   io_uring_submit(ring);
+        sqe = io_uring_get_sqe(ring);
+    }
+    return sqe;
+}
+
+
+static void urSetListening(evLoop_t *loop, csc_bool_t isListening)
+{   struct io_uring_sqe *sqe;
+    if (loop->isListening == isListening)
+        return;
+    sqe = urGetSqe(loop);
+    if (isListening)
+    {   loop->acceptGen++;
+        io_uring_prep_multishot_accept(sqe, loop->listenSock, NULL, NULL, 0);
+        io_uring_sqe_set_data64(sqe, urAcceptData(loop->acceptGen));
+    }
+    else
+    {   io_uring_prep_cancel64(sqe, urAcceptData(loop->acceptGen), 0);
+        io_uring_sqe_set_data64(sqe, urOp_Mask);  // Ignore its completion.
+    }
+    loop->isListening = isListening;
+}
+
+
+static csc_bool_t urIsBusy(csc_servBase_conn_t *conn)
+{   return conn->isRecving || conn->isSending || conn->isPolling;
+}
+
+
+static void urFree(csc_servBase_conn_t *conn)
+{   close(conn->fd);
+    if (conn->out)
+        free(conn->out);
+    free(conn->in);
+    free(conn);
+}
+
+
+// An operation of a closed connection has ended.  Free the connection once
+// nothing more is in flight for it.
+static void urReap(csc_servBase_conn_t *conn)
+{   if (urIsBusy(conn))
+        return;
+    conn->loop->nDead--;
+    urFree(conn);
+}
+
+
+static void urClose(csc_servBase_conn_t *conn)
+{   evLoop_t *loop = conn->loop;
+ 
+    if (loop->handlers->onClose)
+        loop->handlers->onClose(conn, conn->ctx);
+    evUnlink(loop, conn);
+    csc_timerWheel_cancel(loop->timers, &conn->readTimer);
+    csc_timerWheel_cancel(loop->timers, &conn->writeTimer);
+    csc_metric_add(loop->met->active, -1);
+    csc_metric_observe(loop->met->connSecs, csc_metrics_nowUs()-conn->openUs);
+    conn->isDead = csc_TRUE;
+ 
+// Operations in flight end promptly once the socket is shut down.
+    if (urIsBusy(conn))
+    {   shutdown(conn->fd, SHUT_RDWR);
+        loop->nDead++;
+    }
+    else
+        urFree(conn);
+ 
+// There is room for another connection.
+    loop->nConns--;
+    if (loop->nConns<loop->conf->maxConns && !loop->isDraining)
+        urSetListening(loop, csc_TRUE);
+}
+
+
+// Deal with the outcome of calling a handler, and queue whatever
+// operations the connection now needs.
+static void urAfter(csc_servBase_conn_t *conn, int handlerRet)
+{   struct io_uring_sqe *sqe;
+ 
+    if (handlerRet < 0 || (conn->isClosing && conn->outLen==0))
+    {   urClose(conn);
+        return;
+    }
+    evSetWriteTimer(conn, csc_FALSE);
+ 
+// Send what is waiting.
+    if (conn->outOff<conn->outLen && !conn->isSending)
+    {   sqe = urGetSqe(conn->loop);
+        io_uring_prep_send( sqe, conn->fd, conn->out+conn->outOff
+                          , conn->outLen-conn->outOff, MSG_NOSIGNAL);
+        io_uring_sqe_set_data64(sqe, (uint64_t)(uintptr_t)conn | urOp_Send);
+        conn->isSending = csc_TRUE;
+    }
+ 
+// Wait until the socket will take more, if the handler wants to know.
+    else if ( conn->isWantWrite && conn->loop->handlers->onWritable
+            && conn->outOff==conn->outLen && !conn->isSending && !conn->isPolling
+            )
+    {   sqe = urGetSqe(conn->loop);
+        io_uring_prep_poll_add(sqe, conn->fd, POLLOUT);
+        io_uring_sqe_set_data64(sqe, (uint64_t)(uintptr_t)conn | urOp_Poll);
+        conn->isPolling = csc_TRUE;
+    }
+ 
+// Receive more, after whatever the handler has left unread.
+    if ( !conn->isRecving && !conn->isEof && !conn->isClosing
+       && conn->inLen-conn->inOff < urInSize
+       )
+    {   conn->inLen -= conn->inOff;
+        memmove(conn->in, conn->in+conn->inOff, conn->inLen);
+        conn->inOff = 0;
+        sqe = urGetSqe(conn->loop);
+        io_uring_prep_recv(sqe, conn->fd, conn->in+conn->inLen, urInSize-conn->inLen, 0);
+        io_uring_sqe_set_data64(sqe, (uint64_t)(uintptr_t)conn | urOp_Recv);
+        conn->isRecving = csc_TRUE;
+    }
+}
+
+
+// Wake when the new process of a hot restart answers.
+static void urWatchHot(evLoop_t *loop, servSig_t *servSig)
+{   struct io_uring_sqe *sqe;
+    if (servSig->hotFd<0 || servSig->hotGen==loop->hotGen)
+        return;
+    loop->hotGen = servSig->hotGen;
+    sqe = urGetSqe(loop);
+    io_uring_prep_poll_add(sqe, servSig->hotFd, POLLIN);
+    io_uring_sqe_set_data64(sqe, urOp_Mask);  // Only to wake us.
+}
+
+
+static void urAccepted(evLoop_t *loop, csc_blacklist_t *blacklist, int rwSock)
+{   csc_srv_accepted_t accepted;
+    char cliAddrBuf[csc_srv_AddrStrSize];
+    csc_srv_addr_t cliBin;
+    const char *cliAddr = NULL;
+    csc_servBase_conn_t *conn;
+    int ret = 0;
+ 
+// Who is it?
+    csc_srv_tuneAccepted(loop->srv, rwSock);
+    accepted.fd = rwSock;
+    accepted.addrLen = sizeof(accepted.addr);
+    if (getpeername(rwSock, (struct sockaddr*)&accepted.addr, &accepted.addrLen) != 0)
+        accepted.addr.ss_family = AF_UNSPEC;
+    csc_srv_acceptedAddrBin(&accepted, &cliBin);
+    cliAddr = csc_srv_addrStr(&accepted, cliAddrBuf, sizeof(cliAddrBuf));
+    if (!evAdmit(loop, blacklist, rwSock, &cliBin, cliAddr))
+        return;
+ 
+// Create the connection.
+    conn = evNewConn(loop, rwSock, cliAddr);
+    conn->in = csc_allocMany(char, urInSize);
+    if (loop->handlers->onOpen)
+        ret = loop->handlers->onOpen(conn, cliAddr, loop->ini, loop->log, loop->local);
+    urAfter(conn, ret);
+ 
+// Pause accepting if we are full.
+    if (loop->nConns>=loop->conf->maxConns && loop->conf->overloadAction==overload_Wait)
+        urSetListening(loop, csc_FALSE);
+}
+
+
+static void urComplete( evLoop_t *loop, csc_blacklist_t *blacklist
+                      , uint64_t data, int res, unsigned flags)
+{   csc_servBase_conn_t *conn = (csc_servBase_conn_t*)(uintptr_t)(data & ~(uint64_t)urOp_Mask);
+    const csc_servBase_evHandlers_t *handlers = loop->handlers;
+    int op = data & urOp_Mask;
+ 
+    if (op == urOp_Accept)
+    {   if (data != urAcceptData(loop->acceptGen))
+        {   if (res >= 0)  // Accepted by a superseded accept.
+                close(res);
+            return;
+        }
+        if (res >= 0)
+            urAccepted(loop, blacklist, res);
+        else if (res != -ECANCELED)
+            csc_log_printf(loop->log, csc_log_ERROR, "accept: %s", strerror(-res));
+ 
+    // The kernel may end a multishot accept.  Start another if so.
+        if (!(flags & IORING_CQE_F_MORE) && loop->isListening && res != -ECANCELED)
+        {   loop->isListening = csc_FALSE;
+            urSetListening(loop, csc_TRUE);
+        }
+    }
+    else if (op == urOp_Recv)
+    {   conn->isRecving = csc_FALSE;
+        if (conn->isDead)
+            urReap(conn);
+        else if (res < 0)
+            urClose(conn);
+        else
+        {   if (res == 0)
+                conn->isEof = csc_TRUE;
+            conn->inLen += res;
+            evTouch(conn);
+            urAfter(conn, handlers->onReadable(conn, conn->ctx));
+        }
+    }
+    else if (op == urOp_Send)
+    {   conn->isSending = csc_FALSE;
+        if (conn->isDead)
+            urReap(conn);
+        else if (res < 0)
+            urClose(conn);
+        else
+        {   conn->outOff += res;
+            evSetWriteTimer(conn, res > 0);
+            if (conn->outOff == conn->outLen)
+            {   conn->outOff = conn->outLen = 0;
+                if (conn->isWantWrite && handlers->onWritable)
+                {   urAfter(conn, handlers->onWritable(conn, conn->ctx));
+                    return;
+                }
+            }
+            urAfter(conn, 0);
+        }
+    }
+    else if (op == urOp_Poll)
+    {   conn->isPolling = csc_FALSE;
+        if (conn->isDead)
+            urReap(conn);
+        else if (res < 0 || (res & (POLLERR|POLLNVAL)))
+            urClose(conn);
+        else if (conn->isWantWrite && conn->outOff==conn->outLen && handlers->onWritable)
+            urAfter(conn, handlers->onWritable(conn, conn->ctx));
+        else
+            urAfter(conn, 0);
+    }
+}
+
+
+static int serv_Uring( csc_log_t *log
+                     , csc_ini_t *ini
+                     , csc_srv_t *srv
+                     , config_t *conf
+                     , srvMetrics_t *met
+                     , const csc_servBase_evHandlers_t *handlers
+                     , void *local
+                     )
+{   struct io_uring ring;
+    struct io_uring_cqe *cqe;
+    struct __kernel_timespec waitTime;
+    unsigned head, nCqes;
+    int retVal = -2;
+    int result, waitMs;
+    csc_bool_t isQuitting = csc_FALSE;
+    evLoop_t loop;
+ 
+// Resources.
+    csc_blacklist_t *blacklist = NULL;
+ 
+// Set up the ring.
+    result = io_uring_queue_init(urRingEntries, &ring, 0);
+    if (result < 0)
+    {   csc_log_printf(log, csc_log_FATAL, "io_uring_queue_init: %s", strerror(-result)); 
+        return 0;
+    }
+ 
+// Set up the loop.
+    loop.epfd = -1;
+    loop.isUring = csc_TRUE;
+    loop.ring = &ring;
+    loop.acceptGen = 0;
+    loop.nDead = 0;
+    loop.hotGen = 0;
+    loop.srv = srv;
+    loop.listenSock = csc_srv_getListenSock(srv);
+    loop.isListening = csc_FALSE;
+    loop.isDraining = csc_FALSE;
+    loop.drainUntilMs = UINT64_MAX;
+    loop.nConns = 0;
+    loop.conns = NULL;
+    loop.timers = csc_timerWheel_new(evTimerTickMs, csc_timerWheel_nowMs());
+    loop.log = log;
+    loop.ini = ini;
+    loop.conf = conf;
+    loop.met = met;
+    loop.handlers = handlers;
+    loop.local = local;
+    urSetListening(&loop, csc_TRUE);
+    
+// Set up blacklisting.
+    if (conf->blacklistMax > 0)
+        blacklist = csc_blacklist_new(conf->blacklistExpire);
+ 
+// Set up the signal handling.
+    servSig_t servSig;
+    servSig.isQuit = csc_FALSE;
+    servSig.isRestart = csc_FALSE;
+    servSig.hotFd = -1;
+    servSig.hotGen = 0;
+    servSig.log = log;
+    csc_signal_addHndl(SIGINT, sigHandler, &servSig);
+    csc_signal_addHndl(SIGTERM, sigHandler, &servSig);
+    csc_signal_addHndl(SIGHUP, sigHandler, &servSig);
+    csc_signal_addHndl(SIGUSR2, sigHandler, &servSig);
+ 
+// Submit what is queued, and wait for completions or the next timeout.
+// After a hot restart, until the last connection has finished, and when
+// told to quit, for DrainSecs at most.
+    while (!evIsDrained(&loop))
+    {   if (!loop.isDraining && hotHandOver(&servSig, loop.listenSock))
+        {   evDrain(&loop, -1);
+            retVal = 1;
+        }
+        if (evQuit(&loop, &servSig, &isQuitting))
+        {   retVal = 1;
+            continue;
+        }
+        urWatchHot(&loop, &servSig);
+ 
+        waitMs = evWaitMs(&loop);
+        waitTime.tv_sec = waitMs / 1000;
+        waitTime.tv_nsec = (waitMs % 1000) * 1000000L;
+        io_uring_submit(&ring);
+        result = io_uring_wait_cqe_timeout(&ring, &cqe, &waitTime);
+        if (result<0 && result!=-EINTR && result!=-ETIME)
+        {   csc_log_printf(log, csc_log_FATAL, "io_uring_wait_cqe: %s", strerror(-result)); 
+            retVal = 0;
+            break;
+        }
+        else
+        {
+        // Handle the whole batch of completions.
+            csc_timerWheel_setNow(loop.timers, csc_timerWheel_nowMs());
+            nCqes = 0;
+            io_uring_for_each_cqe(&ring, head, cqe)
+            {   if (cqe->user_data != urOp_Mask)
+                    urComplete(&loop, blacklist, cqe->user_data, cqe->res, cqe->flags);
+                nCqes++;
+            }
+            io_uring_cq_advance(&ring, nCqes);
+ 
+        // Close connections that have timed out.
+            csc_timerWheel_advance(loop.timers, csc_timerWheel_nowMs());
+        }
+    }
+ 
+// Close all remaining connections, and wait for whatever they still have
+// in flight to end so that they can be freed.
+    evLogCut(&loop);
+    while (loop.conns != NULL)
+        urClose(loop.conns);
+    urSetListening(&loop, csc_FALSE);
+    while (loop.nDead > 0)
+    {   io_uring_submit(&ring);
+        result = io_uring_wait_cqe(&ring, &cqe);
+        if (result == -EINTR)
+            continue;
+        if (result < 0)
+            break;
+        if (cqe->user_data != urOp_Mask)
+            urComplete(&loop, blacklist, cqe->user_data, cqe->res, cqe->flags);
+        io_uring_cqe_seen(&ring, cqe);
+    }
+    io_uring_queue_exit(&ring);
+    csc_timerWheel_free(loop.timers);
+ 
+// We are finished here, so remove the signal handling.
+    hotCancel(&servSig);
+    csc_signal_delHndl(SIGINT, &servSig);
+    csc_signal_delHndl(SIGTERM, &servSig);
+    csc_signal_delHndl(SIGHUP, &servSig);
+    csc_signal_delHndl(SIGUSR2, &servSig);
+ 
+// Free resources.
+    if (blacklist)
+        csc_blacklist_free(blacklist);
+ 
+    return retVal;
+}
+
+#endif
+
+
+int csc_servBase_connRead(csc_servBase_conn_t *conn, char *buf, int bufSize)
+{   int nRead;
+ 
+// Uring has already received it.
+    if (conn->loop->isUring)
+    {   if (conn->inOff < conn->inLen)
+        {   nRead = csc_min(bufSize, conn->inLen - conn->inOff);
+            memcpy(buf, conn->in+conn->inOff, nRead);
+            conn->inOff += nRead;
+            return nRead;
+        }
+        return conn->isEof ? 0 : -2;
+    }
+ 
+    do
+    {   nRead = recv(conn->fd, buf, bufSize, 0);
+    } while (nRead==-1 && errno==EINTR);
+    if (nRead==-1 && (errno==EAGAIN || errno==EWOULDBLOCK))
+        nRead = -2;
+    return nRead;
+}
+
+
+csc_bool_t csc_servBase_connWrite(csc_servBase_conn_t *conn, const char *buf, int len)
+{   int nSent = 0;
+ 
+// Send directly if nothing else is waiting to go.  Uring sends it later.
+    if (conn->outLen==0 && !conn->loop->isUring)
+    {   nSent = send(conn->fd, buf, len, MSG_NOSIGNAL);
+        if (nSent == -1)
+        {   if (errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR)
+                return csc_FALSE;
+            nSent = 0;
+        }
+    }
+ 
+// Keep the remainder to send later.
+    if (nSent < len)
+    {   if (conn->outLen + len - nSent > conn->outSize)
+        {   conn->outSize = csc_max(2*conn->outSize, conn->outLen+len-nSent);
+            conn->outSize = csc_max(conn->outSize, evMinOutSize);
+            conn->out = csc_ck_ralloc(conn->out, conn->outSize);
+        }
+        memcpy(conn->out+conn->outLen, buf+nSent, len-nSent);
+        conn->outLen += len - nSent;
+    }
+    return csc_TRUE;
+}
+
+
+void csc_servBase_connWantWrite(csc_servBase_conn_t *conn, csc_bool_t isWant)
+{   conn->isWantWrite = isWant;
+}
+
+
+void csc_servBase_connClose(csc_servBase_conn_t *conn)
+{   conn->isClosing = csc_TRUE;
+}
+
+
+void csc_servBase_connSetCtx(csc_servBase_conn_t *conn, void *connCtx)
+{   conn->ctx = connCtx;
+}
+
+
+void *csc_servBase_connGetCtx(csc_servBase_conn_t *conn)
+{   return conn->ctx;
+}
+
+
+int csc_servBase_connFd(csc_servBase_conn_t *conn)
+{   return conn->fd;
+}
+
+
+const char *csc_servBase_connClientIp(csc_servBase_conn_t *conn)
+{   return conn->cliAddr;
+}
+
+
+csc_ini_t *csc_servBase_connConf(csc_servBase_conn_t *conn)
+{   return conn->loop->ini;
+}
+
+
+csc_log_t *csc_servBase_connLog(csc_servBase_conn_t *conn)
+{   return conn->loop->log;
+}
+
+
+void *csc_servBase_connLocal(csc_servBase_conn_t *conn)
+{   return conn->loop->local;
+}
+
+
+// ------------------------------------------------------------------
+// ----------------------- PreFork model ----------------------------
+
+// The life of a PreFork worker process.  It listens on its own
+// SO_REUSEPORT socket, and handles connections one by one until it is
+// told to quit, or it has handled conf->maxConnsPerChild of them (0 means
+// no limit).  SIGHUP has it finish like the latter, after a hot restart.
+// If 'listenedPipe' is not NULL, it writes a byte to it once listening.
+static void preForkWorker( csc_log_t *log
+                         , csc_ini_t *ini
+                         , config_t *conf
+                         , srvMetrics_t *met
+                         , servSig_t *parentSig
+                         , int iWorker
+                         , int *listenedPipe
+                         , int (*doConn)( int fd            // client file descriptor
+                                        , const char *clientIp   // IP of client, or NULL
+                                        , csc_ini_t *ini // Configuration object.
+                                        , csc_log_t *log  // Logging object.
+                                        , void *local
+                                        )
+                         , void *local
+                         )
+{   int rwSock = -1;
+    const char *cliAddr = NULL;
+    csc_srv_addr_t cliBin;
+    int nConns = 0;
+    int cpu = cpuForWorker(conf, iWorker);
+    char listened = 'L';
+ 
+// Resources.
+    csc_blacklist_t *blacklist = NULL;
+    csc_srv_t *srv = NULL;
+ 
+// Only the parent supervises.  Replace its signal handling with our own.
+    csc_signal_delHndl(SIGINT, parentSig);
+    csc_signal_delHndl(SIGTERM, parentSig);
+    csc_signal_delHndl(SIGHUP, parentSig);
+    csc_signal_delHndl(SIGUSR2, parentSig);
+    servSig_t servSig;
+    servSig.isQuit = csc_FALSE;
+    servSig.isRestart = csc_FALSE;
+    servSig.hotFd = -1;
+    servSig.hotGen = 0;
+    servSig.log = log;
+    csc_signal_addHndl(SIGINT, sigHandler, &servSig);
+    csc_signal_addHndl(SIGTERM, sigHandler, &servSig);
+    csc_signal_addHndl(SIGHUP, sigHandler, &servSig);
+    csc_signal_addHndl(SIGUSR2, sigHandler, &servSig);
+ 
+// Stay on our own CPU, if pinning, before we allocate anything.
+    cpuPinSelf(log, conf, iWorker);
+ 
+// Our own listening socket.  When pinned, ask the kernel to give it the
+// connections that arrive on our CPU, so that each is handled where its
+// packets are.
+    srv = csc_srv_new();
+    csc_srv_setReusePort(srv, csc_TRUE);
+    csc_srv_setSockOpts(srv, &conf->sockOpts);
+    if (!csc_srv_setAddr(srv, conf->ipStr, conf->portNum, conf->backlog))
+    {   csc_log_str(log , csc_log_FATAL, csc_srv_getErrMsg(srv));
+        exit(preForkExit_NoListen);
+    }
+    if (cpu >= 0)
+        setsockopt(csc_srv_getListenSock(srv), SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+    if (listenedPipe != NULL)
+    {   close(listenedPipe[0]);
+        write(listenedPipe[1], &listened, 1);
+        close(listenedPipe[1]);
+    }
+    
+// Set up blacklisting.  Each worker keeps its own.
+    if (conf->blacklistMax > 0)
+        blacklist = csc_blacklist_new(conf->blacklistExpire);
+ 
+// Call accept.
+    while (!servSig.isQuit)
+    {
+    // Connections already queued on our socket would be reset when we exit,
+    // so once we have done our share, take only those that are waiting.
+        if ( servSig.isRestart
+           || (conf->maxConnsPerChild>0 && nConns==conf->maxConnsPerChild)
+           )
+        {   int fd = csc_srv_getListenSock(srv);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+ 
+        rwSock = csc_srv_accept(srv);
+        if (rwSock == -2)   // Interrupted.
+            continue;
+        else if (rwSock == -3)   // Retiring, and none left waiting.
+            break;
+        else if (rwSock < 0)   // Some sort of error.
+        {   csc_log_str(log, csc_log_FATAL, csc_srv_getErrMsg(srv)); 
+            servSig.isQuit = csc_TRUE;
+        }
+        else  // The socket is OK.
+        {
+        // Accept the connection.
+            cliAddr = csc_srv_acceptAddr(srv);
+            csc_metric_add(met->accepted, 1);
+            nConns++;
+ 
+        // Blacklisting.
+            csc_srv_acceptAddrBin(srv, &cliBin);
+            if (blacklist && ipBlackness(blacklist,&cliBin) > conf->blacklistMax)
+            { // That IP has been blacklisted. Reject the connection.
+                close(rwSock);
+                csc_metric_add(met->blacklisted, 1);
+                csc_log_printf(log, csc_log_NOTICE, "Connection blacklisted %s", cliAddr);
+            }
+            else
+            {
+            // Clean blacklist.
+                if (blacklist && csc_blacklist_accessCount(blacklist) > 200)
+                    csc_blacklist_clean(blacklist);
+ 
+            // Logging.
+                csc_log_printf(log, csc_log_NOTICE,
+                            "Accepted connection from %s", cliAddr);
+ 
+            // Impose read/write timeouts.
+                csc_sock_setTimeout(rwSock, "r", conf->readTimeoutSecs);
+                csc_sock_setTimeout(rwSock, "w", conf->writeTimeoutSecs);
+     
+            // Handle the connection.
+                metDoConn(met, doConn, rwSock, cliAddr, ini, log, local);
+            }
+        }
+    }
+ 
+// Free resources.
+    csc_signal_delHndl(SIGINT, &servSig);
+    csc_signal_delHndl(SIGTERM, &servSig);
+    csc_signal_delHndl(SIGHUP, &servSig);
+    csc_signal_delHndl(SIGUSR2, &servSig);
+    if (blacklist)
+        csc_blacklist_free(blacklist);
+    csc_srv_free(srv);
+    exit(0);
+}
+
+
+static int serv_PreFork( csc_log_t *log
+                       , csc_ini_t *ini
+                       , config_t *conf
+                       , srvMetrics_t *met
+                       , int *readyFd
+                       , int (*doConn)( int fd            // client file descriptor
+                                      , const char *clientIp   // IP of client, or NULL
+                                      , csc_ini_t *ini // Configuration object.
+                                      , csc_log_t *log  // Logging object.
+                                      , void *local
+                                      )
+                       , void *local
+                       )
+{   int retVal = -2;
+    int iWorker, nWorkers = 0;
+    int nListened, nKilled;
+    int status;
+    int listenedPipe[2] = {-1, -1};
+    char listened;
+    csc_bool_t isHandedOver = csc_FALSE;
+    pid_t pid;
+ 
+// Resources.
+    pid_t *pids = NULL;
+    time_t *startTimes = NULL;
+ 
+// Check the configuration.
+    if (conf->maxThreads < 1)
+    {   csc_log_printf(log, csc_log_FATAL
+                      , "\"%s\" must be at least 1 for the %s model"
+                      , configId_MaxThreads, srvModelStr_PreFork);
+        return 0;
+    }
+    pids = csc_allocMany(pid_t, conf->maxThreads);
+    startTimes = csc_allocMany(time_t, conf->maxThreads);
+    for (iWorker=0; iWorker<conf->maxThreads; iWorker++)
+        pids[iWorker] = 0;
+ 
+// Set up the signal handling.
+    servSig_t servSig;
+    servSig.isQuit = csc_FALSE;
+    servSig.isRestart = csc_FALSE;
+    servSig.hotFd = -1;
+    servSig.hotGen = 0;
+    servSig.log = log;
+    csc_signal_addHndl(SIGINT, sigHandler, &servSig);
+    csc_signal_addHndl(SIGTERM, sigHandler, &servSig);
+    csc_signal_addHndl(SIGHUP, sigHandler, &servSig);
+    csc_signal_addHndl(SIGUSR2, sigHandler, &servSig);
+ 
+// After a hot restart, the first workers say when they are listening.
+    if (*readyFd>=0 && pipe(listenedPipe)!=0)
+        listenedPipe[0] = listenedPipe[1] = -1;
+ 
+// Keep a worker in each slot until we are told to quit.
+    while (!servSig.isQuit)
+    {
+    // Let a new process take over, if asked.  It has its own sockets.
+        if (hotHandOver(&servSig, -1))
+        {   isHandedOver = csc_TRUE;
+            retVal = 1;
+            break;
+        }
+ 
+    // Start workers for any empty slots.
+        for (iWorker=0; iWorker<conf->maxThreads && !servSig.isQuit; iWorker++)
+        {   if (pids[iWorker] != 0)
+                continue;
+            pid = fork();
+            if (pid < 0)  // Error.  Fork failed.
+            {   csc_log_printf(log, csc_log_ERROR,
+                                "fork: %s", strerror(errno)); 
+                servSig.isQuit = csc_TRUE;
+                retVal = 0;
+            }
+            else if (pid == 0)  // This is the worker process.
+            {   preForkWorker( log, ini, conf, met, &servSig, iWorker
+                             , listenedPipe[0]>=0 ? listenedPipe : NULL, doConn, local);
+            }
+            else
+            {   pids[iWorker] = pid;
+                startTimes[iWorker] = time(NULL);
+                nWorkers++;
+                csc_metric_add(met->forks, 1);
+            }
+        }
+        csc_metric_set(met->workers, nWorkers);
+        if (servSig.isQuit)
+            break;
+ 
+    // Tell whoever started us that we are serving, once any of the first
+    // workers is listening.
+        if (listenedPipe[0] >= 0)
+        {   close(listenedPipe[1]);
+            nListened = 0;
+            while (nListened<nWorkers && read(listenedPipe[0],&listened,1)==1)
+                nListened++;
+            close(listenedPipe[0]);
+            listenedPipe[0] = listenedPipe[1] = -1;
+            if (nListened > 0)
+                hotSignalReady(readyFd);
+        }
+ 
+    // Wait for a worker to finish, or for the new process to answer.
+        if (servSig.hotFd >= 0)
+        {   hotPoll(&servSig, -1, hotPollMs);
+            pid = waitpid(-1, &status, WNOHANG);
+            if (pid == 0)
+                continue;
+        }
+        else
+            pid = wait(&status);
+        if (pid == -1)
+        {   if (errno != EINTR)
+            {   csc_log_printf(log, csc_log_FATAL, "wait: %s", strerror(errno)); 
+                servSig.isQuit = csc_TRUE;
+                retVal = 0;
+            }
+            continue;
         }
+        for (iWorker=0; iWorker<conf->maxThreads && pids[iWorker]!=pid; iWorker++)
+            ;
+        if (iWorker == conf->maxThreads)
+            continue;
+        pids[iWorker] = 0;
+        nWorkers--;
+        csc_metric_set(met->workers, nWorkers);
+ 
+    // Decide what to do about it.
+        if (WIFEXITED(status) && WEXITSTATUS(status)==preForkExit_NoListen)
+        {   csc_log_str(log, csc_log_FATAL, "PreFork worker could not listen");
+            servSig.isQuit = csc_TRUE;
+            retVal = 0;
+        }
+        else if (WIFEXITED(status) && WEXITSTATUS(status)==0)
+        {   csc_log_printf(log, csc_log_TRACE, "PreFork worker %d recycled", (int)pid);
+        }
+        else
+        {   csc_log_printf(log, csc_log_WARN, "PreFork worker %d died unexpectedly", (int)pid);
+            if (time(NULL) - startTimes[iWorker] < 1)
+                sleep(1);  // Do not restart a failing worker too quickly.
+        }
+    }
+    if (retVal == -2)
+    {   retVal = 1;
+        csc_log_str(log, csc_log_NOTICE
+                    , "Server terminating due to caught signal");
     }
  
+// Tell the workers to finish, and wait for them.  After a hot restart,
+// they first take what is queued on their sockets.  Otherwise they have
+// DrainSecs to finish the connections that they are handling.
+    for (iWorker=0; iWorker<conf->maxThreads; iWorker++)
+    {   if (pids[iWorker] != 0)
+            kill(pids[iWorker], isHandedOver ? SIGHUP : SIGTERM);
+    }
+    nKilled = drainChildren(pids, conf->maxThreads, drainUntil(isHandedOver ? -1 : conf->drainSecs));
+    if (nKilled > 0)
+        csc_log_printf( log, csc_log_WARN, "%d PreFork workers killed after %d seconds of draining"
+                      , nKilled, conf->drainSecs);
+    nWorkers = 0;
+    csc_metric_set(met->workers, nWorkers);
+ 
 // Restore the signal handling.
+    hotCancel(&servSig);
     csc_signal_delHndl(SIGINT, &servSig);
     csc_signal_delHndl(SIGTERM, &servSig);
+    csc_signal_delHndl(SIGHUP, &servSig);
+    csc_signal_delHndl(SIGUSR2, &servSig);
  
 // Free resources.
-    if (blacklist)
-        csc_blacklist_free(blacklist);
+    if (listenedPipe[0] >= 0)
+    {   close(listenedPipe[0]);
+        close(listenedPipe[1]);
+    }
+    free(pids);
+    free(startTimes);
+ 
+    return retVal;
+}
+
+
+// ------------------------------------------------------------------
+// -------------------------- Udp model -----------------------------
+
+// A socket for each worker thread, all bound to the same port with
+// SO_REUSEPORT.  Each worker receives a batch of packets, handles them,
+// and sends the replies that they made in one go.  Nothing is shared
+// between the workers but the configuration, the log and the metrics.
+
+#define udpWaitMs 1000
+
+
+typedef struct
+{   csc_log_t *log;
+    csc_ini_t *ini;
+    config_t *conf;
+    srvMetrics_t *met;
+    volatile int isQuit;
+    int (*onPacket)( csc_servBase_udp_t *udp, char *pkt, int pktLen
+                   , const csc_udpAddr_t *from, void *local);
+    void *local;
+} udpShared_t;
+
+
+typedef struct csc_servBase_udp_t
+{   udpShared_t *shared;
+    int iWorker;
+    csc_udp_t *udp;
+    csc_udpPkt_t *inPkts;      // A batch received, into inBufs from inAddrs.
+    char *inBufs;
+    csc_udpAddr_t **inAddrs;
+    csc_udpPkt_t *outPkts;     // Replies to send, from outBufs.
+    char *outBufs;
+    int nOut;
+    csc_udpAddr_t *from;       // Of the packet being handled.
+    pthread_t thread;
+} csc_servBase_udp_t;
+
+
+// Sends the replies made so far.
+static void udpFlush(csc_servBase_udp_t *wkr)
+{   int nSent;
+    if (wkr->nOut == 0)
+        return;
+    nSent = csc_udp_sndMany(wkr->udp, wkr->outPkts, wkr->nOut);
+    if (nSent < wkr->nOut)
+    {   csc_log_printf( wkr->shared->log, csc_log_WARN, "Udp worker %d: %s"
+                      , wkr->iWorker, csc_udp_getErrMsg(wkr->udp));
+    }
+    if (nSent > 0)
+        csc_metric_add(wkr->shared->met->udpReplies, nSent);
+    wkr->nOut = 0;
+}
+
+
+// Makes a worker with its socket.  Returns NULL on failure.
+static csc_servBase_udp_t *udpNewWorker(udpShared_t *shared, int iWorker)
+{   config_t *conf = shared->conf;
+    int pktSize = conf->udpMaxPkt + 1;
+    int i;
+ 
+// The socket.
+    csc_servBase_udp_t *wkr = csc_allocOne(csc_servBase_udp_t);
+    wkr->shared = shared;
+    wkr->iWorker = iWorker;
+    wkr->udp = csc_udp_new();
+    csc_udp_setReusePort(wkr->udp, csc_TRUE);
+    if ( !csc_udp_setSrv(wkr->udp, conf->ipStr, conf->portNum)
+      || !csc_udp_setBufSizes(wkr->udp, conf->sockOpts.rcvBufSize, conf->sockOpts.sndBufSize)
+       )
+    {   csc_log_printf( shared->log, csc_log_FATAL, "Udp worker %d: %s"
+                      , iWorker, csc_udp_getErrMsg(wkr->udp));
+        csc_udp_free(wkr->udp);
+        free(wkr);
+        return NULL;
+    }
+ 
+// The buffers, allocated once, and used for batch after batch.
+    wkr->inPkts = csc_allocMany(csc_udpPkt_t, conf->udpBatch);
+    wkr->inBufs = csc_allocMany(char, conf->udpBatch * pktSize);
+    wkr->inAddrs = csc_allocMany(csc_udpAddr_t*, conf->udpBatch);
+    wkr->outPkts = csc_allocMany(csc_udpPkt_t, conf->udpBatch);
+    wkr->outBufs = csc_allocMany(char, conf->udpBatch * pktSize);
+    for (i=0; i<conf->udpBatch; i++)
+    {   wkr->inAddrs[i] = csc_udpAddr_new();
+        wkr->inPkts[i].buf = &wkr->inBufs[i*pktSize];
+        wkr->inPkts[i].bufSiz = conf->udpMaxPkt;
+        wkr->inPkts[i].addr = wkr->inAddrs[i];
+        wkr->outPkts[i].buf = &wkr->outBufs[i*pktSize];
+        wkr->outPkts[i].addr = csc_udpAddr_new();
+    }
+    wkr->nOut = 0;
+    wkr->from = NULL;
+    return wkr;
+}
+
+
+static void udpFreeWorker(csc_servBase_udp_t *wkr)
+{   int i;
+    for (i=0; i<wkr->shared->conf->udpBatch; i++)
+    {   csc_udpAddr_free(wkr->inAddrs[i]);
+        csc_udpAddr_free(wkr->outPkts[i].addr);
+    }
+    free(wkr->inPkts);
+    free(wkr->inBufs);
+    free(wkr->inAddrs);
+    free(wkr->outPkts);
+    free(wkr->outBufs);
+    csc_udp_free(wkr->udp);
+    free(wkr);
+}
+
+
+static void *udpWorker(void *arg)
+{   csc_servBase_udp_t *wkr = arg;
+    udpShared_t *shared = wkr->shared;
+    csc_udpPkt_t *pkt;
+    int nPkts, i;
+ 
+    while (!shared->isQuit)
+    {
+    // Wait for a batch.  Wake once a second to check whether to quit.
+        nPkts = csc_udp_rcvMany(wkr->udp, wkr->inPkts, shared->conf->udpBatch, udpWaitMs);
+        if (nPkts == -2)
+            continue;
+        else if (nPkts < 0)
+        {   csc_log_printf( shared->log, csc_log_ERROR, "Udp worker %d: %s"
+                          , wkr->iWorker, csc_udp_getErrMsg(wkr->udp));
+            continue;
+        }
+        csc_metric_add(shared->met->udpPackets, nPkts);
+ 
+    // Handle each, and send the replies together.
+        for (i=0; i<nPkts; i++)
+        {   pkt = &wkr->inPkts[i];
+            pkt->buf[pkt->len] = '\0';
+            wkr->from = pkt->addr;
+            if (shared->onPacket(wkr, pkt->buf, pkt->len, pkt->addr, shared->local) < 0)
+                csc_log_printf(shared->log, csc_log_TRACE, "Udp worker %d: packet failed", wkr->iWorker);
+        }
+        wkr->from = NULL;
+        udpFlush(wkr);
+    }
+ 
+    return NULL;
+}
+
+
+csc_bool_t csc_servBase_udpReply(csc_servBase_udp_t *wkr, const char *buf, int len)
+{   csc_udpPkt_t *out;
+    if (len<0 || len>wkr->shared->conf->udpMaxPkt || wkr->from==NULL)
+        return csc_FALSE;
+ 
+// Make room, if this packet has more replies than there are buffers.
+    if (wkr->nOut == wkr->shared->conf->udpBatch)
+        udpFlush(wkr);
+ 
+// Queue the reply.
+    out = &wkr->outPkts[wkr->nOut++];
+    memcpy(out->buf, buf, len);
+    out->len = len;
+    csc_udpAddr_copy(out->addr, wkr->from);
+    return csc_TRUE;
+}
+
+
+int csc_servBase_udpWorkerNum(csc_servBase_udp_t *wkr)
+{   return wkr->iWorker;
+}
+
+
+csc_ini_t *csc_servBase_udpConf(csc_servBase_udp_t *wkr)
+{   return wkr->shared->ini;
+}
+
+
+csc_log_t *csc_servBase_udpLog(csc_servBase_udp_t *wkr)
+{   return wkr->shared->log;
+}
+
+
+static int serv_Udp( csc_log_t *log
+                   , csc_ini_t *ini
+                   , config_t *conf
+                   , srvMetrics_t *met
+                   , int *readyFd
+                   , int (*onPacket)( csc_servBase_udp_t *udp, char *pkt, int pktLen
+                                    , const csc_udpAddr_t *from, void *local)
+                   , void *local
+                   )
+{   int retVal = 1;
+    int iWorker, nWorkers = 0;
+    int result;
+    sigset_t sigMask, oldSigMask;
+    pthread_attr_t attr;
+    udpShared_t shared;
+ 
+// Resources.
+    csc_servBase_udp_t **workers = NULL;
+ 
+// What the workers share.
+    shared.log = log;
+    shared.ini = ini;
+    shared.conf = conf;
+    shared.met = met;
+    shared.isQuit = csc_FALSE;
+    shared.onPacket = onPacket;
+    shared.local = local;
+ 
+// Set up the signal handling.
+    servSig_t servSig;
+    servSig.isQuit = csc_FALSE;
+    servSig.isRestart = csc_FALSE;
+    servSig.hotFd = -1;
+    servSig.hotGen = 0;
+    servSig.log = log;
+    csc_signal_addHndl(SIGINT, sigHandler, &servSig);
+    csc_signal_addHndl(SIGTERM, sigHandler, &servSig);
+    csc_signal_addHndl(SIGHUP, sigHandler, &servSig);
+    csc_signal_addHndl(SIGUSR2, sigHandler, &servSig);
+ 
+// Open all the sockets before any worker starts, so that none receives
+// packets while another may yet fail to bind.
+    workers = csc_allocMany(csc_servBase_udp_t*, conf->udpThreads);
+    for (iWorker=0; iWorker<conf->udpThreads; iWorker++)
+    {   workers[iWorker] = udpNewWorker(&shared, iWorker);
+        if (workers[iWorker] == NULL)
+        {   servSig.isQuit = csc_TRUE;
+            retVal = 0;
+            break;
+        }
+    }
+ 
+// Start the workers.  They block our signals, so that these are
+// delivered to this thread.
+    sigemptyset(&sigMask);
+    sigaddset(&sigMask, SIGINT);
+    sigaddset(&sigMask, SIGTERM);
+    sigaddset(&sigMask, SIGHUP);
+    sigaddset(&sigMask, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &sigMask, &oldSigMask);
+    for (; nWorkers<conf->udpThreads && !servSig.isQuit; nWorkers++)
+    {   result = pthread_create( &workers[nWorkers]->thread, cpuThreadAttr(conf, nWorkers, &attr)
+                               , udpWorker, workers[nWorkers]);
+        pthread_attr_destroy(&attr);
+        if (result != 0)
+        {   csc_log_printf(log, csc_log_ERROR,
+                            "pthread_create: %s", strerror(result)); 
+            servSig.isQuit = csc_TRUE;
+            retVal = 0;
+            break;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &oldSigMask, NULL);
+    csc_metric_set(met->workers, nWorkers);
+ 
+// Tell whoever started us that we are serving.
+    if (!servSig.isQuit)
+        hotSignalReady(readyFd);
+ 
+// Wait to be told to quit, or for a new process to take over.  It has its
+// own sockets.
+    while (!servSig.isQuit)
+    {   if (hotHandOver(&servSig, -1))
+            break;
+        hotPoll(&servSig, -1, hotPollMs);
+    }
+    if (servSig.isQuit && retVal==1)
+    {   csc_log_str(log, csc_log_NOTICE
+                    , "Server terminating due to caught signal");
+    }
+ 
+// The workers finish the batches that they have.
+    shared.isQuit = csc_TRUE;
+    for (iWorker=0; iWorker<nWorkers; iWorker++)
+        pthread_join(workers[iWorker]->thread, NULL);
+    csc_metric_set(met->workers, 0);
+ 
+// We are finished here, so remove the signal handling.
+    hotCancel(&servSig);
+    csc_signal_delHndl(SIGINT, &servSig);
+    csc_signal_delHndl(SIGTERM, &servSig);
+    csc_signal_delHndl(SIGHUP, &servSig);
+    csc_signal_delHndl(SIGUSR2, &servSig);
+ 
+// Free resources.
+    for (iWorker=0; iWorker<conf->udpThreads && workers[iWorker]!=NULL; iWorker++)
+        udpFreeWorker(workers[iWorker]);
+    free(workers);
  
     return retVal;
 }
@@ -299,6 +3732,9 @@ static int serv_Forking( csc_log_t *log
 
 csc_bool_t readConfig(csc_log_t *log, csc_ini_t **ini, config_t *conf, const char *configPath)
 {   int iniFileLineNum;
+    cpu_set_t allowedCpus;
+    csc_srv_sockOpts_t *opts = &conf->sockOpts;
+    int flag;
     const char *str;
 
 // Initialise each element of the configuration to invalid values.
@@ -306,6 +3742,22 @@ csc_bool_t readConfig(csc_log_t *log, csc_ini_t **ini, config_t *conf, const cha
     conf->ipStr = NULL;
     conf->backlog = -1;
     conf->maxThreads = -1;
+    conf->queueSize = -1;
+    conf->maxConns = -1;
+    conf->maxConnsPerChild = -1;
+    conf->metricsPort = -1;
+    conf->overloadAction = -1;
+    conf->onShed = NULL;
+    conf->maxQueueWaitMs = -1;
+    conf->drainSecs = -1;
+    conf->coroThreads = -1;
+    conf->coroStackKb = -1;
+    conf->numaNode = -1;
+    conf->nWorkerCpus = 0;
+    conf->udpThreads = -1;
+    conf->udpBatch = -1;
+    conf->udpMaxPkt = -1;
+    csc_srv_sockOptsInit(opts);
     conf->readTimeoutSecs = -1;
     conf->writeTimeoutSecs = -1;
     conf->blacklistMax = -1;
@@ -319,102 +3771,362 @@ csc_bool_t readConfig(csc_log_t *log, csc_ini_t **ini, config_t *conf, const cha
         return csc_FALSE;
     }
  
-// Read configuration.
-    iniFileLineNum = csc_ini_read(*ini, configPath);
-    if (iniFileLineNum > 0)
-    {   csc_log_printf(log, csc_log_FATAL
-                    , "Error reading ini file \"%s\" on line number %d"
-                    , configPath, iniFileLineNum);
+// Read configuration.
+    iniFileLineNum = csc_ini_read(*ini, configPath);
+    if (iniFileLineNum > 0)
+    {   csc_log_printf(log, csc_log_FATAL
+                    , "Error reading ini file \"%s\" on line number %d"
+                    , configPath, iniFileLineNum);
+        return csc_FALSE;
+    }
+    else if (iniFileLineNum < 0)
+    {   csc_log_printf(log, csc_log_FATAL 
+                    , "Error reading ini file \"%s\".  Could not open."
+                    , configPath);
+        return csc_FALSE;
+    }
+ 
+// Get and set logging level
+    str = csc_ini_getStr(*ini, ConfSection, configId_LogLevel);
+    if (str != NULL)
+    {   if (!csc_isValid_int(str) || !csc_log_setLogLevel(log, atoi(str)))
+        {   csc_log_printf( log
+                         , csc_log_FATAL
+                         , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                         , configId_LogLevel
+                         , ConfSection
+                         , configPath
+                         );
+            return csc_FALSE;
+        }
+    }
+ 
+// Set the error output.
+    const char *stderrPath = csc_ini_getStr(*ini, ConfSection, configId_errPath);
+    if (stderrPath != NULL)
+    {   if (!csc_isValid_decentAbsPath(stderrPath))
+        {   csc_log_printf( log
+                         , csc_log_FATAL
+                         , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                         , configId_errPath
+                         , ConfSection
+                         , configPath
+                         );
+            return csc_FALSE;
+        }
+        csc_setErrOut(stderrPath);
+    }
+ 
+// Get the port number.
+// Some error handling for this is performed already in csc_srv_setAddr().
+    str = csc_ini_getStr(*ini, ConfSection, configId_Port);
+    if (str==NULL || !csc_isValid_int(str))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid or missing \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_Port
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+    conf->portNum = atoi(str);
+ 
+// Get the IP.
+// Error handling for this is performed already in csc_srv_setAddr().
+    conf->ipStr = csc_ini_getStr(*ini, ConfSection, configId_Ip);
+ 
+// Get the backlog.
+    str = csc_ini_getStr(*ini, ConfSection, configId_Backlog);
+    if (str == NULL)
+        str = "10";
+    if (!csc_isValid_int(str))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_Backlog
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+    conf->backlog = atoi(str);
+ 
+// Get the max number of connections.
+    str = csc_ini_getStr(*ini, ConfSection, configId_MaxThreads);
+    if (str == NULL)
+        str = "4";
+    else if (!csc_isValid_int(str))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_MaxThreads
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+    conf->maxThreads = atoi(str);
+ 
+// Get the size of the queue of accepted connections (ThreadPool only).
+    str = csc_ini_getStr(*ini, ConfSection, configId_QueueSize);
+    if (str == NULL)
+        conf->queueSize = csc_max(conf->maxThreads, 1);
+    else if (!csc_isValidRange_int(str, 1, 100000, &conf->queueSize))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_QueueSize
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get the max number of connections (EventLoop and Coro only).
+    str = csc_ini_getStr(*ini, ConfSection, configId_MaxConns);
+    if (str == NULL)
+        str = "1000";
+    if (!csc_isValidRange_int(str, 1, 1000000, &conf->maxConns))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_MaxConns
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get the event driven model.
+    str = csc_ini_getStr(*ini, ConfSection, configId_EventModel);
+    if (str==NULL || csc_streq(str,srvModelStr_EventLoop))
+        conf->isUring = csc_FALSE;
+    else if (csc_streq(str,srvModelStr_Uring))
+        conf->isUring = csc_TRUE;
+    else
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_EventModel
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+#ifndef csc_HAVE_LIBURING
+    if (conf->isUring)
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "The %s model was not compiled into CscNetLib"
+                     , srvModelStr_Uring
+                     );
+        return csc_FALSE;
+    }
+#endif
+ 
+// Get what to do with connections when "Forking" is full.
+    str = csc_ini_getStr(*ini, ConfSection, configId_OverloadAction);
+    if (str==NULL || csc_streq(str,overloadStr_Wait))
+        conf->overloadAction = overload_Wait;
+    else if (csc_streq(str,overloadStr_Close))
+        conf->overloadAction = overload_Close;
+    else if (csc_streq(str,overloadStr_503))
+        conf->overloadAction = overload_503;
+    else
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_OverloadAction
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get how long a connection may wait in the queue.
+    str = csc_ini_getStr(*ini, ConfSection, configId_MaxQueueWaitMs);
+    if (str == NULL)
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, 3600000, &conf->maxQueueWaitMs))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_MaxQueueWaitMs
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get how long to give connections to finish when quitting.
+    str = csc_ini_getStr(*ini, ConfSection, configId_DrainSecs);
+    if (str == NULL)
+        str = "30";
+    if (!csc_isValidRange_int(str, 0, 3600, &conf->drainSecs))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_DrainSecs
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get the number of threads for the Coro model.
+    str = csc_ini_getStr(*ini, ConfSection, configId_CoroThreads);
+    if (str == NULL)
+        str = "1";
+    if (!csc_isValidRange_int(str, 1, 1024, &conf->coroThreads))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_CoroThreads
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get the size of the stack of each coroutine in the Coro model.
+    str = csc_ini_getStr(*ini, ConfSection, configId_CoroStackKb);
+    if (str == NULL)
+        str = "256";
+    if (!csc_isValidRange_int(str, 16, 1048576, &conf->coroStackKb))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_CoroStackKb
+                     , ConfSection
+                     , configPath
+                     );
         return csc_FALSE;
     }
-    else if (iniFileLineNum < 0)
-    {   csc_log_printf(log, csc_log_FATAL 
-                    , "Error reading ini file \"%s\".  Could not open."
-                    , configPath);
+ 
+// Get the number of sockets and threads for the Udp model.
+    str = csc_ini_getStr(*ini, ConfSection, configId_UdpThreads);
+    if (str == NULL)
+        str = "1";
+    if (!csc_isValidRange_int(str, 1, 1024, &conf->udpThreads))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_UdpThreads
+                     , ConfSection
+                     , configPath
+                     );
         return csc_FALSE;
     }
  
-// Get and set logging level
-    str = csc_ini_getStr(*ini, ConfSection, configId_LogLevel);
-    if (str != NULL)
-    {   if (!csc_isValid_int(str) || !csc_log_setLogLevel(log, atoi(str)))
-        {   csc_log_printf( log
-                         , csc_log_FATAL
-                         , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
-                         , configId_LogLevel
-                         , ConfSection
-                         , configPath
-                         );
-            return csc_FALSE;
-        }
+// Get the most packets received or sent at once in the Udp model.
+    str = csc_ini_getStr(*ini, ConfSection, configId_UdpBatch);
+    if (str == NULL)
+        str = "32";
+    if (!csc_isValidRange_int(str, 1, 64, &conf->udpBatch))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_UdpBatch
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
     }
  
-// Set the error output.
-    const char *stderrPath = csc_ini_getStr(*ini, ConfSection, configId_errPath);
-    if (stderrPath != NULL)
-    {   if (!csc_isValid_decentAbsPath(stderrPath))
-        {   csc_log_printf( log
-                         , csc_log_FATAL
-                         , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
-                         , configId_errPath
-                         , ConfSection
-                         , configPath
-                         );
-            return csc_FALSE;
-        }
-        csc_setErrOut(stderrPath);
+// Get the biggest packet in the Udp model.
+    str = csc_ini_getStr(*ini, ConfSection, configId_UdpMaxPkt);
+    if (str == NULL)
+        str = "2048";
+    if (!csc_isValidRange_int(str, 1, 65536, &conf->udpMaxPkt))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_UdpMaxPkt
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
     }
  
-// Get the port number.
-// Some error handling for this is performed already in csc_srv_setAddr().
-    str = csc_ini_getStr(*ini, ConfSection, configId_Port);
-    if (str==NULL || !csc_isValid_int(str))
+// Get the NUMA node to run on, if any.
+    str = csc_ini_getStr(*ini, ConfSection, configId_NumaNode);
+    if (str == NULL)
+        str = "-1";
+    if ( !csc_isValidRange_int(str, -1, cpuMaxNodes-1, &conf->numaNode)
+       || (conf->numaNode>=0 && !cpuNodeCpus(conf->numaNode, &conf->nodeCpus))
+       )
     {   csc_log_printf( log
                      , csc_log_FATAL
-                     , "Invalid or missing \"%s\" in section \"%s\" configuration file \"%s\""
-                     , configId_Port
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_NumaNode
                      , ConfSection
                      , configPath
                      );
         return csc_FALSE;
     }
-    conf->portNum = atoi(str);
  
-// Get the IP.
-// Error handling for this is performed already in csc_srv_setAddr().
-    conf->ipStr = csc_ini_getStr(*ini, ConfSection, configId_Ip);
+// Get the CPUs to pin the workers to, if any.  "auto" uses those that we
+// may run on, within the NUMA node if one is given.  A list may only have
+// CPUs that we may run on.
+    str = csc_ini_getStr(*ini, ConfSection, configId_CpuAffinity);
+    if (str!=NULL && csc_streq(str,cpuAffinityStr_None))
+        str = NULL;
+    sched_getaffinity(0, sizeof(cpu_set_t), &allowedCpus);
+    CPU_ZERO(&conf->workerCpus);
+    if (str!=NULL && csc_streq(str,cpuAffinityStr_Auto))
+    {   conf->workerCpus = allowedCpus;
+        if (conf->numaNode >= 0)
+            CPU_AND(&conf->workerCpus, &conf->workerCpus, &conf->nodeCpus);
+    }
+    else if (str != NULL)
+    {   if (!cpuParseList(str, &conf->workerCpus))
+            CPU_ZERO(&conf->workerCpus);
+        CPU_AND(&allowedCpus, &allowedCpus, &conf->workerCpus);
+        if (!CPU_EQUAL(&allowedCpus, &conf->workerCpus))
+            CPU_ZERO(&conf->workerCpus);
+    }
+    conf->nWorkerCpus = CPU_COUNT(&conf->workerCpus);
+    if (str!=NULL && conf->nWorkerCpus==0)
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_CpuAffinity
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
  
-// Get the backlog.
-    str = csc_ini_getStr(*ini, ConfSection, configId_Backlog);
+// Get the number of connections a PreFork worker handles before it is replaced.
+    str = csc_ini_getStr(*ini, ConfSection, configId_MaxConnsPerChild);
     if (str == NULL)
-        str = "10";
-    if (!csc_isValid_int(str))
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, 100000000, &conf->maxConnsPerChild))
     {   csc_log_printf( log
                      , csc_log_FATAL
                      , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
-                     , configId_Backlog
+                     , configId_MaxConnsPerChild
                      , ConfSection
                      , configPath
                      );
         return csc_FALSE;
     }
-    conf->backlog = atoi(str);
  
-// Get the max number of connections.
-    str = csc_ini_getStr(*ini, ConfSection, configId_MaxThreads);
+// Get the port for serving metrics, if any.
+    str = csc_ini_getStr(*ini, ConfSection, configId_MetricsPort);
     if (str == NULL)
-        str = "4";
-    else if (!csc_isValid_int(str))
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, 65535, &conf->metricsPort))
     {   csc_log_printf( log
                      , csc_log_FATAL
                      , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
-                     , configId_MaxThreads
+                     , configId_MetricsPort
                      , ConfSection
                      , configPath
                      );
         return csc_FALSE;
     }
-    conf->maxThreads = atoi(str);
  
 // Get the read timeout value.
     str = csc_ini_getStr(*ini, ConfSection, configId_ReadTimeout);
@@ -446,6 +4158,113 @@ csc_bool_t readConfig(csc_log_t *log, csc_ini_t **ini, config_t *conf, const cha
         return csc_FALSE;
     }
  
+// Get the socket options.
+    str = csc_ini_getStr(*ini, ConfSection, configId_DeferAccept);
+    if (str == NULL)
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, 3600, &opts->deferAcceptSecs))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_DeferAccept
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get the TCP Fast Open queue length.
+    str = csc_ini_getStr(*ini, ConfSection, configId_FastOpen);
+    if (str == NULL)
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, 65535, &opts->fastOpenQueue))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_FastOpen
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get the busy poll time.
+    str = csc_ini_getStr(*ini, ConfSection, configId_BusyPoll);
+    if (str == NULL)
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, 1000000, &opts->busyPollUs))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_BusyPoll
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get whether to disable Nagle.
+    str = csc_ini_getStr(*ini, ConfSection, configId_NoDelay);
+    if (str == NULL)
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, 1, &flag))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_NoDelay
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+    opts->isNoDelay = flag;
+ 
+// Get whether to acknowledge at once.
+    str = csc_ini_getStr(*ini, ConfSection, configId_QuickAck);
+    if (str == NULL)
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, 1, &flag))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_QuickAck
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+    opts->isQuickAck = flag;
+ 
+// Get the receive buffer size.
+    str = csc_ini_getStr(*ini, ConfSection, configId_RcvBuf);
+    if (str == NULL)
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, INT_MAX/2, &opts->rcvBufSize))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_RcvBuf
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
+// Get the send buffer size.
+    str = csc_ini_getStr(*ini, ConfSection, configId_SndBuf);
+    if (str == NULL)
+        str = "0";
+    if (!csc_isValidRange_int(str, 0, INT_MAX/2, &opts->sndBufSize))
+    {   csc_log_printf( log
+                     , csc_log_FATAL
+                     , "Invalid \"%s\" in section \"%s\" configuration file \"%s\""
+                     , configId_SndBuf
+                     , ConfSection
+                     , configPath
+                     );
+        return csc_FALSE;
+    }
+ 
 // Get blacklistMax.
     str = csc_ini_getStr(*ini, ConfSection, configId_BlacklistMax);
     if (str == NULL)
@@ -481,30 +4300,41 @@ csc_bool_t readConfig(csc_log_t *log, csc_ini_t **ini, config_t *conf, const cha
 }
 
 
-int csc_servBase_server( const char *srvModelStr
-                       , const char *logPath
-                       , const char *logId
-                       , const char *configPath
-                       , int (*doConn)( int fd            // client file descriptor
-                                      , const char *clientIp   // IP of client, or NULL
-                                      , csc_ini_t *ini // Configuration object.
-                                      , csc_log_t *log  // Logging object.
-                                      , void *local
-                                      )
-                       , int (*doInit)( csc_ini_t *ini // Configuration object.
-                                      , csc_log_t *log  // Logging object.
-                                      , void *local
-                                      )
-                       , void *local      // Values to pass to doConn() and to doInit().
-                       )
+// Common to csc_servBase_server(), csc_servBase_evServer() and
+// csc_servBase_udpServer().  Exactly one of 'doConn', 'handlers' or
+// 'onPacket' is used, depending on the model.
+static int servBase( const char *srvModelStr
+                   , const char *logPath
+                   , const char *logId
+                   , const char *configPath
+                   , int (*doConn)( int fd            // client file descriptor
+                                  , const char *clientIp   // IP of client, or NULL
+                                  , csc_ini_t *ini // Configuration object.
+                                  , csc_log_t *log  // Logging object.
+                                  , void *local
+                                  )
+                   , const csc_servBase_evHandlers_t *handlers
+                   , int (*onPacket)( csc_servBase_udp_t *udp, char *pkt, int pktLen
+                                    , const csc_udpAddr_t *from, void *local)
+                   , int (*doInit)( csc_ini_t *ini // Configuration object.
+                                  , csc_log_t *log  // Logging object.
+                                  , void *local
+                                  )
+                   , void (*onShed)(int fd, void *local)
+                   , void *local      // Values to pass to doConn(), doInit() and onShed().
+                   )
 {   int retVal = csc_TRUE;
     int srvModel, result;
+    int listenFd = -1, readyFd = -1;
     config_t config;
+    srvMetrics_t metrics;
  
 // Resources.
     csc_ini_t *ini = NULL;
     csc_log_t *log = NULL;
     csc_srv_t *srv = NULL;
+    metServer_t *metServer = NULL;
+    metrics.reg = NULL;
  
 // Initialise the logging.
     log = csc_log_new(logPath, logId, initialLogLevel);
@@ -520,6 +4350,21 @@ int csc_servBase_server( const char *srvModelStr
     else if (csc_streq(srvModelStr,srvModelStr_Forking))
     {   srvModel = srvModel_Forking;
     }
+    else if (csc_streq(srvModelStr,srvModelStr_ThreadPool))
+    {   srvModel = srvModel_ThreadPool;
+    }
+    else if (csc_streq(srvModelStr,srvModelStr_EventLoop))
+    {   srvModel = srvModel_EventLoop;
+    }
+    else if (csc_streq(srvModelStr,srvModelStr_PreFork))
+    {   srvModel = srvModel_PreFork;
+    }
+    else if (csc_streq(srvModelStr,srvModelStr_Coro))
+    {   srvModel = srvModel_Coro;
+    }
+    else if (csc_streq(srvModelStr,srvModelStr_Udp))
+    {   srvModel = srvModel_Udp;
+    }
     else
     {   csc_log_printf( log , csc_log_FATAL , "Invalid server model");
         retVal = csc_FALSE; 
@@ -530,6 +4375,26 @@ int csc_servBase_server( const char *srvModelStr
     retVal = readConfig(log, &ini, &config, configPath);
     if (!retVal)
         goto cleanup;
+    config.onShed = onShed;
+ 
+// The event driven models share an entry point.
+    if (srvModel==srvModel_EventLoop && config.isUring)
+    {   srvModel = srvModel_Uring;
+        srvModelStr = srvModelStr_Uring;
+    }
+ 
+// Keep to our NUMA node, if asked, before anything is allocated for serving.
+    cpuPlaceProcess(log, &config);
+ 
+// Register our metrics.
+    metInit(&metrics);
+    if (srvModel == srvModel_Udp)
+        metInitUdp(&metrics);
+ 
+// After a hot restart, we have the listening socket of the process that
+// started us, and a pipe on which to tell it when we are serving.
+    listenFd = hotTakeFd(hotEnv_ListenFd);
+    readyFd = hotTakeFd(hotEnv_ReadyFd);
  
 // Create netSrv object.
     srv = csc_srv_new();
@@ -537,13 +4402,29 @@ int csc_servBase_server( const char *srvModelStr
     {   csc_log_str(log, csc_log_FATAL, "Failed to open netSrv object");
         goto cleanup;
     }
+    csc_srv_setSockOpts(srv, &config.sockOpts);
  
-// Set up the server object.
-    result = csc_srv_setAddr(srv, config.ipStr, config.portNum, config.backlog);
-    if (!result)
-    {   csc_log_str(log , csc_log_FATAL, csc_srv_getErrMsg(srv));
-        retVal = csc_FALSE; 
-        goto cleanup;
+// Set up the server object.  PreFork and Udp workers each listen for
+// themselves.
+    if (srvModel==srvModel_PreFork || srvModel==srvModel_Udp)
+        ;
+    else if (listenFd >= 0)
+    {   result = csc_srv_adoptListenSock(srv, listenFd);
+        if (!result)
+        {   csc_log_str(log , csc_log_FATAL, csc_srv_getErrMsg(srv));
+            retVal = csc_FALSE; 
+            goto cleanup;
+        }
+        listenFd = -1;
+        csc_log_str(log, csc_log_NOTICE, "Took over the listening socket in a hot restart");
+    }
+    else
+    {   result = csc_srv_setAddr(srv, config.ipStr, config.portNum, config.backlog);
+        if (!result)
+        {   csc_log_str(log , csc_log_FATAL, csc_srv_getErrMsg(srv));
+            retVal = csc_FALSE; 
+            goto cleanup;
+        }
     }
  
 // Perform initialisations.  doInit() is passed from the caller.
@@ -554,6 +4435,15 @@ int csc_servBase_server( const char *srvModelStr
         }
     }
  
+// Serve the metrics, if asked.
+    if (config.metricsPort > 0)
+    {   metServer = metStart(log, &config, metrics.reg);
+        if (metServer == NULL)
+        {   retVal = csc_FALSE; 
+            goto cleanup;
+        }
+    }
+ 
 // Log success so far.
     csc_log_printf( log
                   , csc_log_NOTICE
@@ -569,13 +4459,47 @@ int csc_servBase_server( const char *srvModelStr
                );
     }
  
+// Tell the process that started us, if any, that we are serving.
+// PreFork and Udp do so once their workers are listening.
+    if (srvModel!=srvModel_PreFork && srvModel!=srvModel_Udp)
+        hotSignalReady(&readyFd);
+ 
+// The models with one thread pin it as the only worker.  The others pin
+// each worker as they start it.
+    if ( srvModel==srvModel_OneByOne || srvModel==srvModel_EventLoop
+       || srvModel==srvModel_Uring
+       )
+        cpuPinSelf(log, &config, 0);
+ 
 // Do each successful connection.
     if (srvModel == srvModel_OneByOne)
-        serv_OneByOne(log, ini, srv, &config, doConn, local);
+        serv_OneByOne(log, ini, srv, &config, &metrics, doConn, local);
+    else if (srvModel == srvModel_ThreadPool)
+        serv_ThreadPool(log, ini, srv, &config, &metrics, doConn, local);
+    else if (srvModel == srvModel_Coro)
+        serv_Coro(log, ini, srv, &config, &metrics, doConn, local);
+    else if (srvModel == srvModel_EventLoop)
+        serv_EventLoop(log, ini, srv, &config, &metrics, handlers, local);
+#ifdef csc_HAVE_LIBURING
+    else if (srvModel == srvModel_Uring)
+        serv_Uring(log, ini, srv, &config, &metrics, handlers, local);
+#endif
+    else if (srvModel == srvModel_PreFork)
+        serv_PreFork(log, ini, &config, &metrics, &readyFd, doConn, local);
+    else if (srvModel == srvModel_Udp)
+        serv_Udp(log, ini, &config, &metrics, &readyFd, onPacket, local);
     else
-        serv_Forking(log, ini, srv, &config, doConn, local);
+        serv_Forking(log, ini, srv, &config, &metrics, doConn, local);
  
 cleanup:  // Free resources.
+    if (metServer != NULL)
+        metStop(metServer);
+    if (metrics.reg != NULL)
+        csc_metrics_free(metrics.reg);
+    if (listenFd >= 0)
+        close(listenFd);
+    if (readyFd >= 0)
+        close(readyFd);
     if (ini != NULL)
         csc_ini_free(ini);
     if (log != NULL)
@@ -587,3 +4511,74 @@ cleanup:  // Free resources.
 }
 
 
+
+
+
+int csc_servBase_server( const char *srvModelStr
+                       , const char *logPath
+                       , const char *logId
+                       , const char *configPath
+                       , int (*doConn)( int fd            // client file descriptor
+                                      , const char *clientIp   // IP of client, or NULL
+                                      , csc_ini_t *ini // Configuration object.
+                                      , csc_log_t *log  // Logging object.
+                                      , void *local
+                                      )
+                       , int (*doInit)( csc_ini_t *ini // Configuration object.
+                                      , csc_log_t *log  // Logging object.
+                                      , void *local
+                                      )
+                       , void (*onShed)(int fd, void *local)
+                       , void *local      // Values to pass to doConn(), doInit() and onShed().
+                       )
+{   if ( csc_streq(srvModelStr,srvModelStr_EventLoop)
+       || csc_streq(srvModelStr,srvModelStr_Uring)
+       )
+    {   fprintf(csc_stderr, "Use csc_servBase_evServer() for the %s model.\n"
+               , srvModelStr);
+        return 0;
+    }
+    if (csc_streq(srvModelStr,srvModelStr_Udp))
+    {   fprintf(csc_stderr, "Use csc_servBase_udpServer() for the %s model.\n"
+               , srvModelStr);
+        return 0;
+    }
+    return servBase( srvModelStr, logPath, logId, configPath
+                   , doConn, NULL, NULL, doInit, onShed, local);
+}
+
+
+int csc_servBase_evServer( const char *logPath
+                         , const char *logId
+                         , const char *configPath
+                         , const csc_servBase_evHandlers_t *handlers
+                         , int (*doInit)( csc_ini_t *ini // Configuration object.
+                                        , csc_log_t *log  // Logging object.
+                                        , void *local
+                                        )
+                         , void (*onShed)(int fd, void *local)
+                         , void *local  // Values to pass to onOpen(), doInit() and onShed().
+                         )
+{   return servBase( srvModelStr_EventLoop, logPath, logId, configPath
+                   , NULL, handlers, NULL, doInit, onShed, local);
+}
+
+
+int csc_servBase_udpServer( const char *logPath
+                          , const char *logId
+                          , const char *configPath
+                          , int (*onPacket)( csc_servBase_udp_t *udp  // The worker.
+                                           , char *pkt              // The packet, with a '\0' after it.
+                                           , int pktLen
+                                           , const csc_udpAddr_t *from // Valid until onPacket() returns.
+                                           , void *local
+                                           )
+                          , int (*doInit)( csc_ini_t *ini // Configuration object.
+                                         , csc_log_t *log  // Logging object.
+                                         , void *local
+                                         )
+                          , void *local  // Values to pass to onPacket() and to doInit().
+                          )
+{   return servBase( srvModelStr_Udp, logPath, logId, configPath
+                   , NULL, NULL, onPacket, doInit, NULL, local);
+}
@@ -14,6 +14,7 @@
 #include "std.h"
 #include "iniFile.h"
 #include "logger.h"
+#include "udp.h"
 
 
 // This function is a base for servers.  Many of its parameters are are not
@@ -24,7 +25,28 @@
 // Listening for connections are terminated if it receives a SIGTERM or
 // SIGINT signal, and this routine will return 1 in this case.  Otherwise
 // it will have returned due to error, and it will return in this case, and
-// the nature of the error will be logged.
+// the nature of the error will be logged.  Connections being handled are
+// given DrainSecs to finish, and are then cut off.  A thread handling one
+// sees the end of its input, and a process handling one is killed.
+// Connections already accepted but not yet handled are still handled in
+// that time.
+// 
+// SIGHUP or SIGUSR2 asks for a hot restart, e.g. after the program file has
+// been replaced by a new version.  The program is run again, with the
+// same arguments, as a new process that inherits the listening socket.
+// This process goes on accepting until the new one is serving, and then
+// stops accepting, finishes the connections that it has, and returns 1.
+// The socket is never closed, so no connection is refused or lost.  If
+// the new process fails to start serving within 30 seconds, this one
+// carries on as before.  Under "PreFork", the new workers listen on their
+// own sockets, and the old ones take what is queued on theirs before
+// they finish.  The new process is not a child of this one.
+// 
+// The metrics are counts of connections accepted and blacklisted, the
+// number being handled, a histogram of how long each took, the number
+// turned away when full, and the number of processes forked and of
+// workers running.  They are kept whether or not they are served, and the
+// children of "Forking" and "PreFork" add to them too.  See metrics.h.
 // 
 // It will call the routine do_init(), if present, after the configuration
 // and logging have been estabilished, but before any connections are
@@ -35,7 +57,30 @@
 // 
 // This routine takes the following arguments:-
 // 
-// 1)   servModel -  Either "OneByOne" or "Forking".  ("ThreadPool" coming soon).
+// 1)   servModel -  One of "OneByOne", "Forking", "ThreadPool", "PreFork"
+//      or "Coro".
+//  *   "OneByOne" handles each connection in turn in this process.
+//  *   "Forking" forks a new process for each connection, with up to
+//      MaxThreads processes running at once.  Finished processes are
+//      reaped as soon as they exit, so a slot is freed without waiting
+//      for the next connection.
+//  *   "ThreadPool" starts MaxThreads worker threads at startup.  Accepted
+//      connections are placed on a queue of QueueSize entries, and are
+//      taken from it by the workers.  doConn() must then be thread safe.
+//  *   "PreFork" starts MaxThreads worker processes at startup.  Each
+//      listens on its own SO_REUSEPORT socket, so that the kernel spreads
+//      connections between them, and handles its connections one by one.
+//      A worker is replaced after it has handled MaxConnsPerChild
+//      connections.
+//  *   "Coro" runs CoroThreads threads, each handling many connections at
+//      once, up to MaxConns in all.  Each connection has a coroutine of its
+//      own (see coro.h), in which doConn() is called.  doConn() must read
+//      and write the connection with csc_coro_read(), csc_coro_write() or
+//      a stream from csc_coro_fdopen(), which yield to the thread's other
+//      connections instead of blocking.  As these simply block outside a
+//      coroutine, such a doConn() works under any model.  It must not
+//      block in any other way, and must be thread safe if CoroThreads is
+//      more than 1.
 // 
 // 2)   logPath - The path to the file for logging.
 // 
@@ -48,7 +93,60 @@
 //  *   IP -         (optional. Dflt=all interfaces) the IP number to listen on.
 //  *   MaxThreads - (optional. Dflt=10) Maximum simultaneous connections.
 //  *   Backlog -    (optional. Dflt=10) Max size of connection queue.
-// 
+//  *   QueueSize -  (optional. Dflt=MaxThreads) Max accepted connections
+//                   waiting for a worker in the "ThreadPool" model.
+//  *   MaxConnsPerChild - (optional. Dflt=0, i.e. never) Connections handled
+//                   by a "PreFork" worker before it is replaced.
+//  *   MaxConns -   (optional. Dflt=1000) Maximum simultaneous connections
+//                   in the "Coro" model.
+//  *   CoroThreads - (optional. Dflt=1) Threads in the "Coro" model.
+//  *   CoroStackKb - (optional. Dflt=256) The stack size of each coroutine
+//                   in the "Coro" model, in kilobytes.  Memory is only used
+//                   as the stack grows into it.
+//  *   CpuAffinity - (optional. Dflt=none) "none", "auto", or a list of
+//                   CPUs such as "0-3,8".  Pins each worker to one CPU of
+//                   the list, or with "auto" of those that the process may
+//                   use, taking them in turn.  A worker is a thread under
+//                   "ThreadPool" and "Coro", a process under "PreFork" and
+//                   "Forking", and the one thread of the other models.  A
+//                   "PreFork" worker's socket is given the connections that
+//                   arrive on its CPU (SO_INCOMING_CPU).  Workers are pinned
+//                   before they allocate, so that their memory is local.
+//  *   NumaNode -   (optional. Dflt=-1, i.e. any) Keeps the whole server on
+//                   the CPUs of this NUMA node, preferring its memory.
+//  *   MetricsPort - (optional. Dflt=0, i.e. none) The port on which to serve
+//                   metrics at "/metrics", in the Prometheus text format.
+//  *   OverloadAction - (optional. Dflt=Wait) What to do with connections
+//                   when full, i.e. when MaxThreads are running under
+//                   "Forking", the queue is full under "ThreadPool", or
+//                   MaxConns are open under "Coro" (in the thread that
+//                   takes it) or csc_servBase_evServer().  "Wait" leaves
+//                   them queued until there is room.  "Close" accepts and
+//                   closes them at once, and "503" first sends them an HTTP
+//                   "503 Service Unavailable" response.  See also onShed()
+//                   below.
+//  *   MaxQueueWaitMs - (optional. Dflt=0, i.e. none) Under "ThreadPool", a
+//                   connection that has been queued for longer than this
+//                   is turned away as for OverloadAction, rather than
+//                   handled, as its client has probably given up.
+//  *   DrainSecs -  (optional. Dflt=30) When told to quit, how long to
+//                   give the connections in progress to finish.
+//  *   DeferAccept - (optional. Dflt=0, i.e. off) Seconds for which a
+//                   connection is not accepted until the client sends
+//                   something (TCP_DEFER_ACCEPT).
+//  *   FastOpen -   (optional. Dflt=0, i.e. off) Length of the TCP Fast Open
+//                   queue, letting clients send their request with the SYN.
+//  *   BusyPoll -   (optional. Dflt=0, i.e. off) Microseconds for which reads
+//                   spin on the device queue before sleeping (SO_BUSY_POLL).
+//                   Usually needs CAP_NET_ADMIN.
+//  *   NoDelay -    (optional. Dflt=0) 1 to set TCP_NODELAY on connections.
+//  *   QuickAck -   (optional. Dflt=0) 1 to set TCP_QUICKACK on connections.
+//  *   RcvBuf, SndBuf - (optional. Dflt=0, i.e. the system's) Socket buffer
+//                   sizes in bytes for the connections.
+//  The socket options above are set when the socket starts listening.  A
+//  new process in a hot restart keeps those of the socket that it takes
+//  over, apart from QuickAck.  See csc_srv_setSockOpts() in netSrv.h.
+//
 // 4)  doConn() is called for each connection.  doConn() returns 0 on
 //  success, negative on error.  doConn() must close the file descriptor
 //  'fd' before returning.  Its args are:-
@@ -64,9 +162,17 @@
 //  a function to do this, otherwise pass NULL.  Return TRUE on success
 //  or FALSE to terminate the server.
 // 
-// 6)  local - A pointer to whatever your want (usually a structure).  This
-//  merely passed onto doInit() and also to doConn().  Pass NULL if you
-//  have nothing to pass to doInit() and doConn().
+// 6)  onShed() is passed each connection turned away, as OverloadAction
+//  and MaxQueueWaitMs say, rather than it being given the response that
+//  OverloadAction would send.  It may send its own, e.g. a page saying
+//  that the site is busy, but must not block.  The connection is then
+//  closed for it.  It is called from whichever thread turns the connection
+//  away, so must be thread safe under "ThreadPool" and "Coro".  Pass NULL
+//  for the response that OverloadAction says.
+// 
+// 7)  local - A pointer to whatever your want (usually a structure).  This
+//  merely passed onto doInit() and also to doConn() and onShed().  Pass
+//  NULL if you have nothing to pass to them.
 int csc_servBase_server( const char *srvModelStr
                        , const char *logPath
                        , const char *logId
@@ -81,9 +187,172 @@ int csc_servBase_server( const char *srvModelStr
                                       , csc_log_t *log  // Logging object.
                                       , void *local
                                       )
-                       , void *local      // Values to pass to doConn() and to doInit().
+                       , void (*onShed)(int fd, void *local)  // Or NULL.
+                       , void *local      // Values to pass to doConn(), doInit() and onShed().
                        );
 
 
+// ------------------------------------------------------------------
+// ---------------------- Event driven server -----------------------
+
+// csc_servBase_evServer() is like csc_servBase_server(), but uses a single
+// thread and epoll() to serve many connections at once.  Rather than
+// calling doConn() for the life of a connection, it calls the handlers
+// below whenever there is something to be done for a connection.  No
+// handler may block.  The model is "EventLoop".
+// 
+// It uses the same configuration as csc_servBase_server(), and takes
+// doInit(), onShed() and local as it does, but MaxThreads is not used.
+// It also uses:-
+//  *   EventModel - (optional. Dflt=EventLoop) "EventLoop" or "Uring".
+//                   "Uring" accepts, receives and sends through io_uring,
+//                   submitting them in batches to save system calls.  It
+//                   is only available if CscNetLib was built where the
+//                   liburing headers were found, and then programs must
+//                   also link with -luring.
+//  *   MaxConns -   (optional. Dflt=1000) Maximum simultaneous connections.
+//                   Accepting pauses while there are this many, unless
+//                   OverloadAction says to turn the rest away.
+//  *   ReadTimeout  A connection is closed if nothing has been read from
+//                   it for this many seconds.  0 means never.
+//  *   WriteTimeout A connection is closed if its output has been waiting
+//                   this many seconds without any of it being sent.  0
+//                   means never.
+// 
+// A connection is represented by an object of type csc_servBase_conn_t.  It
+// belongs to the server, and is valid until onClose() returns.
+
+typedef struct csc_servBase_conn_t csc_servBase_conn_t;
+
+typedef struct
+{
+// Called when a connection is accepted.  Use csc_servBase_connSetCtx() to
+// attach your per connection context.  Return 0 on success, or negative
+// to close the connection at once (onClose() is still called).
+    int (*onOpen)( csc_servBase_conn_t *conn
+                 , const char *clientIp   // IP of client, or NULL
+                 , csc_ini_t *conf        // Configuration object.
+                 , csc_log_t *log         // Logging object.
+                 , void *local            // As passed to csc_servBase_evServer().
+                 );
+ 
+// Called when the connection has input, or the peer has hung up.  Call
+// csc_servBase_connRead() until it returns -2 (or it will be called again).
+// Return 0 on success, or negative to close the connection.
+    int (*onReadable)(csc_servBase_conn_t *conn, void *connCtx);
+ 
+// Called when all output has been sent, if csc_servBase_connWantWrite() has
+// asked for it.  May be NULL.  Returns as for onReadable().
+    int (*onWritable)(csc_servBase_conn_t *conn, void *connCtx);
+ 
+// Called once, just before the connection is closed.  Free your context
+// here.  May be NULL.
+    void (*onClose)(csc_servBase_conn_t *conn, void *connCtx);
+} csc_servBase_evHandlers_t;
+
+
+int csc_servBase_evServer( const char *logPath
+                         , const char *logId
+                         , const char *configPath
+                         , const csc_servBase_evHandlers_t *handlers
+                         , int (*doInit)( csc_ini_t *conf // Configuration object.
+                                        , csc_log_t *log  // Logging object.
+                                        , void *local
+                                        )
+                         , void (*onShed)(int fd, void *local)  // Or NULL.
+                         , void *local  // Values to pass to onOpen(), doInit() and onShed().
+                         );
+
+
+// Reads up to 'bufSize' bytes from the connection into 'buf'.  Returns the
+// number of bytes read, 0 if the peer has closed the connection, -2 if
+// there is nothing more to read for now, or -1 on error.
+int csc_servBase_connRead(csc_servBase_conn_t *conn, char *buf, int bufSize);
+
+// Writes 'len' bytes of 'buf' to the connection.  Whatever the socket does
+// not take at once is kept and sent when it can be.  Returns csc_FALSE if
+// the connection has failed.
+csc_bool_t csc_servBase_connWrite(csc_servBase_conn_t *conn, const char *buf, int len);
+
+// Ask for onWritable() to be called whenever all output has been sent.
+void csc_servBase_connWantWrite(csc_servBase_conn_t *conn, csc_bool_t isWant);
+
+// Close the connection once all output has been sent.
+void csc_servBase_connClose(csc_servBase_conn_t *conn);
+
+// Per connection context.
+void csc_servBase_connSetCtx(csc_servBase_conn_t *conn, void *connCtx);
+void *csc_servBase_connGetCtx(csc_servBase_conn_t *conn);
+
+// Things belonging to the connection.
+int csc_servBase_connFd(csc_servBase_conn_t *conn);
+const char *csc_servBase_connClientIp(csc_servBase_conn_t *conn);
+csc_ini_t *csc_servBase_connConf(csc_servBase_conn_t *conn);
+csc_log_t *csc_servBase_connLog(csc_servBase_conn_t *conn);
+void *csc_servBase_connLocal(csc_servBase_conn_t *conn);
+
+
+// ------------------------------------------------------------------
+// -------------------------- UDP server ----------------------------
+
+// csc_servBase_udpServer() is like csc_servBase_server(), but serves UDP
+// packets rather than TCP connections.  It opens UdpThreads sockets on the
+// same port, with SO_REUSEPORT, and gives each a worker thread of its own,
+// so that the kernel spreads the packets between them, and they are
+// received on as many CPUs.  A worker receives packets in batches, and
+// calls onPacket() for each.  The replies are sent together once the batch
+// has been handled.  The model is "Udp".
+// 
+// It quits on SIGTERM or SIGINT, once each worker has finished its batch.
+// SIGHUP or SIGUSR2 asks for a hot restart, as for csc_servBase_server().
+// The new process opens sockets of its own, and once it is serving, this
+// one's workers finish their batches and it returns 1.  Packets still
+// queued on this one's sockets then are lost.  The metrics are counts of
+// packets received and of replies sent, and the number of workers.
+// 
+// It uses the following from the configuration, as for csc_servBase_server():-
+// PortNum, IP, LogLevel, CpuAffinity, NumaNode, MetricsPort, RcvBuf and
+// SndBuf, and also:-
+//  *   UdpThreads - (optional. Dflt=1) The number of sockets and workers.
+//  *   UdpBatch -   (optional. Dflt=32, Max=64) The most packets received,
+//                   or replies sent, in one go.
+//  *   UdpMaxPkt -  (optional. Dflt=2048) The size of the biggest packet
+//                   received, or reply sent, in bytes.  The rest of a bigger
+//                   packet is lost.
+// 
+// onPacket() is called for each packet, from the worker's thread, so must
+// be thread safe if UdpThreads is more than 1, and should not block.  It
+// returns 0 on success, or negative on error.  A worker is represented by
+// an object of type csc_servBase_udp_t.  It belongs to the server.
+
+typedef struct csc_servBase_udp_t csc_servBase_udp_t;
+
+int csc_servBase_udpServer( const char *logPath
+                          , const char *logId
+                          , const char *configPath
+                          , int (*onPacket)( csc_servBase_udp_t *udp  // The worker.
+                                           , char *pkt              // The packet, with a '\0' after it.
+                                           , int pktLen
+                                           , const csc_udpAddr_t *from // Valid until onPacket() returns.
+                                           , void *local
+                                           )
+                          , int (*doInit)( csc_ini_t *conf // Configuration object.
+                                         , csc_log_t *log  // Logging object.
+                                         , void *local
+                                         )
+                          , void *local  // Values to pass to onPacket() and to doInit().
+                          );
+
+// Replies to the packet that onPacket() is handling.  'buf' is copied, to
+// be sent with the worker's other replies.  Returns csc_FALSE if 'len' is
+// more than UdpMaxPkt.  To be called only from onPacket().
+csc_bool_t csc_servBase_udpReply(csc_servBase_udp_t *udp, const char *buf, int len);
+
+// Things belonging to the worker.  Each worker has its own number, from 0.
+int csc_servBase_udpWorkerNum(csc_servBase_udp_t *udp);
+csc_ini_t *csc_servBase_udpConf(csc_servBase_udp_t *udp);
+csc_log_t *csc_servBase_udpLog(csc_servBase_udp_t *udp);
+
+
 #endif
 
@@ -0,0 +1,283 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "std.h"
+#include "alloc.h"
+#include "timerWheel.h"
+
+// Four levels of 256 slots.  Level 0 holds the timers due in the next 256
+// ticks, one slot per tick.  Each slot of level 1 holds the timers due in a
+// span of 256 ticks, and so on.  When level 0 has gone all the way around,
+// the next slot of level 1 is cascaded down into it.
+#define twBits 8
+#define twSize (1<<twBits)
+#define twMask (twSize-1)
+#define twLevels 4
+#define twMaxTicks (((uint64_t)1<<(twBits*twLevels)) - 1)
+
+
+struct csc_timerWheel_t
+{   uint64_t curTick;            // The next tick to be processed.
+    uint64_t startMs;            // The time of tick 0.
+    uint64_t nowMs;              // Delays are from this time.
+    int tickMs;
+    int count;
+    csc_timer_t slots[twLevels][twSize];  // Heads of circular lists.
+};
+
+
+// ------------------------ Lists of timers -------------------------
+
+static void listInit(csc_timer_t *head)
+{   head->prev = head->next = head;
+}
+
+
+static csc_bool_t listIsEmpty(const csc_timer_t *head)
+{   return head->next == head;
+}
+
+
+static void listAppend(csc_timer_t *head, csc_timer_t *timer)
+{   timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+
+static void listUnlink(csc_timer_t *timer)
+{   timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+}
+
+
+// Moves all the timers in 'from' to 'to', leaving 'from' empty.
+static void listTake(csc_timer_t *to, csc_timer_t *from)
+{   if (listIsEmpty(from))
+        listInit(to);
+    else
+    {   to->next = from->next;
+        to->prev = from->prev;
+        to->next->prev = to;
+        to->prev->next = to;
+        listInit(from);
+    }
+}
+
+
+// ------------------------ Timers ----------------------------------
+
+void csc_timer_init(csc_timer_t *timer, void (*fn)(csc_timer_t *timer, void *arg), void *arg)
+{   timer->prev = timer->next = NULL;
+    timer->expires = 0;
+    timer->fn = fn;
+    timer->arg = arg;
+}
+
+
+csc_bool_t csc_timer_isArmed(const csc_timer_t *timer)
+{   return timer->next != NULL;
+}
+
+
+// ------------------------ The wheel -------------------------------
+
+csc_timerWheel_t *csc_timerWheel_new(int tickMs, uint64_t nowMs)
+{   csc_timerWheel_t *tw = csc_allocOne(csc_timerWheel_t);
+    int level, slot;
+ 
+    if (tickMs < 1)
+        tickMs = 1;
+    tw->curTick = 0;
+    tw->startMs = nowMs;
+    tw->nowMs = nowMs;
+    tw->tickMs = tickMs;
+    tw->count = 0;
+    for (level=0; level<twLevels; level++)
+    {   for (slot=0; slot<twSize; slot++)
+            listInit(&tw->slots[level][slot]);
+    }
+    return tw;
+}
+
+
+void csc_timerWheel_free(csc_timerWheel_t *tw)
+{   csc_timer_t *head;
+    int level, slot;
+ 
+// Disarm whatever is left, as the timers belong to the caller.
+    for (level=0; level<twLevels; level++)
+    {   for (slot=0; slot<twSize; slot++)
+        {   head = &tw->slots[level][slot];
+            while (!listIsEmpty(head))
+                listUnlink(head->next);
+        }
+    }
+    free(tw);
+}
+
+
+// Places an armed timer into the slot for its expiry time.
+static void place(csc_timerWheel_t *tw, csc_timer_t *timer)
+{   uint64_t expires = timer->expires;
+    uint64_t delta;
+    int level;
+ 
+// Overdue timers go in the slot processed next.
+    if (expires < tw->curTick)
+        expires = tw->curTick;
+ 
+// Find the level that spans the delay.
+    delta = expires - tw->curTick;
+    if (delta > twMaxTicks)
+    {   delta = twMaxTicks;
+        expires = tw->curTick + delta;
+        timer->expires = expires;
+    }
+    for (level=0; level<twLevels-1 && delta>=((uint64_t)1<<(twBits*(level+1))); level++)
+        ;
+ 
+    listAppend(&tw->slots[level][(expires>>(twBits*level)) & twMask], timer);
+}
+
+
+void csc_timerWheel_add(csc_timerWheel_t *tw, csc_timer_t *timer, int delayMs)
+{   if (csc_timer_isArmed(timer))
+        listUnlink(timer);
+    else
+        tw->count++;
+    if (delayMs < 0)
+        delayMs = 0;
+    timer->expires = (tw->nowMs - tw->startMs + delayMs + tw->tickMs - 1) / tw->tickMs;
+    place(tw, timer);
+}
+
+
+void csc_timerWheel_cancel(csc_timerWheel_t *tw, csc_timer_t *timer)
+{   if (csc_timer_isArmed(timer))
+    {   listUnlink(timer);
+        tw->count--;
+    }
+}
+
+
+// Moves the timers in one slot of an upper level down to where they now belong.
+static void cascade(csc_timerWheel_t *tw, int level)
+{   csc_timer_t list;
+    int slot = (tw->curTick >> (twBits*level)) & twMask;
+ 
+    listTake(&list, &tw->slots[level][slot]);
+    while (!listIsEmpty(&list))
+    {   csc_timer_t *timer = list.next;
+        listUnlink(timer);
+        place(tw, timer);
+    }
+ 
+// Going around this level means cascading the one above.
+    if (slot==0 && level<twLevels-1)
+        cascade(tw, level+1);
+}
+
+
+// Processes one tick.  Returns the number of timers fired.
+static int tick(csc_timerWheel_t *tw)
+{   csc_timer_t list;
+    csc_timer_t *timer;
+    int slot = tw->curTick & twMask;
+    int nFired = 0;
+ 
+// Bring down the timers that are now due within the next 256 ticks.
+    if (slot == 0 && tw->curTick != 0)
+        cascade(tw, 1);
+ 
+// Fire this tick's timers.  Take them off the wheel first, so that their
+// functions may arm and cancel timers freely.
+    listTake(&list, &tw->slots[0][slot]);
+    tw->curTick++;
+    while (!listIsEmpty(&list))
+    {   timer = list.next;
+        listUnlink(timer);
+        tw->count--;
+        nFired++;
+        timer->fn(timer, timer->arg);
+    }
+ 
+    return nFired;
+}
+
+
+int csc_timerWheel_advance(csc_timerWheel_t *tw, uint64_t nowMs)
+{   uint64_t target;
+    int nFired = 0;
+ 
+    if (nowMs < tw->startMs)
+        return 0;
+    target = (nowMs - tw->startMs) / tw->tickMs;
+ 
+    while (tw->curTick <= target)
+    {   if (tw->count == 0)
+        {   // Nothing to do, so jump straight there.
+            tw->curTick = target + 1;
+            break;
+        }
+ 
+    // Timers armed as others fire are timed from the tick being processed.
+        tw->nowMs = tw->startMs + tw->curTick*tw->tickMs;
+        nFired += tick(tw);
+    }
+    if (nowMs > tw->nowMs)
+        tw->nowMs = nowMs;
+ 
+    return nFired;
+}
+
+
+void csc_timerWheel_setNow(csc_timerWheel_t *tw, uint64_t nowMs)
+{   if (nowMs > tw->nowMs)
+        tw->nowMs = nowMs;
+}
+
+
+int csc_timerWheel_nextMs(const csc_timerWheel_t *tw, uint64_t nowMs)
+{   uint64_t nextTick, dueMs;
+    int i;
+ 
+    if (tw->count == 0)
+        return -1;
+ 
+// The next tick with a timer on level 0, or where a cascade is due.
+    nextTick = tw->curTick;
+    for (i=0; i<twSize; i++)
+    {   nextTick = tw->curTick + i;
+        if ((nextTick&twMask)==0 && nextTick!=0)
+            break;
+        if (!listIsEmpty(&tw->slots[0][nextTick&twMask]))
+            break;
+    }
+ 
+// When that is.
+    dueMs = tw->startMs + nextTick*tw->tickMs;
+    if (dueMs <= nowMs)
+        return 0;
+    if (dueMs - nowMs > 0x7fffffff)
+        return 0x7fffffff;
+    return dueMs - nowMs;
+}
+
+
+int csc_timerWheel_count(const csc_timerWheel_t *tw)
+{   return tw->count;
+}
+
+
+uint64_t csc_timerWheel_nowMs(void)
+{   struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
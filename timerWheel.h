@@ -0,0 +1,84 @@
+// Author: Dr Stephen Braithwaite.
+// This work is licensed under a Creative Commons Attribution-ShareAlike 4.0 International License.
+
+// ======= timerWheel ===================================================
+// A hierarchical timing wheel.  Arming, cancelling and expiring a timer
+// each take constant time, and need no system call, so it suits having
+// very many timers armed at once, e.g. read and write deadlines for each
+// of 100k connections.
+//
+// The caller owns each timer, typically embedded in the structure that it
+// times, so arming a timer allocates nothing.  Time is in milliseconds,
+// rounded up to whole ticks.  Timers only fire from within
+// csc_timerWheel_advance(), which is expected to be called regularly,
+// e.g. once for each time around an event loop.
+// ======================================================================
+
+#ifndef csc_TIMERWHEEL_H
+#define csc_TIMERWHEEL_H 1
+
+#include <stdint.h>
+#include "std.h"
+
+typedef struct csc_timerWheel_t csc_timerWheel_t;
+typedef struct csc_timer_t csc_timer_t;
+
+// A timer.  Initialise it with csc_timer_init() before first use.  Apart
+// from 'arg', the members are private.
+struct csc_timer_t
+{   csc_timer_t *prev, *next;
+    uint64_t expires;          // In ticks.
+    void (*fn)(csc_timer_t *timer, void *arg);
+    void *arg;
+};
+
+
+// Prepares 'timer' to call 'fn'(timer, 'arg') when it expires.  The timer
+// starts disarmed.
+void csc_timer_init(csc_timer_t *timer, void (*fn)(csc_timer_t *timer, void *arg), void *arg);
+
+// Returns csc_TRUE if 'timer' is armed.
+csc_bool_t csc_timer_isArmed(const csc_timer_t *timer);
+
+
+// Constructor.  Each tick is 'tickMs' milliseconds, and 'nowMs' is the
+// current time, e.g. from csc_timerWheel_nowMs().  Timers may be armed for
+// up to 2^32 ticks.
+csc_timerWheel_t *csc_timerWheel_new(int tickMs, uint64_t nowMs);
+
+// Destructor.  Any timers still armed are disarmed, but not fired.
+void csc_timerWheel_free(csc_timerWheel_t *tw);
+
+// Arms 'timer' to fire 'delayMs' milliseconds from the time last given to
+// csc_timerWheel_advance() or csc_timerWheel_setNow(), or from a firing
+// timer's due time if called from its function.  If it is already armed,
+// it is re-armed.
+void csc_timerWheel_add(csc_timerWheel_t *tw, csc_timer_t *timer, int delayMs);
+
+// Disarms 'timer'.  Does nothing if it is not armed.
+void csc_timerWheel_cancel(csc_timerWheel_t *tw, csc_timer_t *timer);
+
+// Brings the wheel up to the time 'nowMs', firing each timer that has
+// expired.  A timer is disarmed before it fires, and its function may arm
+// or cancel any timer, including itself.  Returns the number of timers
+// fired.
+int csc_timerWheel_advance(csc_timerWheel_t *tw, uint64_t nowMs);
+
+// Sets the time from which csc_timerWheel_add() measures delays, without
+// firing any timers, e.g. when an event loop wakes but has events to handle
+// before it is safe for timers to fire.
+void csc_timerWheel_setNow(csc_timerWheel_t *tw, uint64_t nowMs);
+
+// Returns how many milliseconds after 'nowMs' csc_timerWheel_advance()
+// next needs to be called, e.g. as a timeout for poll() or epoll_wait().
+// It may be called sooner, but not much later.  Returns -1 if no timer is
+// armed.
+int csc_timerWheel_nextMs(const csc_timerWheel_t *tw, uint64_t nowMs);
+
+// Returns the number of timers armed.
+int csc_timerWheel_count(const csc_timerWheel_t *tw);
+
+// Returns the time in milliseconds from a clock that does not jump.
+uint64_t csc_timerWheel_nowMs(void);
+
+#endif
@@ -5,24 +5,42 @@
 // Set up socket for UDP server.
 // ===============================================
 
+#define _GNU_SOURCE  // For recvmmsg() and sendmmsg().
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 
 #include "std.h"
 #include "alloc.h"
 #include "isvalid.h"
+#include "hashStr.h"
 
 #include "udp.h"
 
+#define MaxBatch 64
+
+// The most that the kernel splits from one buffer.  Fewer, and fewer
+// bytes than fit in an IP packet, are sent at once.
+#define MaxGsoSegs 64
+#define MaxGsoBytes 65000
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
 // --------------------------------------------
 // --------- UDP address to send --------------
 
@@ -58,6 +76,7 @@ const char *csc_udpAddr_resetErrMsg(csc_udpAddr_t *this)
     {   free(this->errMsg);
         this->errMsg = NULL;
     }
+    return NULL;
 }
 
 
@@ -66,6 +85,7 @@ csc_udpAddr_t *csc_udpAddr_new()
     addr->errMsg = NULL;
     addr->flags = 0;
     addr->isSet = csc_FALSE;
+    return addr;
 }
 
 
@@ -74,6 +94,7 @@ static csc_bool_t csc_udpAddr_setAdd( csc_udpAddr_t *addr
                              )
 {   memcpy(&addr->sockAddr, sockAddr, sizeof (struct sockaddr_storage));
     addr->isSet = csc_TRUE;
+    return csc_TRUE;
 }
 
 
@@ -172,6 +193,50 @@ void csc_udpAddr_free(csc_udpAddr_t *addr)
 }
 
 
+void csc_udpAddr_copy(csc_udpAddr_t *to, const csc_udpAddr_t *from)
+{   to->flags = from->flags;
+    to->isSet = from->isSet;
+    memcpy(&to->sockAddr, &from->sockAddr, sizeof(struct sockaddr_storage));
+}
+
+
+csc_bool_t csc_udpAddr_getBin(const csc_udpAddr_t *addr, unsigned char *bin)
+{   memset(bin, 0, csc_udpAddr_BinSize);
+    if (!addr->isSet)
+        return csc_FALSE;
+    if (addr->sockAddr.ss_family == AF_INET)
+    {   const struct sockaddr_in *sin = (const struct sockaddr_in*)&addr->sockAddr;
+        bin[10] = bin[11] = 0xff;
+        memcpy(bin+12, &sin->sin_addr, 4);
+        memcpy(bin+16, &sin->sin_port, 2);
+    }
+    else if (addr->sockAddr.ss_family == AF_INET6)
+    {   const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6*)&addr->sockAddr;
+        memcpy(bin, &sin6->sin6_addr, 16);
+        memcpy(bin+16, &sin6->sin6_port, 2);
+    }
+    else
+        return csc_FALSE;
+    return csc_TRUE;
+}
+
+
+int csc_udpAddr_cmp(const csc_udpAddr_t *addr1, const csc_udpAddr_t *addr2)
+{   unsigned char bin1[csc_udpAddr_BinSize];
+    unsigned char bin2[csc_udpAddr_BinSize];
+    csc_udpAddr_getBin(addr1, bin1);
+    csc_udpAddr_getBin(addr2, bin2);
+    return memcmp(bin1, bin2, csc_udpAddr_BinSize);
+}
+
+
+uint64_t csc_udpAddr_hash(const csc_udpAddr_t *addr)
+{   unsigned char bin[csc_udpAddr_BinSize];
+    csc_udpAddr_getBin(addr, bin);
+    return csc_hash_bytes(bin, csc_udpAddr_BinSize);
+}
+
+
 // --------------------------------------------
 // ------------------ UDP ---------------------
 
@@ -186,6 +251,10 @@ typedef struct csc_udp_t
     char *errMsg;   // Error messages.
     udpState_t state;  // Is this a server, a client, or not specified.
     csc_bool_t isConnect;
+    csc_bool_t isReusePort;  // Bind a server with SO_REUSEPORT.
+    csc_bool_t isGso;        // Have the kernel split csc_udp_sndSegs().
+    csc_bool_t isGsoProbed;  // The kernel has been asked whether it can.
+    csc_bool_t isGsoOk;      // The kernel can.
 } csc_udp_t;
 
 
@@ -217,6 +286,11 @@ csc_udp_t *csc_udp_new()
     udp->sock = -1;
     udp->state = udpStateNone;
     udp->isConnect = csc_TRUE;
+    udp->isReusePort = csc_FALSE;
+    udp->isGso = csc_TRUE;
+    udp->isGsoProbed = csc_FALSE;
+    udp->isGsoOk = csc_TRUE;
+    return udp;
 }
 
 
@@ -286,6 +360,18 @@ csc_bool_t csc_udp_setSrv( csc_udp_t *udp       // UDP object.
         return csc_FALSE;
     }
  
+// Share the port with other sockets, if asked.
+    int isOn = 1;
+    if ( udp->isReusePort
+      && setsockopt(udp->sock, SOL_SOCKET, SO_REUSEPORT, &isOn, sizeof(isOn)) != 0
+       )
+    {   udp_setErrMsg(udp, "csc_udp_setSrv(): setsockopt(SO_REUSEPORT) failed", strerror(errno));
+        freeaddrinfo(servInfo);
+        close(udp->sock);
+        udp->sock = -1;
+        return csc_FALSE;
+    }
+ 
 // Bind the socket to the address.
     result = bind(udp->sock, addrInfo->ai_addr, addrInfo->ai_addrlen);
     if (result != 0)
@@ -330,6 +416,36 @@ void csc_udp_cliNoConnect(csc_udp_t *udp)
 }
 
 
+void csc_udp_setReusePort(csc_udp_t *udp, csc_bool_t isReuse)
+{   udp->isReusePort = isReuse;
+}
+
+
+csc_bool_t csc_udp_setBufSizes(csc_udp_t *udp, int rcvBufSize, int sndBufSize)
+{
+// Have things been set up?
+    if (udp->state!=udpStateCli && udp->state!=udpStateSrv)
+    {   udp_setErrMsg( udp, "csc_udp_setBufSizes(): udp object not initialised", NULL);
+        return csc_FALSE;
+    }
+ 
+// Set the sizes asked for.
+    if ( rcvBufSize > 0
+      && setsockopt(udp->sock, SOL_SOCKET, SO_RCVBUF, &rcvBufSize, sizeof(rcvBufSize)) != 0
+       )
+    {   udp_setErrMsg(udp, "csc_udp_setBufSizes(): setsockopt(SO_RCVBUF) failed", strerror(errno));
+        return csc_FALSE;
+    }
+    if ( sndBufSize > 0
+      && setsockopt(udp->sock, SOL_SOCKET, SO_SNDBUF, &sndBufSize, sizeof(sndBufSize)) != 0
+       )
+    {   udp_setErrMsg(udp, "csc_udp_setBufSizes(): setsockopt(SO_SNDBUF) failed", strerror(errno));
+        return csc_FALSE;
+    }
+    return csc_TRUE;
+}
+
+
 csc_bool_t csc_udp_snd( csc_udp_t *udp          // UDP object.
                       , char *buf, int msgLen   // Buffer to read into.
                       , csc_udpAddr_t *addr  // Address.
@@ -377,6 +493,21 @@ int csc_udp_rcv( csc_udp_t *udp          // UDP object.
                , char *buf, int bufSiz   // Buffer to read into.
                , csc_udpAddr_t **addr  // Address to assign allocated or NULL.
                )
+{   
+// Reuse the caller's address object, or allocate one.
+    if (addr == NULL)
+        return csc_udp_rcvInto(udp, buf, bufSiz, NULL);
+    if (*addr == NULL)
+        *addr = csc_udpAddr_new();
+    return csc_udp_rcvInto(udp, buf, bufSiz, *addr);
+}
+
+
+// Returns >=0:nBytes read, -2:timeout, -1:error - use csc_udp_getErrMsg().
+int csc_udp_rcvInto( csc_udp_t *udp          // UDP object.
+                   , char *buf, int bufSiz   // Buffer to read into.
+                   , csc_udpAddr_t *addr     // Address to set, or NULL.
+                   )
 {   int numRead;
     struct sockaddr_storage caller;
     
@@ -386,12 +517,13 @@ int csc_udp_rcv( csc_udp_t *udp          // UDP object.
         return -1;
     }
  
-// Receive the packet.
+// Receive the packet, straight into the address if there is one.
+    struct sockaddr_storage *from = addr==NULL ? &caller : &addr->sockAddr;
     socklen_t addrLen = sizeof(caller);
     numRead = recvfrom( udp->sock
                       , buf, bufSiz
                       , udp->rcvFlags
-                      , (struct sockaddr *)&caller, &addrLen
+                      , (struct sockaddr *)from, &addrLen
                       );
     if (numRead == -1)
     {   if (errno == EAGAIN)
@@ -406,12 +538,7 @@ int csc_udp_rcv( csc_udp_t *udp          // UDP object.
  
 // Address packet received from.
     if (addr != NULL)
-    {   if (*addr != NULL)
-        {   csc_udpAddr_free(*addr);
-        }
-        *addr = csc_udpAddr_new();
-        csc_udpAddr_setAdd(*addr, &caller);
-    }
+        addr->isSet = csc_TRUE;
  
 // Bye.
     return numRead;
@@ -444,5 +571,322 @@ csc_bool_t csc_udp_setRcvTimeout(csc_udp_t *udp, int secs)
 // Return success.
     return csc_TRUE;
 }
+
+
+// Returns >=1:nPackets read, -2:timeout, -1:error - use csc_udp_getErrMsg().
+int csc_udp_rcvMany(csc_udp_t *udp, csc_udpPkt_t *pkts, int nPkts, int timeoutMs)
+{   struct mmsghdr msgs[MaxBatch];
+    struct iovec iovs[MaxBatch];
+    struct sockaddr_storage callers[MaxBatch];
+    struct pollfd pfd;
+    int flags = MSG_WAITFORONE;
+    int i, ret;
+ 
+// Have things been set up?
+    if (udp->state!=udpStateCli && udp->state!=udpStateSrv)
+    {   udp_setErrMsg( udp, "csc_udp_rcvMany(): udp object not initialised", NULL);
+        return -1;
+    }
+    if (nPkts > MaxBatch)
+        nPkts = MaxBatch;
+ 
+// Wait for the first.
+    if (timeoutMs >= 0)
+    {   pfd.fd = udp->sock;
+        pfd.events = POLLIN;
+        ret = poll(&pfd, 1, timeoutMs);
+        if (ret == 0)
+            return -2;
+        else if (ret<0 && errno!=EINTR)
+        {   udp_setErrMsg(udp, "csc_udp_rcvMany(): poll() failed", strerror(errno));
+            return -1;
+        }
+        flags = MSG_DONTWAIT;
+    }
  
+// Receive what there is.
+    memset(msgs, 0, nPkts*sizeof(struct mmsghdr));
+    for (i=0; i<nPkts; i++)
+    {   iovs[i].iov_base = pkts[i].buf;
+        iovs[i].iov_len = pkts[i].bufSiz;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &callers[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(callers[i]);
+    }
+    ret = recvmmsg(udp->sock, msgs, nPkts, udp->rcvFlags|flags, NULL);
+    if (ret == -1)
+    {   if (errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)
+            return -2;
+        udp_setErrMsg(udp, "csc_udp_rcvMany(): recvmmsg() failed", strerror(errno));
+        return -1;
+    }
+ 
+// The lengths and addresses.
+    for (i=0; i<ret; i++)
+    {   pkts[i].len = msgs[i].msg_len;
+        if (pkts[i].addr != NULL)
+            csc_udpAddr_setAdd(pkts[i].addr, &callers[i]);
+    }
+    return ret;
+}
+
 
+int csc_udp_sndMany(csc_udp_t *udp, csc_udpPkt_t *pkts, int nPkts)
+{   struct mmsghdr msgs[MaxBatch];
+    struct iovec iovs[MaxBatch];
+    int nSent = 0;
+    int nBatch, i, ret;
+ 
+// Have things been set up?
+    if (udp->state!=udpStateCli && udp->state!=udpStateSrv)
+    {   udp_setErrMsg( udp, "csc_udp_sndMany(): udp object not initialised", NULL);
+        return -1;
+    }
+ 
+// Check that the addresses are valid.
+    for (i=0; i<nPkts; i++)
+    {   if (pkts[i].addr==NULL || !pkts[i].addr->isSet)
+        {   udp_setErrMsg(udp, "csc_udp_sndMany(): address not set", NULL);
+            return -1;
+        }
+    }
+ 
+// Connect the client, as for csc_udp_snd().
+    if (nPkts>0 && udp->state==udpStateCli && udp->isConnect)
+    {   udp->isConnect = csc_FALSE;
+        if (connect( udp->sock, (struct sockaddr *)&pkts[0].addr->sockAddr
+                   , sizeof(pkts[0].addr->sockAddr)))
+        {   udp_setErrMsg(udp, "csc_udp_sndMany(): connect() failed", strerror(errno));
+            return -1;
+        }
+    }
+ 
+// Send them a batch at a time.
+    while (nSent < nPkts)
+    {   nBatch = nPkts-nSent < MaxBatch ? nPkts-nSent : MaxBatch;
+        memset(msgs, 0, nBatch*sizeof(struct mmsghdr));
+        for (i=0; i<nBatch; i++)
+        {   csc_udpPkt_t *pkt = &pkts[nSent+i];
+            iovs[i].iov_base = pkt->buf;
+            iovs[i].iov_len = pkt->len;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &pkt->addr->sockAddr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(pkt->addr->sockAddr);
+        }
+        ret = sendmmsg(udp->sock, msgs, nBatch, 0);
+        if (ret == -1)
+        {   if (errno == EINTR)
+                continue;
+            udp_setErrMsg(udp, "csc_udp_sndMany(): sendmmsg() failed", strerror(errno));
+            return nSent>0 ? nSent : -1;
+        }
+        nSent += ret;
+    }
+ 
+    return nSent;
+}
+
+
+// ------------ Segmentation offload ----------
+
+// Sends the 'len' bytes of 'buf' in one call, for the kernel to split
+// into packets of 'segSize' bytes.  Returns the bytes sent, or -1.
+static int sndGso( csc_udp_t *udp, const char *buf, int len, int segSize
+                 , csc_udpAddr_t *addr
+                 )
+{   char ctl[CMSG_SPACE(sizeof(uint16_t))];
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    uint16_t gsoSize = segSize;
+ 
+    iov.iov_base = (char*)buf;
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &addr->sockAddr;
+    msg.msg_namelen = sizeof(addr->sockAddr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl;
+    msg.msg_controllen = sizeof(ctl);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(gsoSize));
+    memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+    return sendmsg(udp->sock, &msg, 0);
+}
+
+
+// Sends up to MaxBatch segments of 'buf' with sendmmsg().  Returns the
+// number sent, or -1.
+static int sndSoft( csc_udp_t *udp, const char *buf, int len, int segSize
+                  , csc_udpAddr_t *addr
+                  )
+{   struct mmsghdr msgs[MaxBatch];
+    struct iovec iovs[MaxBatch];
+    int nSegs = 0;
+    int at;
+ 
+    memset(msgs, 0, sizeof(msgs));
+    for (at=0; at<len && nSegs<MaxBatch; at+=segSize, nSegs++)
+    {   iovs[nSegs].iov_base = (char*)buf + at;
+        iovs[nSegs].iov_len = len-at < segSize ? len-at : segSize;
+        msgs[nSegs].msg_hdr.msg_iov = &iovs[nSegs];
+        msgs[nSegs].msg_hdr.msg_iovlen = 1;
+        msgs[nSegs].msg_hdr.msg_name = &addr->sockAddr;
+        msgs[nSegs].msg_hdr.msg_namelen = sizeof(addr->sockAddr);
+    }
+    return sendmmsg(udp->sock, msgs, nSegs, 0);
+}
+
+
+int csc_udp_sndSegs( csc_udp_t *udp          // UDP object.
+                   , const char *buf, int len
+                   , int segSize
+                   , csc_udpAddr_t *addr     // Address.
+                   )
+{   int nSent = 0;
+    int at = 0;
+    int chunk, ret, val;
+    socklen_t valLen = sizeof(val);
+    csc_bool_t isSoft;
+ 
+// Have things been set up?
+    if (udp->state!=udpStateCli && udp->state!=udpStateSrv)
+    {   udp_setErrMsg( udp, "csc_udp_sndSegs(): udp object not initialised", NULL);
+        return -1;
+    }
+    if (addr==NULL || !addr->isSet)
+    {   udp_setErrMsg(udp, "csc_udp_sndSegs(): address not set", NULL);
+        return -1;
+    }
+    if (segSize<1 || segSize>MaxGsoBytes)
+    {   udp_setErrMsg(udp, "csc_udp_sndSegs(): invalid segment size", NULL);
+        return -1;
+    }
+ 
+// Connect the client, as for csc_udp_snd().
+    if (udp->state==udpStateCli && udp->isConnect)
+    {   udp->isConnect = csc_FALSE;
+        if (connect(udp->sock, (struct sockaddr *)&addr->sockAddr, sizeof(addr->sockAddr)))
+        {   udp_setErrMsg(udp, "csc_udp_sndSegs(): connect() failed", strerror(errno));
+            return -1;
+        }
+    }
+ 
+// Ask once whether the kernel knows UDP_SEGMENT at all.  If not, we
+// always split them ourselves.
+    if (udp->isGso && !udp->isGsoProbed)
+    {   udp->isGsoProbed = csc_TRUE;
+        if (getsockopt(udp->sock, SOL_UDP, UDP_SEGMENT, &val, &valLen) != 0)
+            udp->isGsoOk = csc_FALSE;
+    }
+    isSoft = !udp->isGso || !udp->isGsoOk;
+ 
+// As many segments at a time as the kernel, or sendmmsg(), takes.  If the
+// route cannot take them, split them ourselves this time.  EINVAL is for
+// the caller, e.g. a segment too big for the path's MTU.
+    chunk = csc_min(MaxGsoSegs, MaxGsoBytes/segSize) * segSize;
+    while (at < len)
+    {   if (!isSoft)
+        {   ret = sndGso(udp, buf+at, csc_min(chunk, len-at), segSize, addr);
+            if (ret >= 0)
+            {   nSent += (ret + segSize - 1) / segSize;
+                at += ret;
+                continue;
+            }
+            else if (errno==EIO || errno==ENOPROTOOPT || errno==EOPNOTSUPP)
+            {   isSoft = csc_TRUE;
+                continue;
+            }
+        }
+        else
+        {   ret = sndSoft(udp, buf+at, len-at, segSize, addr);
+            if (ret >= 0)
+            {   nSent += ret;
+                at += ret * segSize;
+                continue;
+            }
+        }
+        if (errno == EINTR)
+            continue;
+        udp_setErrMsg(udp, "csc_udp_sndSegs(): send failed", strerror(errno));
+        return nSent>0 ? nSent : -1;
+    }
+ 
+    return nSent;
+}
+
+
+void csc_udp_setGso(csc_udp_t *udp, csc_bool_t isOn)
+{   udp->isGso = isOn;
+}
+
+
+csc_bool_t csc_udp_setGro(csc_udp_t *udp, csc_bool_t isOn)
+{   int flag = isOn;
+ 
+// Have things been set up?
+    if (udp->state!=udpStateCli && udp->state!=udpStateSrv)
+    {   udp_setErrMsg( udp, "csc_udp_setGro(): udp object not initialised", NULL);
+        return csc_FALSE;
+    }
+ 
+    if (setsockopt(udp->sock, SOL_UDP, UDP_GRO, &flag, sizeof(flag)) != 0)
+    {   udp_setErrMsg(udp, "csc_udp_setGro(): setsockopt(UDP_GRO) failed", strerror(errno));
+        return csc_FALSE;
+    }
+    return csc_TRUE;
+}
+
+
+// Returns >=0:nBytes read, -2:timeout, -1:error - use csc_udp_getErrMsg().
+int csc_udp_rcvSegs( csc_udp_t *udp          // UDP object.
+                   , char *buf, int bufSiz   // Buffer to read into.
+                   , int *segSize            // Set to the packet size.
+                   , csc_udpAddr_t *addr     // Address to set, or NULL.
+                   )
+{   char ctl[CMSG_SPACE(sizeof(int))];
+    struct sockaddr_storage caller;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    int numRead;
+ 
+// Have things been set up?
+    if (udp->state!=udpStateCli && udp->state!=udpStateSrv)
+    {   udp_setErrMsg( udp, "csc_udp_rcvSegs(): udp object not initialised", NULL);
+        return -1;
+    }
+ 
+// Receive the packet, or packets, straight into the address if there is one.
+    iov.iov_base = buf;
+    iov.iov_len = bufSiz;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = addr==NULL ? &caller : &addr->sockAddr;
+    msg.msg_namelen = sizeof(caller);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl;
+    msg.msg_controllen = sizeof(ctl);
+    numRead = recvmsg(udp->sock, &msg, udp->rcvFlags);
+    if (numRead == -1)
+    {   if (errno == EAGAIN)
+            return -2;  // Receive packet timed out.
+        udp_setErrMsg(udp, "csc_udp_rcvSegs(): recvmsg() failed", strerror(errno));
+        return -1;
+    }
+    if (addr != NULL)
+        addr->isSet = csc_TRUE;
+ 
+// The size of the packets, if joined.
+    *segSize = numRead;
+    for (cmsg=CMSG_FIRSTHDR(&msg); cmsg!=NULL; cmsg=CMSG_NXTHDR(&msg,cmsg))
+    {   if (cmsg->cmsg_level==SOL_UDP && cmsg->cmsg_type==UDP_GRO)
+            memcpy(segSize, CMSG_DATA(cmsg), sizeof(int));
+    }
+    return numRead;
+}
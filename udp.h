@@ -30,6 +30,27 @@ int csc_udpAddr_getPortNum(csc_udpAddr_t *addr);
 // Free an UDP address.
 void csc_udpAddr_free(csc_udpAddr_t *addr);
 
+// Copy the address from 'from' into 'to'.
+void csc_udpAddr_copy(csc_udpAddr_t *to, const csc_udpAddr_t *from);
+
+
+// -- Addresses in binary form, e.g. as keys for tables of peers. --
+
+// IPv6 address, with IPv4 addresses mapped, then port, in network order.
+#define csc_udpAddr_BinSize 18
+
+// Writes the address in binary form into 'bin'.  IPv4 addresses and the
+// same addresses mapped into IPv6 give the same.  Returns csc_FALSE if the
+// address is not set.
+csc_bool_t csc_udpAddr_getBin(const csc_udpAddr_t *addr, unsigned char *bin);
+
+// Compares two addresses in binary form, as for memcmp().  Returns 0 if
+// they are the same.
+int csc_udpAddr_cmp(const csc_udpAddr_t *addr1, const csc_udpAddr_t *addr2);
+
+// Hashes an address in binary form.
+uint64_t csc_udpAddr_hash(const csc_udpAddr_t *addr);
+
 //-- Errors in UDP address. --
 const char *csc_udpAddr_getErrMsg(const csc_udpAddr_t *this);
 const char *csc_udpAddr_resetErrMsg(csc_udpAddr_t *this);
@@ -63,6 +84,18 @@ csc_bool_t csc_udp_setSrv( csc_udp_t *udp       // UDP object.
                          , int portNo         // Port number to serve on.
                          );
  
+// To be called before csc_udp_setSrv().  If 'isReuse', the socket is
+// bound with SO_REUSEPORT, so that several sockets, e.g. one for each
+// thread, may serve the same port, and the kernel spreads the packets
+// between them.
+void csc_udp_setReusePort(csc_udp_t *udp, csc_bool_t isReuse);
+
+// Sets the sizes in bytes of the socket's receive and send buffers, e.g.
+// so that bursts of packets are not dropped.  0 leaves a size as it is.
+// To be called after csc_udp_setSrv() or csc_udp_setCli().  Returns
+// csc_FALSE on failure.
+csc_bool_t csc_udp_setBufSizes(csc_udp_t *udp, int rcvBufSize, int sndBufSize);
+ 
 // csc_udp_rcv() will block indefinitely if the a packet fails to arrive.
 // Calling this will set a timeout so that csc_udp_rcv() will return after
 // the specified time, so that the call cannot block indefinitely.  On
@@ -83,21 +116,101 @@ void csc_udp_cliNoConnect(csc_udp_t *udp);
 
 // Receive a packet.  On success returns number of bytes read.
 // Returns >=0:nBytes read, -2:timeout, -1:error - use csc_udp_getErrMsg().
-// If addr is not NULL, then *addr should be NULL.  In the latter case,
-// *addr will be assigned a new object.  The caller owns the new address
-// object and is responsible for csc_udpAddr_free()ing it.  
+// If addr is not NULL, then *addr is set to the address received from.
+// If *addr is NULL, it will be assigned a new object.  The caller owns the
+// new address object and is responsible for csc_udpAddr_free()ing it.  If
+// *addr is not NULL, that object is reused.
 int csc_udp_rcv( csc_udp_t *udp          // UDP object.
                , char *buf, int bufSiz  // Buffer to read into.
                , csc_udpAddr_t **addr  // Address to assign allocated or NULL.
                );
 
 
+// Like csc_udp_rcv(), but sets 'addr', if not NULL, to the address received
+// from, without allocating anything.  'addr' is from csc_udpAddr_new(), and
+// may be used for packet after packet.
+int csc_udp_rcvInto( csc_udp_t *udp          // UDP object.
+                   , char *buf, int bufSiz  // Buffer to read into.
+                   , csc_udpAddr_t *addr    // Address to set, or NULL.
+                   );
+
+
 // Send a packet.  Returns TRUE on only on success.
 csc_bool_t csc_udp_snd( csc_udp_t *udp          // UDP object.
                       , char *buf, int msgLen   // Data and length of data to be sent.
                       , csc_udpAddr_t *addr  // Address to send to.
                       );
 
+// --------------------------------------------
+// ------------ Many packets at once ----------
+
+// A packet for csc_udp_rcvMany() or csc_udp_sndMany().
+typedef struct
+{   char *buf;             // The data.
+    int bufSiz;            // Room in 'buf', for receiving.
+    int len;               // Length of the data, received or to be sent.
+    csc_udpAddr_t *addr;   // Address sent to.  Or, for receiving, NULL, or
+                           // an address from csc_udpAddr_new() that is set
+                           // to the address received from.
+} csc_udpPkt_t;
+
+
+// Receive up to 'nPkts' packets with one system call, recvmmsg().  Waits
+// for the first for 'timeoutMs' milliseconds, or as for csc_udp_rcv() if
+// negative, but not for any after the first.  Unlike csc_udp_rcv(), no
+// '\0' is put after the data.  Returns >=1:nPackets read, -2:timeout,
+// -1:error - use csc_udp_getErrMsg().
+int csc_udp_rcvMany(csc_udp_t *udp, csc_udpPkt_t *pkts, int nPkts, int timeoutMs);
+
+
+// Send 'nPkts' packets with as few system calls as may be, sendmmsg().
+// Returns the number of packets sent, which is 'nPkts' on success, or
+// fewer if there is an error, or -1 if none could be sent.  Use
+// csc_udp_getErrMsg() on error.
+int csc_udp_sndMany(csc_udp_t *udp, csc_udpPkt_t *pkts, int nPkts);
+
+
+// ------------ Segmentation offload ----------
+
+// Many packets of the same size, to the same address, may be sent as one
+// buffer, which the kernel splits into packets (UDP_SEGMENT, or GSO).  A
+// receiver may likewise be given packets from the same sender joined into
+// one buffer, with the size of the packets (UDP_GRO).  Where the kernel
+// cannot do these, the packets are split here, or received one at a time.
+
+// Send the 'len' bytes of 'buf' to 'addr' as packets of 'segSize' bytes,
+// the last perhaps shorter.  'segSize' should fit in the path's MTU.
+// Returns the number of packets sent, or -1 if none could be sent.  Use
+// csc_udp_getErrMsg() on error.
+int csc_udp_sndSegs( csc_udp_t *udp          // UDP object.
+                   , const char *buf, int len
+                   , int segSize
+                   , csc_udpAddr_t *addr     // Address.
+                   );
+
+// Whether csc_udp_sndSegs() is to ask the kernel to split the packets.  It
+// is on by default, but they are split here instead if the kernel does not
+// know how, or cannot on the route.  Turning it off splits them here
+// always, e.g. for testing.
+void csc_udp_setGso(csc_udp_t *udp, csc_bool_t isOn);
+
+// Ask for packets to be joined when received.  To be called after
+// csc_udp_setSrv().  Returns csc_FALSE if the kernel cannot, in which case
+// they are received one at a time.
+csc_bool_t csc_udp_setGro(csc_udp_t *udp, csc_bool_t isOn);
+
+// Receive a packet, or packets joined, as csc_udp_rcvInto().  '*segSize' is
+// set to the size of each packet, the last perhaps shorter, or to the
+// length of the one packet.  'bufSiz' should be 65535, so that nothing
+// joined is lost.  No '\0' is put after the data.  Returns >=0:nBytes read,
+// -2:timeout, -1:error - use csc_udp_getErrMsg().
+int csc_udp_rcvSegs( csc_udp_t *udp          // UDP object.
+                   , char *buf, int bufSiz   // Buffer to read into.
+                   , int *segSize            // Set to the packet size.
+                   , csc_udpAddr_t *addr     // Address to set, or NULL.
+                   );
+
+
 //-- Errors --
 const char *csc_udp_getErrMsg(const csc_udp_t *this);
 